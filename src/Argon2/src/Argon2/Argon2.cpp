@@ -35,6 +35,7 @@
 ///////////////////
 
 #include "Argon2/Constants.h"
+#include "Argon2/Instrumentation.h"
 
 #include "Blake2/Blake2b.h"
 
@@ -62,6 +63,24 @@ Argon2::Argon2(
     m_keyLen(keyLen),
     m_optimizationMethod(optimizationMethod)
 {
+    m_scratchpadSize = ScratchpadSize(memory, threads);
+    m_lanes = m_scratchpadSize / m_threads;
+    m_segments = m_lanes / Constants::SYNC_POINTS;
+
+    m_B = std::vector<Block>(m_scratchpadSize);
+
+    validateParameters();
+}
+
+uint32_t Argon2::ScratchpadSize(
+    const uint32_t memory,
+    const uint32_t threads)
+{
+    if (threads == 0)
+    {
+        throw std::invalid_argument("Threads must be between 1 and 2^24 - 1!");
+    }
+
     uint32_t scratchpadSize 
         = memory / (Constants::SYNC_POINTS * threads) * (Constants::SYNC_POINTS * threads);
 
@@ -70,13 +89,7 @@ Argon2::Argon2(
         scratchpadSize = 2 * Constants::SYNC_POINTS * threads;
     }
 
-    m_scratchpadSize = scratchpadSize;
-    m_lanes = m_scratchpadSize / m_threads;
-    m_segments = m_lanes / Constants::SYNC_POINTS;
-
-    m_B = std::vector<Block>(m_scratchpadSize);
-
-    validateParameters();
+    return scratchpadSize;
 }
 
 std::vector<uint8_t> Argon2::Argon2d(
@@ -178,6 +191,8 @@ std::vector<uint8_t> Argon2::Hash(
         throw std::invalid_argument("Salt must be at least 8 bytes!");
     }
 
+    ARGON2_COUNT_HASH();
+
     std::vector<uint8_t> h0 = initHash(message, salt);
 
     initBlocks(h0);
@@ -191,6 +206,8 @@ std::vector<uint8_t> Argon2::initHash(
     const std::vector<uint8_t> &message,
     const std::vector<uint8_t> &salt)
 {
+    ARGON2_TIME_PHASE(Instrumentation::INIT_HASH);
+
     const uint32_t messageSize = static_cast<uint32_t>(message.size());
     const uint32_t saltSize = salt.size();
     const uint32_t secretSize = m_secret.size();
@@ -247,11 +264,15 @@ std::vector<uint8_t> Argon2::initHash(
     std::memcpy(&initialInput[index], &m_data[0], dataSize);
     index += dataSize;
 
+    ARGON2_COUNT_KERNEL(Instrumentation::BLAKE2B);
+
     return Blake2b::Hash(initialInput);
 }
 
 void Argon2::initBlocks(std::vector<uint8_t> &h0)
 {
+    ARGON2_TIME_PHASE(Instrumentation::INIT_BLOCKS);
+
     h0.resize(Constants::INITIAL_HASH_SIZE, 0);
 
     uint8_t block0[Constants::BLOCK_SIZE_BYTES];
@@ -290,6 +311,8 @@ void Argon2::initBlocks(std::vector<uint8_t> &h0)
 
 void Argon2::processBlocks()
 {
+    ARGON2_TIME_PHASE(Instrumentation::PROCESS_BLOCKS);
+
     for (uint32_t i = 0; i < m_time; i++)
     {
         for (uint32_t slice = 0; slice < Constants::SYNC_POINTS; slice++)
@@ -309,6 +332,8 @@ void Argon2::processSegment(
     const uint32_t slice,
     const uint32_t lane)
 {
+    ARGON2_TIME_SEGMENT(n, slice);
+
     /* Default initializing to zero */
     Block addresses {};
     Block in {};
@@ -336,6 +361,8 @@ void Argon2::processSegment(
 
         if (m_mode == Constants::ARGON2I || m_mode == Constants::ARGON2ID)
         {
+            ARGON2_TIME_PHASE(Instrumentation::ADDRESS_GENERATION);
+
             in[6]++;
             processBlock(addresses, in, zero);
             processBlock(addresses, addresses, zero);
@@ -360,6 +387,8 @@ void Argon2::processSegment(
         {
             if (index % Constants::BLOCK_SIZE == 0)
             {
+                ARGON2_TIME_PHASE(Instrumentation::ADDRESS_GENERATION);
+
                 in[6]++;
                 processBlock(addresses, in, zero);
                 processBlock(addresses, addresses, zero);
@@ -386,6 +415,8 @@ void Argon2::blake2bHash(
     std::vector<uint8_t> input,
     uint32_t outputLength)
 {
+    ARGON2_COUNT_KERNEL(Instrumentation::BLAKE2B_LONG);
+
     /* Prepend the length of the output hash length to the input data */
     input.insert(
         input.begin(),
@@ -450,6 +481,8 @@ void Argon2::blake2bHash(
 
 std::vector<uint8_t> Argon2::extractKey()
 {
+    ARGON2_TIME_PHASE(Instrumentation::EXTRACT_KEY);
+
     for (uint32_t lane = 0; lane < m_threads - 1; lane++)
     {
         for (uint32_t i = 0; i < Constants::BLOCK_SIZE; i++)
@@ -707,6 +740,8 @@ void Argon2::processBlock(
     const Block &in1,
     const Block &in2)
 {
+    ARGON2_COUNT_KERNEL(Instrumentation::COMPRESS);
+
     processBlockGeneric(out, in1, in2, false);
 }
 
@@ -715,6 +750,8 @@ void Argon2::processBlockXOR(
     const Block &in1,
     const Block &in2)
 {
+    ARGON2_COUNT_KERNEL(Instrumentation::COMPRESS_XOR);
+
     processBlockGeneric(out, in1, in2, true);
 }
 
@@ -66,6 +66,12 @@ class Argon2
             const uint32_t threads,
             const uint32_t keyLen);
 
+        /* The number of blocks, or KB, of scratchpad a hash with these
+           parameters uses */
+        static uint32_t ScratchpadSize(
+            const uint32_t memory,
+            const uint32_t threads);
+
         /* PUBLIC METHODS */
 
         std::vector<uint8_t> Hash(
@@ -0,0 +1,246 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////
+#include "Argon2/Argon2Pool.h"
+//////////////////////////////
+
+#include <algorithm>
+#include <stdexcept>
+
+Argon2Pool::Argon2Pool(
+    const uint64_t memoryBudget,
+    const uint32_t threadCount,
+    const size_t maxQueued,
+    const Constants::OptimizationMethod optimizationMethod):
+    m_memoryBudget(memoryBudget),
+    m_maxQueued(maxQueued),
+    m_optimizationMethod(optimizationMethod)
+{
+    for (uint32_t i = 0; i < std::max<uint32_t>(threadCount, 1); i++)
+    {
+        m_threads.emplace_back(&Argon2Pool::hashRequests, this);
+    }
+}
+
+Argon2Pool::~Argon2Pool()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+        m_queue.clear();
+    }
+
+    m_canStart.notify_all();
+
+    for (auto &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+std::future<std::vector<uint8_t>> Argon2Pool::DeriveKey(
+    const Constants::ArgonVariant mode,
+    const std::vector<uint8_t> &message,
+    const std::vector<uint8_t> &salt,
+    const std::vector<uint8_t> &secret,
+    const std::vector<uint8_t> &data,
+    const uint32_t time,
+    const uint32_t memory,
+    const uint32_t threads,
+    const uint32_t keyLen)
+{
+    Request request;
+
+    request.parameters = { mode, secret, data, time, memory, threads, keyLen };
+    request.message = message;
+    request.salt = salt;
+
+    auto future = request.promise.get_future();
+
+    try
+    {
+        request.scratchpadSize = Argon2::ScratchpadSize(memory, threads);
+    }
+    catch (const std::invalid_argument &)
+    {
+        request.promise.set_exception(std::current_exception());
+        return future;
+    }
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if (request.scratchpadSize > m_memoryBudget)
+        {
+            m_stats.rejected++;
+
+            request.promise.set_exception(std::make_exception_ptr(std::invalid_argument(
+                "Hash needs " + std::to_string(request.scratchpadSize) + "KB, more than the "
+                + std::to_string(m_memoryBudget) + "KB memory budget!"
+            )));
+
+            return future;
+        }
+
+        if (m_maxQueued != 0 && m_queue.size() >= m_maxQueued)
+        {
+            m_stats.rejected++;
+
+            request.promise.set_exception(std::make_exception_ptr(std::runtime_error(
+                "Too many hashes queued!"
+            )));
+
+            return future;
+        }
+
+        m_queue.push_back(std::move(request));
+    }
+
+    m_canStart.notify_all();
+
+    return future;
+}
+
+std::future<std::vector<uint8_t>> Argon2Pool::Argon2id(
+    const std::vector<uint8_t> &message,
+    const std::vector<uint8_t> &salt,
+    const uint32_t time,
+    const uint32_t memory,
+    const uint32_t threads,
+    const uint32_t keyLen)
+{
+    return DeriveKey(Constants::ARGON2ID, message, salt, {}, {}, time, memory, threads, keyLen);
+}
+
+Argon2Pool::Stats Argon2Pool::getStats() const
+{
+    std::scoped_lock lock(m_mutex);
+
+    Stats stats = m_stats;
+
+    stats.queued = m_queue.size();
+
+    return stats;
+}
+
+bool Argon2Pool::admit(const Request &request, Scratchpad &scratchpad, bool &allocate)
+{
+    const auto reusable = std::find_if(m_idle.begin(), m_idle.end(), [&request](const Scratchpad &idle)
+    {
+        return idle.parameters == request.parameters;
+    });
+
+    if (reusable != m_idle.end())
+    {
+        scratchpad = std::move(*reusable);
+        m_idle.erase(reusable);
+
+        m_stats.memoryCached -= scratchpad.size;
+        m_stats.memoryInUse += scratchpad.size;
+
+        allocate = false;
+
+        return true;
+    }
+
+    while (m_stats.memoryInUse + m_stats.memoryCached + request.scratchpadSize > m_memoryBudget && !m_idle.empty())
+    {
+        m_stats.memoryCached -= m_idle.back().size;
+        m_idle.pop_back();
+    }
+
+    if (m_stats.memoryInUse + m_stats.memoryCached + request.scratchpadSize > m_memoryBudget)
+    {
+        return false;
+    }
+
+    scratchpad.parameters = request.parameters;
+    scratchpad.size = request.scratchpadSize;
+    scratchpad.argon.reset();
+
+    m_stats.memoryInUse += scratchpad.size;
+    m_stats.allocations++;
+
+    allocate = true;
+
+    return true;
+}
+
+void Argon2Pool::hashRequests()
+{
+    while (true)
+    {
+        Request request;
+        Scratchpad scratchpad;
+
+        bool allocate = false;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            /* Only the oldest hash may start, so a large hash isn't
+               overtaken forever by smaller ones */
+            m_canStart.wait(lock, [&]
+            {
+                return m_shouldStop || (!m_queue.empty() && admit(m_queue.front(), scratchpad, allocate));
+            });
+
+            if (m_shouldStop)
+            {
+                return;
+            }
+
+            request = std::move(m_queue.front());
+            m_queue.pop_front();
+
+            m_stats.running++;
+        }
+
+        /* The next hash may be able to start on another thread */
+        m_canStart.notify_all();
+
+        try
+        {
+            if (allocate)
+            {
+                const auto &parameters = request.parameters;
+
+                scratchpad.argon = std::make_unique<Argon2>(
+                    parameters.mode,
+                    parameters.secret,
+                    parameters.data,
+                    parameters.time,
+                    parameters.memory,
+                    parameters.threads,
+                    parameters.keyLen,
+                    m_optimizationMethod
+                );
+            }
+
+            request.promise.set_value(scratchpad.argon->Hash(request.message, request.salt));
+        }
+        catch (...)
+        {
+            request.promise.set_exception(std::current_exception());
+        }
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            m_stats.running--;
+            m_stats.completed++;
+            m_stats.memoryInUse -= scratchpad.size;
+
+            /* Keep it for the next hash, unless the parameters were invalid */
+            if (scratchpad.argon)
+            {
+                m_stats.memoryCached += scratchpad.size;
+                m_idle.push_front(std::move(scratchpad));
+            }
+        }
+
+        m_canStart.notify_all();
+    }
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Argon2/Argon2.h"
+#include "Argon2/Constants.h"
+
+/* Everything about a hash except the message and salt. Hashes with the same
+   parameters can share a scratchpad. */
+struct Argon2Parameters
+{
+    Constants::ArgonVariant mode;
+
+    std::vector<uint8_t> secret;
+
+    std::vector<uint8_t> data;
+
+    uint32_t time;
+
+    uint32_t memory;
+
+    uint32_t threads;
+
+    uint32_t keyLen;
+
+    bool operator==(const Argon2Parameters &other) const
+    {
+        return mode == other.mode
+            && secret == other.secret
+            && data == other.data
+            && time == other.time
+            && memory == other.memory
+            && threads == other.threads
+            && keyLen == other.keyLen;
+    }
+};
+
+/* Runs hashes on a fixed set of threads, within a memory budget. Scratchpads
+   are kept after each hash and reused by later hashes with the same
+   parameters, so a steady load does no allocation.
+
+   Hashes start in the order they were submitted. When the next hash would go
+   over the budget, idle scratchpads are freed, least recently used first,
+   and if that isn't enough it waits for running hashes to finish. A hash
+   needing more than the whole budget, or submitted when maxQueued hashes are
+   already waiting, fails straight away rather than queueing. */
+class Argon2Pool
+{
+    public:
+        struct Stats
+        {
+            /* KB of scratchpads being hashed with */
+            uint64_t memoryInUse = 0;
+
+            /* KB of idle scratchpads, kept for reuse */
+            uint64_t memoryCached = 0;
+
+            /* Hashes waiting to start */
+            size_t queued = 0;
+
+            size_t running = 0;
+
+            uint64_t completed = 0;
+
+            /* Hashes failed for going over the budget or the queue limit */
+            uint64_t rejected = 0;
+
+            /* Scratchpads allocated, as opposed to reused */
+            uint64_t allocations = 0;
+        };
+
+        /* CONSTRUCTOR */
+
+        Argon2Pool(
+            const uint64_t memoryBudget, /* In KB, in use or idle */
+            const uint32_t threadCount = std::thread::hardware_concurrency(),
+            const size_t maxQueued = 0, /* 0 for no limit */
+            const Constants::OptimizationMethod optimizationMethod = Constants::AUTO);
+
+        /* Hashes still queued fail with std::future_error */
+        ~Argon2Pool();
+
+        /* PUBLIC METHODS */
+
+        /* The same as Argon2::DeriveKey, but runs on the pool */
+        std::future<std::vector<uint8_t>> DeriveKey(
+            const Constants::ArgonVariant mode,
+            const std::vector<uint8_t> &message,
+            const std::vector<uint8_t> &salt,
+            const std::vector<uint8_t> &secret,
+            const std::vector<uint8_t> &data,
+            const uint32_t time,
+            const uint32_t memory,
+            const uint32_t threads,
+            const uint32_t keyLen);
+
+        std::future<std::vector<uint8_t>> Argon2id(
+            const std::vector<uint8_t> &message,
+            const std::vector<uint8_t> &salt,
+            const uint32_t time, /* Or iterations */
+            const uint32_t memory,
+            const uint32_t threads, /* Or parallelism */
+            const uint32_t keyLen /* Output hash length */);
+
+        Stats getStats() const;
+
+    private:
+        /* DEFINITIONS */
+
+        struct Request
+        {
+            Argon2Parameters parameters;
+
+            std::vector<uint8_t> message;
+
+            std::vector<uint8_t> salt;
+
+            /* KB of scratchpad needed */
+            uint64_t scratchpadSize;
+
+            std::promise<std::vector<uint8_t>> promise;
+        };
+
+        struct Scratchpad
+        {
+            Argon2Parameters parameters;
+
+            uint64_t size;
+
+            std::unique_ptr<Argon2> argon;
+        };
+
+        /* PRIVATE METHODS */
+
+        /* Run queued hashes until stopped */
+        void hashRequests();
+
+        /* Take an idle scratchpad for the request, or free enough idle
+           scratchpads to allocate one. Returns false if the request has to
+           wait. Call with m_mutex held. */
+        bool admit(const Request &request, Scratchpad &scratchpad, bool &allocate);
+
+        /* PRIVATE VARIABLES */
+
+        const uint64_t m_memoryBudget;
+
+        const size_t m_maxQueued;
+
+        const Constants::OptimizationMethod m_optimizationMethod;
+
+        std::deque<Request> m_queue;
+
+        /* Most recently used first */
+        std::list<Scratchpad> m_idle;
+
+        Stats m_stats;
+
+        bool m_shouldStop = false;
+
+        /* Signalled when a hash is queued, or a scratchpad is returned */
+        std::condition_variable m_canStart;
+
+        /* Guards everything above */
+        mutable std::mutex m_mutex;
+
+        std::vector<std::thread> m_threads;
+};
@@ -10,6 +10,11 @@
 #include <stdexcept>
 #include <string>
 
+/* The portable kernel is written with GCC/Clang vector extensions */
+#if defined(__GNUC__) || defined(__clang__)
+#define ARGON2_PORTABLE_KERNEL
+#endif
+
 namespace Constants
 {
     constexpr uint32_t CURRENT_ARGON_VERSION = 19;
@@ -21,6 +26,12 @@ namespace Constants
         ARGON2ID = 2,
     };
 
+#if defined(ARGON2_PORTABLE_KERNEL)
+    constexpr bool PORTABLE_KERNEL_AVAILABLE = true;
+#else
+    constexpr bool PORTABLE_KERNEL_AVAILABLE = false;
+#endif
+
     enum OptimizationMethod
     {
         AVX512,
@@ -29,6 +40,8 @@ namespace Constants
         SSSE3,
         SSE2,
         NEON,
+        /* Vector extensions, for any architecture without intrinsics here */
+        PORTABLE,
         NONE,
         AUTO,
     };
@@ -61,6 +74,10 @@ namespace Constants
             {
                 return "NEON";
             }
+            case PORTABLE:
+            {
+                return "Portable";
+            }
             case NONE:
             {
                 return "None";
@@ -104,6 +121,10 @@ namespace Constants
         {
             return NEON;
         }
+        else if (method == "PORTABLE")
+        {
+            return PORTABLE;
+        }
         else if (method == "NONE")
         {
             return NONE;
@@ -0,0 +1,40 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+////////////////////////////////////
+#include "Argon2/Instrumentation.h"
+////////////////////////////////////
+
+namespace Instrumentation
+{
+#if defined(ARGON2_INSTRUMENTATION)
+    Counters &threadCounters()
+    {
+        thread_local Counters counters;
+        return counters;
+    }
+
+    bool isEnabled()
+    {
+        return true;
+    }
+
+    Counters takeThreadCounters()
+    {
+        Counters counters = threadCounters();
+        threadCounters() = Counters();
+        return counters;
+    }
+#else
+    bool isEnabled()
+    {
+        return false;
+    }
+
+    Counters takeThreadCounters()
+    {
+        return Counters();
+    }
+#endif
+}
@@ -0,0 +1,227 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "Argon2/Constants.h"
+
+#if defined(ARGON2_INSTRUMENTATION)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+/* Where the time goes inside Argon2::Hash. Only recorded when built with the
+   ARGON2_INSTRUMENTATION CMake option, otherwise the recording macros below
+   compile to nothing and the counters stay zero. */
+namespace Instrumentation
+{
+    enum Phase
+    {
+        INIT_HASH,
+        INIT_BLOCKS,
+        /* Filling the scratchpad, broken down by pass and slice below */
+        PROCESS_BLOCKS,
+        /* Generating the data independent addresses for Argon2i/id */
+        ADDRESS_GENERATION,
+        EXTRACT_KEY,
+        PHASE_COUNT,
+    };
+
+    enum Kernel
+    {
+        /* Blake2b::Hash of the initial input */
+        BLAKE2B,
+        /* Variable length Blake2b, used for the first blocks and the output */
+        BLAKE2B_LONG,
+        /* Compression function without XOR, used for address generation */
+        COMPRESS,
+        /* Compression function XORed into the block, used to fill the scratchpad */
+        COMPRESS_XOR,
+        KERNEL_COUNT,
+    };
+
+    /* Passes after this share the last pass's counters */
+    constexpr uint32_t MAX_PASSES = 4;
+
+    /* Counts and cycles, summed over every hash since last collected */
+    struct Counters
+    {
+        uint64_t hashes = 0;
+
+        /* Cycles spent in each phase. On platforms without a cycle counter,
+           nanoseconds instead. */
+        std::array<uint64_t, PHASE_COUNT> phaseCycles {};
+
+        /* Cycles spent filling each slice of each pass */
+        std::array<std::array<uint64_t, Constants::SYNC_POINTS>, MAX_PASSES> segmentCycles {};
+
+        std::array<uint64_t, KERNEL_COUNT> kernelCalls {};
+
+        Counters &operator+=(const Counters &other)
+        {
+            hashes += other.hashes;
+
+            for (size_t i = 0; i < PHASE_COUNT; i++)
+            {
+                phaseCycles[i] += other.phaseCycles[i];
+            }
+
+            for (size_t pass = 0; pass < MAX_PASSES; pass++)
+            {
+                for (size_t slice = 0; slice < Constants::SYNC_POINTS; slice++)
+                {
+                    segmentCycles[pass][slice] += other.segmentCycles[pass][slice];
+                }
+            }
+
+            for (size_t i = 0; i < KERNEL_COUNT; i++)
+            {
+                kernelCalls[i] += other.kernelCalls[i];
+            }
+
+            return *this;
+        }
+    };
+
+    inline std::string phaseToString(const Phase phase)
+    {
+        switch (phase)
+        {
+            case INIT_HASH:
+            {
+                return "initHash";
+            }
+            case INIT_BLOCKS:
+            {
+                return "initBlocks";
+            }
+            case PROCESS_BLOCKS:
+            {
+                return "processBlocks";
+            }
+            case ADDRESS_GENERATION:
+            {
+                return "addressGeneration";
+            }
+            case EXTRACT_KEY:
+            {
+                return "extractKey";
+            }
+            case PHASE_COUNT:
+            {
+                break;
+            }
+        }
+
+        throw std::invalid_argument("Invalid phase given");
+    }
+
+    inline std::string kernelToString(const Kernel kernel)
+    {
+        switch (kernel)
+        {
+            case BLAKE2B:
+            {
+                return "blake2b";
+            }
+            case BLAKE2B_LONG:
+            {
+                return "blake2bLong";
+            }
+            case COMPRESS:
+            {
+                return "compress";
+            }
+            case COMPRESS_XOR:
+            {
+                return "compressXOR";
+            }
+            case KERNEL_COUNT:
+            {
+                break;
+            }
+        }
+
+        throw std::invalid_argument("Invalid kernel given");
+    }
+
+    /* Was the library built with instrumentation */
+    bool isEnabled();
+
+    /* Get and reset the counters of the calling thread. Hashing threads
+       should call this between hashes and aggregate the results. */
+    Counters takeThreadCounters();
+
+#if defined(ARGON2_INSTRUMENTATION)
+    /* The calling thread's counters. Only ever touched by that thread. */
+    Counters &threadCounters();
+
+    inline uint64_t readCycles()
+    {
+    #if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    #endif
+    }
+
+    /* Adds the cycles between construction and destruction to a counter */
+    class ScopedCycles
+    {
+        public:
+            ScopedCycles(uint64_t &counter):
+                m_counter(counter),
+                m_start(readCycles())
+            {
+            }
+
+            ~ScopedCycles()
+            {
+                m_counter += readCycles() - m_start;
+            }
+
+        private:
+            uint64_t &m_counter;
+
+            const uint64_t m_start;
+    };
+#endif
+}
+
+#if defined(ARGON2_INSTRUMENTATION)
+
+#define ARGON2_TIME_PHASE(phase) \
+    Instrumentation::ScopedCycles phaseCycles_(Instrumentation::threadCounters().phaseCycles[phase])
+
+#define ARGON2_TIME_SEGMENT(pass, slice) \
+    Instrumentation::ScopedCycles segmentCycles_( \
+        Instrumentation::threadCounters().segmentCycles[std::min<uint32_t>(pass, Instrumentation::MAX_PASSES - 1)][slice])
+
+#define ARGON2_COUNT_KERNEL(kernel) \
+    Instrumentation::threadCounters().kernelCalls[kernel]++
+
+#define ARGON2_COUNT_HASH() \
+    Instrumentation::threadCounters().hashes++
+
+#else
+
+#define ARGON2_TIME_PHASE(phase)
+#define ARGON2_TIME_SEGMENT(pass, slice)
+#define ARGON2_COUNT_KERNEL(kernel)
+#define ARGON2_COUNT_HASH()
+
+#endif
@@ -118,6 +118,14 @@ Blake2b::Blake2b(const Constants::OptimizationMethod optimizationMethod):
 void Blake2b::Init(
     const std::vector<uint8_t> key,
     const uint8_t outputHashLength)
+{
+    Init(key, outputHashLength, TreeParameters());
+}
+
+void Blake2b::Init(
+    const std::vector<uint8_t> key,
+    const uint8_t outputHashLength,
+    const TreeParameters &tree)
 {
     if (outputHashLength > 64 || outputHashLength < 1)
     {
@@ -135,8 +143,21 @@ void Blake2b::Init(
     /* Copy the IV to the hash */
     std::copy(IV.begin(), IV.end(), m_hash.begin());
 
-    /* Mix key size and desired hash length into hash[0] */
-    m_hash[0] ^= 0x01010000 ^ (key.size() << 8) ^ outputHashLength;
+    const uint64_t keyLength = key.empty() ? tree.keyLength : key.size();
+
+    /* Mix the parameter block into the hash. The first word holds the hash
+       length, key size, fanout, depth and leaf length. */
+    m_hash[0] ^= outputHashLength
+               ^ (keyLength << 8)
+               ^ (static_cast<uint64_t>(tree.fanout) << 16)
+               ^ (static_cast<uint64_t>(tree.depth) << 24)
+               ^ (static_cast<uint64_t>(tree.leafLength) << 32);
+
+    m_hash[1] ^= tree.nodeOffset;
+
+    m_hash[2] ^= tree.nodeDepth ^ (static_cast<uint64_t>(tree.innerLength) << 8);
+
+    m_lastNode = tree.lastNode;
 
     if (!key.empty())
     {
@@ -147,7 +168,7 @@ void Blake2b::Init(
         std::memcpy(&m_chunk[0], &key[0], key.size());
 
         /* Pad with zeros to make it 128 bytes */
-        std::memset(&m_chunk[remainingBytes], 0, remainingBytes);
+        std::memset(reinterpret_cast<uint8_t *>(&m_chunk[0]) + keySize, 0, remainingBytes);
 
         /* Signal we have a chunk to process */
         m_chunkSize = 128;
@@ -184,13 +205,15 @@ void Blake2b::incrementBytesCompressed(const uint64_t bytesCompressed)
 void Blake2b::setLastBlock()
 {
     m_compressXorFlags[2] = std::numeric_limits<uint64_t>::max();
+
+    if (m_lastNode)
+    {
+        m_compressXorFlags[3] = std::numeric_limits<uint64_t>::max();
+    }
 }
 
 void Blake2b::Update(const uint8_t *data, size_t len)
 {
-    /* 128 byte chunk to process */
-    std::vector<uint64_t> chunk(16);
-
     size_t offset = 0;
 
     /* Process 128 bytes at once, aside from final chunk */
@@ -235,6 +258,21 @@ void Blake2b::Update(const uint8_t *data, size_t len)
 
 std::vector<uint8_t> Blake2b::Finalize()
 {
+    /* Return the final hash as a byte array */
+    std::vector<uint8_t> finalHash(m_outputHashLength);
+
+    Finalize(&finalHash[0], m_outputHashLength);
+
+    return finalHash;
+}
+
+void Blake2b::Finalize(uint8_t *out, const size_t outputLength)
+{
+    if (outputLength > 64)
+    {
+        throw std::invalid_argument("Invalid argument for outputLength. Must be at most 64.");
+    }
+
     /* Get void pointer to the chunk vector */
     void *ptr = static_cast<void *>(&m_chunk[0]);
 
@@ -252,10 +290,5 @@ std::vector<uint8_t> Blake2b::Finalize()
     /* Process final chunk */
     compress();
 
-    /* Return the final hash as a byte array */
-    std::vector<uint8_t> finalHash(m_outputHashLength);
-
-    std::memcpy(&finalHash[0], &m_hash[0], m_outputHashLength);
-
-    return finalHash;
+    std::memcpy(out, &m_hash[0], outputLength);
 }
@@ -14,17 +14,50 @@
 class Blake2b
 {
     public:
+        /* The tree hashing fields of the parameter block. The defaults are
+           plain sequential hashing. */
+        struct TreeParameters
+        {
+            uint8_t fanout = 1;
+
+            uint8_t depth = 1;
+
+            uint32_t leafLength = 0;
+
+            uint64_t nodeOffset = 0;
+
+            uint8_t nodeDepth = 0;
+
+            uint8_t innerLength = 0;
+
+            /* Used when no key is given. Tree roots declare the key length
+               without hashing the key, which goes through the leaves. */
+            uint8_t keyLength = 0;
+
+            /* Is this the last node at its depth */
+            bool lastNode = false;
+        };
+
         Blake2b(const Constants::OptimizationMethod optimizationMethod = Constants::AUTO);
 
         void Init(
             const std::vector<uint8_t> key = {},
             const uint8_t outputHashLength = 64);
 
+        void Init(
+            const std::vector<uint8_t> key,
+            const uint8_t outputHashLength,
+            const TreeParameters &tree);
+
         void Update(const std::vector<uint8_t> &data);
         void Update(const uint8_t *data, size_t len);
 
         std::vector<uint8_t> Finalize();
 
+        /* Write the first outputLength bytes of the final hash to out. Tree
+           leaves output more than the output hash length of the tree. */
+        void Finalize(uint8_t *out, const size_t outputLength);
+
         static std::vector<uint8_t> Hash(const std::vector<uint8_t> &message);
         static std::vector<uint8_t> Hash(const std::string &message);
 
@@ -85,6 +118,9 @@ class Blake2b
         /* Length of output hash in bytes */
         uint8_t m_outputHashLength = 64;
 
+        /* Set the last node flag when finalizing */
+        bool m_lastNode = false;
+
         /* What method of optimization to use */
         const Constants::OptimizationMethod m_optimizationMethod;
 };
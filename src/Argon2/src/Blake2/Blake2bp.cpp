@@ -0,0 +1,193 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////
+#include "Blake2bp.h"
+/////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+Blake2bp::Blake2bp(
+    const Constants::OptimizationMethod optimizationMethod,
+    const uint32_t threads):
+    m_leaves(PARALLELISM, Blake2b(optimizationMethod)),
+    m_root(optimizationMethod),
+    m_threads(std::clamp<uint32_t>(threads, 1, PARALLELISM))
+{
+}
+
+std::vector<uint8_t> Blake2bp::Hash(
+    const std::vector<uint8_t> &message,
+    const uint32_t threads)
+{
+    Blake2bp blake(Constants::AUTO, threads);
+
+    blake.Init();
+    blake.Update(message);
+
+    return blake.Finalize();
+}
+
+std::vector<uint8_t> Blake2bp::Hash(const std::string &message)
+{
+    Blake2bp blake;
+
+    blake.Init();
+    blake.Update(reinterpret_cast<const uint8_t *>(message.data()), message.size());
+
+    return blake.Finalize();
+}
+
+void Blake2bp::Init(
+    const std::vector<uint8_t> key,
+    const uint8_t outputHashLength)
+{
+    if (outputHashLength > 64 || outputHashLength < 1)
+    {
+        throw std::invalid_argument("Invalid argument for outputHashLength. Must be between 1 and 64.");
+    }
+
+    if (key.size() > 64)
+    {
+        throw std::invalid_argument("Optional key must be at most 64 bytes");
+    }
+
+    Blake2b::TreeParameters tree;
+
+    tree.fanout = PARALLELISM;
+    tree.depth = 2;
+    tree.innerLength = 64;
+
+    for (uint32_t i = 0; i < PARALLELISM; i++)
+    {
+        tree.nodeOffset = i;
+        tree.lastNode = i == PARALLELISM - 1;
+
+        m_leaves[i].Init(key, outputHashLength, tree);
+    }
+
+    /* The root declares the key, but only the leaves hash it */
+    tree.nodeOffset = 0;
+    tree.nodeDepth = 1;
+    tree.keyLength = static_cast<uint8_t>(key.size());
+    tree.lastNode = true;
+
+    m_root.Init({}, outputHashLength, tree);
+
+    m_bufferSize = 0;
+    m_outputHashLength = outputHashLength;
+}
+
+void Blake2bp::Update(const std::vector<uint8_t> &data)
+{
+    return Update(data.data(), data.size());
+}
+
+void Blake2bp::updateLeaf(
+    const uint32_t leaf,
+    const uint8_t *data,
+    const size_t len)
+{
+    const size_t stripeSize = PARALLELISM * BLOCK_SIZE;
+
+    for (size_t offset = 0; offset + stripeSize <= len; offset += stripeSize)
+    {
+        m_leaves[leaf].Update(data + offset + leaf * BLOCK_SIZE, BLOCK_SIZE);
+    }
+}
+
+void Blake2bp::Update(const uint8_t *data, size_t len)
+{
+    const size_t stripeSize = PARALLELISM * BLOCK_SIZE;
+
+    /* Complete the buffered stripe first */
+    if (m_bufferSize != 0 && len >= stripeSize - m_bufferSize)
+    {
+        const size_t fill = stripeSize - m_bufferSize;
+
+        std::memcpy(m_buffer.data() + m_bufferSize, data, fill);
+
+        for (uint32_t i = 0; i < PARALLELISM; i++)
+        {
+            updateLeaf(i, m_buffer.data(), stripeSize);
+        }
+
+        data += fill;
+        len -= fill;
+
+        m_bufferSize = 0;
+    }
+
+    const size_t stripesLength = m_bufferSize == 0 ? len - len % stripeSize : 0;
+
+    if (stripesLength >= THREADING_THRESHOLD && m_threads > 1)
+    {
+        std::vector<std::thread> threads;
+
+        /* Thread n takes leaves n, n + m_threads, ... The calling thread
+           takes its share too. */
+        for (uint32_t thread = 1; thread < m_threads; thread++)
+        {
+            threads.emplace_back([this, thread, data, stripesLength]
+            {
+                for (uint32_t leaf = thread; leaf < PARALLELISM; leaf += m_threads)
+                {
+                    updateLeaf(leaf, data, stripesLength);
+                }
+            });
+        }
+
+        for (uint32_t leaf = 0; leaf < PARALLELISM; leaf += m_threads)
+        {
+            updateLeaf(leaf, data, stripesLength);
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+    else if (stripesLength != 0)
+    {
+        for (uint32_t i = 0; i < PARALLELISM; i++)
+        {
+            updateLeaf(i, data, stripesLength);
+        }
+    }
+
+    data += stripesLength;
+    len -= stripesLength;
+
+    std::memcpy(m_buffer.data() + m_bufferSize, data, len);
+
+    m_bufferSize += len;
+}
+
+std::vector<uint8_t> Blake2bp::Finalize()
+{
+    std::array<std::array<uint8_t, 64>, PARALLELISM> leafHashes;
+
+    for (uint32_t i = 0; i < PARALLELISM; i++)
+    {
+        /* Hand each leaf its part of the final partial stripe */
+        if (m_bufferSize > i * BLOCK_SIZE)
+        {
+            const size_t remaining = std::min(m_bufferSize - i * BLOCK_SIZE, BLOCK_SIZE);
+
+            m_leaves[i].Update(m_buffer.data() + i * BLOCK_SIZE, remaining);
+        }
+
+        m_leaves[i].Finalize(leafHashes[i].data(), leafHashes[i].size());
+    }
+
+    for (const auto &leafHash : leafHashes)
+    {
+        m_root.Update(leafHash.data(), leafHash.size());
+    }
+
+    return m_root.Finalize();
+}
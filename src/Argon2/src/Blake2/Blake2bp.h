@@ -0,0 +1,68 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Blake2/Blake2b.h"
+
+/* BLAKE2bp, the 4 way parallel tree mode of Blake2b. The message is split
+   into 128 byte blocks dealt out to 4 leaves in turn, and the leaf hashes
+   are hashed by a root node. The leaves are independent, so large inputs
+   can be hashed on up to 4 threads. The output differs from Blake2b. */
+class Blake2bp
+{
+    public:
+        Blake2bp(
+            const Constants::OptimizationMethod optimizationMethod = Constants::AUTO,
+            const uint32_t threads = 1);
+
+        void Init(
+            const std::vector<uint8_t> key = {},
+            const uint8_t outputHashLength = 64);
+
+        void Update(const std::vector<uint8_t> &data);
+        void Update(const uint8_t *data, size_t len);
+
+        std::vector<uint8_t> Finalize();
+
+        static std::vector<uint8_t> Hash(
+            const std::vector<uint8_t> &message,
+            const uint32_t threads = 1);
+
+        static std::vector<uint8_t> Hash(const std::string &message);
+
+        constexpr static uint32_t PARALLELISM = 4;
+
+        constexpr static size_t BLOCK_SIZE = 128;
+
+        /* Updates smaller than this are hashed on the calling thread, as
+           starting threads would cost more than it saves */
+        constexpr static size_t THREADING_THRESHOLD = 1024 * 1024;
+
+    private:
+        /* Feed every full stripe of PARALLELISM blocks to the given leaf */
+        void updateLeaf(
+            const uint32_t leaf,
+            const uint8_t *data,
+            const size_t len);
+
+        std::vector<Blake2b> m_leaves;
+
+        Blake2b m_root;
+
+        /* Data not yet making up a full stripe */
+        std::array<uint8_t, PARALLELISM * BLOCK_SIZE> m_buffer;
+
+        size_t m_bufferSize = 0;
+
+        uint8_t m_outputHashLength = 64;
+
+        /* How many threads to hash large updates on */
+        const uint32_t m_threads;
+};
@@ -10,6 +10,7 @@
 #include <cstring>
 
 #include "Argon2/Argon2.h"
+#include "Intrinsics/Portable/ProcessBlockPortable.h"
 #include "Intrinsics/ARM/ProcessBlockNEON.h"
 
 void Argon2::processBlockGeneric(
@@ -18,6 +19,14 @@ void Argon2::processBlockGeneric(
     const Block &prevBlock,
     const bool doXor)
 {
+#if defined(ARGON2_PORTABLE_KERNEL)
+    if (m_optimizationMethod == Constants::PORTABLE)
+    {
+        ProcessBlockPortable::processBlockPortable(nextBlock, refBlock, prevBlock, doXor);
+        return;
+    }
+#endif
+
     /* NEON disabled by default unless explicitly specified.
        https://github.com/weidai11/cryptopp/issues/367 */
     if (m_optimizationMethod == Constants::NEON && hasNEON)
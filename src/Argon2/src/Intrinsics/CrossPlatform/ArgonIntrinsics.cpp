@@ -5,6 +5,7 @@
 #include <cstddef>
 
 #include "Argon2/Argon2.h"
+#include "Intrinsics/Portable/ProcessBlockPortable.h"
 
 void Argon2::processBlockGeneric(
     Block &out,
@@ -12,5 +13,15 @@ void Argon2::processBlockGeneric(
     const Block &in2,
     const bool doXor)
 {
+#if defined(ARGON2_PORTABLE_KERNEL)
+    /* Opt in only. It has yet to beat the scalar path anywhere we have
+       measured, so Auto stays on that. */
+    if (m_optimizationMethod == Constants::PORTABLE)
+    {
+        ProcessBlockPortable::processBlockPortable(out, in1, in2, doXor);
+        return;
+    }
+#endif
+
     processBlockGenericCrossPlatform(out, in1, in2, doXor);
 }
@@ -0,0 +1,179 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////////////////////////////
+#include "Intrinsics/Portable/ProcessBlockPortable.h"
+/////////////////////////////////////////////////////
+
+#if defined(ARGON2_PORTABLE_KERNEL)
+
+#include <cstring>
+#include <utility>
+
+namespace ProcessBlockPortable
+{
+    /* Two 64 bit words, the narrowest vector most SIMD units support */
+    typedef uint64_t Vector __attribute__((vector_size(16)));
+
+    /* x + y + 2 * lo32(x) * lo32(y) */
+    inline Vector fBlaMka(const Vector x, const Vector y)
+    {
+        const Vector lowMask = { 0xFFFFFFFF, 0xFFFFFFFF };
+        const Vector product = (x & lowMask) * (y & lowMask);
+
+        return x + y + product + product;
+    }
+
+    template<int bits>
+    inline Vector rotr(const Vector x)
+    {
+        return (x >> bits) | (x << (64 - bits));
+    }
+
+    /* Half of G on both columns, a0..d0 and a1..d1 */
+    template<int rotationD, int rotationB>
+    inline void blamkaHalfRound(
+        Vector &a0, Vector &a1, Vector &b0, Vector &b1,
+        Vector &c0, Vector &c1, Vector &d0, Vector &d1)
+    {
+        a0 = fBlaMka(a0, b0);
+        a1 = fBlaMka(a1, b1);
+
+        d0 = rotr<rotationD>(d0 ^ a0);
+        d1 = rotr<rotationD>(d1 ^ a1);
+
+        c0 = fBlaMka(c0, d0);
+        c1 = fBlaMka(c1, d1);
+
+        b0 = rotr<rotationB>(b0 ^ c0);
+        b1 = rotr<rotationB>(b1 ^ c1);
+    }
+
+    inline void diagonalize(
+        Vector &b0, Vector &b1, Vector &c0, Vector &c1, Vector &d0, Vector &d1)
+    {
+        const Vector tmpB0 = b0;
+        const Vector tmpD0 = d0;
+
+        b0 = Vector { tmpB0[1], b1[0] };
+        b1 = Vector { b1[1], tmpB0[0] };
+
+        std::swap(c0, c1);
+
+        d0 = Vector { d1[1], tmpD0[0] };
+        d1 = Vector { tmpD0[1], d1[0] };
+    }
+
+    inline void undiagonalize(
+        Vector &b0, Vector &b1, Vector &c0, Vector &c1, Vector &d0, Vector &d1)
+    {
+        const Vector tmpB0 = b0;
+        const Vector tmpD0 = d0;
+
+        b0 = Vector { b1[1], tmpB0[0] };
+        b1 = Vector { tmpB0[1], b1[0] };
+
+        std::swap(c0, c1);
+
+        d0 = Vector { tmpD0[1], d1[0] };
+        d1 = Vector { d1[1], tmpD0[0] };
+    }
+
+    /* A full BlaMka round on 8 vectors of the state. They are copied into
+       locals so the compiler can keep them all in registers. */
+    inline void blamkaRound(
+        Vector *state,
+        const size_t start,
+        const size_t stride)
+    {
+        Vector a0 = state[start + 0 * stride];
+        Vector a1 = state[start + 1 * stride];
+        Vector b0 = state[start + 2 * stride];
+        Vector b1 = state[start + 3 * stride];
+        Vector c0 = state[start + 4 * stride];
+        Vector c1 = state[start + 5 * stride];
+        Vector d0 = state[start + 6 * stride];
+        Vector d1 = state[start + 7 * stride];
+
+        blamkaHalfRound<32, 24>(a0, a1, b0, b1, c0, c1, d0, d1);
+        blamkaHalfRound<16, 63>(a0, a1, b0, b1, c0, c1, d0, d1);
+
+        diagonalize(b0, b1, c0, c1, d0, d1);
+
+        blamkaHalfRound<32, 24>(a0, a1, b0, b1, c0, c1, d0, d1);
+        blamkaHalfRound<16, 63>(a0, a1, b0, b1, c0, c1, d0, d1);
+
+        undiagonalize(b0, b1, c0, c1, d0, d1);
+
+        state[start + 0 * stride] = a0;
+        state[start + 1 * stride] = a1;
+        state[start + 2 * stride] = b0;
+        state[start + 3 * stride] = b1;
+        state[start + 4 * stride] = c0;
+        state[start + 5 * stride] = c1;
+        state[start + 6 * stride] = d0;
+        state[start + 7 * stride] = d1;
+    }
+
+    void processBlockPortable(
+        Block &nextBlock,
+        const Block &refBlock,
+        const Block &prevBlock,
+        const bool doXor)
+    {
+        /* 64 * 16 = Constants::BLOCK_SIZE_BYTES */
+        Vector state[64];
+        Vector prevBlockVector[64];
+
+        std::memcpy(state, refBlock.data(), Constants::BLOCK_SIZE_BYTES);
+        std::memcpy(prevBlockVector, prevBlock.data(), Constants::BLOCK_SIZE_BYTES);
+
+        /* R = ref ^ prev, which we need again at the end */
+        for (int i = 0; i < 64; i++)
+        {
+            state[i] ^= prevBlockVector[i];
+        }
+
+        Vector xorBlock[64];
+
+        std::memcpy(xorBlock, state, Constants::BLOCK_SIZE_BYTES);
+
+        /* Rows */
+        for (size_t i = 0; i < 8; i++)
+        {
+            blamkaRound(state, 8 * i, 1);
+        }
+
+        /* Columns */
+        for (size_t i = 0; i < 8; i++)
+        {
+            blamkaRound(state, i, 8);
+        }
+
+        if (doXor)
+        {
+            Vector next[64];
+
+            std::memcpy(next, nextBlock.data(), Constants::BLOCK_SIZE_BYTES);
+
+            for (int i = 0; i < 64; i++)
+            {
+                next[i] ^= xorBlock[i] ^ state[i];
+            }
+
+            std::memcpy(nextBlock.data(), next, Constants::BLOCK_SIZE_BYTES);
+        }
+        else
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                state[i] ^= xorBlock[i];
+            }
+
+            std::memcpy(nextBlock.data(), state, Constants::BLOCK_SIZE_BYTES);
+        }
+    }
+}
+
+#endif
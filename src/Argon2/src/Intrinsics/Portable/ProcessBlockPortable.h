@@ -0,0 +1,25 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include "Argon2/Argon2.h"
+#include "Argon2/Constants.h"
+
+#if defined(ARGON2_PORTABLE_KERNEL)
+
+/* The block compression written with GCC/Clang vector extensions instead of
+   intrinsics, so the compiler vectorizes it for whatever architecture it
+   targets. Laid out like the SSE2 kernel: the block is 64 vectors of two
+   words, and each round works on 8 of them held in locals. */
+namespace ProcessBlockPortable
+{
+    void processBlockPortable(
+        Block &nextBlock,
+        const Block &refBlock,
+        const Block &prevBlock,
+        const bool doXor);
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <iostream>
 
 #include "Argon2/Argon2.h"
+#include "Intrinsics/Portable/ProcessBlockPortable.h"
 #include "Intrinsics/X86/ProcessBlockAVX512.h"
 #include "Intrinsics/X86/ProcessBlockAVX2.h"
 #include "Intrinsics/X86/ProcessBlockSSSE3.h"
@@ -32,6 +33,14 @@ void Argon2::processBlockGeneric(
     const Block &prevBlock,
     const bool doXor)
 {
+#if defined(ARGON2_PORTABLE_KERNEL)
+    if (m_optimizationMethod == Constants::PORTABLE)
+    {
+        ProcessBlockPortable::processBlockPortable(nextBlock, refBlock, prevBlock, doXor);
+        return;
+    }
+#endif
+
     const bool tryAVX512
         = m_optimizationMethod == Constants::AVX512 || m_optimizationMethod == Constants::AUTO;
 
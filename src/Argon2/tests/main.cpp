@@ -15,9 +15,11 @@
 #include <iomanip>
 
 #include "Argon2/Argon2.h"
+#include "Argon2/Argon2Pool.h"
 #include "Argon2/Constants.h"
 
 #include "Blake2/Blake2b.h"
+#include "Blake2/Blake2bp.h"
 
 std::string byteArrayToHexString(const std::vector<uint8_t> &input)
 {
@@ -52,6 +54,22 @@ bool testHashFunction(std::string expectedOutput, std::string testName, std::fun
     }
 }
 
+bool testCondition(std::string testName, std::function<bool(void)> condition)
+{
+    if (!condition())
+    {
+        std::cout << "❌ Failed test for " << testName << std::endl;
+
+        return false;
+    }
+    else
+    {
+        std::cout << "✔️  Passed test for " << testName << std::endl;
+
+        return true;
+    }
+}
+
 int main()
 {
     std::vector<bool> results;
@@ -67,6 +85,94 @@ int main()
         return Blake2b::Hash("The quick brown fox jumps over the lazy dog");
     }));
 
+    /* Sequential input, keyed with 0..63, as in the reference test vectors */
+    std::vector<uint8_t> blakeKey(64);
+    std::vector<uint8_t> blakeInput(10000);
+
+    for (size_t i = 0; i < blakeKey.size(); i++)
+    {
+        blakeKey[i] = static_cast<uint8_t>(i);
+    }
+
+    for (size_t i = 0; i < blakeInput.size(); i++)
+    {
+        blakeInput[i] = static_cast<uint8_t>(i % 251);
+    }
+
+    results.push_back(testHashFunction("1d58d71414d24752db3274afdc483fc0f4c68317c4c2f6a31e09de9437ba02ccab8c8585790a52b0d476f7920c0e1397d1aec9e52f3df3feae76f7d6223ce5cf", "Blake2b keyed", [&blakeKey](){
+        const std::string message = "The quick brown fox jumps over the lazy dog";
+
+        Blake2b blake;
+        blake.Init(blakeKey);
+        blake.Update({message.begin(), message.end()});
+        return blake.Finalize();
+    }));
+
+    results.push_back(testHashFunction("b5ef811a8038f70b628fa8b294daae7492b1ebe343a80eaabbf1f6ae664dd67b9d90b0120791eab81dc96985f28849f6a305186a85501b405114bfa678df9380", "Blake2bp 1/2", [](){
+        return Blake2bp::Hash("");
+    }));
+
+    results.push_back(testHashFunction("4184d2acbcce03adc3b8f2fccd1ae3d6ced3aa0b051ae648f6986bb46579a0cf", "Blake2bp 2/2", [](){
+        const std::string message = "The quick brown fox jumps over the lazy dog";
+
+        Blake2bp blake;
+        blake.Init({}, 32);
+        blake.Update({message.begin(), message.end()});
+        return blake.Finalize();
+    }));
+
+    const std::vector<std::pair<size_t, std::string>> blake2bpKeyedExpected = {
+        { 0, "9d9461073e4eb640a255357b839f394b838c6ff57c9b686a3f76107c1066728f3c9956bd785cbc3bf79dc2ab578c5a0c063b9d9c405848de1dbe821cd05c940a" },
+        { 1, "ff8e90a37b94623932c59f7559f26035029c376732cb14d41602001cbb73adb79293a2dbda5f60703025144d158e2735529596251c73c0345ca6fccb1fb1e97e" },
+        { 255, "96fbcbb60bd313b8845033e5bc058a38027438572d7e7957f3684f6268aadd3ad08d21767ed6878685331ba98571487e12470aad669326716e46667f69f8d7e8" },
+    };
+
+    for (const auto &[length, expected] : blake2bpKeyedExpected)
+    {
+        results.push_back(testHashFunction(expected, "Blake2bp keyed, " + std::to_string(length) + " bytes", [&blakeKey, length](){
+            std::vector<uint8_t> message(length);
+
+            for (size_t i = 0; i < length; i++)
+            {
+                message[i] = static_cast<uint8_t>(i);
+            }
+
+            Blake2bp blake;
+            blake.Init(blakeKey);
+            blake.Update(message);
+            return blake.Finalize();
+        }));
+    }
+
+    results.push_back(testHashFunction("ce5622afeac4bb4a09386dc4decea346c202fd8dff8c924cad73802e43ee7f7578a907e768d333db7569228e362560c0c99d9448405ec85c916c07478d88b771", "Blake2bp streaming", [&blakeInput](){
+        Blake2bp blake;
+        blake.Init();
+
+        /* Uneven pieces, so updates start and end mid block and mid stripe */
+        size_t offset = 0;
+
+        for (size_t size = 1; offset < blakeInput.size(); size = size * 3 + 1)
+        {
+            const size_t len = std::min(size, blakeInput.size() - offset);
+            blake.Update(&blakeInput[offset], len);
+            offset += len;
+        }
+
+        return blake.Finalize();
+    }));
+
+    results.push_back(testCondition("Blake2bp multi-threaded", [](){
+        std::vector<uint8_t> message(3 * 1024 * 1024 + 100);
+
+        for (size_t i = 0; i < message.size(); i++)
+        {
+            message[i] = static_cast<uint8_t>(i * 7);
+        }
+
+        return Blake2bp::Hash(message, 4) == Blake2bp::Hash(message, 1)
+            && Blake2bp::Hash(message, 3) == Blake2bp::Hash(message, 1);
+    }));
+
     const std::vector<uint8_t> password = {
         1, 1, 1, 1, 1, 1, 1, 1,
         1, 1, 1, 1, 1, 1, 1, 1,
@@ -146,6 +252,114 @@ int main()
         return chukwa.Hash(chukwaInput, chukwaSalt);
     }));
 
+    /* Every method must agree with the reference, whichever AUTO picks */
+    Argon2 scalar(Constants::ARGON2D, key, associatedData, 3, 32, 4, 32, Constants::NONE);
+
+    results.push_back(testHashFunction(argon2DExpected, "Argon2D No Optimizations", [&scalar, &password, &salt](){
+        return scalar.Hash(password, salt);
+    }));
+
+    if (Constants::PORTABLE_KERNEL_AVAILABLE)
+    {
+        Argon2 portable(Constants::ARGON2D, key, associatedData, 3, 32, 4, 32, Constants::PORTABLE);
+
+        results.push_back(testHashFunction(argon2DExpected, "Argon2D Portable", [&portable, &password, &salt](){
+            return portable.Hash(password, salt);
+        }));
+
+        Argon2 portableChukwa(Constants::ARGON2ID, {}, {}, 3, 512, 1, 32, Constants::PORTABLE);
+
+        results.push_back(testHashFunction(chukwaExpected, "TurtleCoin Compatibility Portable", [&chukwaInput, &chukwaSalt, &portableChukwa](){
+            return portableChukwa.Hash(chukwaInput, chukwaSalt);
+        }));
+    }
+
+    /* Room for 2 of the 32KB scratchpads the argonHash parameters need */
+    Argon2Pool pool(64, 4);
+
+    results.push_back(testHashFunction(argon2DExpected, "Argon2Pool Argon2D", [&pool, &password, &salt, &key, &associatedData](){
+        return pool.DeriveKey(Constants::ARGON2D, password, salt, key, associatedData, 3, 32, 4, 32).get();
+    }));
+
+    results.push_back(testHashFunction(argon2IDExpected, "Argon2Pool Argon2ID", [&pool, &password, &salt, &key, &associatedData](){
+        return pool.DeriveKey(Constants::ARGON2ID, password, salt, key, associatedData, 3, 32, 4, 32).get();
+    }));
+
+    results.push_back(testCondition("Argon2Pool within memory budget", [&pool, &password, &salt, &key, &associatedData, argon2DExpected](){
+        const uint64_t allocations = pool.getStats().allocations;
+
+        std::vector<std::future<std::vector<uint8_t>>> futures;
+
+        for (int i = 0; i < 16; i++)
+        {
+            futures.push_back(pool.DeriveKey(Constants::ARGON2D, password, salt, key, associatedData, 3, 32, 4, 32));
+        }
+
+        const bool correct = std::all_of(futures.begin(), futures.end(), [argon2DExpected](auto &future){
+            return byteArrayToHexString(future.get()) == argon2DExpected;
+        });
+
+        const auto stats = pool.getStats();
+
+        return correct && stats.memoryInUse + stats.memoryCached <= 64 && stats.allocations - allocations <= 2;
+    }));
+
+    results.push_back(testCondition("Argon2Pool rejects hashes over budget", [&pool, &chukwaInput, &chukwaSalt](){
+        try
+        {
+            pool.Argon2id(chukwaInput, chukwaSalt, 3, 512, 1, 32).get();
+            return false;
+        }
+        catch (const std::invalid_argument &)
+        {
+            return pool.getStats().rejected == 1;
+        }
+    }));
+
+    results.push_back(testCondition("Argon2Pool frees idle scratchpads", [&chukwaInput, &chukwaSalt, &password, &salt, &key, &associatedData, chukwaExpected, argon2DExpected](){
+        /* Only room for the chukwa scratchpad, or the smaller ones */
+        Argon2Pool smallPool(512, 2);
+
+        std::vector<std::pair<std::string, std::future<std::vector<uint8_t>>>> futures;
+
+        for (int i = 0; i < 4; i++)
+        {
+            futures.emplace_back(chukwaExpected, smallPool.Argon2id(chukwaInput, chukwaSalt, 3, 512, 1, 32));
+            futures.emplace_back(argon2DExpected, smallPool.DeriveKey(Constants::ARGON2D, password, salt, key, associatedData, 3, 32, 4, 32));
+        }
+
+        return std::all_of(futures.begin(), futures.end(), [](auto &expectedAndFuture){
+            return byteArrayToHexString(expectedAndFuture.second.get()) == expectedAndFuture.first;
+        });
+    }));
+
+    results.push_back(testCondition("Argon2Pool queue limit", [&chukwaInput, &chukwaSalt](){
+        Argon2Pool queuePool(512, 1, 1);
+
+        std::vector<std::future<std::vector<uint8_t>>> futures;
+
+        for (int i = 0; i < 50; i++)
+        {
+            futures.push_back(queuePool.Argon2id(chukwaInput, chukwaSalt, 3, 512, 1, 32));
+        }
+
+        size_t rejected = 0;
+
+        for (auto &future : futures)
+        {
+            try
+            {
+                future.get();
+            }
+            catch (const std::runtime_error &)
+            {
+                rejected++;
+            }
+        }
+
+        return rejected != 0 && rejected == queuePool.getStats().rejected;
+    }));
+
     const bool success = std::all_of(results.begin(), results.end(), [](const bool x) { return x; });
 
     if (success)
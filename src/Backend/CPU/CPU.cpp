@@ -6,34 +6,42 @@
 #include "Backend/CPU/CPU.h"
 ////////////////////////////
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
-#include "Types/JobSubmit.h"
+#include "ArgonVariants/Variants.h"
+#include "Backend/CPU/PerfEvents.h"
+#include "Logger/Logger.h"
+#include "Utilities/ColouredMsg.h"
+#include "Utilities/Utilities.h"
 
-CPU::CPU(
-    const std::shared_ptr<HardwareConfig> &hardwareConfig,
-    const std::function<void(const JobSubmit &jobSubmit)> &submitHashCallback):
+CPU::CPU(const std::shared_ptr<HardwareConfig> &hardwareConfig):
     m_hardwareConfig(hardwareConfig),
-    m_submitHash(submitHashCallback)
+    m_activeThreads(hardwareConfig->cpu.threadCount),
+    m_threadHashrates(hardwareConfig->cpu.threadCount)
 {
+    for (uint32_t i = 0; i < hardwareConfig->cpu.threadCount; i++)
+    {
+        m_threadCounters.push_back(std::make_unique<ThreadCounters>());
+    }
+}
+
+CPU::~CPU()
+{
+    stop();
 }
 
-void CPU::start(const Job &job, const uint32_t initialNonce)
+void CPU::start(const std::shared_ptr<CompletionQueue> &completions)
 {
     if (!m_threads.empty())
     {
         stop();
     }
 
+    m_completions = completions;
     m_shouldStop = false;
 
-    m_nonce = initialNonce;
-
-    m_currentJob = job;
-
-    /* Indicate that there's no new jobs available to other threads */
-    m_newJobAvailable = std::vector<bool>(m_hardwareConfig->cpu.threadCount, false);
-
     for (uint32_t i = 0; i < m_hardwareConfig->cpu.threadCount; i++)
     {
         m_threads.push_back(std::thread(&CPU::hash, this, i));
@@ -42,13 +50,17 @@ void CPU::start(const Job &job, const uint32_t initialNonce)
 
 void CPU::stop()
 {
-    m_shouldStop = true;
-
-    for (int i = 0; i < m_newJobAvailable.size(); i++)
     {
-        m_newJobAvailable[i] = true;
+        /* Taking the locks ensures a thread about to wait sees m_shouldStop */
+        std::scoped_lock lock(m_queueMutex, m_parkMutex);
+
+        m_shouldStop = true;
+        m_queue.clear();
     }
 
+    m_workAvailable.notify_all();
+    m_unpark.notify_all();
+
     /* Wait for all the threads to stop */
     for (auto &thread : m_threads)
     {
@@ -62,67 +74,258 @@ void CPU::stop()
     m_threads.clear();
 }
 
-void CPU::setNewJob(const Job &job, const uint32_t initialNonce)
+void CPU::submit(const WorkUnit &unit)
+{
+    {
+        std::scoped_lock lock(m_queueMutex);
+        m_queue.push_back(unit);
+    }
+
+    m_workAvailable.notify_one();
+}
+
+void CPU::abandonBefore(const uint64_t epoch)
 {
-    /* Set new nonce */
-    m_nonce = initialNonce;
+    std::vector<WorkCompletion> completions;
+
+    {
+        std::scoped_lock lock(m_queueMutex);
 
-    /* Update stored job */
-    m_currentJob = job;
+        /* Running units are cut short when their thread next checks */
+        m_currentEpoch = std::max(m_currentEpoch.load(), epoch);
 
-    /* Indicate to each thread that there's a new job */
-    for (int i = 0; i < m_newJobAvailable.size(); i++)
+        const auto stale = std::stable_partition(m_queue.begin(), m_queue.end(), [epoch](const auto &unit)
+        {
+            return unit.epoch >= epoch;
+        });
+
+        for (auto it = stale; it != m_queue.end(); it++)
+        {
+            completions.push_back(abandoned(*it));
+        }
+
+        m_queue.erase(stale, m_queue.end());
+    }
+
+    for (auto &completion : completions)
     {
-        m_newJobAvailable[i] = true;
+        post(completion);
     }
 }
 
+std::string CPU::getName() const
+{
+    return "CPU";
+}
+
+uint32_t CPU::concurrency() const
+{
+    return m_activeThreads;
+}
+
+void CPU::setActiveThreads(const uint32_t count)
+{
+    {
+        std::scoped_lock lock(m_queueMutex, m_parkMutex);
+
+        m_activeThreads = std::min<uint32_t>(count, m_hardwareConfig->cpu.threadCount);
+    }
+
+    /* Threads waiting for work need to notice they are parked too */
+    m_unpark.notify_all();
+    m_workAvailable.notify_all();
+}
+
+uint32_t CPU::getActiveThreads() const
+{
+    return m_activeThreads;
+}
+
+bool CPU::shouldPark(const uint32_t threadNumber) const
+{
+    return threadNumber >= m_activeThreads.load(std::memory_order_relaxed);
+}
+
+void CPU::park(const uint32_t threadNumber)
+{
+    ThreadCounters &counters = *m_threadCounters[threadNumber];
+
+    counters.parked = true;
+
+    std::unique_lock lock(m_parkMutex);
+
+    m_unpark.wait(lock, [&]{ return !shouldPark(threadNumber) || m_shouldStop; });
+
+    counters.parked = false;
+}
+
 std::vector<PerformanceStats> CPU::getPerformanceStats()
 {
-    return {};
+    std::scoped_lock lock(m_statsMutex);
+
+    std::vector<PerformanceStats> stats;
+
+    for (uint32_t i = 0; i < m_threadCounters.size(); i++)
+    {
+        stats.push_back(snapshotCounters(*m_threadCounters[i], m_threadHashrates[i], "CPU", i));
+    }
+
+    return stats;
+}
+
+void CPU::post(WorkCompletion &completion)
+{
+    /* The scheduler drains the queue continuously, so it's only full for a
+       moment, if ever */
+    while (!m_completions->tryPush(completion))
+    {
+        if (m_shouldStop)
+        {
+            return;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+WorkCompletion CPU::abandoned(const WorkUnit &unit)
+{
+    WorkCompletion completion;
+
+    completion.leaseID = unit.leaseID;
+    completion.epoch = unit.epoch;
+    completion.job = unit.job;
+    completion.startNonce = unit.startNonce;
+    completion.nonceCount = unit.nonceCount;
+    completion.started = std::chrono::steady_clock::now();
+    completion.finished = completion.started;
+
+    return completion;
 }
 
 void CPU::hash(const uint32_t threadNumber)
 {
-    std::string currentAlgorithm;
-    NonceInfo nonceInfo;
+    ThreadCounters &counters = *m_threadCounters[threadNumber];
+
+    /* How often to fold the hardware counters and Argon2 profile into the
+       thread's stats. Reading the hardware counters is a syscall per event,
+       and the stats are behind a lock, so we don't want to do it every hash. */
+    const auto sampleInterval = std::chrono::seconds(1);
+
+    std::unique_ptr<PerfEvents> perfEvents;
+
+    if (m_hardwareConfig->cpu.hardwareCounters)
+    {
+        perfEvents = std::make_unique<PerfEvents>();
+
+        if (!perfEvents->available() && threadNumber == 0)
+        {
+            std::cout << WarningMsg("Hardware counters unavailable: " + perfEvents->error()) << std::endl;
+        }
+    }
+
+    auto lastSample = std::chrono::steady_clock::now();
+
+    uint64_t hashesSinceSample = 0;
+
+    /* The job the algorithm is set up for, and our copy of it to write the
+       nonces into */
+    std::shared_ptr<const Job> currentJob;
+
+    Job job;
+
+    std::shared_ptr<Argon2Hash> algorithm;
+
+    /* Hashes of the current job, for logging */
+    uint64_t jobHashes = 0;
 
     while (!m_shouldStop)
     {
-        uint32_t localNonce = m_nonce;
+        /* Parked by the governor. Keep hold of the algorithm and its
+           scratchpad, and carry on with this job if it's still current
+           when we're unparked. */
+        if (shouldPark(threadNumber))
+        {
+            park(threadNumber);
+            continue;
+        }
 
-        Job job = m_currentJob;
+        WorkUnit unit;
 
-        const bool isNiceHash = job.isNiceHash;
+        {
+            std::unique_lock lock(m_queueMutex);
 
-        auto algorithm = ArgonVariant::getCPUMiningAlgorithm(m_currentJob.algorithm);
+            m_workAvailable.wait(lock, [&]{
+                return m_shouldStop || !m_queue.empty() || shouldPark(threadNumber);
+            });
 
-        if (job.algorithm != currentAlgorithm)
+            if (m_shouldStop || shouldPark(threadNumber))
+            {
+                continue;
+            }
+
+            unit = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        WorkCompletion completion = abandoned(unit);
+
+        if (unit.epoch < m_currentEpoch)
         {
-            nonceInfo = m_hardwareConfig->getNonceOffsetInfo("cpu");
-            currentAlgorithm = job.algorithm;
+            post(completion);
+            continue;
         }
 
-        /* Let the algorithm perform any necessary initialization */
-        algorithm->init(m_currentJob.rawBlob);
-        algorithm->reinit(m_currentJob.rawBlob);
+        if (unit.job != currentJob)
+        {
+            if (currentJob)
+            {
+                counters.recordJobSwitch();
+
+                LOG(Logger::DEBUG, Logger::CPU, "Thread " << threadNumber << " switching job after " << jobHashes << " hashes");
+            }
+
+            currentJob = unit.job;
+            job = *unit.job;
+            jobHashes = 0;
+
+            algorithm = ArgonVariant::getCPUMiningAlgorithm(job.algorithm);
+
+            /* Let the algorithm perform any necessary initialization */
+            algorithm->init(job.rawBlob);
+            algorithm->reinit(job.rawBlob);
+        }
+
+        const bool isNiceHash = job.isNiceHash;
 
-        int i = 0;
+        completion.started = std::chrono::steady_clock::now();
 
-        while (!m_newJobAvailable[threadNumber])
+        while (completion.hashesPerformed < unit.nonceCount)
         {
-            const uint32_t ourNonce = localNonce + (i * nonceInfo.noncesPerRound) + threadNumber;
+            if (m_shouldStop)
+            {
+                break;
+            }
+
+            /* The job changed, or we've been parked. Whatever we didn't get
+               to is leased to another thread. */
+            if (unit.epoch < m_currentEpoch.load(std::memory_order_relaxed) || shouldPark(threadNumber))
+            {
+                break;
+            }
+
+            const uint32_t ourNonce = unit.startNonce + completion.hashesPerformed;
 
             /* If nicehash mode is enabled, we are only allowed to alter 3 bytes
                in the nonce, instead of four. The first byte is reserved for nicehash
                to do with as they like.
-               To achieve this, we wipe the top byte (localNonce & 0x00FFFFFF) of
-               local nonce. We then wipe the bottom 3 bytes of job.nonce
+               To achieve this, we wipe the top byte (ourNonce & 0x00FFFFFF) of
+               our nonce. We then wipe the bottom 3 bytes of job.nonce
                (*job.nonce() & 0xFF000000). Finally, we AND them together, so the
                top byte of the nonce is reserved for nicehash.
                See further https://github.com/nicehash/Specifications/blob/master/NiceHash_CryptoNight_modification_v1.0.txt
                Note that the above specification indicates that the final byte of
-               the nonce is reserved, but in fact it is the first byte that is 
+               the nonce is reserved, but in fact it is the first byte that is
                reserved. */
             if (isNiceHash)
             {
@@ -133,21 +336,54 @@ void CPU::hash(const uint32_t threadNumber)
                 *job.nonce() = ourNonce;
             }
 
+            const auto hashStart = std::chrono::steady_clock::now();
+
             const auto hash = algorithm->hash(job.rawBlob);
 
-            m_submitHash({ hash.data(), job.jobID, *job.nonce(), job.target, "CPU" });
+            const auto hashEnd = std::chrono::steady_clock::now();
 
-            i++;
+            counters.recordHashes(
+                1,
+                std::chrono::duration_cast<std::chrono::microseconds>(hashEnd - hashStart).count()
+            );
 
-            /* If not all hardware has checked in with the new job, keep attempting
-             * to fetch it to ensure we're not doing duplicate work. */
-            if (!nonceInfo.allHardwareInitialized)
+            hashesSinceSample++;
+
+            if (hashEnd - lastSample >= sampleInterval)
             {
-                nonceInfo = m_hardwareConfig->getNonceOffsetInfo("cpu");
+                if (perfEvents)
+                {
+                    counters.recordHardwareCounters(perfEvents->sample(hashesSinceSample));
+                }
+
+                /* Argon2 sums its timings per thread until we take them */
+                #if defined(ARGON2_INSTRUMENTATION)
+                counters.recordArgon2Profile(Instrumentation::takeThreadCounters());
+                #endif
+
+                hashesSinceSample = 0;
+                lastSample = hashEnd;
+            }
+
+            completion.hashesPerformed++;
+            jobHashes++;
+
+            /* Hand shares over straight away, rather than at the end of the
+               unit. The rest of the range is leased out again. */
+            if (Utilities::isHashValidForTarget(hash.data(), job.target))
+            {
+                completion.found.push_back({ *job.nonce(), hash });
+                break;
             }
         }
 
-        /* Switch to new job. */
-        m_newJobAvailable[threadNumber] = false;
+        completion.finished = std::chrono::steady_clock::now();
+
+        post(completion);
     }
+
+    /* Don't lose the timings since the last sample */
+    #if defined(ARGON2_INSTRUMENTATION)
+    counters.recordArgon2Profile(Instrumentation::takeThreadCounters());
+    #endif
 }
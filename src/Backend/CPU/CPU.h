@@ -5,34 +5,76 @@
 #pragma once
 
 #include <atomic>
-
-#include "Backend/IBackend.h"
-#include "Types/JobSubmit.h"
-
-class CPU : virtual public IBackend
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Backend/IAsyncBackend.h"
+#include "Miner/GetConfig.h"
+#include "Types/PerformanceStats.h"
+
+/* Hashes the units leased to it by the WorkScheduler, one per thread at a
+   time. Threads check between hashes whether their unit has been abandoned,
+   so job switches are quick. */
+class CPU : virtual public IAsyncBackend
 {
   public:
-    CPU(
-        const std::shared_ptr<HardwareConfig> &hardwareConfig,
-        const std::function<void(const JobSubmit &jobSubmit)> &submitHashCallback);
+    CPU(const std::shared_ptr<HardwareConfig> &hardwareConfig);
+
+    ~CPU();
 
-    virtual void start(const Job &job, const uint32_t initialNonce);
+    virtual void start(const std::shared_ptr<CompletionQueue> &completions);
 
     virtual void stop();
 
-    virtual void setNewJob(const Job &job, const uint32_t initialNonce);
+    virtual void submit(const WorkUnit &unit);
+
+    virtual void abandonBefore(const uint64_t epoch);
+
+    virtual std::string getName() const;
 
-    virtual std::vector<PerformanceStats> getPerformanceStats();
+    /* One unit per hashing thread that isn't parked */
+    virtual uint32_t concurrency() const;
+
+    std::vector<PerformanceStats> getPerformanceStats();
+
+    /* Only hash on the first count threads, parking the rest. Parked threads
+       keep their scratchpads, so unparking them is immediate. */
+    void setActiveThreads(const uint32_t count);
+
+    uint32_t getActiveThreads() const;
 
   private:
 
     void hash(const uint32_t threadNumber);
 
-    /* Current job to be working on */
-    Job m_currentJob;
+    /* Block until this thread is unparked or we are stopping */
+    void park(const uint32_t threadNumber);
+
+    bool shouldPark(const uint32_t threadNumber) const;
+
+    /* Hand a completion to the scheduler */
+    void post(WorkCompletion &completion);
 
-    /* Nonce to begin hashing at */
-    uint32_t m_nonce;
+    /* A completion for a unit that was never started */
+    static WorkCompletion abandoned(const WorkUnit &unit);
+
+    /* Units waiting for a thread */
+    std::deque<WorkUnit> m_queue;
+
+    /* Wakes the hashing threads when there is work, or we are stopping */
+    std::condition_variable m_workAvailable;
+
+    /* Guards m_queue */
+    std::mutex m_queueMutex;
+
+    /* Units of epochs before this are abandoned. Read by the hashing threads
+       between hashes. */
+    std::atomic<uint64_t> m_currentEpoch = 0;
+
+    std::shared_ptr<CompletionQueue> m_completions;
 
     /* Should we stop the worker funcs */
     std::atomic<bool> m_shouldStop = false;
@@ -43,9 +85,20 @@ class CPU : virtual public IBackend
     /* Worker threads */
     std::vector<std::thread> m_threads;
 
-    /* A bool for each thread indicating if they should swap to a new job */
-    std::vector<bool> m_newJobAvailable;
+    /* Threads numbered this or above are parked */
+    std::atomic<uint32_t> m_activeThreads;
+
+    /* Wakes parked threads when unparked or stopping */
+    std::condition_variable m_unpark;
+
+    std::mutex m_parkMutex;
+
+    /* Hashes, latencies, etc for each thread. Kept across start/stop. */
+    std::vector<std::unique_ptr<ThreadCounters>> m_threadCounters;
+
+    /* Decayed hashrate for each thread. Only touched by getPerformanceStats. */
+    std::vector<RollingHashrate> m_threadHashrates;
 
-    /* Used to submit a hash back to the miner manager */
-    const std::function<void(const JobSubmit &jobSubmit)> m_submitHash;
+    /* Guards m_threadHashrates */
+    std::mutex m_statsMutex;
 };
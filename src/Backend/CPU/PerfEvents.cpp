@@ -0,0 +1,228 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////
+#include "Backend/CPU/PerfEvents.h"
+//////////////////////////////////
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+
+namespace
+{
+    perf_event_attr eventAttributes(const HardwareEvent event)
+    {
+        perf_event_attr attributes;
+
+        std::memset(&attributes, 0, sizeof(attributes));
+
+        attributes.size = sizeof(attributes);
+
+        /* Lets us scale the count up if the kernel multiplexes the counter */
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        /* Counting kernel events needs more privileges than we usually have,
+           and the hashing loop barely enters the kernel anyway */
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        switch (event)
+        {
+            case CYCLES:
+            {
+                attributes.type = PERF_TYPE_HARDWARE;
+                attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            }
+            case INSTRUCTIONS:
+            {
+                attributes.type = PERF_TYPE_HARDWARE;
+                attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            }
+            case LLC_MISSES:
+            {
+                attributes.type = PERF_TYPE_HW_CACHE;
+                attributes.config = PERF_COUNT_HW_CACHE_LL
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            }
+            case DTLB_MISSES:
+            {
+                attributes.type = PERF_TYPE_HW_CACHE;
+                attributes.config = PERF_COUNT_HW_CACHE_DTLB
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            }
+            case HARDWARE_EVENT_COUNT:
+            {
+                break;
+            }
+        }
+
+        return attributes;
+    }
+
+    /* Read an event, scaled up to cover the time it was not scheduled */
+    uint64_t readScaled(const int fd)
+    {
+        struct
+        {
+            uint64_t value;
+            uint64_t timeEnabled;
+            uint64_t timeRunning;
+        } reading;
+
+        if (read(fd, &reading, sizeof(reading)) != sizeof(reading) || reading.timeRunning == 0)
+        {
+            return 0;
+        }
+
+        if (reading.timeRunning >= reading.timeEnabled)
+        {
+            return reading.value;
+        }
+
+        return static_cast<uint64_t>(
+            static_cast<double>(reading.value) * reading.timeEnabled / reading.timeRunning
+        );
+    }
+}
+
+PerfEvents::PerfEvents():
+    m_lastSample(std::chrono::steady_clock::now())
+{
+    m_fds.fill(-1);
+
+    for (size_t i = 0; i < HARDWARE_EVENT_COUNT; i++)
+    {
+        perf_event_attr attributes = eventAttributes(static_cast<HardwareEvent>(i));
+
+        /* This thread, on any CPU. Not a group, so one unsupported event
+           doesn't take the rest down with it. */
+        const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+
+        if (fd == -1)
+        {
+            if (errno == EACCES || errno == EPERM)
+            {
+                m_error = "Not permitted to use perf events, check /proc/sys/kernel/perf_event_paranoid";
+            }
+            else if (m_error == "")
+            {
+                m_error = "Hardware counters are not supported by this CPU or kernel: " + std::string(std::strerror(errno));
+            }
+
+            continue;
+        }
+
+        m_fds[i] = fd;
+    }
+}
+
+PerfEvents::~PerfEvents()
+{
+    for (const int fd : m_fds)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+}
+
+HardwareCounters PerfEvents::sample(const uint64_t hashes)
+{
+    HardwareCounters counters;
+
+    counters.enabled = true;
+    counters.hashes = hashes;
+
+    if (!available())
+    {
+        counters.error = m_error;
+        return counters;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    counters.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_lastSample).count();
+
+    m_lastSample = now;
+
+    for (size_t i = 0; i < HARDWARE_EVENT_COUNT; i++)
+    {
+        if (m_fds[i] == -1)
+        {
+            continue;
+        }
+
+        const uint64_t count = readScaled(m_fds[i]);
+
+        counters.supported[i] = true;
+
+        /* Scaling is an estimate, so don't let it run backwards */
+        counters.counts[i] = count > m_lastCounts[i] ? count - m_lastCounts[i] : 0;
+
+        m_lastCounts[i] = std::max(count, m_lastCounts[i]);
+    }
+
+    return counters;
+}
+
+#else
+
+PerfEvents::PerfEvents():
+    m_lastSample(std::chrono::steady_clock::now()),
+    m_error("Hardware counters are only supported on Linux")
+{
+    m_fds.fill(-1);
+}
+
+PerfEvents::~PerfEvents()
+{
+}
+
+HardwareCounters PerfEvents::sample(const uint64_t hashes)
+{
+    HardwareCounters counters;
+
+    counters.enabled = true;
+    counters.hashes = hashes;
+    counters.error = m_error;
+
+    return counters;
+}
+
+#endif
+
+bool PerfEvents::available() const
+{
+    for (const int fd : m_fds)
+    {
+        if (fd != -1)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string PerfEvents::error() const
+{
+    return m_error;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include "Types/PerformanceStats.h"
+
+/* Counts cache misses, TLB misses, cycles and instructions for the thread
+   which constructs it, using perf_event_open. Only supported on Linux, and
+   only if the kernel lets us count our own user space events, i.e.
+   /proc/sys/kernel/perf_event_paranoid is 2 or lower. Events the CPU doesn't
+   support, such as in many virtual machines, are left unsupported rather than
+   failing the whole thing. */
+class PerfEvents
+{
+  public:
+    /* Start counting on the calling thread */
+    PerfEvents();
+
+    ~PerfEvents();
+
+    PerfEvents(const PerfEvents &) = delete;
+
+    PerfEvents &operator=(const PerfEvents &) = delete;
+
+    /* Were any of the events opened */
+    bool available() const;
+
+    /* Why none of the events could be opened */
+    std::string error() const;
+
+    /* The counts since the last sample, or since we started counting. Must be
+       called from the thread which constructed us. */
+    HardwareCounters sample(const uint64_t hashes);
+
+  private:
+    /* File descriptor of each event, or -1 if it could not be opened */
+    std::array<int, HARDWARE_EVENT_COUNT> m_fds;
+
+    /* Scaled counts as of the last sample */
+    std::array<uint64_t, HARDWARE_EVENT_COUNT> m_lastCounts {};
+
+    std::chrono::steady_clock::time_point m_lastSample;
+
+    std::string m_error;
+};
@@ -0,0 +1,49 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Types/WorkUnit.h"
+#include "Utilities/BoundedQueue.h"
+
+typedef BoundedQueue<WorkCompletion> CompletionQueue;
+
+/* A device which is handed units of work, rather than a job to hash forever
+   like IBackend. Results come back through a lock free completion queue,
+   so the device threads never wait on the scheduler. */
+class IAsyncBackend
+{
+  public:
+    /* Begin working on submitted units, posting a completion for each. */
+    virtual void start(const std::shared_ptr<CompletionQueue> &completions) = 0;
+
+    /* Stop working. Units not yet completed are dropped without posting a
+       completion. */
+    virtual void stop() = 0;
+
+    /* Queue a unit to work on after any already queued. Must not block on
+       the device. */
+    virtual void submit(const WorkUnit &unit) = 0;
+
+    /* The job changed. Queued units of earlier epochs should be completed
+       straight away without hashing them, and a running one cut short if
+       the device is able to. */
+    virtual void abandonBefore(const uint64_t epoch) = 0;
+
+    /* An identifier for the device, for example 'CPU' or 'GTX 1070' */
+    virtual std::string getName() const = 0;
+
+    /* How many units the device works on at once, e.g. one per CPU thread.
+       Each unit is still sized to take unitDuration on its own. */
+    virtual uint32_t concurrency() const
+    {
+        return 1;
+    }
+
+    virtual ~IAsyncBackend() {};
+};
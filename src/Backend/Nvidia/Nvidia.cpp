@@ -6,6 +6,7 @@
 #include "Backend/Nvidia/Nvidia.h"
 //////////////////////////////////
 
+#include <chrono>
 #include <iostream>
 
 #include "ArgonVariants/Variants.h"
@@ -21,8 +22,14 @@ Nvidia::Nvidia(
         const std::string &deviceName)> &incrementHashesPerformedCallback):
     m_hardwareConfig(hardwareConfig),
     m_submitValidHash(submitValidHashCallback),
-    m_incrementHashesPerformed(incrementHashesPerformedCallback)
+    m_incrementHashesPerformed(incrementHashesPerformedCallback),
+    m_gpuHashrates(hardwareConfig->nvidia.devices.size())
 {
+    for (size_t i = 0; i < hardwareConfig->nvidia.devices.size(); i++)
+    {
+        m_gpuCounters.push_back(std::make_unique<ThreadCounters>());
+    }
+
     m_numAvailableGPUs = std::count_if(
         hardwareConfig->nvidia.devices.begin(),
         hardwareConfig->nvidia.devices.end(),
@@ -111,7 +118,28 @@ void Nvidia::setNewJob(const Job &job, const uint32_t initialNonce)
 
 std::vector<PerformanceStats> Nvidia::getPerformanceStats()
 {
-    return {};
+    std::scoped_lock lock(m_statsMutex);
+
+    std::vector<PerformanceStats> stats;
+
+    for (uint32_t i = 0; i < m_hardwareConfig->nvidia.devices.size(); i++)
+    {
+        const auto &gpu = m_hardwareConfig->nvidia.devices[i];
+
+        if (!gpu.enabled)
+        {
+            continue;
+        }
+
+        stats.push_back(snapshotCounters(
+            *m_gpuCounters[i],
+            m_gpuHashrates[i],
+            gpu.name + "-" + std::to_string(gpu.id),
+            0
+        ));
+    }
+
+    return stats;
 }
 
 std::shared_ptr<NvidiaHash> getNvidiaMiningAlgorithm(const std::string &algorithm)
@@ -151,6 +179,8 @@ void Nvidia::hash(NvidiaDevice &gpu, const uint32_t threadNumber)
 
     const std::string gpuName = gpu.name + "-" + std::to_string(gpu.id);
 
+    ThreadCounters &counters = *m_gpuCounters[threadNumber];
+
     NonceInfo nonceInfo;
 
     const uint32_t gpuLag = getGpuLagMicroseconds(gpu);
@@ -219,8 +249,18 @@ void Nvidia::hash(NvidiaDevice &gpu, const uint32_t threadNumber)
 
             try
             {
+                const auto kernelStart = std::chrono::steady_clock::now();
+
                 const auto hashResult = algorithm->hash(ourNonce);
 
+                /* Latency here is per kernel launch, not per hash */
+                counters.recordHashes(
+                    state.launchParams.noncesPerRun,
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - kernelStart
+                    ).count()
+                );
+
                 /* Increment the number of hashes we performed so the hashrate
                    printer is accurate */
                 m_incrementHashesPerformed(state.launchParams.noncesPerRun, gpuName);
@@ -265,6 +305,11 @@ void Nvidia::hash(NvidiaDevice &gpu, const uint32_t threadNumber)
 
         /* Switch to new job. */
         m_newJobAvailable[threadNumber] = false;
+
+        if (!m_shouldStop)
+        {
+            counters.recordJobSwitch();
+        }
     }
 
     freeState(state);
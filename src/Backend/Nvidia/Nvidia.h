@@ -65,4 +65,14 @@ class Nvidia : virtual public IBackend
 
     /* Mutex to ensure output is not interleaved */
     std::mutex m_outputMutex;
+
+    /* Hashes, latencies, etc for each GPU. Indexed the same as the
+       hardwareConfig nvidia devices. Kept across start/stop. */
+    std::vector<std::unique_ptr<ThreadCounters>> m_gpuCounters;
+
+    /* Decayed hashrate for each GPU. Only touched by getPerformanceStats. */
+    std::vector<RollingHashrate> m_gpuHashrates;
+
+    /* Guards m_gpuHashrates */
+    std::mutex m_statsMutex;
 };
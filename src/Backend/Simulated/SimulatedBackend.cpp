@@ -0,0 +1,207 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////////////////////
+#include "Backend/Simulated/SimulatedBackend.h"
+/////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+
+SimulatedBackend::SimulatedBackend(const SimulatedDeviceConfig &config):
+    m_config(config),
+    m_generator(config.seed)
+{
+}
+
+SimulatedBackend::~SimulatedBackend()
+{
+    stop();
+}
+
+void SimulatedBackend::start(const std::shared_ptr<CompletionQueue> &completions)
+{
+    stop();
+
+    m_completions = completions;
+    m_shouldStop = false;
+
+    m_thread = std::thread(&SimulatedBackend::run, this);
+}
+
+void SimulatedBackend::stop()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+
+        m_shouldStop = true;
+        m_queue.clear();
+    }
+
+    m_wake.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void SimulatedBackend::submit(const WorkUnit &unit)
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_queue.push_back(unit);
+    }
+
+    m_wake.notify_all();
+}
+
+void SimulatedBackend::abandonBefore(const uint64_t epoch)
+{
+    std::vector<WorkCompletion> completions;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        m_currentEpoch = std::max(m_currentEpoch, epoch);
+
+        const auto stale = std::stable_partition(m_queue.begin(), m_queue.end(), [epoch](const auto &unit)
+        {
+            return unit.epoch >= epoch;
+        });
+
+        for (auto it = stale; it != m_queue.end(); it++)
+        {
+            completions.push_back(abandoned(*it));
+        }
+
+        m_queue.erase(stale, m_queue.end());
+    }
+
+    /* Wake the device thread if it's part way through an abandoned unit */
+    m_wake.notify_all();
+
+    for (auto &completion : completions)
+    {
+        post(completion);
+    }
+}
+
+std::string SimulatedBackend::getName() const
+{
+    return m_config.name;
+}
+
+void SimulatedBackend::run()
+{
+    while (true)
+    {
+        WorkUnit unit;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_wake.wait(lock, [this]{ return m_shouldStop || !m_queue.empty(); });
+
+            if (m_shouldStop)
+            {
+                return;
+            }
+
+            unit = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        WorkCompletion completion = abandoned(unit);
+
+        completion.started = std::chrono::steady_clock::now();
+        completion.hashesPerformed = simulateUnit(unit, completion.started);
+        completion.finished = std::chrono::steady_clock::now();
+
+        if (m_shouldStop)
+        {
+            return;
+        }
+
+        if (std::bernoulli_distribution(m_config.failureRate)(m_generator))
+        {
+            completion.failed = true;
+            completion.error = "Simulated failure on " + m_config.name;
+            completion.hashesPerformed = 0;
+        }
+        else if (m_config.shareProbability > 0)
+        {
+            /* Skip straight from one share to the next rather than rolling
+               the dice for every hash */
+            std::geometric_distribution<uint64_t> gap(std::min(m_config.shareProbability, 1.0));
+
+            for (uint64_t i = gap(m_generator); i < completion.hashesPerformed; i += gap(m_generator) + 1)
+            {
+                completion.found.push_back({ static_cast<uint32_t>(unit.startNonce + i), {} });
+            }
+        }
+
+        post(completion);
+    }
+}
+
+uint32_t SimulatedBackend::simulateUnit(
+    const WorkUnit &unit,
+    const std::chrono::steady_clock::time_point started)
+{
+    const auto hashing = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(unit.nonceCount / m_config.hashrate)
+    );
+
+    const auto finish = started + m_config.latency + hashing;
+
+    std::unique_lock lock(m_mutex);
+
+    m_wake.wait_until(lock, finish, [&]
+    {
+        return m_shouldStop || (m_config.interruptible && unit.epoch < m_currentEpoch);
+    });
+
+    const auto now = std::chrono::steady_clock::now();
+
+    if (now >= finish)
+    {
+        return unit.nonceCount;
+    }
+
+    /* Cut short, count what we got through after the fixed cost */
+    const double seconds = std::chrono::duration<double>(now - started - m_config.latency).count();
+
+    return static_cast<uint32_t>(std::clamp(seconds * m_config.hashrate, 0.0, static_cast<double>(unit.nonceCount)));
+}
+
+void SimulatedBackend::post(WorkCompletion &completion)
+{
+    /* The scheduler drains the queue continuously, so it's only full for a
+       moment, if ever */
+    while (!m_completions->tryPush(completion))
+    {
+        if (m_shouldStop)
+        {
+            return;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+WorkCompletion SimulatedBackend::abandoned(const WorkUnit &unit)
+{
+    WorkCompletion completion;
+
+    completion.leaseID = unit.leaseID;
+    completion.epoch = unit.epoch;
+    completion.job = unit.job;
+    completion.startNonce = unit.startNonce;
+    completion.nonceCount = unit.nonceCount;
+    completion.started = std::chrono::steady_clock::now();
+    completion.finished = completion.started;
+
+    return completion;
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "Backend/IAsyncBackend.h"
+
+struct SimulatedDeviceConfig
+{
+    std::string name = "Simulated";
+
+    /* Hashes per second */
+    double hashrate = 1000;
+
+    /* Fixed cost of every unit, e.g. launching a kernel and copying the
+       results back */
+    std::chrono::microseconds latency {0};
+
+    /* Chance each unit fails, from 0 to 1 */
+    double failureRate = 0;
+
+    /* Chance each hash meets the target, from 0 to 1 */
+    double shareProbability = 0;
+
+    /* Can a running unit be cut short when abandoned. CPU threads can check
+       between hashes, a GPU kernel runs to completion once launched. */
+    bool interruptible = true;
+
+    uint32_t seed = 0;
+};
+
+/* A device that doesn't hash anything, but takes as long as a real one with
+   the configured speed would, and fails and finds shares at the configured
+   rates. Lets the scheduling be tested on machines without the hardware. */
+class SimulatedBackend : virtual public IAsyncBackend
+{
+  public:
+    SimulatedBackend(const SimulatedDeviceConfig &config);
+
+    ~SimulatedBackend();
+
+    virtual void start(const std::shared_ptr<CompletionQueue> &completions);
+
+    virtual void stop();
+
+    virtual void submit(const WorkUnit &unit);
+
+    virtual void abandonBefore(const uint64_t epoch);
+
+    virtual std::string getName() const;
+
+  private:
+    void run();
+
+    /* Sleep for however long the unit takes, returning how many nonces
+       were hashed before finishing or being abandoned */
+    uint32_t simulateUnit(const WorkUnit &unit, const std::chrono::steady_clock::time_point started);
+
+    void post(WorkCompletion &completion);
+
+    /* A completion for a unit that was never started */
+    static WorkCompletion abandoned(const WorkUnit &unit);
+
+    const SimulatedDeviceConfig m_config;
+
+    std::shared_ptr<CompletionQueue> m_completions;
+
+    /* Units waiting to be worked on */
+    std::deque<WorkUnit> m_queue;
+
+    /* Units of epochs before this are abandoned */
+    uint64_t m_currentEpoch = 0;
+
+    /* Guards m_queue and m_currentEpoch */
+    std::mutex m_mutex;
+
+    /* Wakes the device thread on new work, abandonment or stopping */
+    std::condition_variable m_wake;
+
+    std::atomic<bool> m_shouldStop = false;
+
+    std::thread m_thread;
+
+    /* Only used by the device thread */
+    std::mt19937 m_generator;
+};
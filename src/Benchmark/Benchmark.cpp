@@ -0,0 +1,279 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+////////////////////////////////
+#include "Benchmark/Benchmark.h"
+////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "Benchmark/BenchmarkJobSource.h"
+#include "Config/Constants.h"
+#include "MinerManager/MinerManager.h"
+#include "Utilities/ColouredMsg.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    HashrateSpread getSpread(const std::vector<double> &hashrates)
+    {
+        HashrateSpread spread;
+
+        if (hashrates.empty())
+        {
+            return spread;
+        }
+
+        for (const double hashrate : hashrates)
+        {
+            spread.mean += hashrate;
+        }
+
+        spread.mean /= hashrates.size();
+
+        double variance = 0;
+
+        for (const double hashrate : hashrates)
+        {
+            variance += (hashrate - spread.mean) * (hashrate - spread.mean);
+        }
+
+        spread.standardDeviation = std::sqrt(variance / hashrates.size());
+
+        if (spread.mean != 0)
+        {
+            spread.coefficientOfVariation = 100 * spread.standardDeviation / spread.mean;
+        }
+
+        return spread;
+    }
+
+    /* The selected mode is in brackets, e.g. "always [madvise] never" */
+    std::string getTransparentHugePageMode()
+    {
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+
+        std::string modes;
+
+        if (!std::getline(file, modes))
+        {
+            return "";
+        }
+
+        const size_t start = modes.find('[');
+        const size_t end = modes.find(']');
+
+        if (start == std::string::npos || end == std::string::npos || end < start)
+        {
+            return "";
+        }
+
+        return modes.substr(start + 1, end - start - 1);
+    }
+
+    /* Total hashes of each thread, keyed by device and thread number */
+    std::map<std::pair<std::string, uint32_t>, uint64_t> threadHashes(const MinerStats &stats)
+    {
+        std::map<std::pair<std::string, uint32_t>, uint64_t> hashes;
+
+        for (const auto &thread : stats.threads)
+        {
+            hashes[{ thread.deviceName, thread.threadNumber }] = thread.totalHashes;
+        }
+
+        return hashes;
+    }
+}
+
+void to_json(nlohmann::json &j, const HashrateSpread &spread)
+{
+    j = {
+        {"mean", spread.mean},
+        {"standardDeviation", spread.standardDeviation},
+        {"coefficientOfVariation", spread.coefficientOfVariation}
+    };
+}
+
+void to_json(nlohmann::json &j, const BenchmarkResult &result)
+{
+    nlohmann::json devices = nlohmann::json::object();
+
+    for (const auto &[device, hashrate] : result.devices)
+    {
+        devices[device] = hashrate;
+    }
+
+    j = {
+        {"version", result.version},
+        {"algorithm", result.algorithm},
+        {"optimizationMethod", result.optimizationMethod},
+        {"durationSeconds", result.duration},
+        {"warmupSeconds", result.warmup},
+        {"score", result.score},
+        {"hashes", result.hashes},
+        {"devices", devices},
+        {"threads", {
+            {"count", result.threadCount},
+            {"logicalCPUs", result.logicalCPUs},
+            {"hashrates", result.threadHashrates},
+            {"spread", result.threadSpread}
+        }},
+        {"secondToSecond", result.secondSpread},
+        {"hugePages", {
+            {"transparent", result.transparentHugePages},
+            {"scratchpads", result.hugePageScratchpads}
+        }},
+        {"energy", result.energy}
+    };
+}
+
+BenchmarkResult runBenchmark(const MinerConfig &config)
+{
+    BenchmarkResult result;
+
+    const auto duration = config.benchmark.duration;
+
+    /* Long enough for the threads to allocate their scratchpads and settle
+       into their clock speeds */
+    const auto warmup = std::clamp<std::chrono::seconds>(
+        duration / 10, std::chrono::seconds(2), std::chrono::seconds(10)
+    );
+
+    auto optimization = config.hardwareConfiguration->cpu.optimizationMethod;
+
+    if (optimization == Constants::AUTO)
+    {
+        optimization = getAutoChosenOptimization();
+    }
+
+    result.version = Constants::VERSION;
+    result.algorithm = config.benchmark.algorithm;
+    result.optimizationMethod = Constants::optimizationMethodToString(optimization);
+    result.threadCount = config.hardwareConfiguration->cpu.enabled ? config.hardwareConfiguration->cpu.threadCount : 0;
+    result.logicalCPUs = std::thread::hardware_concurrency();
+    result.transparentHugePages = getTransparentHugePageMode();
+    result.warmup = static_cast<double>(warmup.count());
+
+    const auto jobSource = std::make_shared<BenchmarkJobSource>(config.benchmark.algorithm);
+
+    MinerManager minerManager(jobSource, config.hardwareConfiguration, false);
+
+    minerManager.start();
+
+    std::cout << InformationMsg("Warming up for " + std::to_string(warmup.count()) + " seconds, then benchmarking for "
+                                + std::to_string(duration.count()) + " seconds") << std::endl;
+
+    std::this_thread::sleep_for(warmup);
+
+    const MinerStats startStats = minerManager.getStats();
+    const auto startTime = Clock::now();
+
+    std::vector<double> secondHashrates;
+
+    uint64_t lastHashes = startStats.total.totalHashes;
+    auto lastTime = startTime;
+
+    while (Clock::now() - startTime < duration)
+    {
+        std::this_thread::sleep_until(lastTime + std::chrono::seconds(1));
+
+        const uint64_t hashes = minerManager.getStats().total.totalHashes;
+        const auto now = Clock::now();
+
+        secondHashrates.push_back((hashes - lastHashes) / std::chrono::duration<double>(now - lastTime).count());
+
+        lastHashes = hashes;
+        lastTime = now;
+    }
+
+    const MinerStats endStats = minerManager.getStats();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+    minerManager.stop();
+
+    result.duration = elapsed;
+    result.hashes = endStats.total.totalHashes - startStats.total.totalHashes;
+    result.score = result.hashes / elapsed;
+
+    for (const auto &device : endStats.devices)
+    {
+        const auto start = std::find_if(startStats.devices.begin(), startStats.devices.end(), [&](const auto &startDevice)
+        {
+            return startDevice.deviceName == device.deviceName;
+        });
+
+        const uint64_t startHashes = start == startStats.devices.end() ? 0 : start->totalHashes;
+
+        result.devices.emplace_back(device.deviceName, (device.totalHashes - startHashes) / elapsed);
+    }
+
+    const auto startThreads = threadHashes(startStats);
+
+    for (const auto &[thread, hashes] : threadHashes(endStats))
+    {
+        const auto start = startThreads.find(thread);
+
+        const uint64_t startHashes = start == startThreads.end() ? 0 : start->second;
+
+        result.threadHashrates.push_back((hashes - startHashes) / elapsed);
+    }
+
+    result.threadSpread = getSpread(result.threadHashrates);
+    result.secondSpread = getSpread(secondHashrates);
+    result.energy = endStats.energy;
+
+    return result;
+}
+
+void printBenchmarkResult(const BenchmarkResult &result)
+{
+    std::cout << std::endl << std::fixed << std::setprecision(2)
+              << InformationMsg("* ") << WhiteMsg("SCORE", 25) << SuccessMsg(result.score) << SuccessMsg(" H/s") << std::endl
+              << InformationMsg("* ") << WhiteMsg("ALGORITHM", 25) << InformationMsg(result.algorithm) << std::endl
+              << InformationMsg("* ") << WhiteMsg("OPTIMIZATION", 25) << InformationMsg(result.optimizationMethod) << std::endl
+              << InformationMsg("* ") << WhiteMsg("THREADS", 25) << InformationMsg(result.threadCount)
+              << InformationMsg(" on ") << InformationMsg(result.logicalCPUs) << InformationMsg(" logical CPUs") << std::endl;
+
+    std::cout << InformationMsg("* ") << WhiteMsg("HUGE PAGES", 25)
+              << InformationMsg(result.hugePageScratchpads ? "Scratchpads on huge pages" : "Scratchpads not explicitly on huge pages")
+              << InformationMsg(", transparent huge pages: ")
+              << InformationMsg(result.transparentHugePages == "" ? "unknown" : result.transparentHugePages) << std::endl;
+
+    for (const auto &[device, hashrate] : result.devices)
+    {
+        std::cout << InformationMsg("* ") << WhiteMsg(device, 25) << InformationMsg(hashrate) << InformationMsg(" H/s") << std::endl;
+    }
+
+    for (size_t i = 0; i < result.threadHashrates.size(); i++)
+    {
+        std::cout << InformationMsg("  - ") << WhiteMsg("Thread " + std::to_string(i), 23)
+                  << InformationMsg(result.threadHashrates[i]) << InformationMsg(" H/s") << std::endl;
+    }
+
+    std::cout << InformationMsg("* ") << WhiteMsg("THREAD VARIANCE", 25)
+              << InformationMsg("stddev ") << InformationMsg(result.threadSpread.standardDeviation)
+              << InformationMsg(" H/s (") << InformationMsg(result.threadSpread.coefficientOfVariation) << InformationMsg("%)") << std::endl
+              << InformationMsg("* ") << WhiteMsg("STABILITY", 25)
+              << InformationMsg("stddev ") << InformationMsg(result.secondSpread.standardDeviation)
+              << InformationMsg(" H/s second to second (") << InformationMsg(result.secondSpread.coefficientOfVariation)
+              << InformationMsg("%)") << std::endl;
+
+    for (const auto &configuration : result.energy.configurations)
+    {
+        if (configuration.joules != 0)
+        {
+            std::cout << InformationMsg("* ") << WhiteMsg("EFFICIENCY", 25)
+                      << InformationMsg(configuration.hashesPerJoule()) << InformationMsg(" H/J, ")
+                      << InformationMsg(configuration.watts()) << InformationMsg(" W") << std::endl;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ExternalLibs/json.hpp"
+#include "Miner/GetConfig.h"
+#include "Types/MinerStats.h"
+
+/* Mean and spread of a set of hashrates */
+struct HashrateSpread
+{
+    double mean = 0;
+
+    double standardDeviation = 0;
+
+    /* Standard deviation as a percentage of the mean */
+    double coefficientOfVariation = 0;
+};
+
+struct BenchmarkResult
+{
+    std::string version;
+
+    std::string algorithm;
+
+    /* The hashing kernel used, with auto resolved */
+    std::string optimizationMethod;
+
+    /* Seconds measured, after the warm up */
+    double duration = 0;
+
+    double warmup = 0;
+
+    /* Hashes per second over all devices. The number to compare. */
+    double score = 0;
+
+    uint64_t hashes = 0;
+
+    /* Hashes per second of each device */
+    std::vector<std::pair<std::string, double>> devices;
+
+    /* CPU hashing threads, and the logical CPUs they were spread over */
+    uint32_t threadCount = 0;
+
+    uint32_t logicalCPUs = 0;
+
+    /* Hashes per second of each hashing thread */
+    std::vector<double> threadHashrates;
+
+    /* How evenly the hashrate was spread over the threads */
+    HashrateSpread threadSpread;
+
+    /* How steady the total hashrate was from one second to the next */
+    HashrateSpread secondSpread;
+
+    /* The transparent huge page mode, e.g. always, madvise or never. Empty
+       if unknown. */
+    std::string transparentHugePages;
+
+    /* Are the scratchpads explicitly backed by huge pages */
+    bool hugePageScratchpads = false;
+
+    /* Hashes per joule, if the RAPL counters could be read */
+    EnergyStats energy;
+};
+
+void to_json(nlohmann::json &j, const HashrateSpread &spread);
+
+void to_json(nlohmann::json &j, const BenchmarkResult &result);
+
+/* Mine synthetic jobs through the usual mining path, with no network, for a
+   warm up period and then config.benchmark.duration, and report how it went */
+BenchmarkResult runBenchmark(const MinerConfig &config);
+
+void printBenchmarkResult(const BenchmarkResult &result);
@@ -0,0 +1,199 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////////////////
+#include "Benchmark/BenchmarkJobSource.h"
+/////////////////////////////////////////
+
+#include <iostream>
+#include <random>
+
+#include "Utilities/ColouredMsg.h"
+
+namespace
+{
+    /* The size of a TurtleCoin block hashing blob */
+    const size_t BLOB_SIZE = 76;
+
+    /* High enough that we don't flood the console with accepted shares, low
+       enough that shares still go through the submission path */
+    const uint64_t SHARE_DIFFICULTY = 100000;
+}
+
+BenchmarkJobSource::BenchmarkJobSource(
+    const std::string &algorithm,
+    const std::chrono::seconds jobInterval):
+    m_algorithm(algorithm),
+    m_jobInterval(jobInterval),
+    m_currentJob(makeJob(0))
+{
+}
+
+BenchmarkJobSource::~BenchmarkJobSource()
+{
+    logout();
+}
+
+Job BenchmarkJobSource::makeJob(const uint64_t jobNumber) const
+{
+    Job job;
+
+    /* Seeded with the job number, so every run gets the same jobs */
+    std::mt19937 generator(static_cast<uint32_t>(jobNumber));
+
+    job.rawBlob.resize(BLOB_SIZE);
+
+    for (auto &byte : job.rawBlob)
+    {
+        byte = static_cast<uint8_t>(generator());
+    }
+
+    *job.nonce() = 0;
+
+    job.jobID = "benchmark-" + std::to_string(jobNumber);
+    job.shareDifficulty = SHARE_DIFFICULTY;
+    job.target = 0xFFFFFFFFFFFFFFFFULL / SHARE_DIFFICULTY;
+    job.algorithm = m_algorithm;
+
+    return job;
+}
+
+void BenchmarkJobSource::logout()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+    }
+
+    m_stop.notify_all();
+
+    if (m_jobThread.joinable())
+    {
+        m_jobThread.join();
+    }
+}
+
+Job BenchmarkJobSource::getJob()
+{
+    std::scoped_lock lock(m_mutex);
+    return m_currentJob;
+}
+
+bool BenchmarkJobSource::submitShare(
+    const uint8_t *,
+    const std::string jobID,
+    const uint32_t)
+{
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if (jobID != m_currentJob.jobID)
+        {
+            return false;
+        }
+
+        m_acceptedShares++;
+    }
+
+    if (m_onHashAccepted)
+    {
+        m_onHashAccepted(jobID);
+    }
+
+    return true;
+}
+
+void BenchmarkJobSource::startManaging()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+
+        m_shouldStop = false;
+        m_jobReceived = std::chrono::steady_clock::now();
+    }
+
+    Pool pool;
+
+    pool.host = "benchmark";
+    pool.algorithm = m_algorithm;
+
+    if (m_onPoolSwapped)
+    {
+        m_onPoolSwapped(pool);
+    }
+
+    m_jobThread = std::thread(&BenchmarkJobSource::sendJobs, this);
+}
+
+void BenchmarkJobSource::sendJobs()
+{
+    uint64_t jobNumber = 0;
+
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            if (m_stop.wait_for(lock, m_jobInterval, [this]{ return m_shouldStop; }))
+            {
+                return;
+            }
+
+            jobNumber++;
+
+            m_currentJob = makeJob(jobNumber);
+            m_jobReceived = std::chrono::steady_clock::now();
+
+            job = m_currentJob;
+        }
+
+        if (m_onNewJob)
+        {
+            m_onNewJob(job);
+        }
+    }
+}
+
+void BenchmarkJobSource::onNewJob(const std::function<void(const Job &job)> callback)
+{
+    m_onNewJob = callback;
+}
+
+void BenchmarkJobSource::onHashAccepted(const std::function<void(const std::string &shareID)> callback)
+{
+    m_onHashAccepted = callback;
+}
+
+void BenchmarkJobSource::onPoolSwapped(const std::function<void(const Pool &pool)> callback)
+{
+    m_onPoolSwapped = callback;
+}
+
+void BenchmarkJobSource::onPoolDisconnected(const std::function<void(void)> callback)
+{
+    m_onPoolDisconnected = callback;
+}
+
+void BenchmarkJobSource::printPool() const
+{
+    std::cout << InformationMsg("[benchmark] ");
+}
+
+PoolStats BenchmarkJobSource::getPoolStats() const
+{
+    std::scoped_lock lock(m_mutex);
+
+    PoolStats stats;
+
+    stats.pool = "benchmark";
+    stats.connected = true;
+    stats.jobAgeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_jobReceived).count();
+    stats.shareDifficulty = m_currentJob.shareDifficulty;
+    stats.algorithm = m_algorithm;
+    stats.acceptedShares = m_acceptedShares;
+
+    return stats;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "PoolCommunication/IJobSource.h"
+
+/* Hands out synthetic jobs for the offline benchmark, in place of a pool.
+   The jobs are the same every run, so scores can be compared between
+   machines and builds. Every share is accepted. */
+class BenchmarkJobSource : virtual public IJobSource
+{
+  public:
+    BenchmarkJobSource(
+        const std::string &algorithm,
+        const std::chrono::seconds jobInterval = std::chrono::seconds(30));
+
+    ~BenchmarkJobSource();
+
+    virtual void logout();
+
+    virtual Job getJob();
+
+    virtual bool submitShare(
+        const uint8_t *hash,
+        const std::string jobID,
+        const uint32_t nonce);
+
+    virtual void startManaging();
+
+    virtual void onNewJob(const std::function<void(const Job &job)>);
+
+    virtual void onHashAccepted(const std::function<void(const std::string &shareID)>);
+
+    virtual void onPoolSwapped(const std::function<void(const Pool &pool)>);
+
+    virtual void onPoolDisconnected(const std::function<void(void)>);
+
+    virtual void printPool() const;
+
+    virtual PoolStats getPoolStats() const;
+
+  private:
+    /* The nth job of the run */
+    Job makeJob(const uint64_t jobNumber) const;
+
+    /* Send a new job every m_jobInterval, like a pool would each block */
+    void sendJobs();
+
+    const std::string m_algorithm;
+
+    const std::chrono::seconds m_jobInterval;
+
+    Job m_currentJob;
+
+    std::chrono::steady_clock::time_point m_jobReceived;
+
+    uint64_t m_acceptedShares = 0;
+
+    std::function<void(const Job &job)> m_onNewJob;
+
+    std::function<void(const std::string &shareID)> m_onHashAccepted;
+
+    std::function<void(const Pool &pool)> m_onPoolSwapped;
+
+    std::function<void(void)> m_onPoolDisconnected;
+
+    std::thread m_jobThread;
+
+    bool m_shouldStop = false;
+
+    std::condition_variable m_stop;
+
+    /* Guards the current job, share count and m_shouldStop */
+    mutable std::mutex m_mutex;
+};
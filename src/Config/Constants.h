@@ -6,12 +6,13 @@
 
 namespace Constants
 {
-    /* How many times to attempt logging into a pool before giving up and trying
-       the next */
-    const int MAX_LOGIN_ATTEMPTS = 3;
+    /* How long to wait for a pool to accept our connection, or respond to our
+       login, in milliseconds. Retrying is paced by the pool manager. */
+    const int POOL_CONNECT_TIMEOUT = 5000;
 
-    /* How long to wait before trying again after a failed login, in milliseconds */
-    const int POOL_LOGIN_RETRY_INTERVAL = 5000;
+    /* How long to wait for the pool to respond to a share or keepalive before
+       counting it as timed out, in milliseconds */
+    const int POOL_REQUEST_TIMEOUT = 60000;
 
     /* The percentage of time to spend mining for the miner developer */
     const float DEV_FEE_PERCENT = 0;
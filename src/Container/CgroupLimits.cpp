@@ -0,0 +1,322 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+///////////////////////////////////
+#include "Container/CgroupLimits.h"
+///////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "Utilities/String.h"
+
+namespace
+{
+    /* cgroup v1 reports no memory limit as the largest page aligned signed
+       64 bit number, so anything this large is no limit at all */
+    constexpr uint64_t V1_UNLIMITED_MEMORY = 1ULL << 62;
+
+    /* Read the first line of a cgroup file. Returns false if it can't be read. */
+    bool readLine(const std::string &filename, std::string &line)
+    {
+        std::ifstream file(filename);
+
+        if (!std::getline(file, line))
+        {
+            return false;
+        }
+
+        Utilities::trim(line);
+
+        return true;
+    }
+
+    bool readNumber(const std::string &filename, int64_t &number)
+    {
+        std::string line;
+
+        if (!readLine(filename, line))
+        {
+            return false;
+        }
+
+        try
+        {
+            number = std::stoll(line);
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    /* Take the tighter of the limit we have so far and this one */
+    template<typename T>
+    void tighten(bool &haveLimit, T &limit, const T newLimit)
+    {
+        limit = haveLimit ? std::min(limit, newLimit) : newLimit;
+        haveLimit = true;
+    }
+}
+
+bool countCpuList(const std::string &list, uint32_t &count)
+{
+    count = 0;
+
+    for (auto range : Utilities::split(list, ','))
+    {
+        Utilities::trim(range);
+
+        if (range.empty())
+        {
+            continue;
+        }
+
+        try
+        {
+            const size_t dash = range.find('-');
+
+            const unsigned long first = std::stoul(range.substr(0, dash));
+            const unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+            if (last < first)
+            {
+                return false;
+            }
+
+            count += static_cast<uint32_t>(last - first + 1);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    return count != 0;
+}
+
+uint32_t ContainerLimits::threadLimit(const uint32_t hardwareThreads) const
+{
+    uint32_t limit = std::max<uint32_t>(hardwareThreads, 1);
+
+    if (haveCpuset)
+    {
+        limit = std::min(limit, cpusetCpus);
+    }
+
+    /* A thread over the quota gets the whole container throttled, a thread
+       short leaves part of it unused, so round to the nearest CPU */
+    if (haveCpuQuota)
+    {
+        limit = std::min(limit, static_cast<uint32_t>(std::lround(cpuQuota)));
+    }
+
+    return std::max<uint32_t>(limit, 1);
+}
+
+uint64_t ContainerLimits::scratchpadBudget() const
+{
+    if (!haveMemoryLimit)
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    return memoryLimit > MEMORY_HEADROOM ? memoryLimit - MEMORY_HEADROOM : 0;
+}
+
+CgroupLimits::CgroupLimits(
+    const std::string &root,
+    const std::string &membershipFile):
+    m_root(root),
+    m_membershipFile(membershipFile)
+{
+}
+
+ContainerLimits CgroupLimits::read() const
+{
+    ContainerLimits limits;
+
+    /* The unified hierarchy has the list of controllers at its root. Hybrid
+       setups mount it at unified/ instead, and put the controllers we care
+       about in v1. */
+    if (std::ifstream(m_root + "/cgroup.controllers"))
+    {
+        readCgroupV2(limits);
+    }
+    else
+    {
+        readCgroupV1(limits);
+    }
+
+    return limits;
+}
+
+std::vector<std::string> CgroupLimits::cgroupDirectories(
+    const std::string &hierarchy,
+    const std::string &controller) const
+{
+    std::ifstream membership(m_membershipFile);
+
+    std::string path;
+    std::string line;
+
+    /* Lines are <id>:<comma separated controllers>:<path>, where the unified
+       hierarchy is id 0 with no controllers */
+    while (std::getline(membership, line))
+    {
+        const size_t firstColon = line.find(':');
+        const size_t secondColon = line.find(':', firstColon + 1);
+
+        if (firstColon == std::string::npos || secondColon == std::string::npos)
+        {
+            continue;
+        }
+
+        const auto lineControllers = Utilities::split(line.substr(firstColon + 1, secondColon - firstColon - 1), ',');
+
+        const bool matches = controller.empty()
+            ? line.substr(0, firstColon) == "0" && lineControllers.empty()
+            : std::find(lineControllers.begin(), lineControllers.end(), controller) != lineControllers.end();
+
+        if (matches)
+        {
+            path = line.substr(secondColon + 1);
+            break;
+        }
+    }
+
+    std::vector<std::string> directories;
+
+    /* Our cgroup, then each parent. If our cgroup isn't under the hierarchy,
+       because we can only see our own part of it, nothing is read from these
+       and the root covers us. */
+    while (!path.empty() && path != "/")
+    {
+        directories.push_back(hierarchy + path);
+
+        path = path.substr(0, path.find_last_of('/'));
+    }
+
+    directories.push_back(hierarchy);
+
+    return directories;
+}
+
+void CgroupLimits::readCgroupV2(ContainerLimits &limits) const
+{
+    limits.cgroupVersion = 2;
+
+    const auto directories = cgroupDirectories(m_root, "");
+
+    /* Already narrowed down by every parent, so ours is enough */
+    for (const auto &directory : directories)
+    {
+        std::string cpus;
+
+        if (readLine(directory + "/cpuset.cpus.effective", cpus))
+        {
+            limits.haveCpuset = countCpuList(cpus, limits.cpusetCpus);
+            break;
+        }
+    }
+
+    for (const auto &directory : directories)
+    {
+        /* <quota> <period> in microseconds, or max <period> */
+        std::string cpuMax;
+
+        if (readLine(directory + "/cpu.max", cpuMax))
+        {
+            std::stringstream stream(cpuMax);
+
+            std::string quota;
+            double period = 0;
+
+            if (stream >> quota >> period && quota != "max" && period > 0)
+            {
+                try
+                {
+                    tighten(limits.haveCpuQuota, limits.cpuQuota, std::stod(quota) / period);
+                }
+                catch (const std::exception &)
+                {
+                }
+            }
+        }
+
+        std::string memoryMax;
+
+        if (readLine(directory + "/memory.max", memoryMax) && memoryMax != "max")
+        {
+            try
+            {
+                tighten(limits.haveMemoryLimit, limits.memoryLimit, static_cast<uint64_t>(std::stoull(memoryMax)));
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+    }
+}
+
+void CgroupLimits::readCgroupV1(ContainerLimits &limits) const
+{
+    const std::string cpusetRoot = m_root + "/cpuset";
+    const std::string cpuRoot = m_root + "/cpu";
+    const std::string memoryRoot = m_root + "/memory";
+
+    for (const auto &directory : cgroupDirectories(cpusetRoot, "cpuset"))
+    {
+        std::string cpus;
+
+        /* effective_cpus is narrowed down by the parents, but older kernels
+           only have the cpus we asked for */
+        if (readLine(directory + "/cpuset.effective_cpus", cpus)
+         || readLine(directory + "/cpuset.cpus", cpus))
+        {
+            limits.cgroupVersion = 1;
+            limits.haveCpuset = countCpuList(cpus, limits.cpusetCpus);
+            break;
+        }
+    }
+
+    for (const auto &directory : cgroupDirectories(cpuRoot, "cpu"))
+    {
+        int64_t quota = 0;
+        int64_t period = 0;
+
+        if (!readNumber(directory + "/cpu.cfs_period_us", period))
+        {
+            continue;
+        }
+
+        limits.cgroupVersion = 1;
+
+        if (readNumber(directory + "/cpu.cfs_quota_us", quota) && quota > 0 && period > 0)
+        {
+            tighten(limits.haveCpuQuota, limits.cpuQuota, static_cast<double>(quota) / period);
+        }
+    }
+
+    for (const auto &directory : cgroupDirectories(memoryRoot, "memory"))
+    {
+        int64_t limit = 0;
+
+        if (!readNumber(directory + "/memory.limit_in_bytes", limit))
+        {
+            continue;
+        }
+
+        limits.cgroupVersion = 1;
+
+        if (limit > 0 && static_cast<uint64_t>(limit) < V1_UNLIMITED_MEMORY)
+        {
+            tighten(limits.haveMemoryLimit, limits.memoryLimit, static_cast<uint64_t>(limit));
+        }
+    }
+}
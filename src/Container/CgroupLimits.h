@@ -0,0 +1,95 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* The CPU and memory a container lets us use, which may be far less than the
+   machine has */
+struct ContainerLimits
+{
+    /* Leave this much of the memory limit for everything but the scratchpads */
+    static constexpr uint64_t MEMORY_HEADROOM = 64 * 1024 * 1024;
+
+    /* 1 or 2, or 0 if there is no cgroup filesystem */
+    int cgroupVersion = 0;
+
+    bool haveCpuset = false;
+
+    /* How many CPUs the cpuset lets us run on */
+    uint32_t cpusetCpus = 0;
+
+    bool haveCpuQuota = false;
+
+    /* How many CPUs worth of time we get each period before being throttled */
+    double cpuQuota = 0;
+
+    bool haveMemoryLimit = false;
+
+    /* In bytes */
+    uint64_t memoryLimit = 0;
+
+    /* How many busy threads fit in the container, given how many the machine
+       has. Never less than one. */
+    uint32_t threadLimit(const uint32_t hardwareThreads) const;
+
+    /* How many bytes of scratchpads fit in the memory limit. Unbounded
+       without a memory limit. */
+    uint64_t scratchpadBudget() const;
+};
+
+/* Reads the limits of the cgroup we are in, from cgroup v2, e.g.
+
+   /proc/self/cgroup                                       0::/docker/abc
+   /sys/fs/cgroup/docker/abc/cpuset.cpus.effective         0-3,8
+   /sys/fs/cgroup/docker/abc/cpu.max                       150000 100000
+   /sys/fs/cgroup/docker/abc/memory.max                    Bytes, or max
+
+   or from the cpuset, cpu and memory controllers of cgroup v1, e.g.
+
+   /proc/self/cgroup                                       4:cpuset:/docker/abc
+   /sys/fs/cgroup/cpuset/docker/abc/cpuset.cpus            0-3,8
+   /sys/fs/cgroup/cpu/docker/abc/cpu.cfs_quota_us          150000, or -1
+   /sys/fs/cgroup/cpu/docker/abc/cpu.cfs_period_us         100000
+   /sys/fs/cgroup/memory/docker/abc/memory.limit_in_bytes  Bytes
+
+   Limits of the parent cgroups apply too, so the tightest is used. Containers
+   without their own cgroup namespace see the host's path for their cgroup,
+   but have it mounted at the root, so we fall back to reading the root. The
+   root can be pointed at a copy of either layout for testing. */
+class CgroupLimits
+{
+  public:
+    static constexpr const char *DEFAULT_ROOT = "/sys/fs/cgroup";
+
+    static constexpr const char *DEFAULT_MEMBERSHIP_FILE = "/proc/self/cgroup";
+
+    CgroupLimits(
+        const std::string &root = DEFAULT_ROOT,
+        const std::string &membershipFile = DEFAULT_MEMBERSHIP_FILE);
+
+    ContainerLimits read() const;
+
+  private:
+    /* The directories to read a controller's files from, our own cgroup
+       first, then each parent up to the root of the hierarchy */
+    std::vector<std::string> cgroupDirectories(
+        const std::string &hierarchy,
+        const std::string &controller) const;
+
+    void readCgroupV2(ContainerLimits &limits) const;
+
+    void readCgroupV1(ContainerLimits &limits) const;
+
+    const std::string m_root;
+
+    const std::string m_membershipFile;
+};
+
+/* Count the CPUs in a cpuset list, such as 0-3,8. Returns false if the list
+   can't be parsed. */
+bool countCpuList(const std::string &list, uint32_t &count);
@@ -0,0 +1,174 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////
+#include "Energy/CpuSensors.h"
+//////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+    /* hwmon drivers which report the CPU temperature */
+    const std::vector<std::string> CPU_HWMON_NAMES
+    {
+        "coretemp",
+        "k10temp",
+        "zenpower",
+        "cpu_thermal",
+    };
+
+    /* Device numbers can have gaps, e.g. after a module is unloaded, so keep
+       looking for a while after a missing one */
+    const uint32_t MAX_DEVICE_GAP = 16;
+
+    bool readLine(const std::string &filename, std::string &line)
+    {
+        std::ifstream file(filename);
+
+        return static_cast<bool>(std::getline(file, line));
+    }
+
+    bool readNumber(const std::string &filename, uint64_t &number)
+    {
+        std::string line;
+
+        if (!readLine(filename, line))
+        {
+            return false;
+        }
+
+        try
+        {
+            number = std::stoull(line);
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    bool exists(const std::string &filename)
+    {
+        return static_cast<bool>(std::ifstream(filename));
+    }
+}
+
+CpuSensors::CpuSensors(
+    const std::string &hwmonRoot,
+    const std::string &cpuRoot)
+{
+    for (uint32_t device = 0, missing = 0; missing < MAX_DEVICE_GAP; device++)
+    {
+        const std::string directory = hwmonRoot + "/hwmon" + std::to_string(device);
+
+        std::string name;
+
+        if (!readLine(directory + "/name", name))
+        {
+            missing++;
+            continue;
+        }
+
+        missing = 0;
+
+        if (std::find(CPU_HWMON_NAMES.begin(), CPU_HWMON_NAMES.end(), name) == CPU_HWMON_NAMES.end())
+        {
+            continue;
+        }
+
+        /* coretemp numbers its sensors from 1 for the package, and from 2
+           upwards for the cores, with gaps */
+        for (uint32_t sensor = 1, missingSensors = 0; missingSensors < MAX_DEVICE_GAP; sensor++)
+        {
+            const std::string filename = directory + "/temp" + std::to_string(sensor) + "_input";
+
+            if (!exists(filename))
+            {
+                missingSensors++;
+                continue;
+            }
+
+            missingSensors = 0;
+
+            m_temperatureFiles.push_back(filename);
+        }
+    }
+
+    for (uint32_t cpu = 0, missing = 0; missing < MAX_DEVICE_GAP; cpu++)
+    {
+        const std::string directory = cpuRoot + "/cpu" + std::to_string(cpu);
+
+        const std::string frequencyFile = directory + "/cpufreq/scaling_cur_freq";
+        const std::string coreThrottleFile = directory + "/thermal_throttle/core_throttle_count";
+        const std::string packageThrottleFile = directory + "/thermal_throttle/package_throttle_count";
+
+        bool found = false;
+
+        for (const auto &[filename, files] : {
+            std::make_pair(frequencyFile, &m_frequencyFiles),
+            std::make_pair(coreThrottleFile, &m_throttleFiles),
+            std::make_pair(packageThrottleFile, &m_throttleFiles) })
+        {
+            if (exists(filename))
+            {
+                files->push_back(filename);
+                found = true;
+            }
+        }
+
+        missing = found ? 0 : missing + 1;
+    }
+}
+
+CpuSensorReading CpuSensors::read() const
+{
+    CpuSensorReading reading;
+
+    for (const auto &filename : m_temperatureFiles)
+    {
+        uint64_t milliDegrees;
+
+        if (readNumber(filename, milliDegrees))
+        {
+            reading.temperature = std::max(reading.temperature, milliDegrees / 1000.0);
+            reading.haveTemperature = true;
+        }
+    }
+
+    uint64_t totalFrequency = 0;
+    uint64_t frequencies = 0;
+
+    for (const auto &filename : m_frequencyFiles)
+    {
+        uint64_t kiloHertz;
+
+        if (readNumber(filename, kiloHertz))
+        {
+            totalFrequency += kiloHertz;
+            frequencies++;
+        }
+    }
+
+    if (frequencies != 0)
+    {
+        reading.frequency = totalFrequency / 1000.0 / frequencies;
+        reading.haveFrequency = true;
+    }
+
+    for (const auto &filename : m_throttleFiles)
+    {
+        uint64_t count;
+
+        if (readNumber(filename, count))
+        {
+            reading.throttleCount += count;
+            reading.haveThrottleCount = true;
+        }
+    }
+
+    return reading;
+}
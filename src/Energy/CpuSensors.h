@@ -0,0 +1,63 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* The latest temperature, frequency and throttling of the CPU */
+struct CpuSensorReading
+{
+    bool haveTemperature = false;
+
+    /* Hottest sensor, in degrees celsius */
+    double temperature = 0;
+
+    bool haveFrequency = false;
+
+    /* Average current frequency of all cores, in MHz */
+    double frequency = 0;
+
+    bool haveThrottleCount = false;
+
+    /* Times the CPU has throttled itself for being too hot, summed over all
+       cores and packages. Only the change between readings means anything. */
+    uint64_t throttleCount = 0;
+};
+
+/* Reads the CPU temperature from hwmon, and the frequency and thermal
+   throttle counts from the cpu devices, e.g.
+
+   /sys/class/hwmon/hwmon2/name                                         coretemp
+   /sys/class/hwmon/hwmon2/temp1_input                                  Millidegrees
+   /sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq                kHz
+   /sys/devices/system/cpu/cpu0/thermal_throttle/core_throttle_count
+
+   Both roots can be pointed at copies of this layout for testing. Any of the
+   readings may be missing, for example in virtual machines. */
+class CpuSensors
+{
+  public:
+    static constexpr const char *DEFAULT_HWMON_ROOT = "/sys/class/hwmon";
+
+    static constexpr const char *DEFAULT_CPU_ROOT = "/sys/devices/system/cpu";
+
+    CpuSensors(
+        const std::string &hwmonRoot = DEFAULT_HWMON_ROOT,
+        const std::string &cpuRoot = DEFAULT_CPU_ROOT);
+
+    CpuSensorReading read() const;
+
+  private:
+    /* temp*_input files of the CPU hwmon devices */
+    std::vector<std::string> m_temperatureFiles;
+
+    /* scaling_cur_freq of each core */
+    std::vector<std::string> m_frequencyFiles;
+
+    /* core_throttle_count and package_throttle_count of each core */
+    std::vector<std::string> m_throttleFiles;
+};
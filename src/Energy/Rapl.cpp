@@ -0,0 +1,193 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+////////////////////////
+#include "Energy/Rapl.h"
+////////////////////////
+
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    /* Read the first line of a sysfs file. Returns false if it can't be read. */
+    bool readLine(const std::string &filename, std::string &line)
+    {
+        std::ifstream file(filename);
+
+        return static_cast<bool>(std::getline(file, line));
+    }
+
+    bool readNumber(const std::string &filename, uint64_t &number)
+    {
+        std::string line;
+
+        if (!readLine(filename, line))
+        {
+            return false;
+        }
+
+        try
+        {
+            number = std::stoull(line);
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+}
+
+std::string energyDomainToString(const EnergyDomain domain)
+{
+    switch (domain)
+    {
+        case PACKAGE:
+        {
+            return "package";
+        }
+        case DRAM:
+        {
+            return "dram";
+        }
+        case ENERGY_DOMAIN_COUNT:
+        {
+            break;
+        }
+    }
+
+    throw std::invalid_argument("Invalid energy domain given");
+}
+
+double EnergySample::totalJoules() const
+{
+    double total = 0;
+
+    for (const double domainJoules : joules)
+    {
+        total += domainJoules;
+    }
+
+    return total;
+}
+
+Rapl::Rapl(const std::string &root):
+    m_lastSample(std::chrono::steady_clock::now())
+{
+    /* Zones are numbered from zero without gaps: intel-rapl:<package> and
+       intel-rapl:<package>:<subzone> */
+    for (uint32_t package = 0; addZone(root + "/intel-rapl:" + std::to_string(package)); package++)
+    {
+        for (uint32_t subzone = 0; addZone(root + "/intel-rapl:" + std::to_string(package) + ":" + std::to_string(subzone)); subzone++)
+        {
+        }
+    }
+
+    if (m_zones.empty() && m_error == "")
+    {
+        m_error = "No RAPL energy counters found in " + root;
+    }
+}
+
+bool Rapl::addZone(const std::string &directory)
+{
+    std::string name;
+
+    if (!readLine(directory + "/name", name))
+    {
+        return false;
+    }
+
+    Zone zone;
+
+    /* Core, uncore and psys are either included in the package or cover more
+       than the CPU, so skip them */
+    if (name.rfind("package", 0) == 0)
+    {
+        zone.domain = PACKAGE;
+    }
+    else if (name == "dram")
+    {
+        zone.domain = DRAM;
+    }
+    else
+    {
+        return true;
+    }
+
+    zone.energyFile = directory + "/energy_uj";
+
+    /* Since Linux 5.10 energy_uj is only readable by root by default */
+    if (!readNumber(zone.energyFile, zone.lastEnergy))
+    {
+        m_error = "Can't read " + zone.energyFile + ", energy counters need root or read permission on this file";
+        return true;
+    }
+
+    if (!readNumber(directory + "/max_energy_range_uj", zone.maxEnergyRange))
+    {
+        zone.maxEnergyRange = 0;
+    }
+
+    m_zones.push_back(zone);
+
+    return true;
+}
+
+bool Rapl::available() const
+{
+    return !m_zones.empty();
+}
+
+std::string Rapl::error() const
+{
+    return m_error;
+}
+
+EnergySample Rapl::sample()
+{
+    EnergySample sample;
+
+    const auto now = std::chrono::steady_clock::now();
+
+    sample.seconds = std::chrono::duration<double>(now - m_lastSample).count();
+
+    m_lastSample = now;
+
+    for (auto &zone : m_zones)
+    {
+        uint64_t energy;
+
+        if (!readNumber(zone.energyFile, energy))
+        {
+            continue;
+        }
+
+        uint64_t used;
+
+        if (energy >= zone.lastEnergy)
+        {
+            used = energy - zone.lastEnergy;
+        }
+        /* Wrapped around. Counters wrap every few minutes to hours depending
+           on the CPU, so we only need to handle wrapping once per sample. */
+        else if (zone.maxEnergyRange > zone.lastEnergy)
+        {
+            used = (zone.maxEnergyRange - zone.lastEnergy) + energy;
+        }
+        /* Don't know the range, or the counter was reset */
+        else
+        {
+            used = energy;
+        }
+
+        zone.lastEnergy = energy;
+
+        sample.joules[zone.domain] += used / 1e6;
+        sample.measured[zone.domain] = true;
+    }
+
+    return sample;
+}
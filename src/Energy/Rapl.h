@@ -0,0 +1,84 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum EnergyDomain
+{
+    /* The whole CPU package, cores, caches and memory controller */
+    PACKAGE,
+    /* The memory attached to the package, not reported by every CPU */
+    DRAM,
+    ENERGY_DOMAIN_COUNT,
+};
+
+std::string energyDomainToString(const EnergyDomain domain);
+
+/* Energy used over a period of time */
+struct EnergySample
+{
+    std::array<double, ENERGY_DOMAIN_COUNT> joules {};
+
+    /* Was each domain measured */
+    std::array<bool, ENERGY_DOMAIN_COUNT> measured {};
+
+    double seconds = 0;
+
+    double totalJoules() const;
+};
+
+/* Reads the package and DRAM energy counters of Intel and AMD CPUs from the
+   Linux powercap sysfs interface, e.g.
+
+   /sys/class/powercap/intel-rapl:0/name         package-0
+   /sys/class/powercap/intel-rapl:0/energy_uj    Microjoules used, wraps around
+   /sys/class/powercap/intel-rapl:0:0/name       dram
+
+   Multi socket machines have one package zone per socket, which are summed. The
+   root can be pointed at a copy of this layout for testing. */
+class Rapl
+{
+  public:
+    static constexpr const char *DEFAULT_ROOT = "/sys/class/powercap";
+
+    Rapl(const std::string &root = DEFAULT_ROOT);
+
+    /* Did we find any readable zones */
+    bool available() const;
+
+    /* Why we can't read the energy counters, if we can't */
+    std::string error() const;
+
+    /* The energy used since the last sample, or since we were constructed */
+    EnergySample sample();
+
+  private:
+    struct Zone
+    {
+        std::string energyFile;
+
+        EnergyDomain domain;
+
+        /* The counter wraps around to zero after this many microjoules */
+        uint64_t maxEnergyRange;
+
+        uint64_t lastEnergy;
+    };
+
+    /* Add the zone in this directory, if it's one we measure. Returns false
+       if the directory does not exist. */
+    bool addZone(const std::string &directory);
+
+    std::vector<Zone> m_zones;
+
+    std::chrono::steady_clock::time_point m_lastSample;
+
+    std::string m_error;
+};
@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
 namespace Logger
 {
@@ -102,40 +103,258 @@ namespace Logger
         throw std::invalid_argument("Invalid log category given");
     }
 
-    void Logger::log(const std::string message, const LogLevel level, const std::vector<LogCategory> categories) const
+    LogCategory stringToLogCategory(std::string category)
     {
-        if (level == DISABLED)
+        /* Convert to lower case */
+        std::transform(category.begin(), category.end(), category.begin(), ::tolower);
+
+        if (category == "network")
+        {
+            return NETWORK;
+        }
+        else if (category == "pool")
+        {
+            return POOL;
+        }
+        else if (category == "cpu")
+        {
+            return CPU;
+        }
+        else if (category == "nvidia")
+        {
+            return NVIDIA;
+        }
+        else if (category == "config")
+        {
+            return CONFIG;
+        }
+
+        throw std::invalid_argument("Invalid log category given");
+    }
+
+    Logger::~Logger()
+    {
+        m_shouldStop = true;
+
+        m_wakeDrainThread.notify_all();
+
+        if (m_drainThread.joinable())
+        {
+            m_drainThread.join();
+        }
+
+        drain();
+    }
+
+    Logger::RingHandle::~RingHandle()
+    {
+        if (ring)
+        {
+            ring->closed = true;
+        }
+    }
+
+    void Logger::log(const std::string &message, const LogLevel level, const std::vector<LogCategory> &categories)
+    {
+        if (level == DISABLED || level > m_logLevel.load(std::memory_order_relaxed))
         {
             return;
         }
-        const std::time_t now = std::time(nullptr);
-        std::stringstream output;
-        output << "[" << std::put_time(std::localtime(&now), "%H:%M:%S") << "] "
-               << "[" << logLevelToString(level) << "]";
+
+        uint32_t mask = 0;
+
         for (const auto &category : categories)
         {
-            output << " [" << logCategoryToString(category) << "]";
+            mask |= categoryMask(category);
+        }
+
+        /* Uncategorized messages are only filtered by level */
+        if (!categories.empty() && (mask & m_categories.load(std::memory_order_relaxed)) == 0)
+        {
+            return;
+        }
+
+        push({ message, level, mask, std::chrono::system_clock::now() });
+    }
+
+    void Logger::enqueue(std::string message, const LogLevel level, const LogCategory category)
+    {
+        push({ std::move(message), level, categoryMask(category), std::chrono::system_clock::now() });
+    }
+
+    void Logger::push(Entry entry)
+    {
+        const bool isFatal = entry.level == FATAL;
+
+        Ring &ring = threadRing();
+
+        const size_t head = ring.head.load(std::memory_order_relaxed);
+
+        /* Full, drop rather than block the caller */
+        if (head - ring.tail.load(std::memory_order_acquire) >= Ring::CAPACITY)
+        {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        ring.entries[head % Ring::CAPACITY] = std::move(entry);
+
+        ring.head.store(head + 1, std::memory_order_release);
+
+        /* Otherwise, we let the background thread pick it up on its next
+           pass, to avoid a syscall per message */
+        if (isFatal)
+        {
+            m_wakeDrainThread.notify_one();
+        }
+    }
+
+    Logger::Ring &Logger::threadRing()
+    {
+        thread_local RingHandle handle;
+
+        if (!handle.ring)
+        {
+            handle.ring = std::make_shared<Ring>();
+
+            {
+                std::scoped_lock lock(m_ringsMutex);
+                m_rings.push_back(handle.ring);
+            }
+
+            std::call_once(m_startDrainThread, [this]() {
+                m_drainThread = std::thread(&Logger::drainLoop, this);
+            });
+        }
+
+        return *handle.ring;
+    }
+
+    size_t Logger::drain()
+    {
+        std::scoped_lock drainLock(m_drainMutex);
+
+        std::vector<std::shared_ptr<Ring>> rings;
+
+        {
+            std::scoped_lock lock(m_ringsMutex);
+            rings = m_rings;
         }
-        output << ": " << message;
-        if (level <= m_logLevel)
+
+        std::vector<Entry> entries;
+
+        uint64_t dropped = 0;
+
+        for (const auto &ring : rings)
         {
-            /* If the user provides a callback, log to that instead */
-            if (m_callback)
+            const size_t head = ring->head.load(std::memory_order_acquire);
+            size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+            for (; tail != head; tail++)
             {
-                m_callback(output.str(), message, level, categories);
+                entries.push_back(std::move(ring->entries[tail % Ring::CAPACITY]));
             }
-            else
+
+            ring->tail.store(tail, std::memory_order_release);
+
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+        /* Interleave the threads' messages in the order they were logged */
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+            return a.time < b.time;
+        });
+
+        for (const auto &entry : entries)
+        {
+            write(entry);
+        }
+
+        if (dropped != 0)
+        {
+            write({
+                "Dropped " + std::to_string(dropped) + " log messages, logging faster than they can be written",
+                WARNING,
+                0,
+                std::chrono::system_clock::now()
+            });
+        }
+
+        /* Forget threads which have exited, once we've written their messages */
+        {
+            std::scoped_lock lock(m_ringsMutex);
+
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const auto &ring) {
+                return ring->closed && ring->tail.load() == ring->head.load();
+            }), m_rings.end());
+        }
+
+        return entries.size();
+    }
+
+    void Logger::write(const Entry &entry)
+    {
+        const std::time_t time = std::chrono::system_clock::to_time_t(entry.time);
+
+        std::vector<LogCategory> categories;
+
+        std::stringstream output;
+
+        output << "[" << std::put_time(std::localtime(&time), "%H:%M:%S") << "] "
+               << "[" << logLevelToString(entry.level) << "]";
+
+        for (const auto category : { NETWORK, POOL, CPU, NVIDIA, CONFIG })
+        {
+            if (entry.categories & categoryMask(category))
+            {
+                categories.push_back(category);
+                output << " [" << logCategoryToString(category) << "]";
+            }
+        }
+
+        output << ": " << entry.message;
+
+        /* If the user provides a callback, log to that instead */
+        if (m_callback)
+        {
+            m_callback(output.str(), entry.message, entry.level, categories);
+        }
+        else
+        {
+            std::cout << output.str() << std::endl;
+        }
+    }
+
+    void Logger::drainLoop()
+    {
+        while (!m_shouldStop)
+        {
             {
-                std::cout << output.str() << std::endl;
+                std::unique_lock lock(m_wakeMutex);
+
+                /* Woken early for fatal messages and when stopping */
+                m_wakeDrainThread.wait_for(lock, std::chrono::milliseconds(100));
             }
+
+            drain();
         }
     }
 
+    void Logger::flush()
+    {
+        drain();
+    }
+
     void Logger::setLogLevel(const LogLevel level)
     {
         m_logLevel = level;
     }
 
+    void Logger::setLogCategories(const uint32_t categories)
+    {
+        m_categories = categories;
+    }
+
     void Logger::setLogCallback(std::function<void(
                                     const std::string prettyMessage,
                                     const std::string message,
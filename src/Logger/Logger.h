@@ -4,10 +4,40 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+/* The most verbose level compiled in. Log statements above this level are
+   removed entirely by the compiler, e.g. define as 3 to strip debug logging
+   from a build. */
+#ifndef LOGGER_MAX_LEVEL
+#define LOGGER_MAX_LEVEL 4
+#endif
+
+/* Log a message built with <<, e.g.
+   LOG(Logger::DEBUG, Logger::NETWORK, "Sent " << bytes << " bytes");
+   The message is only formatted if the level and category are enabled, so
+   disabled log statements cost an atomic load and a branch. */
+#define LOG(level, category, message)                                                  \
+    do                                                                                 \
+    {                                                                                  \
+        if ((level) <= LOGGER_MAX_LEVEL && Logger::logger.shouldLog((level), (category))) \
+        {                                                                              \
+            std::ostringstream logStream_;                                             \
+            logStream_ << message;                                                     \
+            Logger::logger.enqueue(logStream_.str(), (level), (category));             \
+        }                                                                              \
+    } while (0)
+
 namespace Logger
 {
     enum LogLevel
@@ -28,30 +58,119 @@ namespace Logger
         CONFIG
     };
 
+    /* Every category enabled */
+    constexpr uint32_t ALL_CATEGORIES = (1 << (CONFIG + 1)) - 1;
+
+    constexpr uint32_t categoryMask(const LogCategory category)
+    {
+        return 1u << category;
+    }
+
     std::string logLevelToString(const LogLevel level);
 
     LogLevel stringToLogLevel(std::string level);
 
     std::string logCategoryToString(const LogCategory category);
 
+    LogCategory stringToLogCategory(std::string category);
+
+    /* Messages are handed from the logging thread to a per thread ring
+       buffer without locking, and formatted and written out by a background
+       thread, so logging never blocks the hashing or socket threads on the
+       console. */
     class Logger
     {
       public:
         Logger() {};
 
-        void log(const std::string message, const LogLevel level, const std::vector<LogCategory> categories) const;
+        ~Logger();
+
+        /* Is the level and any of the categories enabled. Cheap enough to call
+           before building the message. */
+        bool shouldLog(const LogLevel level, const LogCategory category) const
+        {
+            return level <= m_logLevel.load(std::memory_order_relaxed)
+                && (m_categories.load(std::memory_order_relaxed) & categoryMask(category)) != 0;
+        }
+
+        void log(const std::string &message, const LogLevel level, const std::vector<LogCategory> &categories);
+
+        /* Queue an already formatted message. Prefer the LOG macro, which
+           checks the level before formatting. */
+        void enqueue(std::string message, const LogLevel level, const LogCategory category);
 
         void setLogLevel(const LogLevel level);
 
+        /* Only log messages in these categories, a mask of categoryMask() */
+        void setLogCategories(const uint32_t categories);
+
+        /* Called from the background thread instead of printing to stdout */
         void setLogCallback(std::function<void(
                                 const std::string prettyMessage,
                                 const std::string message,
                                 const LogLevel level,
                                 const std::vector<LogCategory> categories)> callback);
 
+        /* Block until every message queued before this call is written out */
+        void flush();
+
       private:
+        struct Entry
+        {
+            std::string message;
+
+            LogLevel level;
+
+            uint32_t categories;
+
+            std::chrono::system_clock::time_point time;
+        };
+
+        /* Single producer, single consumer ring. Written by its owning thread,
+           read by the background thread. */
+        struct Ring
+        {
+            static constexpr size_t CAPACITY = 1024;
+
+            std::array<Entry, CAPACITY> entries;
+
+            /* Next slot to write, only advanced by the owning thread */
+            std::atomic<size_t> head = 0;
+
+            /* Next slot to read, only advanced by the background thread */
+            std::atomic<size_t> tail = 0;
+
+            /* Messages lost because the ring was full */
+            std::atomic<uint64_t> dropped = 0;
+
+            /* The owning thread has exited, remove once empty */
+            std::atomic<bool> closed = false;
+        };
+
+        /* Closes the ring when its thread exits */
+        struct RingHandle
+        {
+            std::shared_ptr<Ring> ring;
+
+            ~RingHandle();
+        };
+
+        void push(Entry entry);
+
+        /* Get the calling thread's ring, registering it on first use */
+        Ring &threadRing();
+
+        /* Write out every queued message. Returns how many were written. */
+        size_t drain();
+
+        void write(const Entry &entry);
+
+        void drainLoop();
+
         /* Logging disabled by default */
-        LogLevel m_logLevel = DISABLED;
+        std::atomic<LogLevel> m_logLevel = DISABLED;
+
+        std::atomic<uint32_t> m_categories = ALL_CATEGORIES;
 
         std::function<void(
             const std::string prettyMessage,
@@ -59,6 +178,26 @@ namespace Logger
             const LogLevel level,
             const std::vector<LogCategory> categories)>
             m_callback;
+
+        /* Every thread's ring. Only locked when a thread logs for the first
+           time, and by the background thread. */
+        std::vector<std::shared_ptr<Ring>> m_rings;
+
+        std::mutex m_ringsMutex;
+
+        /* Serializes draining between the background thread and flush() */
+        std::mutex m_drainMutex;
+
+        std::thread m_drainThread;
+
+        /* Guards starting the drain thread */
+        std::once_flag m_startDrainThread;
+
+        std::atomic<bool> m_shouldStop = false;
+
+        std::condition_variable m_wakeDrainThread;
+
+        std::mutex m_wakeMutex;
     };
 
     /* Global logger instance */
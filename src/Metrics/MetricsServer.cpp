@@ -0,0 +1,661 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////
+#include "Metrics/MetricsServer.h"
+//////////////////////////////////
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    /* Largest request we'll bother reading. We only care about the request line. */
+    constexpr size_t MAX_REQUEST_SIZE = 8192;
+
+    /* Time a client gets to send its request and read the response */
+    constexpr auto MAX_REQUEST_TIME = std::chrono::seconds(5);
+
+    std::string escapeLabel(const std::string &value)
+    {
+        std::string escaped;
+
+        for (const char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+
+        return escaped;
+    }
+
+    void writeHeader(
+        std::stringstream &stream,
+        const std::string &name,
+        const std::string &type,
+        const std::string &help)
+    {
+        stream << "# HELP " << name << " " << help << "\n"
+               << "# TYPE " << name << " " << type << "\n";
+    }
+
+    std::string makeResponse(
+        const std::string &status,
+        const std::string &contentType,
+        const std::string &body)
+    {
+        std::stringstream stream;
+
+        stream << "HTTP/1.1 " << status << "\r\n"
+               << "Content-Type: " << contentType << "\r\n"
+               << "Content-Length: " << body.size() << "\r\n"
+               << "Connection: close\r\n"
+               << "\r\n"
+               << body;
+
+        return stream.str();
+    }
+}
+
+MetricsServer::MetricsServer(
+    const std::string &host,
+    const uint16_t port,
+    const std::function<MinerStats(void)> &getStats):
+    m_host(host),
+    m_port(port),
+    m_getStats(getStats)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+void MetricsServer::start()
+{
+    if (m_socket != INVALID_SOCKET)
+    {
+        stop();
+    }
+
+    uint16_t port = m_port;
+
+    m_socket = sockwrapper::detail::create_listener(m_host.c_str(), port, 16);
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        throw std::runtime_error("Failed to bind metrics server to " + m_host + ":" + std::to_string(m_port));
+    }
+
+    sockwrapper::detail::set_nonblocking(m_socket, true);
+
+    m_listenReactorID = sockwrapper::Reactor::instance().add(m_socket, [this]() {
+        acceptClients();
+    });
+
+    if (m_listenReactorID == 0)
+    {
+        sockwrapper::detail::close_socket(m_socket);
+        m_socket = INVALID_SOCKET;
+
+        throw std::runtime_error("Failed to watch the metrics server socket for clients");
+    }
+}
+
+void MetricsServer::stop()
+{
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    /* No new clients from here on */
+    sockwrapper::Reactor::instance().remove(m_socket, m_listenReactorID);
+
+    m_listenReactorID = 0;
+
+    std::map<uint64_t, Client> clients;
+
+    /* Their handlers find nothing to do from here on */
+    {
+        std::scoped_lock lock(m_mutex);
+        clients.swap(m_clients);
+    }
+
+    /* Waits for any of their handlers which are running, so can't hold the
+       lock, which the handlers take */
+    for (const auto &[id, client] : clients)
+    {
+        sockwrapper::Reactor::instance().remove(client.socket, client.reactorID);
+        sockwrapper::detail::close_socket(client.socket);
+    }
+
+    sockwrapper::detail::close_socket(m_socket);
+    m_socket = INVALID_SOCKET;
+}
+
+void MetricsServer::acceptClients()
+{
+    std::scoped_lock lock(m_mutex);
+
+    const auto now = std::chrono::steady_clock::now();
+
+    std::vector<uint64_t> expired;
+
+    for (const auto &[id, client] : m_clients)
+    {
+        if (now - client.connectedAt > MAX_REQUEST_TIME)
+        {
+            expired.push_back(id);
+        }
+    }
+
+    for (const auto id : expired)
+    {
+        removeClient(id);
+    }
+
+    while (true)
+    {
+        const socket_t socket = accept(m_socket, nullptr, nullptr);
+
+        /* None left waiting */
+        if (socket == INVALID_SOCKET)
+        {
+            return;
+        }
+
+        sockwrapper::detail::set_nonblocking(socket, true);
+
+        const uint64_t clientID = m_nextClientID++;
+
+        /* Its handler can't run until we return, we're on the reactor thread */
+        const uint64_t reactorID = sockwrapper::Reactor::instance().add(socket, [this, clientID]() {
+            serviceClient(clientID);
+        });
+
+        if (reactorID == 0)
+        {
+            sockwrapper::detail::close_socket(socket);
+            continue;
+        }
+
+        Client &client = m_clients[clientID];
+
+        client.socket = socket;
+        client.reactorID = reactorID;
+        client.connectedAt = now;
+    }
+}
+
+void MetricsServer::serviceClient(const uint64_t clientID)
+{
+    std::scoped_lock lock(m_mutex);
+
+    const auto it = m_clients.find(clientID);
+
+    /* Removed by stop() */
+    if (it == m_clients.end())
+    {
+        return;
+    }
+
+    Client &client = it->second;
+
+    const bool tooSlow = std::chrono::steady_clock::now() - client.connectedAt > MAX_REQUEST_TIME;
+
+    if (tooSlow || !readClient(client) || !flush(client))
+    {
+        removeClient(clientID);
+    }
+}
+
+bool MetricsServer::readClient(Client &client)
+{
+    char buffer[1024];
+
+    while (true)
+    {
+        const auto bytesRead = recv(client.socket, buffer, sizeof(buffer), 0);
+
+        if (bytesRead == 0)
+        {
+            return false;
+        }
+
+        /* Read everything it has sent so far */
+        if (bytesRead < 0)
+        {
+            return sockwrapper::detail::would_block();
+        }
+
+        /* Anything after the request is of no interest */
+        if (client.responded)
+        {
+            continue;
+        }
+
+        client.request.append(buffer, bytesRead);
+
+        /* Respond once we have the headers, or as much as we'll read of them */
+        if (client.request.find("\r\n\r\n") != std::string::npos || client.request.size() >= MAX_REQUEST_SIZE)
+        {
+            client.outgoing = handleRequest(client.request);
+            client.responded = true;
+        }
+    }
+}
+
+bool MetricsServer::flush(Client &client)
+{
+    while (!client.outgoing.empty())
+    {
+        const auto sent = send(
+            client.socket,
+            client.outgoing.data(),
+            static_cast<int>(client.outgoing.size()),
+            MSG_NOSIGNAL
+        );
+
+        if (sent > 0)
+        {
+            client.outgoing.erase(0, sent);
+            continue;
+        }
+
+        /* The client has gone */
+        if (sent == 0 || !sockwrapper::detail::would_block())
+        {
+            return false;
+        }
+
+        break;
+    }
+
+    /* Sent it all, and we always close the connection after the response */
+    if (client.responded && client.outgoing.empty())
+    {
+        return false;
+    }
+
+    /* Carry on sending once it has room */
+    const bool watchWritable = !client.outgoing.empty();
+
+    if (watchWritable != client.watchingWritable)
+    {
+        sockwrapper::Reactor::instance().watchWritable(client.socket, client.reactorID, watchWritable);
+        client.watchingWritable = watchWritable;
+    }
+
+    return true;
+}
+
+void MetricsServer::removeClient(const uint64_t clientID)
+{
+    const auto it = m_clients.find(clientID);
+
+    if (it == m_clients.end())
+    {
+        return;
+    }
+
+    /* We're on the reactor thread, so this won't wait on ourselves */
+    sockwrapper::Reactor::instance().remove(it->second.socket, it->second.reactorID);
+    sockwrapper::detail::close_socket(it->second.socket);
+
+    m_clients.erase(it);
+}
+
+std::string MetricsServer::handleRequest(const std::string &request) const
+{
+    std::stringstream requestLine(request.substr(0, request.find("\r\n")));
+
+    std::string method;
+    std::string path;
+
+    requestLine >> method >> path;
+
+    /* Ignore any query string */
+    path = path.substr(0, path.find('?'));
+
+    try
+    {
+        if (method != "GET")
+        {
+            return makeResponse("405 Method Not Allowed", "text/plain", "Method not allowed\n");
+        }
+
+        if (path == "/metrics")
+        {
+            return makeResponse("200 OK", "text/plain; version=0.0.4", getPrometheusMetrics());
+        }
+
+        if (path == "/json" || path == "/")
+        {
+            return makeResponse("200 OK", "application/json", getJSONMetrics());
+        }
+
+        return makeResponse("404 Not Found", "text/plain", "Not found\n");
+    }
+    catch (const std::exception &e)
+    {
+        return makeResponse("500 Internal Server Error", "text/plain", std::string(e.what()) + "\n");
+    }
+}
+
+std::string MetricsServer::getJSONMetrics() const
+{
+    const nlohmann::json j = m_getStats();
+
+    return j.dump(4) + "\n";
+}
+
+std::string MetricsServer::getPrometheusMetrics() const
+{
+    const MinerStats stats = m_getStats();
+
+    std::stringstream stream;
+
+    stream.precision(15);
+
+    const std::vector<std::tuple<std::string, double DeviceStats::*>> windows {
+        { "10s", &DeviceStats::hashrate10s },
+        { "60s", &DeviceStats::hashrate60s },
+        { "15m", &DeviceStats::hashrate15m },
+        { "average", &DeviceStats::hashrateAverage }
+    };
+
+    writeHeader(stream, "miner_hashrate", "gauge", "Hashrate in hashes per second, over the given window");
+
+    for (const auto &device : stats.devices)
+    {
+        for (const auto &[window, member] : windows)
+        {
+            stream << "miner_hashrate{device=\"" << escapeLabel(device.deviceName)
+                   << "\",window=\"" << window << "\"} " << device.*member << "\n";
+        }
+    }
+
+    writeHeader(stream, "miner_hashes_total", "counter", "Total hashes performed");
+
+    for (const auto &device : stats.devices)
+    {
+        stream << "miner_hashes_total{device=\"" << escapeLabel(device.deviceName) << "\"} "
+               << device.totalHashes << "\n";
+    }
+
+    writeHeader(stream, "miner_thread_hashrate", "gauge", "Per thread hashrate in hashes per second, over the given window");
+
+    for (const auto &thread : stats.threads)
+    {
+        const std::vector<std::tuple<std::string, double>> threadWindows {
+            { "10s", thread.hashrate10s },
+            { "60s", thread.hashrate60s },
+            { "15m", thread.hashrate15m }
+        };
+
+        for (const auto &[window, hashrate] : threadWindows)
+        {
+            stream << "miner_thread_hashrate{device=\"" << escapeLabel(thread.deviceName)
+                   << "\",thread=\"" << thread.threadNumber
+                   << "\",window=\"" << window << "\"} " << hashrate << "\n";
+        }
+    }
+
+    writeHeader(stream, "miner_thread_job_switches_total", "counter", "Number of times the thread has switched to a new job");
+
+    for (const auto &thread : stats.threads)
+    {
+        stream << "miner_thread_job_switches_total{device=\"" << escapeLabel(thread.deviceName)
+               << "\",thread=\"" << thread.threadNumber << "\"} " << thread.jobSwitches << "\n";
+    }
+
+    const bool haveHardwareCounters = std::any_of(stats.threads.begin(), stats.threads.end(), [](const auto &thread) {
+        return thread.hardwareCounters.available();
+    });
+
+    if (haveHardwareCounters)
+    {
+        writeHeader(stream, "miner_thread_hardware_counted_hashes_total", "counter", "Hashes performed while counting hardware events");
+
+        for (const auto &thread : stats.threads)
+        {
+            stream << "miner_thread_hardware_counted_hashes_total{device=\"" << escapeLabel(thread.deviceName)
+                   << "\",thread=\"" << thread.threadNumber << "\"} " << thread.hardwareCounters.hashes << "\n";
+        }
+
+        writeHeader(stream, "miner_thread_hardware_events_total", "counter", "Hardware events counted on the thread, by event");
+
+        for (const auto &thread : stats.threads)
+        {
+            for (size_t event = 0; event < HARDWARE_EVENT_COUNT; event++)
+            {
+                if (!thread.hardwareCounters.supported[event])
+                {
+                    continue;
+                }
+
+                stream << "miner_thread_hardware_events_total{device=\"" << escapeLabel(thread.deviceName)
+                       << "\",thread=\"" << thread.threadNumber
+                       << "\",event=\"" << hardwareEventToString(static_cast<HardwareEvent>(event))
+                       << "\"} " << thread.hardwareCounters.counts[event] << "\n";
+            }
+        }
+
+        writeHeader(stream, "miner_thread_instructions_per_cycle", "gauge", "Instructions retired per CPU cycle since the thread started");
+
+        for (const auto &thread : stats.threads)
+        {
+            stream << "miner_thread_instructions_per_cycle{device=\"" << escapeLabel(thread.deviceName)
+                   << "\",thread=\"" << thread.threadNumber << "\"} " << thread.hardwareCounters.instructionsPerCycle() << "\n";
+        }
+
+        writeHeader(stream, "miner_thread_misses_per_hash", "gauge", "Last level cache and dTLB misses per hash since the thread started");
+
+        for (const auto &thread : stats.threads)
+        {
+            const std::vector<std::tuple<std::string, double>> misses {
+                { "llc", thread.hardwareCounters.perHash(LLC_MISSES) },
+                { "dtlb", thread.hardwareCounters.perHash(DTLB_MISSES) }
+            };
+
+            for (const auto &[cache, perHash] : misses)
+            {
+                stream << "miner_thread_misses_per_hash{device=\"" << escapeLabel(thread.deviceName)
+                       << "\",thread=\"" << thread.threadNumber
+                       << "\",cache=\"" << cache << "\"} " << perHash << "\n";
+            }
+        }
+
+        writeHeader(stream, "miner_thread_memory_bandwidth_bytes", "gauge", "Memory bandwidth in bytes per second, estimated from last level cache misses");
+
+        for (const auto &thread : stats.threads)
+        {
+            stream << "miner_thread_memory_bandwidth_bytes{device=\"" << escapeLabel(thread.deviceName)
+                   << "\",thread=\"" << thread.threadNumber << "\"} " << thread.hardwareCounters.memoryBandwidth() << "\n";
+        }
+    }
+
+    /* Only present in instrumentation builds */
+    const bool haveArgon2Profile = std::any_of(stats.threads.begin(), stats.threads.end(), [](const auto &thread) {
+        return thread.argon2Profile.hashes != 0;
+    });
+
+    if (haveArgon2Profile)
+    {
+        writeHeader(stream, "miner_argon2_profiled_hashes_total", "counter", "Hashes included in the Argon2 phase timings");
+
+        for (const auto &thread : stats.threads)
+        {
+            stream << "miner_argon2_profiled_hashes_total{device=\"" << escapeLabel(thread.deviceName)
+                   << "\",thread=\"" << thread.threadNumber << "\"} " << thread.argon2Profile.hashes << "\n";
+        }
+
+        writeHeader(stream, "miner_argon2_phase_cycles_total", "counter", "CPU cycles spent in each phase of the Argon2 hash. processBlocks includes addressGeneration.");
+
+        for (const auto &thread : stats.threads)
+        {
+            for (size_t phase = 0; phase < Instrumentation::PHASE_COUNT; phase++)
+            {
+                stream << "miner_argon2_phase_cycles_total{device=\"" << escapeLabel(thread.deviceName)
+                       << "\",thread=\"" << thread.threadNumber
+                       << "\",phase=\"" << Instrumentation::phaseToString(static_cast<Instrumentation::Phase>(phase))
+                       << "\"} " << thread.argon2Profile.phaseCycles[phase] << "\n";
+            }
+        }
+
+        writeHeader(stream, "miner_argon2_segment_cycles_total", "counter", "CPU cycles spent filling each slice of each pass over the scratchpad");
+
+        for (const auto &thread : stats.threads)
+        {
+            for (size_t pass = 0; pass < Instrumentation::MAX_PASSES; pass++)
+            {
+                for (size_t slice = 0; slice < Constants::SYNC_POINTS; slice++)
+                {
+                    stream << "miner_argon2_segment_cycles_total{device=\"" << escapeLabel(thread.deviceName)
+                           << "\",thread=\"" << thread.threadNumber
+                           << "\",pass=\"" << pass << "\",slice=\"" << slice
+                           << "\"} " << thread.argon2Profile.segmentCycles[pass][slice] << "\n";
+                }
+            }
+        }
+
+        writeHeader(stream, "miner_argon2_kernel_calls_total", "counter", "Calls to each Blake2b and compression kernel");
+
+        for (const auto &thread : stats.threads)
+        {
+            for (size_t kernel = 0; kernel < Instrumentation::KERNEL_COUNT; kernel++)
+            {
+                stream << "miner_argon2_kernel_calls_total{device=\"" << escapeLabel(thread.deviceName)
+                       << "\",thread=\"" << thread.threadNumber
+                       << "\",kernel=\"" << Instrumentation::kernelToString(static_cast<Instrumentation::Kernel>(kernel))
+                       << "\"} " << thread.argon2Profile.kernelCalls[kernel] << "\n";
+            }
+        }
+    }
+
+    if (stats.energy.available)
+    {
+        writeHeader(stream, "miner_cpu_energy_joules_total", "counter", "Energy used by the CPU while mining, from RAPL");
+
+        stream << "miner_cpu_energy_joules_total{domain=\"package\"} " << stats.energy.packageJoules << "\n";
+        stream << "miner_cpu_energy_joules_total{domain=\"dram\"} " << stats.energy.dramJoules << "\n";
+
+        writeHeader(stream, "miner_cpu_hashes_per_joule", "gauge", "CPU hashes per joule of package and DRAM energy, by configuration");
+
+        for (const auto &configuration : stats.energy.configurations)
+        {
+            stream << "miner_cpu_hashes_per_joule{optimization=\"" << escapeLabel(configuration.optimizationMethod)
+                   << "\",threads=\"" << configuration.threadCount
+                   << "\",algorithm=\"" << escapeLabel(configuration.algorithm)
+                   << "\"} " << configuration.hashesPerJoule() << "\n";
+        }
+    }
+
+    if (stats.governor.enabled)
+    {
+        writeHeader(stream, "miner_cpu_active_threads", "gauge", "CPU threads hashing, the rest are parked by the governor");
+        stream << "miner_cpu_active_threads " << stats.governor.activeThreads << "\n";
+
+        if (stats.governor.haveTemperature)
+        {
+            writeHeader(stream, "miner_cpu_temperature_celsius", "gauge", "Temperature of the hottest CPU sensor");
+            stream << "miner_cpu_temperature_celsius " << stats.governor.temperature << "\n";
+        }
+
+        if (stats.governor.haveFrequency)
+        {
+            writeHeader(stream, "miner_cpu_frequency_mhz", "gauge", "Average CPU core frequency");
+            stream << "miner_cpu_frequency_mhz " << stats.governor.frequency << "\n";
+        }
+
+        writeHeader(stream, "miner_cpu_throttle_events_total", "counter", "Times the CPU throttled itself for being too hot");
+        stream << "miner_cpu_throttle_events_total " << stats.governor.throttleEvents << "\n";
+    }
+
+    writeHeader(stream, "miner_shares_submitted_total", "counter", "Shares submitted to the pool");
+    stream << "miner_shares_submitted_total " << stats.submittedShares << "\n";
+
+    writeHeader(stream, "miner_shares_accepted_total", "counter", "Shares accepted by the pool");
+    stream << "miner_shares_accepted_total " << stats.acceptedShares << "\n";
+
+    const std::string poolLabel = "{pool=\"" + escapeLabel(stats.pool.pool) + "\"}";
+
+    writeHeader(stream, "miner_pool_connected", "gauge", "Whether we are currently connected to the pool");
+    stream << "miner_pool_connected" << poolLabel << " " << (stats.pool.connected ? 1 : 0) << "\n";
+
+    writeHeader(stream, "miner_pool_rtt_seconds", "gauge", "Round trip time of the last pool login or keepalive");
+    stream << "miner_pool_rtt_seconds" << poolLabel << " " << stats.pool.roundTripMilliseconds / 1000 << "\n";
+
+    writeHeader(stream, "miner_job_age_seconds", "gauge", "Time since the pool last sent us a job");
+    stream << "miner_job_age_seconds" << poolLabel << " " << stats.pool.jobAgeSeconds << "\n";
+
+    writeHeader(stream, "miner_share_difficulty", "gauge", "Share difficulty of the current job");
+    stream << "miner_share_difficulty" << poolLabel << " " << stats.pool.shareDifficulty << "\n";
+
+    const std::string poolName = "pool=\"" + escapeLabel(stats.pool.pool) + "\"";
+
+    writeHeader(stream, "miner_pool_shares_total", "counter", "Shares the pool has responded to, by result");
+    stream << "miner_pool_shares_total{" << poolName << ",result=\"accepted\"} " << stats.pool.acceptedShares << "\n";
+    stream << "miner_pool_shares_total{" << poolName << ",result=\"rejected\"} " << stats.pool.rejectedShares << "\n";
+
+    writeHeader(stream, "miner_pool_share_rejects_total", "counter", "Shares rejected by the pool, by the reason given");
+
+    for (const auto &[reason, count] : stats.pool.rejectReasons)
+    {
+        stream << "miner_pool_share_rejects_total{" << poolName << ",reason=\"" << escapeLabel(reason) << "\"} " << count << "\n";
+    }
+
+    writeHeader(stream, "miner_pool_stale_shares_total", "counter", "Shares found for superseded jobs, by whether we dropped or submitted them");
+    stream << "miner_pool_stale_shares_total{" << poolName << ",action=\"dropped\"} " << stats.pool.staleSharesDropped << "\n";
+    stream << "miner_pool_stale_shares_total{" << poolName << ",action=\"submitted\"} " << stats.pool.staleSharesSubmitted << "\n";
+
+    writeHeader(stream, "miner_pool_share_latency_seconds", "histogram", "Time from submitting a share to the pool accepting or rejecting it");
+
+    uint64_t cumulative = 0;
+
+    /* Bucket n holds latencies below 2^n microseconds, the final bucket
+       is everything else */
+    for (size_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS - 1; bucket++)
+    {
+        cumulative += stats.pool.shareLatencyHistogram[bucket];
+
+        stream << "miner_pool_share_latency_seconds_bucket{" << poolName << ",le=\""
+               << (bucket == 0 ? 0 : (1ULL << bucket) / 1e6) << "\"} " << cumulative << "\n";
+    }
+
+    cumulative += stats.pool.shareLatencyHistogram[LATENCY_HISTOGRAM_BUCKETS - 1];
+
+    stream << "miner_pool_share_latency_seconds_bucket{" << poolName << ",le=\"+Inf\"} " << cumulative << "\n";
+    stream << "miner_pool_share_latency_seconds_sum" << poolLabel << " " << stats.pool.shareLatencySumMicroseconds / 1e6 << "\n";
+    stream << "miner_pool_share_latency_seconds_count" << poolLabel << " " << cumulative << "\n";
+
+    writeHeader(stream, "miner_pool_requests_in_flight", "gauge", "Shares and keepalives awaiting a response from the pool");
+    stream << "miner_pool_requests_in_flight" << poolLabel << " " << stats.pool.inFlightRequests << "\n";
+
+    writeHeader(stream, "miner_pool_requests_timed_out_total", "counter", "Shares and keepalives the pool never responded to");
+    stream << "miner_pool_requests_timed_out_total" << poolLabel << " " << stats.pool.timedOutRequests << "\n";
+
+    writeHeader(stream, "miner_pool_standby_connections", "gauge", "Standby pools logged in, ready to fail over to");
+    stream << "miner_pool_standby_connections " << stats.pool.standbyPools << "\n";
+
+    writeHeader(stream, "miner_info", "gauge", "The hashing kernel and algorithm in use");
+    stream << "miner_info{optimization=\"" << escapeLabel(stats.optimizationMethod)
+           << "\",algorithm=\"" << escapeLabel(stats.pool.algorithm) << "\"} 1\n";
+
+    return stream.str();
+}
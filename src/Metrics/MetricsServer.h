@@ -0,0 +1,102 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "SocketWrapper/SocketWrapper.h"
+#include "Types/MinerStats.h"
+
+/* A tiny HTTP server exposing the miner stats for monitoring. Serves
+   Prometheus text format on /metrics, and JSON on /json. The sockets are non
+   blocking and driven by the socket reactor, and responses queue up until the
+   client takes them, so a slow or stuck client never holds up the others, or
+   stop(). Clients which take more than a few seconds over their request are
+   hung up on when we next hear from them, or another client connects. */
+class MetricsServer
+{
+  public:
+    MetricsServer(
+        const std::string &host,
+        const uint16_t port,
+        const std::function<MinerStats(void)> &getStats);
+
+    ~MetricsServer();
+
+    /* Bind to the address and start serving. Throws if we cannot bind. */
+    void start();
+
+    void stop();
+
+  private:
+    struct Client
+    {
+        socket_t socket;
+
+        uint64_t reactorID = 0;
+
+        /* The request so far, up to the end of the headers */
+        std::string request;
+
+        /* Bytes of the response the socket hasn't taken yet */
+        std::string outgoing;
+
+        /* Have we queued the whole response */
+        bool responded = false;
+
+        /* Are we asking the reactor to tell us when we can send more */
+        bool watchingWritable = false;
+
+        std::chrono::steady_clock::time_point connectedAt;
+    };
+
+    /* Accept every client waiting to connect, and hang up on any which are
+       taking too long. Called on the reactor thread. */
+    void acceptClients();
+
+    /* Read the request, and send what we can of the response. Called on the
+       reactor thread. */
+    void serviceClient(const uint64_t clientID);
+
+    /* Read whatever the client has sent, queueing the response once we have
+       the whole request. Returns false if it disconnected. */
+    bool readClient(Client &client);
+
+    /* Send as much of the response as the socket will take. Returns false
+       once we're done with the client. */
+    bool flush(Client &client);
+
+    /* Must be called with m_mutex held, on the reactor thread */
+    void removeClient(const uint64_t clientID);
+
+    std::string handleRequest(const std::string &request) const;
+
+    std::string getPrometheusMetrics() const;
+
+    std::string getJSONMetrics() const;
+
+    const std::string m_host;
+
+    const uint16_t m_port;
+
+    /* Used to fetch the latest stats on each request */
+    const std::function<MinerStats(void)> m_getStats;
+
+    /* The listening socket */
+    socket_t m_socket = INVALID_SOCKET;
+
+    uint64_t m_listenReactorID = 0;
+
+    std::map<uint64_t, Client> m_clients;
+
+    uint64_t m_nextClientID = 0;
+
+    /* Guards the clients */
+    std::mutex m_mutex;
+};
@@ -6,6 +6,7 @@
 #include "Miner/GetConfig.h"
 ////////////////////////////
 
+#include <algorithm>
 #include <fstream>
 
 #include "Config/Constants.h"
@@ -51,12 +52,61 @@ std::vector<NvidiaDevice> getNvidiaDevices()
     return devices;
 }
 
+void to_json(nlohmann::json &j, const GovernorConfig &config)
+{
+    j = {
+        {"enabled", config.enabled},
+        {"maxTemperature", config.maxTemperature},
+        {"maxPower", config.maxPower},
+        {"minThreads", config.minThreads},
+        {"hwmonRoot", config.hwmonRoot},
+        {"cpuRoot", config.cpuRoot}
+    };
+}
+
+void from_json(const nlohmann::json &j, GovernorConfig &config)
+{
+    if (j.find("enabled") != j.end())
+    {
+        config.enabled = j.at("enabled").get<bool>();
+    }
+
+    if (j.find("maxTemperature") != j.end())
+    {
+        config.maxTemperature = j.at("maxTemperature").get<double>();
+    }
+
+    if (j.find("maxPower") != j.end())
+    {
+        config.maxPower = j.at("maxPower").get<double>();
+    }
+
+    if (j.find("minThreads") != j.end())
+    {
+        config.minThreads = j.at("minThreads").get<uint32_t>();
+    }
+
+    if (j.find("hwmonRoot") != j.end())
+    {
+        config.hwmonRoot = j.at("hwmonRoot").get<std::string>();
+    }
+
+    if (j.find("cpuRoot") != j.end())
+    {
+        config.cpuRoot = j.at("cpuRoot").get<std::string>();
+    }
+}
+
 void to_json(nlohmann::json &j, const CpuConfig &config)
 {
     j = {
         {"enabled", config.enabled},
         {"optimizationMethod", Constants::optimizationMethodToString(config.optimizationMethod)},
-        {"threadCount", config.threadCount}
+        {"threadCount", config.threadCount},
+        {"hardwareCounters", config.hardwareCounters},
+        {"powercapRoot", config.powercapRoot},
+        {"cgroupRoot", config.cgroupRoot},
+        {"governor", config.governor}
     };
 }
 
@@ -76,6 +126,26 @@ void from_json(const nlohmann::json &j, CpuConfig &config)
         config.threadCount = j.at("threadCount").get<uint32_t>();
     }
 
+    if (j.find("hardwareCounters") != j.end())
+    {
+        config.hardwareCounters = j.at("hardwareCounters").get<bool>();
+    }
+
+    if (j.find("powercapRoot") != j.end())
+    {
+        config.powercapRoot = j.at("powercapRoot").get<std::string>();
+    }
+
+    if (j.find("cgroupRoot") != j.end())
+    {
+        config.cgroupRoot = j.at("cgroupRoot").get<std::string>();
+    }
+
+    if (j.find("governor") != j.end())
+    {
+        config.governor = j.at("governor").get<GovernorConfig>();
+    }
+
     if (j.find("optimizationMethod") != j.end())
     {
         const auto optimizations = getAvailableOptimizations();
@@ -313,17 +383,160 @@ void from_json(const nlohmann::json &j, HardwareConfig &config)
 }
 
 
+void to_json(nlohmann::json &j, const MetricsConfig &config)
+{
+    j = {
+        {"enabled", config.enabled},
+        {"host", config.host},
+        {"port", config.port}
+    };
+}
+
+void from_json(const nlohmann::json &j, MetricsConfig &config)
+{
+    if (j.find("enabled") != j.end())
+    {
+        config.enabled = j.at("enabled").get<bool>();
+    }
+
+    if (j.find("host") != j.end())
+    {
+        config.host = j.at("host").get<std::string>();
+    }
+
+    if (j.find("port") != j.end())
+    {
+        config.port = j.at("port").get<uint16_t>();
+    }
+}
+
+void to_json(nlohmann::json &j, const ProxyConfig &config)
+{
+    j = {
+        {"enabled", config.enabled},
+        {"host", config.host},
+        {"port", config.port}
+    };
+}
+
+void from_json(const nlohmann::json &j, ProxyConfig &config)
+{
+    if (j.find("enabled") != j.end())
+    {
+        config.enabled = j.at("enabled").get<bool>();
+    }
+
+    if (j.find("host") != j.end())
+    {
+        config.host = j.at("host").get<std::string>();
+    }
+
+    if (j.find("port") != j.end())
+    {
+        config.port = j.at("port").get<uint16_t>();
+    }
+}
+
+void to_json(nlohmann::json &j, const PartitionConfig &config)
+{
+    j = {
+        {"name", config.name},
+        {"threadCount", config.threadCount},
+        {"pools", config.pools}
+    };
+}
+
+void from_json(const nlohmann::json &j, PartitionConfig &config)
+{
+    config.pools = j.at("pools").get<std::vector<Pool>>();
+
+    if (config.pools.empty())
+    {
+        throw std::invalid_argument("Partition has no pools");
+    }
+
+    if (j.find("threadCount") != j.end())
+    {
+        config.threadCount = j.at("threadCount").get<uint32_t>();
+    }
+
+    if (config.threadCount == 0)
+    {
+        throw std::invalid_argument("Partition threadCount must be at least 1");
+    }
+
+    if (j.find("name") != j.end())
+    {
+        config.name = j.at("name").get<std::string>();
+    }
+    else
+    {
+        config.name = config.pools[0].host;
+    }
+}
+
+void to_json(nlohmann::json &j, const LogConfig &config)
+{
+    std::vector<std::string> categories;
+
+    for (const auto category : { Logger::NETWORK, Logger::POOL, Logger::CPU, Logger::NVIDIA, Logger::CONFIG })
+    {
+        if (config.categories & Logger::categoryMask(category))
+        {
+            categories.push_back(Logger::logCategoryToString(category));
+        }
+    }
+
+    j = {
+        {"level", Logger::logLevelToString(config.level)},
+        {"categories", categories}
+    };
+}
+
+void from_json(const nlohmann::json &j, LogConfig &config)
+{
+    if (j.find("level") != j.end())
+    {
+        config.level = Logger::stringToLogLevel(j.at("level").get<std::string>());
+    }
+
+    if (j.find("categories") != j.end())
+    {
+        config.categories = 0;
+
+        for (const auto &category : j.at("categories").get<std::vector<std::string>>())
+        {
+            config.categories |= Logger::categoryMask(Logger::stringToLogCategory(category));
+        }
+    }
+}
+
 void to_json(nlohmann::json &j, const MinerConfig &config)
 {
     j = {
         {"pools", config.pools},
-        {"hardwareConfiguration", *(config.hardwareConfiguration)}
+        {"poolManager", config.poolManager},
+        {"daemon", config.daemon},
+        {"hardwareConfiguration", *(config.hardwareConfiguration)},
+        {"metrics", config.metrics},
+        {"proxy", config.proxy},
+        {"partitions", config.partitions},
+        {"log", config.log}
     };
 }
 
 void from_json(const nlohmann::json &j, MinerConfig &config)
 {
-    config.pools = j.at("pools").get<std::vector<Pool>>();
+    if (j.find("daemon") != j.end())
+    {
+        config.daemon = j.at("daemon").get<DaemonConfig>();
+    }
+
+    /* No pools are needed to solo mine */
+    if (!config.daemon.enabled || j.find("pools") != j.end())
+    {
+        config.pools = j.at("pools").get<std::vector<Pool>>();
+    }
 
     if (j.find("hardwareConfiguration") != j.end())
     {
@@ -334,13 +547,56 @@ void from_json(const nlohmann::json &j, MinerConfig &config)
         config.hardwareConfiguration->nvidia.devices = getNvidiaDevices();
         config.hardwareConfiguration->amd.devices = getAmdDevices();
     }
+
+    if (j.find("poolManager") != j.end())
+    {
+        config.poolManager = j.at("poolManager").get<PoolManagerConfig>();
+    }
+
+    if (j.find("metrics") != j.end())
+    {
+        config.metrics = j.at("metrics").get<MetricsConfig>();
+    }
+
+    if (j.find("proxy") != j.end())
+    {
+        config.proxy = j.at("proxy").get<ProxyConfig>();
+    }
+
+    if (j.find("partitions") != j.end())
+    {
+        config.partitions = j.at("partitions").get<std::vector<PartitionConfig>>();
+
+        uint32_t partitionThreads = 0;
+
+        for (const auto &partition : config.partitions)
+        {
+            partitionThreads += partition.threadCount;
+        }
+
+        /* The main pools need at least one thread */
+        if (partitionThreads >= config.hardwareConfiguration->cpu.threadCount)
+        {
+            throw std::invalid_argument(
+                "Partitions use " + std::to_string(partitionThreads) + " threads, leaving none of the "
+              + std::to_string(config.hardwareConfiguration->cpu.threadCount) + " threads for the main pools"
+            );
+        }
+    }
+
+    if (j.find("log") != j.end())
+    {
+        config.log = j.at("log").get<LogConfig>();
+    }
 }
 
 Constants::OptimizationMethod getAutoChosenOptimization()
 {
     auto best = getAvailableOptimizations()[0];
 
-    if (best == Constants::AUTO)
+    /* The portable kernel is opt in, it is slower than the scalar path where
+       we have measured it */
+    if (best == Constants::AUTO || best == Constants::PORTABLE)
     {
         best = Constants::NONE;
     }
@@ -395,6 +651,11 @@ std::vector<Constants::OptimizationMethod> getAvailableOptimizations()
 
     #endif
 
+    if (Constants::PORTABLE_KERNEL_AVAILABLE)
+    {
+        availableOptimizations.push_back(Constants::PORTABLE);
+    }
+
     availableOptimizations.push_back(Constants::AUTO);
     availableOptimizations.push_back(Constants::NONE);
 
@@ -672,6 +933,12 @@ MinerConfig getMinerConfig(int argc, char **argv)
     Pool poolConfig;
 
     std::string poolAddress;
+    std::string daemonAddress;
+
+    std::string logLevel;
+    std::string logCategories;
+
+    uint32_t benchmarkDuration = static_cast<uint32_t>(config.benchmark.duration.count());
 
     bool help;
     bool version;
@@ -707,6 +974,10 @@ MinerConfig getMinerConfig(int argc, char **argv)
         ("ssl", "Should we use SSL with this pool",
          cxxopts::value<bool>(poolConfig.ssl)->implicit_value("true"));
 
+    options.add_options("Solo")
+        ("daemon", "Solo mine against the daemon RPC at <host:port> instead of a pool, paying to --username",
+         cxxopts::value<std::string>(daemonAddress), "<host:port>");
+
     options.add_options("Miner")
         ("algorithm", "The mining algorithm to use",
          cxxopts::value<std::string>(poolConfig.algorithm), "<algorithm>")
@@ -715,6 +986,23 @@ MinerConfig getMinerConfig(int argc, char **argv)
          cxxopts::value<uint32_t>(config.hardwareConfiguration->cpu.threadCount)->default_value(
             std::to_string(config.hardwareConfiguration->cpu.threadCount)), "<threads>")
 
+        ("hardwareCounters", "Report cache misses, TLB misses and instructions per cycle of the CPU threads. Linux only",
+         cxxopts::value<bool>(config.hardwareConfiguration->cpu.hardwareCounters)->implicit_value("true"))
+
+        ("powercapRoot", "Where to read the CPU energy counters from",
+         cxxopts::value<std::string>(config.hardwareConfiguration->cpu.powercapRoot)->default_value(
+            config.hardwareConfiguration->cpu.powercapRoot), "<path>")
+
+        ("cgroupRoot", "Where to read the CPU and memory limits of the container from",
+         cxxopts::value<std::string>(config.hardwareConfiguration->cpu.cgroupRoot)->default_value(
+            config.hardwareConfiguration->cpu.cgroupRoot), "<path>")
+
+        ("maxTemperature", "Park CPU threads as needed to keep the CPU below this temperature, in celsius",
+         cxxopts::value<double>(config.hardwareConfiguration->cpu.governor.maxTemperature), "<celsius>")
+
+        ("maxPower", "Park CPU threads as needed to keep the CPU below this many watts. Needs readable RAPL counters",
+         cxxopts::value<double>(config.hardwareConfiguration->cpu.governor.maxPower), "<watts>")
+
         ("disableCPU", "Disable CPU mining",
          cxxopts::value<bool>(disableCPU)->implicit_value("true"))
 
@@ -724,6 +1012,37 @@ MinerConfig getMinerConfig(int argc, char **argv)
         ("disableAMD", "Disable AMD mining",
          cxxopts::value<bool>(disableAMD)->implicit_value("true"));
 
+    options.add_options("Benchmark")
+        ("benchmark", "Mine synthetic jobs with the given algorithm offline, and print a hashrate score to compare machines and builds",
+         cxxopts::value<std::string>(config.benchmark.algorithm), "<algorithm>")
+
+        ("duration", "How many seconds to benchmark for, after warming up",
+         cxxopts::value<uint32_t>(benchmarkDuration)->default_value(std::to_string(benchmarkDuration)), "<seconds>")
+
+        ("benchmarkOutput", "Where to write the benchmark results as JSON",
+         cxxopts::value<std::string>(config.benchmark.outputFile)->default_value(config.benchmark.outputFile), "<file>");
+
+    options.add_options("Metrics")
+        ("metricsPort", "Serve Prometheus metrics on /metrics and JSON on /json on the given port",
+         cxxopts::value<uint16_t>(config.metrics.port), "<port>")
+
+        ("metricsHost", "The address to serve metrics on",
+         cxxopts::value<std::string>(config.metrics.host)->default_value(config.metrics.host), "<host>");
+
+    options.add_options("Proxy")
+        ("proxy", "Instead of mining, share our pool connection with other miners connecting on the given port",
+         cxxopts::value<uint16_t>(config.proxy.port), "<port>")
+
+        ("proxyHost", "The address to accept miners on",
+         cxxopts::value<std::string>(config.proxy.host)->default_value(config.proxy.host), "<host>");
+
+    options.add_options("Logging")
+        ("logLevel", "Print debug logging at this level or above: fatal, warning, info or debug",
+         cxxopts::value<std::string>(logLevel), "<level>")
+
+        ("logCategories", "Only print debug logging for these comma separated categories: network, pool, cpu, nvidia, config",
+         cxxopts::value<std::string>(logCategories), "<categories>");
+
     try
     {
         const auto result = options.parse(argc, argv);
@@ -740,6 +1059,15 @@ MinerConfig getMinerConfig(int argc, char **argv)
             exit(0);
         }
 
+        if (result.count("benchmark") != 0)
+        {
+            config.benchmark.enabled = true;
+            config.benchmark.duration = std::chrono::seconds(std::max<uint32_t>(benchmarkDuration, 1));
+
+            /* Validated along with the pool algorithm below */
+            poolConfig.algorithm = config.benchmark.algorithm;
+        }
+
         const bool configFileExists = static_cast<bool>(std::ifstream(Constants::CONFIG_FILE_NAME));
 
         /* Use config file if no args given and config file exists on disk */
@@ -752,7 +1080,19 @@ MinerConfig getMinerConfig(int argc, char **argv)
            file exists on disk */
         if (config.configLocation != "")
         {
-            return getConfigFromJSON(config.configLocation);
+            MinerConfig jsonConfig = getConfigFromJSON(config.configLocation);
+
+            /* Benchmark with the hardware settings from the config file */
+            jsonConfig.benchmark = config.benchmark;
+
+            /* Proxy the pools from the config file */
+            if (result.count("proxy") != 0)
+            {
+                jsonConfig.proxy = config.proxy;
+                jsonConfig.proxy.enabled = true;
+            }
+
+            return jsonConfig;
         }
         /* No command line args given, and no config on disk, create config from
            user input */
@@ -762,7 +1102,19 @@ MinerConfig getMinerConfig(int argc, char **argv)
         }
         else
         {
-            const std::vector<std::string> requiredArgs { "pool", "username", "algorithm" };
+            const bool solo = result.count("daemon") != 0;
+
+            /* No pool is needed to benchmark or solo mine */
+            std::vector<std::string> requiredArgs;
+
+            if (solo)
+            {
+                requiredArgs = { "username", "algorithm" };
+            }
+            else if (!config.benchmark.enabled)
+            {
+                requiredArgs = { "pool", "username", "algorithm" };
+            }
 
             for (const auto &arg : requiredArgs)
             {
@@ -773,16 +1125,32 @@ MinerConfig getMinerConfig(int argc, char **argv)
                 }
             }
 
-            if (!Utilities::parseAddressFromString(poolConfig.host, poolConfig.port, poolAddress))
+            if (solo)
             {
-                std::cout << WarningMsg("Failed to parse pool address!") << std::endl;
-                Console::exitOrWaitForInput(1);
+                if (!Utilities::parseAddressFromString(config.daemon.host, config.daemon.port, daemonAddress))
+                {
+                    std::cout << WarningMsg("Failed to parse daemon address!") << std::endl;
+                    Console::exitOrWaitForInput(1);
+                }
+
+                config.daemon.enabled = true;
+                config.daemon.walletAddress = poolConfig.username;
+                config.daemon.algorithm = poolConfig.algorithm;
             }
 
-            if (poolConfig.username == "")
+            if (!config.benchmark.enabled && !solo)
             {
-                std::cout << WarningMsg("Username cannot be empty!") << std::endl;
-                Console::exitOrWaitForInput(1);
+                if (!Utilities::parseAddressFromString(poolConfig.host, poolConfig.port, poolAddress))
+                {
+                    std::cout << WarningMsg("Failed to parse pool address!") << std::endl;
+                    Console::exitOrWaitForInput(1);
+                }
+
+                if (poolConfig.username == "")
+                {
+                    std::cout << WarningMsg("Username cannot be empty!") << std::endl;
+                    Console::exitOrWaitForInput(1);
+                }
             }
 
             #if !defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
@@ -815,7 +1183,11 @@ MinerConfig getMinerConfig(int argc, char **argv)
                 Console::exitOrWaitForInput(1);
             }
 
-            config.pools.push_back(poolConfig);
+            if (!config.benchmark.enabled && !solo)
+            {
+                config.pools.push_back(poolConfig);
+            }
+
             config.hardwareConfiguration->nvidia.devices = getNvidiaDevices();
             config.hardwareConfiguration->amd.devices = getAmdDevices();
             config.hardwareConfiguration->cpu.enabled = true;
@@ -826,6 +1198,51 @@ MinerConfig getMinerConfig(int argc, char **argv)
                 config.hardwareConfiguration->cpu.enabled = false;
             }
 
+            if (result.count("metricsPort") != 0)
+            {
+                config.metrics.enabled = true;
+            }
+
+            if (result.count("proxy") != 0)
+            {
+                config.proxy.enabled = true;
+            }
+
+            if (result.count("maxTemperature") != 0 || result.count("maxPower") != 0)
+            {
+                config.hardwareConfiguration->cpu.governor.enabled = true;
+
+                /* Only limit what was asked for */
+                if (result.count("maxTemperature") == 0)
+                {
+                    config.hardwareConfiguration->cpu.governor.maxTemperature = 0;
+                }
+            }
+
+            try
+            {
+                if (logLevel != "")
+                {
+                    config.log.level = Logger::stringToLogLevel(logLevel);
+                }
+
+                if (logCategories != "")
+                {
+                    config.log.categories = 0;
+
+                    for (auto category : Utilities::split(logCategories, ','))
+                    {
+                        Utilities::trim(category);
+                        config.log.categories |= Logger::categoryMask(Logger::stringToLogCategory(category));
+                    }
+                }
+            }
+            catch (const std::invalid_argument &e)
+            {
+                std::cout << WarningMsg("Failed to parse logging options: ") << WarningMsg(e.what()) << std::endl;
+                Console::exitOrWaitForInput(1);
+            }
+
             if (disableNVIDIA)
             {
                 for (auto &device : config.hardwareConfiguration->nvidia.devices)
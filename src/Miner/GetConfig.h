@@ -4,10 +4,17 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <thread>
 
+#include "Container/CgroupLimits.h"
+#include "Energy/CpuSensors.h"
+#include "Energy/Rapl.h"
+#include "Logger/Logger.h"
+#include "Types/DaemonConfig.h"
 #include "Types/Pool.h"
+#include "Types/PoolManagerConfig.h"
 #include "Argon2/Constants.h"
 
 #if defined(NVIDIA_ENABLED)
@@ -60,6 +67,26 @@ struct AmdDevice
     float desktopLag = 100.0;
 };
 
+struct GovernorConfig
+{
+    /* Park and unpark CPU threads to stay within the limits below */
+    bool enabled = false;
+
+    /* Degrees celsius of the hottest CPU sensor. Zero for no limit. */
+    double maxTemperature = 85;
+
+    /* Watts of CPU package and DRAM power, from RAPL. Zero for no limit. */
+    double maxPower = 0;
+
+    /* Never park more threads than would leave this many running */
+    uint32_t minThreads = 1;
+
+    /* Where to read the temperature and frequency from */
+    std::string hwmonRoot = CpuSensors::DEFAULT_HWMON_ROOT;
+
+    std::string cpuRoot = CpuSensors::DEFAULT_CPU_ROOT;
+};
+
 struct CpuConfig
 {
     bool enabled = true;
@@ -67,6 +94,19 @@ struct CpuConfig
     uint32_t threadCount = std::thread::hardware_concurrency();
 
     Constants::OptimizationMethod optimizationMethod = Constants::OptimizationMethod::AUTO;
+
+    /* Count cache misses, TLB misses and instructions per hash with
+       perf_event_open. Linux only. */
+    bool hardwareCounters = false;
+
+    /* Where to read the RAPL energy counters from, for hashes per joule */
+    std::string powercapRoot = Rapl::DEFAULT_ROOT;
+
+    /* Where to read the cpuset, CPU quota and memory limit of our container
+       from. threadCount is capped to fit them. */
+    std::string cgroupRoot = CgroupLimits::DEFAULT_ROOT;
+
+    GovernorConfig governor;
 };
 
 struct NvidiaConfig
@@ -102,21 +142,8 @@ struct HardwareConfig
 
         bool foundOurDevice = false;
 
-        if (cpu.enabled)
-        {
-            /* CPU will process one nonce per round, per thread */
-            nonceInfo.noncesPerRound += cpu.threadCount;
-
-            /* CPU will start processing nonces with no offset. */
-            if (device != "cpu")
-            {
-                nonceInfo.nonceOffset += cpu.threadCount;
-            }
-            else
-            {
-                foundOurDevice = true;
-            }
-        }
+        /* The CPU hashes ranges leased by the WorkScheduler instead, from a
+           different part of the nonce space, see MinerManager::setNewJob */
 
         for (auto &gpu : nvidia.devices)
         {
@@ -175,10 +202,86 @@ struct HardwareConfig
     }
 };
 
+struct MetricsConfig
+{
+    /* Should we serve hashrate, shares, etc over HTTP for monitoring */
+    bool enabled = false;
+
+    /* Address to listen on. Only localhost by default, as there's no auth. */
+    std::string host = "127.0.0.1";
+
+    uint16_t port = 9100;
+};
+
+struct ProxyConfig
+{
+    /* Serve our pool connection to other miners on the LAN, instead of
+       mining ourselves */
+    bool enabled = false;
+
+    /* Address to accept miners on. All interfaces by default, as the rigs
+       are on other machines. */
+    std::string host = "0.0.0.0";
+
+    uint16_t port = 3333;
+};
+
+/* Some of the CPU threads, mining their own pools at the same time as the
+   rest of the miner */
+struct PartitionConfig
+{
+    /* Shown in the stats, to tell the partitions apart */
+    std::string name;
+
+    /* Taken from the CPU thread count, the main pools get what's left */
+    uint32_t threadCount = 1;
+
+    std::vector<Pool> pools;
+};
+
+struct LogConfig
+{
+    /* Most verbose level of debug logging to print */
+    Logger::LogLevel level = Logger::DISABLED;
+
+    /* Which categories to print, a mask of Logger::categoryMask() */
+    uint32_t categories = Logger::ALL_CATEGORIES;
+};
+
+/* Only settable on the command line, never written to the config file */
+struct BenchmarkConfig
+{
+    /* Mine synthetic jobs offline and print a score, instead of mining to a pool */
+    bool enabled = false;
+
+    std::string algorithm;
+
+    /* How long to measure for, after warming up */
+    std::chrono::seconds duration = std::chrono::seconds(60);
+
+    /* Where to write the results as JSON */
+    std::string outputFile = "benchmark.json";
+};
+
 struct MinerConfig
 {
     std::vector<Pool> pools;
 
+    PoolManagerConfig poolManager;
+
+    /* Solo mine against a daemon instead of the pools */
+    DaemonConfig daemon;
+
+    MetricsConfig metrics;
+
+    ProxyConfig proxy;
+
+    std::vector<PartitionConfig> partitions;
+
+    LogConfig log;
+
+    BenchmarkConfig benchmark;
+
     std::string configLocation;
 
     std::shared_ptr<HardwareConfig> hardwareConfiguration = std::make_shared<HardwareConfig>();
@@ -2,14 +2,24 @@
 //
 // Please see the included LICENSE file for more information.
 
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <sstream>
 
 #include "ArgonVariants/Variants.h"
+#include "Benchmark/Benchmark.h"
 #include "Config/Config.h"
 #include "Config/Constants.h"
+#include "Container/CgroupLimits.h"
+#include "Logger/Logger.h"
+#include "Metrics/MetricsServer.h"
 #include "MinerManager/MinerManager.h"
 #include "Miner/GetConfig.h"
+#include "PoolCommunication/DaemonJobSource.h"
 #include "PoolCommunication/PoolCommunication.h"
+#include "Proxy/StratumProxy.h"
 #include "Types/Pool.h"
 #include "Utilities/ColouredMsg.h"
 #include "Utilities/GetChar.h"
@@ -39,11 +49,152 @@ std::vector<Pool> getDevPools()
     return pools;
 }
 
-void printWelcomeHeader(MinerConfig config)
+/* Cap the CPU threads to what the cpuset, CPU quota and memory limit of our
+   container allow. Every thread needs a scratchpad for the largest algorithm
+   we may be given, the dev pools included. Only the container can lower the
+   thread count, so oversubscribing bare metal on purpose still works. */
+ContainerLimits fitToContainer(MinerConfig &config)
+{
+    CpuConfig &cpu = config.hardwareConfiguration->cpu;
+
+    const ContainerLimits limits = CgroupLimits(cpu.cgroupRoot).read();
+
+    const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+
+    uint32_t threadLimit = std::numeric_limits<uint32_t>::max();
+
+    if (limits.threadLimit(hardwareThreads) < hardwareThreads)
+    {
+        threadLimit = limits.threadLimit(hardwareThreads);
+    }
+
+    std::vector<std::string> algorithms;
+
+    for (const auto &pool : getDevPools())
+    {
+        algorithms.push_back(pool.algorithm);
+    }
+
+    for (const auto &pool : config.pools)
+    {
+        algorithms.push_back(pool.algorithm);
+    }
+
+    for (const auto &partition : config.partitions)
+    {
+        for (const auto &pool : partition.pools)
+        {
+            algorithms.push_back(pool.algorithm);
+        }
+    }
+
+    if (config.daemon.enabled)
+    {
+        algorithms.push_back(config.daemon.algorithm);
+    }
+
+    if (config.benchmark.enabled)
+    {
+        algorithms.push_back(config.benchmark.algorithm);
+    }
+
+    uint64_t scratchpadBytes = 0;
+
+    for (const auto &algorithm : algorithms)
+    {
+        if (ArgonVariant::isSupportedAlgorithm(algorithm))
+        {
+            const uint64_t bytes = ArgonVariant::getCPUMiningAlgorithm(algorithm)->getMemory() * 1024ULL;
+
+            scratchpadBytes = std::max(scratchpadBytes, bytes);
+        }
+    }
+
+    if (limits.haveMemoryLimit && scratchpadBytes != 0)
+    {
+        const uint64_t memoryThreads = std::max<uint64_t>(limits.scratchpadBudget() / scratchpadBytes, 1);
+
+        threadLimit = static_cast<uint32_t>(std::min<uint64_t>(threadLimit, memoryThreads));
+    }
+
+    if (!cpu.enabled || cpu.threadCount <= threadLimit)
+    {
+        return limits;
+    }
+
+    std::cout << WarningMsg("Only " + std::to_string(threadLimit) + " of the " + std::to_string(cpu.threadCount)
+                          + " CPU threads fit in the limits of the container, mining with " + std::to_string(threadLimit) + ".")
+              << std::endl;
+
+    cpu.threadCount = threadLimit;
+
+    uint32_t partitionThreads = 0;
+
+    for (const auto &partition : config.partitions)
+    {
+        partitionThreads += partition.threadCount;
+    }
+
+    /* The main pools need at least one thread */
+    if (!config.partitions.empty() && partitionThreads >= cpu.threadCount)
+    {
+        std::cout << WarningMsg("Partitions use " + std::to_string(partitionThreads) + " threads, leaving none of the "
+                              + std::to_string(cpu.threadCount) + " threads the container allows for the main pools.")
+                  << std::endl;
+
+        Console::exitOrWaitForInput(1);
+    }
+
+    return limits;
+}
+
+std::string containerLimitsToString(const ContainerLimits &limits)
+{
+    std::vector<std::string> parts;
+
+    if (limits.haveCpuset)
+    {
+        parts.push_back(std::to_string(limits.cpusetCpus) + (limits.cpusetCpus == 1 ? " CPU" : " CPUs"));
+    }
+
+    if (limits.haveCpuQuota)
+    {
+        std::stringstream stream;
+
+        stream << std::fixed << std::setprecision(2) << limits.cpuQuota << " CPUs of quota";
+
+        parts.push_back(stream.str());
+    }
+
+    if (limits.haveMemoryLimit)
+    {
+        parts.push_back(std::to_string(limits.memoryLimit / (1024 * 1024)) + " MiB of memory");
+    }
+
+    std::string result;
+
+    for (const auto &part : parts)
+    {
+        result += (result.empty() ? "" : ", ") + part;
+    }
+
+    return result;
+}
+
+void printWelcomeHeader(MinerConfig config, const ContainerLimits &limits)
 {
     std::cout << InformationMsg("* ") << WhiteMsg("ABOUT", 25) << InformationMsg("TRRXITTEminer " + Constants::VERSION) << std::endl
-              << InformationMsg("* ") << WhiteMsg("THREADS", 25) << InformationMsg(config.hardwareConfiguration->cpu.threadCount) << std::endl
-              << InformationMsg("* ") << WhiteMsg("OPTIMIZATION SUPPORT", 25);
+              << InformationMsg("* ") << WhiteMsg("THREADS", 25) << InformationMsg(config.hardwareConfiguration->cpu.threadCount) << std::endl;
+
+    const std::string containerLimits = containerLimitsToString(limits);
+
+    if (!containerLimits.empty())
+    {
+        std::cout << InformationMsg("* ") << WhiteMsg("CONTAINER LIMITS", 25) << InformationMsg(containerLimits)
+                  << InformationMsg(" (cgroup v" + std::to_string(limits.cgroupVersion) + ")") << std::endl;
+    }
+
+    std::cout << InformationMsg("* ") << WhiteMsg("OPTIMIZATION SUPPORT", 25);
 
     std::vector<std::tuple<Constants::OptimizationMethod, bool>> availableOptimizations;
 
@@ -56,13 +207,20 @@ void printWelcomeHeader(MinerConfig config)
         { Constants::AVX2, features.avx2 },
         { Constants::SSE41, features.sse4_1 },
         { Constants::SSSE3, features.ssse3 },
-        { Constants::SSE2, features.sse2 }
+        { Constants::SSE2, features.sse2 },
+        { Constants::PORTABLE, Constants::PORTABLE_KERNEL_AVAILABLE }
     };
 
 #elif defined(ARMV8_OPTIMIZATIONS)
-    availableOptimizations = { { Constants::NEON, true} }; /* All ARMv8 cpus have NEON optimizations */
+    availableOptimizations = {
+        { Constants::NEON, true }, /* All ARMv8 cpus have NEON optimizations */
+        { Constants::PORTABLE, Constants::PORTABLE_KERNEL_AVAILABLE }
+    };
 #else
-    availableOptimizations = {{ Constants::NONE, false } };
+    availableOptimizations = {
+        { Constants::PORTABLE, Constants::PORTABLE_KERNEL_AVAILABLE },
+        { Constants::NONE, false }
+    };
 #endif
 
     for (const auto &[optimization, enabled] : availableOptimizations)
@@ -112,7 +270,17 @@ void printWelcomeHeader(MinerConfig config)
               << std::endl << std::endl;
 }
 
-void interact(MinerManager &userMinerManager, MinerManager &devMinerManager)
+/* Some of the CPU threads, mining their own pools alongside the main ones */
+struct Partition
+{
+    std::string name;
+
+    std::shared_ptr<PoolCommunication> pool;
+
+    std::unique_ptr<MinerManager> manager;
+};
+
+void interact(MinerManager &userMinerManager, const std::vector<Partition> &partitions)
 {
     std::string input;
 
@@ -125,6 +293,12 @@ void interact(MinerManager &userMinerManager, MinerManager &devMinerManager)
             case 'h':
             {
                 userMinerManager.printStats();
+
+                for (const auto &partition : partitions)
+                {
+                    partition.manager->printStats();
+                }
+
                 break;
             }
             default:
@@ -136,6 +310,78 @@ void interact(MinerManager &userMinerManager, MinerManager &devMinerManager)
     }
 }
 
+/* The hardware a partition mines with: threadCount CPU threads, and none of
+   the GPUs, which stay with the main pools. The energy counters and sensors
+   cover the whole CPU, so the partitions don't read them, and the governor
+   only parks threads of the main pools. */
+std::shared_ptr<HardwareConfig> getPartitionHardware(
+    const HardwareConfig &hardwareConfig,
+    const uint32_t threadCount)
+{
+    auto partitionConfig = std::make_shared<HardwareConfig>(hardwareConfig);
+
+    partitionConfig->cpu.threadCount = threadCount;
+    partitionConfig->cpu.governor.enabled = false;
+    partitionConfig->cpu.powercapRoot = "";
+
+    for (auto &gpu : partitionConfig->nvidia.devices)
+    {
+        gpu.enabled = false;
+    }
+
+    for (auto &gpu : partitionConfig->amd.devices)
+    {
+        gpu.enabled = false;
+    }
+
+    return partitionConfig;
+}
+
+Partition makePartition(
+    const std::string &name,
+    const std::vector<Pool> &pools,
+    const PoolManagerConfig &poolManagerConfig,
+    const HardwareConfig &hardwareConfig,
+    const uint32_t threadCount)
+{
+    Partition partition;
+
+    partition.name = name;
+    partition.pool = std::make_shared<PoolCommunication>(pools, poolManagerConfig);
+
+    /* Quiet, the main pools have already warned about any missing hardware */
+    partition.manager = std::make_unique<MinerManager>(
+        partition.pool,
+        getPartitionHardware(hardwareConfig, threadCount),
+        true
+    );
+
+    std::cout << InformationMsg("* ") << WhiteMsg("PARTITION", 25)
+              << SuccessMsg(name) << InformationMsg(" (" + std::to_string(threadCount) + " threads)")
+              << std::endl;
+
+    return partition;
+}
+
+/* Share the pool connection with the rigs on the LAN, instead of mining */
+void runProxy(const MinerConfig &config, const std::shared_ptr<IJobSource> &pool)
+{
+    StratumProxy proxy(pool, config.proxy.host, config.proxy.port);
+
+    proxy.start();
+
+    std::cout << InformationMsg("* ") << WhiteMsg("PROXY", 25)
+              << SuccessMsg(config.proxy.host + ":" + std::to_string(proxy.port()))
+              << std::endl << std::endl;
+
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(20));
+
+        proxy.printStats();
+    }
+}
+
 void start(int argc, char **argv)
 {
     /* Get the pools, algorithm, etc from the user in some way */
@@ -144,20 +390,154 @@ void start(int argc, char **argv)
     /* Set the global config */
     Config::config.optimizationMethod = config.hardwareConfiguration->cpu.optimizationMethod;
 
+    Logger::logger.setLogLevel(config.log.level);
+    Logger::logger.setLogCategories(config.log.categories);
+
+    const ContainerLimits limits = fitToContainer(config);
+
     /* Print welcome header, version, devices, etc */
-    printWelcomeHeader(config);
+    printWelcomeHeader(config, limits);
+
+    if (config.benchmark.enabled)
+    {
+        const BenchmarkResult result = runBenchmark(config);
+
+        printBenchmarkResult(result);
+
+        std::ofstream outputFile(config.benchmark.outputFile);
+
+        if (outputFile)
+        {
+            outputFile << nlohmann::json(result).dump(4) << std::endl;
+
+            std::cout << std::endl << SuccessMsg("Wrote benchmark results to " + config.benchmark.outputFile) << std::endl;
+        }
+        else
+        {
+            std::cout << std::endl << WarningMsg("Failed to write benchmark results to " + config.benchmark.outputFile) << std::endl;
+        }
+
+        return;
+    }
+
+    std::shared_ptr<IJobSource> userPoolManager;
+
+    /* Straight to the daemon, skipping the pool */
+    if (config.daemon.enabled)
+    {
+        userPoolManager = std::make_shared<DaemonJobSource>(config.daemon);
+    }
+    else
+    {
+        userPoolManager = std::make_shared<PoolCommunication>(config.pools, config.poolManager);
+    }
 
-    const auto userPoolManager = std::make_shared<PoolCommunication>(config.pools);
+    if (config.proxy.enabled)
+    {
+        runProxy(config, userPoolManager);
+        return;
+    }
 
     /* Get the dev pools */
     std::vector<Pool> devPools = getDevPools();
 
     const auto devPoolManager = std::make_shared<PoolCommunication>(devPools);
 
+    HardwareConfig &hardwareConfig = *config.hardwareConfiguration;
+
+    std::vector<Partition> partitions;
+
+    /* The CPU threads left for the user pools, once the partitions have theirs */
+    uint32_t userThreads = hardwareConfig.cpu.threadCount;
+
+    if (!config.partitions.empty() && !hardwareConfig.cpu.enabled)
+    {
+        std::cout << WarningMsg("CPU mining disabled, ignoring the partitions.") << std::endl;
+    }
+    else
+    {
+        for (const auto &partitionConfig : config.partitions)
+        {
+            partitions.push_back(makePartition(
+                partitionConfig.name,
+                partitionConfig.pools,
+                config.poolManager,
+                hardwareConfig,
+                partitionConfig.threadCount
+            ));
+
+            userThreads -= partitionConfig.threadCount;
+        }
+    }
+
+    /* Mine for the dev continuously on a share of the threads, instead of
+       stopping the user pools for a while every cycle. Only once the fee
+       comes to a whole thread. */
+    const uint32_t devThreads = hardwareConfig.cpu.enabled
+        ? static_cast<uint32_t>(hardwareConfig.cpu.threadCount * Constants::DEV_FEE_PERCENT / 100)
+        : 0;
+
+    const bool continuousDevFee = devThreads != 0 && devThreads < userThreads;
+
+    if (continuousDevFee)
+    {
+        partitions.push_back(makePartition("Dev fee", devPools, PoolManagerConfig(), hardwareConfig, devThreads));
+
+        userThreads -= devThreads;
+    }
+
+    if (!partitions.empty())
+    {
+        std::cout << std::endl;
+    }
+
+    hardwareConfig.cpu.threadCount = userThreads;
+
     /* Setup a manager for the user pools and the dev pools */
     MinerManager userMinerManager(userPoolManager, config.hardwareConfiguration, false);
     MinerManager devMinerManager(devPoolManager, config.hardwareConfiguration, true);
 
+    /* The energy counters see the partitions mining too, so hashes per joule
+       of the main pools would be wrong */
+    if (!partitions.empty())
+    {
+        const std::string reason = "The CPU is shared with the partitions";
+
+        userMinerManager.setEnergyUnavailable(reason);
+        devMinerManager.setEnergyUnavailable(reason);
+    }
+
+    std::unique_ptr<MetricsServer> metricsServer;
+
+    if (config.metrics.enabled)
+    {
+        auto optimization = config.hardwareConfiguration->cpu.optimizationMethod;
+
+        if (optimization == Constants::AUTO)
+        {
+            optimization = getAutoChosenOptimization();
+        }
+
+        const std::string optimizationName = Constants::optimizationMethodToString(optimization);
+
+        metricsServer = std::make_unique<MetricsServer>(
+            config.metrics.host,
+            config.metrics.port,
+            [&userMinerManager, optimizationName]()
+            {
+                MinerStats stats = userMinerManager.getStats();
+                stats.optimizationMethod = optimizationName;
+                return stats;
+            }
+        );
+
+        metricsServer->start();
+
+        std::cout << InformationMsg("* ") << WhiteMsg("METRICS", 25)
+                  << SuccessMsg("http://" + config.metrics.host + ":" + std::to_string(config.metrics.port) + "/metrics")
+                  << std::endl << std::endl;
+    }
+
     /* A cycle lasts 300 minutes */
     const auto cycleLength = std::chrono::minutes(300);
 
@@ -167,13 +547,17 @@ void start(int argc, char **argv)
     /* We mine for the user for the rest of the time */
     const auto userMiningTime = cycleLength - devMiningTime;
 
-    if (Constants::DEV_FEE_PERCENT == 0)
+    for (auto &partition : partitions)
+    {
+        partition.manager->start();
+    }
+
+    if (Constants::DEV_FEE_PERCENT == 0 || continuousDevFee)
     {
-       
-        /* No dev fee, just start the users mining */
+        /* No dev fee to swap to, just start the users mining */
         userMinerManager.start();
 
-        std::thread interactionThread(interact, std::ref(userMinerManager), std::ref(devMinerManager));
+        std::thread interactionThread(interact, std::ref(userMinerManager), std::cref(partitions));
 
         /* Wait forever */
         std::promise<void>().get_future().wait();
@@ -187,7 +571,7 @@ void start(int argc, char **argv)
         /* Start mining for the user */
         userMinerManager.start();
 
-        std::thread interactionThread(interact, std::ref(userMinerManager), std::ref(devMinerManager));
+        std::thread interactionThread(interact, std::ref(userMinerManager), std::cref(partitions));
 
         /* 100 minute rounds, alternating between users pool and devs pool */
         while (true)
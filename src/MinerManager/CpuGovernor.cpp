@@ -0,0 +1,145 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+////////////////////////////////////
+#include "MinerManager/CpuGovernor.h"
+////////////////////////////////////
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+    /* Give the temperature time to respond before parking another thread */
+    const uint32_t SECONDS_BETWEEN_PARKING = 5;
+
+    /* How long we need headroom before unparking a thread */
+    const uint32_t SECONDS_BEFORE_UNPARKING = 30;
+
+    /* How far under the temperature limit counts as headroom */
+    const double TEMPERATURE_HYSTERESIS = 5;
+}
+
+CpuGovernor::CpuGovernor(const GovernorConfig &config, const uint32_t threadCount):
+    m_config(config),
+    m_threadCount(threadCount),
+    m_activeThreads(threadCount)
+{
+    m_stats.enabled = true;
+    m_stats.threadCount = threadCount;
+    m_stats.activeThreads = threadCount;
+}
+
+bool CpuGovernor::overLimit(const CpuSensorReading &reading, const double watts, std::string &reason) const
+{
+    std::stringstream stream;
+
+    if (m_config.maxTemperature != 0 && reading.haveTemperature && reading.temperature > m_config.maxTemperature)
+    {
+        stream << "temperature " << reading.temperature << "C over the limit of " << m_config.maxTemperature << "C";
+    }
+    else if (m_config.maxPower != 0 && watts > m_config.maxPower)
+    {
+        stream << "power " << watts << "W over the limit of " << m_config.maxPower << "W";
+    }
+    else
+    {
+        return false;
+    }
+
+    reason = stream.str();
+
+    return true;
+}
+
+bool CpuGovernor::hasHeadroom(const CpuSensorReading &reading, const double watts) const
+{
+    if (m_config.maxTemperature != 0 && reading.haveTemperature
+     && reading.temperature > m_config.maxTemperature - TEMPERATURE_HYSTERESIS)
+    {
+        return false;
+    }
+
+    /* Assume another thread would draw the same as the average running one */
+    if (m_config.maxPower != 0 && m_activeThreads != 0
+     && watts + watts / m_activeThreads > m_config.maxPower)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t CpuGovernor::update(const CpuSensorReading &reading, const double watts)
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_secondsSinceChange++;
+
+    std::string reason;
+
+    /* The CPU is already slowing down every core, so act straight away */
+    const bool throttling = reading.haveThrottleCount && m_haveThrottleCount
+        && reading.throttleCount > m_lastThrottleCount;
+
+    if (throttling)
+    {
+        reason = "CPU is thermal throttling";
+    }
+
+    if (throttling || overLimit(reading, watts, reason))
+    {
+        m_secondsWithHeadroom = 0;
+
+        if (m_activeThreads > std::max<uint32_t>(m_config.minThreads, 1)
+         && (throttling || m_secondsSinceChange >= SECONDS_BETWEEN_PARKING))
+        {
+            m_activeThreads--;
+            m_secondsSinceChange = 0;
+            m_stats.lastChange = "Parked a thread, " + reason;
+        }
+    }
+    else if (m_activeThreads < m_threadCount && hasHeadroom(reading, watts))
+    {
+        m_secondsWithHeadroom++;
+
+        if (m_secondsWithHeadroom >= SECONDS_BEFORE_UNPARKING)
+        {
+            m_activeThreads++;
+            m_secondsSinceChange = 0;
+            m_secondsWithHeadroom = 0;
+            m_stats.lastChange = "Unparked a thread, back under the limits";
+        }
+    }
+    else
+    {
+        m_secondsWithHeadroom = 0;
+    }
+
+    if (reading.haveThrottleCount)
+    {
+        if (m_haveThrottleCount && reading.throttleCount > m_lastThrottleCount)
+        {
+            m_stats.throttleEvents += reading.throttleCount - m_lastThrottleCount;
+        }
+
+        m_haveThrottleCount = true;
+        m_lastThrottleCount = reading.throttleCount;
+    }
+
+    m_stats.activeThreads = m_activeThreads;
+    m_stats.haveTemperature = reading.haveTemperature;
+    m_stats.temperature = reading.temperature;
+    m_stats.haveFrequency = reading.haveFrequency;
+    m_stats.frequency = reading.frequency;
+    m_stats.watts = watts;
+
+    return m_activeThreads;
+}
+
+GovernorStats CpuGovernor::getStats() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_stats;
+}
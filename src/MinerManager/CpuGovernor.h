@@ -0,0 +1,55 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <mutex>
+
+#include "Energy/CpuSensors.h"
+#include "Miner/GetConfig.h"
+#include "Types/MinerStats.h"
+
+/* Decides how many CPU threads to run to stay within a temperature and power
+   envelope. Running into the limit makes the CPU throttle every core, which
+   usually costs more hashrate than parking a thread, so we back off as soon
+   as we go over, and only add a thread back once we've had plenty of headroom
+   for a while. */
+class CpuGovernor
+{
+  public:
+    CpuGovernor(const GovernorConfig &config, const uint32_t threadCount);
+
+    /* Feed in the latest readings, once a second. watts is zero if unknown.
+       Returns how many threads should be hashing. */
+    uint32_t update(const CpuSensorReading &reading, const double watts);
+
+    GovernorStats getStats() const;
+
+  private:
+    /* Over the temperature or power limit */
+    bool overLimit(const CpuSensorReading &reading, const double watts, std::string &reason) const;
+
+    /* Comfortably under every limit, even with another thread running */
+    bool hasHeadroom(const CpuSensorReading &reading, const double watts) const;
+
+    const GovernorConfig m_config;
+
+    const uint32_t m_threadCount;
+
+    uint32_t m_activeThreads;
+
+    /* Seconds since we last parked or unparked a thread */
+    uint32_t m_secondsSinceChange = 0;
+
+    /* Consecutive seconds with headroom */
+    uint32_t m_secondsWithHeadroom = 0;
+
+    bool m_haveThrottleCount = false;
+
+    uint64_t m_lastThrottleCount = 0;
+
+    GovernorStats m_stats;
+
+    mutable std::mutex m_mutex;
+};
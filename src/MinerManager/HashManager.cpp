@@ -6,22 +6,25 @@
 #include "MinerManager/HashManager.h"
 ////////////////////////////////////
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <sstream>
 
 #include "Utilities/ColouredMsg.h"
 
-HashManager::HashManager(
-    const std::shared_ptr<PoolCommunication> pool):
-    m_pool(pool)
+namespace
 {
+    std::atomic<uint64_t> nextHashManagerID = 0;
 }
 
-bool isHashValidForTarget(
-    const uint8_t *hash,
-    const uint64_t target)
+HashManager::HashManager(
+    const std::shared_ptr<IJobSource> pool):
+    m_pool(pool),
+    m_id(nextHashManagerID++)
 {
-    return *reinterpret_cast<const uint64_t *>(hash + 24) < target;
 }
 
 void HashManager::incrementHashesPerformed(
@@ -33,24 +36,124 @@ void HashManager::incrementHashesPerformed(
         m_effectiveStartTime = std::chrono::high_resolution_clock::now();
     }
 
-    m_hashProducers[device].totalHashes += hashesPerformed;
+    getHashDevice(device).totalHashes += hashesPerformed;
 
     m_totalHashes += hashesPerformed;
 }
 
-void HashManager::submitValidHash(const JobSubmit &jobSubmit)
+HashDevice &HashManager::getHashDevice(const std::string &deviceName)
 {
-    m_submittedHashes++;
-    m_pool->submitShare(jobSubmit.hash, jobSubmit.jobID, jobSubmit.nonce);
+    /* Each hashing thread submits for a single device, so caching the last
+       lookup avoids taking the lock on every hash. References into an
+       unordered_map remain valid when other elements are inserted. */
+    struct DeviceCache
+    {
+        uint64_t managerID = std::numeric_limits<uint64_t>::max();
+        std::string deviceName;
+        HashDevice *device = nullptr;
+    };
+
+    thread_local DeviceCache cache;
+
+    if (cache.device == nullptr || cache.managerID != m_id || cache.deviceName != deviceName)
+    {
+        std::scoped_lock lock(m_hashProducersMutex);
+
+        cache.managerID = m_id;
+        cache.deviceName = deviceName;
+        cache.device = &m_hashProducers[deviceName];
+    }
+
+    return *cache.device;
 }
 
-void HashManager::submitHash(const JobSubmit &jobSubmit)
+void HashManager::updatePerformanceStats(const std::vector<PerformanceStats> &threadStats)
 {
-    incrementHashesPerformed(1, jobSubmit.hardwareIdentifier);
+    const auto now = std::chrono::steady_clock::now();
 
-    if (isHashValidForTarget(jobSubmit.hash, jobSubmit.target))
+    std::scoped_lock lock(m_statsMutex, m_hashProducersMutex);
+
+    for (auto &[deviceName, device] : m_hashProducers)
     {
-        submitValidHash(jobSubmit);
+        device.hashrate.update(device.totalHashes, now);
+    }
+
+    m_totalHashrate.update(m_totalHashes, now);
+
+    m_threadStats = threadStats;
+}
+
+void HashManager::startEnergyMeasurement()
+{
+    std::scoped_lock lock(m_statsMutex, m_hashProducersMutex);
+
+    const auto cpu = m_hashProducers.find("CPU");
+
+    m_lastEnergyHashes = cpu == m_hashProducers.end() ? 0 : cpu->second.totalHashes.load();
+}
+
+void HashManager::recordEnergy(
+    const EnergySample &sample,
+    const std::string &optimizationMethod,
+    const uint32_t threadCount,
+    const std::string &algorithm)
+{
+    std::scoped_lock lock(m_statsMutex, m_hashProducersMutex);
+
+    /* RAPL only covers the CPU and memory, so GPU hashes don't count */
+    const auto cpu = m_hashProducers.find("CPU");
+
+    const uint64_t cpuHashes = cpu == m_hashProducers.end() ? 0 : cpu->second.totalHashes.load();
+
+    const uint64_t hashes = cpuHashes >= m_lastEnergyHashes ? cpuHashes - m_lastEnergyHashes : cpuHashes;
+
+    m_lastEnergyHashes = cpuHashes;
+
+    m_energy.available = true;
+    m_energy.packageJoules += sample.joules[PACKAGE];
+    m_energy.dramJoules += sample.joules[DRAM];
+
+    auto it = std::find_if(m_energy.configurations.begin(), m_energy.configurations.end(), [&](const auto &configuration)
+    {
+        return configuration.optimizationMethod == optimizationMethod
+            && configuration.threadCount == threadCount
+            && configuration.algorithm == algorithm;
+    });
+
+    if (it == m_energy.configurations.end())
+    {
+        EfficiencyStats configuration;
+
+        configuration.optimizationMethod = optimizationMethod;
+        configuration.threadCount = threadCount;
+        configuration.algorithm = algorithm;
+
+        it = m_energy.configurations.insert(m_energy.configurations.end(), configuration);
+    }
+
+    it->hashes += hashes;
+    it->joules += sample.totalJoules();
+    it->seconds += sample.seconds;
+}
+
+void HashManager::setEnergyUnavailable(const std::string &error)
+{
+    std::scoped_lock lock(m_statsMutex);
+
+    m_energy.available = false;
+    m_energy.error = error;
+}
+
+void HashManager::submitValidHash(const JobSubmit &jobSubmit)
+{
+    /* Count it before sending, otherwise the pool can accept it before we've
+       counted it */
+    m_submittedHashes++;
+
+    /* Stale share, or not connected, the pool will never see it */
+    if (!m_pool->submitShare(jobSubmit.hash, jobSubmit.jobID, jobSubmit.nonce))
+    {
+        m_submittedHashes--;
     }
 }
 
@@ -85,6 +188,52 @@ void HashManager::shareAccepted()
     std::cout << InformationMsg(stream.str());
 }
 
+MinerStats HashManager::getStats()
+{
+    const auto elapsedTime = std::chrono::high_resolution_clock::now() - m_effectiveStartTime;
+
+    const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsedTime).count();
+
+    const auto makeDeviceStats = [milliseconds](
+        const std::string &name,
+        const uint64_t totalHashes,
+        const RollingHashrate &hashrate)
+    {
+        DeviceStats stats;
+
+        stats.deviceName = name;
+        stats.totalHashes = totalHashes;
+
+        if (milliseconds != 0)
+        {
+            stats.hashrateAverage = 1000 * static_cast<double>(totalHashes) / milliseconds;
+        }
+
+        stats.hashrate10s = hashrate.tenSeconds();
+        stats.hashrate60s = hashrate.sixtySeconds();
+        stats.hashrate15m = hashrate.fifteenMinutes();
+
+        return stats;
+    };
+
+    MinerStats stats;
+
+    std::scoped_lock lock(m_statsMutex, m_hashProducersMutex);
+
+    for (const auto &[device, hashes] : m_hashProducers)
+    {
+        stats.devices.push_back(makeDeviceStats(device, hashes.totalHashes, hashes.hashrate));
+    }
+
+    stats.total = makeDeviceStats("Total", m_totalHashes, m_totalHashrate);
+    stats.threads = m_threadStats;
+    stats.energy = m_energy;
+    stats.submittedShares = m_submittedHashes;
+    stats.acceptedShares = m_acceptedHashes;
+
+    return stats;
+}
+
 void HashManager::printStats()
 {
     const auto elapsedTime = std::chrono::high_resolution_clock::now() - m_effectiveStartTime;
@@ -92,41 +241,142 @@ void HashManager::printStats()
     /* Calculating in milliseconds for more accuracy */
     const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsedTime).count();
 
-    for (const auto &[device, hashes] : m_hashProducers)
+    const auto printHashrate = [this, milliseconds](
+        const std::string &name,
+        const uint64_t totalHashes,
+        const RollingHashrate &hashrate)
     {
         m_pool->printPool();
 
-        std::cout << WhiteMsg(device, 20);
+        std::cout << WhiteMsg(name, 20);
 
-        if (milliseconds != 0 && hashes.totalHashes != 0)
+        if (milliseconds != 0 && totalHashes != 0)
         {
-            const double hashratePerSecond = (1000 * static_cast<double>(hashes.totalHashes) / milliseconds);
+            const double hashratePerSecond = (1000 * static_cast<double>(totalHashes) / milliseconds);
 
             std::cout << std::fixed << std::setprecision(2) << "| "
-                      << WhiteMsg(hashratePerSecond) << WhiteMsg(" H/s") << std::endl;
+                      << WhiteMsg(hashratePerSecond) << WhiteMsg(" H/s")
+                      << InformationMsg(" (10s: ") << InformationMsg(hashrate.tenSeconds())
+                      << InformationMsg(", 60s: ") << InformationMsg(hashrate.sixtySeconds())
+                      << InformationMsg(", 15m: ") << InformationMsg(hashrate.fifteenMinutes())
+                      << InformationMsg(")") << std::endl;
         }
         else
         {
             std::cout << WhiteMsg("N/A") << std::endl;
         }
+    };
+
+    std::scoped_lock lock(m_statsMutex, m_hashProducersMutex);
+
+    for (const auto &[device, hashes] : m_hashProducers)
+    {
+        printHashrate(device, hashes.totalHashes, hashes.hashrate);
     }
 
     if (m_hashProducers.size() > 1)
     {
+        printHashrate("Total Hashrate", m_totalHashes, m_totalHashrate);
+    }
+
+    for (const auto &configuration : m_energy.configurations)
+    {
+        if (configuration.joules == 0)
+        {
+            continue;
+        }
+
         m_pool->printPool();
 
-        std::cout << WhiteMsg("Total Hashrate", 20);
+        std::cout << std::fixed << std::setprecision(2)
+                  << WhiteMsg("CPU efficiency", 20) << "| "
+                  << WhiteMsg(configuration.hashesPerJoule()) << WhiteMsg(" H/J")
+                  << InformationMsg(" (") << InformationMsg(configuration.watts()) << InformationMsg(" W, ")
+                  << InformationMsg(configuration.optimizationMethod) << InformationMsg(", ")
+                  << InformationMsg(configuration.threadCount) << InformationMsg(" threads, ")
+                  << InformationMsg(configuration.algorithm) << InformationMsg(")") << std::endl;
+    }
+
+    /* Group the thread stats by device */
+    std::map<std::string, std::vector<PerformanceStats>> deviceThreads;
+
+    for (const auto &stats : m_threadStats)
+    {
+        deviceThreads[stats.deviceName].push_back(stats);
+    }
+
+    for (const auto &[device, threads] : deviceThreads)
+    {
+        PerformanceStats combined;
 
-        if (milliseconds != 0 && m_totalHashes != 0)
+        std::vector<double> hashrates;
+
+        /* Each thread has its own memory traffic, so sum rather than average */
+        double memoryBandwidth = 0;
+
+        for (const auto &thread : threads)
+        {
+            for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+            {
+                combined.latencyHistogram[i] += thread.latencyHistogram[i];
+            }
+
+            if (!thread.parked)
+            {
+                hashrates.push_back(thread.hashrate10s);
+            }
+
+            combined.hardwareCounters += thread.hardwareCounters;
+            memoryBandwidth += thread.hardwareCounters.memoryBandwidth();
+        }
+
+        if (combined.latencyPercentile(50) != 0)
         {
-            const double hashratePerSecond = (1000 * static_cast<double>(m_totalHashes) / milliseconds);
+            m_pool->printPool();
 
-            std::cout << std::fixed << std::setprecision(2) << "| "
-                      << WhiteMsg(hashratePerSecond) << WhiteMsg(" H/s") << std::endl;
+            std::cout << WhiteMsg(device + " latency", 20) << "| "
+                      << WhiteMsg("p50: <") << WhiteMsg(combined.latencyPercentile(50)) << WhiteMsg("us")
+                      << WhiteMsg(", p99: <") << WhiteMsg(combined.latencyPercentile(99)) << WhiteMsg("us")
+                      << std::endl;
         }
-        else
+
+        if (combined.hardwareCounters.available() && combined.hardwareCounters.hashes != 0)
         {
-            std::cout << WhiteMsg("N/A") << std::endl;
+            const auto &hardware = combined.hardwareCounters;
+
+            m_pool->printPool();
+
+            std::cout << std::fixed << std::setprecision(2)
+                      << WhiteMsg(device + " counters", 20) << "| "
+                      << WhiteMsg("IPC: ") << WhiteMsg(hardware.instructionsPerCycle())
+                      << WhiteMsg(", LLC misses/hash: ") << WhiteMsg(hardware.perHash(LLC_MISSES))
+                      << WhiteMsg(", dTLB misses/hash: ") << WhiteMsg(hardware.perHash(DTLB_MISSES))
+                      << WhiteMsg(", memory: ") << WhiteMsg(memoryBandwidth / (1024 * 1024)) << WhiteMsg(" MiB/s")
+                      << std::endl;
+        }
+
+        if (hashrates.size() < 2)
+        {
+            continue;
+        }
+
+        std::nth_element(hashrates.begin(), hashrates.begin() + hashrates.size() / 2, hashrates.end());
+
+        const double median = hashrates[hashrates.size() / 2];
+
+        /* Point out any threads which are lagging well behind the others,
+           likely due to being scheduled on a busy or hyperthreaded core */
+        for (const auto &thread : threads)
+        {
+            if (!thread.parked && median > 0 && thread.hashrate10s < median / 2)
+            {
+                m_pool->printPool();
+
+                std::cout << std::fixed << std::setprecision(2)
+                          << WarningMsg(device + " thread " + std::to_string(thread.threadNumber) + " is running slowly: ")
+                          << WarningMsg(thread.hashrate10s) << WarningMsg(" H/s, median ")
+                          << WarningMsg(median) << WarningMsg(" H/s") << std::endl;
+            }
         }
     }
 
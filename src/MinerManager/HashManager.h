@@ -6,21 +6,24 @@
 
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "Energy/Rapl.h"
 #include "Types/HashDevice.h"
 #include "Types/JobSubmit.h"
-#include "PoolCommunication/PoolCommunication.h"
+#include "Types/MinerStats.h"
+#include "Types/PerformanceStats.h"
+#include "PoolCommunication/IJobSource.h"
 
 class HashManager
 {
   public:
-    HashManager(const std::shared_ptr<PoolCommunication> pool);
+    HashManager(const std::shared_ptr<IJobSource> pool);
 
     /* Used to increment the number of hashes performed. Should be used along
-       with submitValidHash. submitHash will increment the hashes performed
-       on your behalf. */
+       with submitValidHash. */
     void incrementHashesPerformed(
         const uint32_t hashesPerformed,
         const std::string &deviceName);
@@ -28,9 +31,6 @@ class HashManager
     /* Call this to submit a hash to the pool that is above the diff. */
     void submitValidHash(const JobSubmit &jobSubmit);
 
-    /* Call this to submit a hash to the pool. We will check the diff. */
-    void submitHash(const JobSubmit &jobSubmit);
-
     /* Call this when a share got accepted by the pool. */
     void shareAccepted();
 
@@ -45,8 +45,33 @@ class HashManager
 
     /* Reset accepted/submitted count, for example when changing pools */
     void resetShareCount();
-    
+
+    /* Feed in the latest per thread stats from the backends, and update the
+       decayed hashrates. Should be called roughly once a second. */
+    void updatePerformanceStats(const std::vector<PerformanceStats> &threadStats);
+
+    /* Only count CPU hashes and energy from now on, e.g. after resuming */
+    void startEnergyMeasurement();
+
+    /* Record the CPU energy used since the last call, and the CPU hashes
+       performed in that time, against the configuration we are mining with */
+    void recordEnergy(
+        const EnergySample &sample,
+        const std::string &optimizationMethod,
+        const uint32_t threadCount,
+        const std::string &algorithm);
+
+    /* The energy counters can't be read, report why in the stats */
+    void setEnergyUnavailable(const std::string &error);
+
+    /* Get a copy of the current hashrates and share counts. Pool info and
+       optimization method are left for the caller to fill in. */
+    MinerStats getStats();
+
   private:
+    /* Get the device to increment the hashes of, inserting it if needed */
+    HashDevice &getHashDevice(const std::string &deviceName);
+
     /* Total number of hashes we have performed */
     std::atomic<uint64_t> m_totalHashes = 0;
 
@@ -56,7 +81,7 @@ class HashManager
     /* Total number of submitted hashes that were accepted by the pool */
     std::atomic<uint64_t> m_acceptedHashes = 0;
 
-    const std::shared_ptr<PoolCommunication> m_pool;
+    const std::shared_ptr<IJobSource> m_pool;
 
     /* The effective time we started mining. When we start/stop, we alter this
        based on when we stopped. So, taking now() - effectiveStartTime should
@@ -70,4 +95,26 @@ class HashManager
     bool m_paused = false;
 
     std::unordered_map<std::string, HashDevice> m_hashProducers;
+
+    /* Guards insertion into and iteration of m_hashProducers. The hashing
+       threads cache a pointer to their device, so only take it once. */
+    std::mutex m_hashProducersMutex;
+
+    /* Unique per instance, used to key the hash device cache */
+    const uint64_t m_id;
+
+    /* Decayed hashrate over all devices */
+    RollingHashrate m_totalHashrate;
+
+    /* The latest per thread stats from the backends */
+    std::vector<PerformanceStats> m_threadStats;
+
+    /* Energy used, and hashes per joule of each configuration */
+    EnergyStats m_energy;
+
+    /* CPU hashes as of the last energy sample */
+    uint64_t m_lastEnergyHashes = 0;
+
+    /* Guards m_threadStats, m_energy and the rolling hashrates */
+    std::mutex m_statsMutex;
 };
@@ -19,8 +19,17 @@
 #include "Backend/Nvidia/Nvidia.h"
 #endif
 
+namespace
+{
+    /* The nonces we may alter. Nicehash pools keep the top byte. */
+    uint64_t getNonceSpace(const Job &job)
+    {
+        return job.isNiceHash ? uint64_t(1) << 24 : WorkScheduler::NONCE_SPACE;
+    }
+}
+
 MinerManager::MinerManager(
-    const std::shared_ptr<PoolCommunication> pool,
+    const std::shared_ptr<IJobSource> pool,
     const std::shared_ptr<HardwareConfig> hardwareConfig,
     const bool areDevPool):
     m_pool(pool),
@@ -28,14 +37,42 @@ MinerManager::MinerManager(
     m_hardwareConfig(hardwareConfig),
     m_gen(m_device())
 {
-    const auto submit = [this](const JobSubmit &jobSubmit)
-    {
-        m_hashManager.submitHash(jobSubmit);
-    };
-
     if (hardwareConfig->cpu.enabled)
     {
-        m_enabledBackends.push_back(std::make_shared<CPU>(hardwareConfig, submit));
+        m_cpu = std::make_shared<CPU>(hardwareConfig);
+
+        m_asyncBackends.push_back(m_cpu);
+
+        m_rapl = std::make_unique<Rapl>(hardwareConfig->cpu.powercapRoot);
+
+        if (!m_rapl->available())
+        {
+            m_hashManager.setEnergyUnavailable(m_rapl->error());
+        }
+
+        const auto optimization = hardwareConfig->cpu.optimizationMethod;
+
+        m_optimizationMethod = Constants::optimizationMethodToString(
+            optimization == Constants::AUTO ? getAutoChosenOptimization() : optimization
+        );
+
+        const auto &governorConfig = hardwareConfig->cpu.governor;
+
+        if (governorConfig.enabled)
+        {
+            m_sensors = std::make_unique<CpuSensors>(governorConfig.hwmonRoot, governorConfig.cpuRoot);
+            m_governor = std::make_unique<CpuGovernor>(governorConfig, hardwareConfig->cpu.threadCount);
+
+            if (!areDevPool && governorConfig.maxPower != 0 && !m_rapl->available())
+            {
+                std::cout << WarningMsg("Can't read the CPU power usage, the power limit will be ignored: " + m_rapl->error()) << std::endl;
+            }
+
+            if (!areDevPool && governorConfig.maxTemperature != 0 && !m_sensors->read().haveTemperature)
+            {
+                std::cout << WarningMsg("Can't read the CPU temperature, the temperature limit will be ignored") << std::endl;
+            }
+        }
     }
     else if (!areDevPool)
     {
@@ -73,6 +110,25 @@ MinerManager::MinerManager(
         std::cout << WarningMsg("No Nvidia GPUs available, or all disabled, not starting Nvidia mining") << std::endl;
     }
     #endif
+
+    if (!m_asyncBackends.empty())
+    {
+        WorkSchedulerConfig schedulerConfig;
+
+        /* CPU threads manage a few hundred hashes a second, so start small.
+           Shares are submitted when the scheduler picks up their unit, so
+           keep the default poll interval. */
+        schedulerConfig.initialUnitSize = 16;
+
+        m_scheduler = std::make_unique<WorkScheduler>(
+            m_asyncBackends,
+            schedulerConfig,
+            [this](const WorkCompletion &completion, const size_t deviceIndex, const bool)
+            {
+                handleCompletion(completion, deviceIndex);
+            }
+        );
+    }
 }
 
 MinerManager::~MinerManager()
@@ -82,8 +138,11 @@ MinerManager::~MinerManager()
 
 void MinerManager::setNewJob(const Job &job)
 {
-    /* Set new nonce */
-    const uint32_t nonce = m_distribution(m_gen);
+    /* The GPUs walk up from the middle of the nonces we may alter, and the
+       scheduler leases the bottom half, so they never hash the same nonce.
+       A GPU would have to hash the whole top half of a job to reach the
+       bottom. */
+    const uint64_t nonceSpace = getNonceSpace(job);
 
     if (job.algorithm != m_currentAlgorithm)
     {
@@ -108,7 +167,12 @@ void MinerManager::setNewJob(const Job &job)
 
     for (auto &backend : m_enabledBackends)
     {
-        backend->setNewJob(job, nonce);
+        backend->setNewJob(job, static_cast<uint32_t>(nonceSpace / 2));
+    }
+
+    if (m_scheduler)
+    {
+        m_scheduler->setJob(job, m_distribution(m_gen), nonceSpace / 2);
     }
 
     m_pool->printPool();
@@ -146,7 +210,16 @@ void MinerManager::start()
 
         m_currentPool = newPool;
 
-        resumeMining();
+        /* Swapped straight to a standby pool, no need to stop and start
+           the backends, just give them the new job */
+        if (m_statsThread.joinable() && !m_shouldStop)
+        {
+            setNewJob(m_pool->getJob());
+        }
+        else
+        {
+            resumeMining();
+        }
     });
 
     /* Stop mining when we disconnect */
@@ -174,12 +247,18 @@ void MinerManager::resumeMining()
     m_pool->printPool();
     std::cout << WhiteMsg("New job, diff ") << WhiteMsg(job.shareDifficulty) << std::endl;
 
-    /* Set initial nonce */
-    const uint32_t nonce = m_distribution(m_gen);
+    /* Split the nonces as in setNewJob */
+    const uint64_t nonceSpace = getNonceSpace(job);
 
     for (auto &backend : m_enabledBackends)
     {
-        backend->start(job, nonce);
+        backend->start(job, static_cast<uint32_t>(nonceSpace / 2));
+    }
+
+    if (m_scheduler)
+    {
+        m_scheduler->setJob(job, m_distribution(m_gen), nonceSpace / 2);
+        m_scheduler->start();
     }
 
     /* Launch off the thread to print stats regularly */
@@ -197,6 +276,11 @@ void MinerManager::pauseMining()
         backend->stop();
     }
 
+    if (m_scheduler)
+    {
+        m_scheduler->stop();
+    }
+
     /* Pause the hashrate calculator */
     m_hashManager.pause();
 
@@ -215,6 +299,11 @@ void MinerManager::stop()
         backend->stop();
     }
 
+    if (m_scheduler)
+    {
+        m_scheduler->stop();
+    }
+
     /* Pause the hashrate calculator */
     m_hashManager.pause();
 
@@ -234,15 +323,168 @@ void MinerManager::stop()
 void MinerManager::printStats()
 {
     m_hashManager.printStats();
+
+    if (m_governor)
+    {
+        const auto governor = m_governor->getStats();
+
+        m_pool->printPool();
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << WhiteMsg("CPU governor", 20) << "| "
+                  << WhiteMsg(governor.activeThreads) << WhiteMsg("/") << WhiteMsg(governor.threadCount)
+                  << WhiteMsg(" threads active");
+
+        if (governor.haveTemperature)
+        {
+            std::cout << InformationMsg(", ") << InformationMsg(governor.temperature) << InformationMsg("C");
+        }
+
+        if (governor.haveFrequency)
+        {
+            std::cout << InformationMsg(", ") << InformationMsg(governor.frequency) << InformationMsg(" MHz");
+        }
+
+        if (governor.watts != 0)
+        {
+            std::cout << InformationMsg(", ") << InformationMsg(governor.watts) << InformationMsg(" W");
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+MinerStats MinerManager::getStats()
+{
+    MinerStats stats = m_hashManager.getStats();
+
+    stats.pool = m_pool->getPoolStats();
+
+    if (m_governor)
+    {
+        stats.governor = m_governor->getStats();
+    }
+
+    return stats;
+}
+
+void MinerManager::setEnergyUnavailable(const std::string &reason)
+{
+    m_recordEnergy = false;
+    m_hashManager.setEnergyUnavailable(reason);
+}
+
+void MinerManager::updatePerformanceStats()
+{
+    std::vector<PerformanceStats> threadStats;
+
+    for (auto &backend : m_enabledBackends)
+    {
+        const auto backendStats = backend->getPerformanceStats();
+        threadStats.insert(threadStats.end(), backendStats.begin(), backendStats.end());
+    }
+
+    if (m_cpu)
+    {
+        const auto cpuStats = m_cpu->getPerformanceStats();
+        threadStats.insert(threadStats.begin(), cpuStats.begin(), cpuStats.end());
+    }
+
+    m_hashManager.updatePerformanceStats(threadStats);
+}
+
+void MinerManager::handleCompletion(const WorkCompletion &completion, const size_t deviceIndex)
+{
+    const std::string deviceName = m_asyncBackends[deviceIndex]->getName();
+
+    if (completion.hashesPerformed != 0)
+    {
+        m_hashManager.incrementHashesPerformed(completion.hashesPerformed, deviceName);
+    }
+
+    /* Even if the job has been replaced, the pool may still take shares for
+       it, and refuses them itself if not */
+    for (const auto &found : completion.found)
+    {
+        m_hashManager.submitValidHash({
+            found.hash.data(),
+            completion.job->jobID,
+            found.nonce,
+            completion.job->target,
+            deviceName
+        });
+    }
 }
 
 void MinerManager::statPrinter()
 {
     m_hashManager.start();
 
+    /* Sample every second so the decayed hashrates are accurate, but only
+       print every 20 seconds */
+    const uint32_t printInterval = 20;
+
+    uint32_t ticks = 0;
+
+    const bool measureEnergy = m_rapl && m_rapl->available();
+
+    /* Don't count the energy used while we were paused */
+    if (measureEnergy)
+    {
+        m_rapl->sample();
+
+        if (m_recordEnergy)
+        {
+            m_hashManager.startEnergyMeasurement();
+        }
+    }
+
     while (!m_shouldStop)
     {
-        Utilities::sleepUnlessStopping(std::chrono::seconds(20), m_shouldStop);
-        printStats();
+        Utilities::sleepUnlessStopping(std::chrono::seconds(1), m_shouldStop);
+
+        updatePerformanceStats();
+
+        double watts = 0;
+
+        if (measureEnergy)
+        {
+            const EnergySample energy = m_rapl->sample();
+
+            if (m_recordEnergy)
+            {
+                m_hashManager.recordEnergy(
+                    energy,
+                    m_optimizationMethod,
+                    m_cpu->getActiveThreads(),
+                    m_pool->getJob().algorithm
+                );
+            }
+
+            if (energy.seconds != 0)
+            {
+                watts = energy.totalJoules() / energy.seconds;
+            }
+        }
+
+        if (m_governor)
+        {
+            const uint32_t activeThreads = m_governor->update(m_sensors->read(), watts);
+
+            if (activeThreads != m_cpu->getActiveThreads())
+            {
+                m_pool->printPool();
+                std::cout << InformationMsg(m_governor->getStats().lastChange) << std::endl;
+
+                m_cpu->setActiveThreads(activeThreads);
+            }
+        }
+
+        ticks++;
+
+        if (ticks % printInterval == 0 && !m_shouldStop)
+        {
+            printStats();
+        }
     }
 }
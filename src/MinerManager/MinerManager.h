@@ -8,10 +8,15 @@
 #include <random>
 #include <thread>
 
+#include "Backend/CPU/CPU.h"
 #include "Backend/IBackend.h"
+#include "Energy/CpuSensors.h"
+#include "Energy/Rapl.h"
+#include "MinerManager/CpuGovernor.h"
 #include "MinerManager/HashManager.h"
+#include "MinerManager/WorkScheduler.h"
 #include "Miner/GetConfig.h"
-#include "PoolCommunication/PoolCommunication.h"
+#include "PoolCommunication/IJobSource.h"
 #include "Types/IHashingAlgorithm.h"
 
 class MinerManager
@@ -19,7 +24,7 @@ class MinerManager
   public:
     /* CONSTRUCTOR */
     MinerManager(
-        const std::shared_ptr<PoolCommunication> pool,
+        const std::shared_ptr<IJobSource> pool,
         const std::shared_ptr<HardwareConfig> hardwareConfig,
         const bool areDevPool);
 
@@ -33,6 +38,15 @@ class MinerManager
 
     void printStats();
 
+    /* Get a snapshot of the hashrates, shares and pool */
+    MinerStats getStats();
+
+    /* Stop recording the CPU energy, e.g. because other managers mine on
+       the same CPU and the counters can't tell our share apart. The power
+       limit of the governor still applies to the whole CPU. Call before
+       start(). */
+    void setEnergyUnavailable(const std::string &reason);
+
   private:
 
     /* PRIVATE METHODS */
@@ -44,13 +58,20 @@ class MinerManager
 
     void statPrinter();
 
+    /* Sample the performance stats of each backend */
+    void updatePerformanceStats();
+
+    /* Count the hashes of a unit of work, and submit any shares found.
+       Called on the scheduler thread. */
+    void handleCompletion(const WorkCompletion &completion, const size_t deviceIndex);
+
     /* PRIVATE VARIABLES */
 
     /* Should we stop the worker funcs */
     std::atomic<bool> m_shouldStop = false;
 
     /* Pool connection */
-    const std::shared_ptr<PoolCommunication> m_pool;
+    const std::shared_ptr<IJobSource> m_pool;
 
     /* Handles submitting shares and tracking hashrate statistics */
     HashManager m_hashManager;
@@ -65,9 +86,17 @@ class MinerManager
     /* Thread that periodically prints hashrate, etc */
     std::thread m_statsThread;
 
-    /* CPU, GPU, etc hash backends that we are currently using */
+    /* GPU hash backends that we are currently using, each hashing the job
+       from the nonce we give it */
     std::vector<std::shared_ptr<IBackend>> m_enabledBackends;
 
+    /* Backends hashing the units of work leased by m_scheduler */
+    std::vector<std::shared_ptr<IAsyncBackend>> m_asyncBackends;
+
+    /* Splits the nonces of each job between the async backends. Null if
+       there are none. */
+    std::unique_ptr<WorkScheduler> m_scheduler;
+
     const std::shared_ptr<HardwareConfig> m_hardwareConfig;
 
     /* Current algorithm we're mining with */
@@ -75,4 +104,22 @@ class MinerManager
 
     /* Current pool we're hashing on */
     Pool m_currentPool;
+
+    /* Also in m_asyncBackends, null if CPU mining is disabled */
+    std::shared_ptr<CPU> m_cpu;
+
+    /* CPU energy counters, null if CPU mining is disabled */
+    std::unique_ptr<Rapl> m_rapl;
+
+    /* Should we record the energy used against our hashes */
+    bool m_recordEnergy = true;
+
+    /* Parks CPU threads to stay within the thermal and power limits. Null
+       unless enabled. */
+    std::unique_ptr<CpuGovernor> m_governor;
+
+    std::unique_ptr<CpuSensors> m_sensors;
+
+    /* The CPU hashing kernel in use, with auto resolved */
+    std::string m_optimizationMethod;
 };
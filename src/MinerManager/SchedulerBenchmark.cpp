@@ -0,0 +1,318 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+
+#include "Backend/Simulated/SimulatedBackend.h"
+#include "ExternalLibs/cxxopts.hpp"
+#include "MinerManager/WorkScheduler.h"
+#include "Utilities/ColouredMsg.h"
+
+/* Runs the WorkScheduler against simulated devices of differing speeds and
+   reliability, with the job changing regularly. Reports how evenly the work
+   was split, how much was wasted on stale jobs, how long job switches took,
+   and checks no nonce was handed out twice for the same job. */
+
+struct BenchmarkOptions
+{
+    /* Seconds to run each scenario for */
+    uint32_t duration = 10;
+
+    std::chrono::milliseconds jobInterval {2000};
+
+    WorkSchedulerConfig scheduler;
+};
+
+struct Scenario
+{
+    std::string name;
+
+    std::vector<SimulatedDeviceConfig> devices;
+};
+
+/* A range of nonces hashed by a device */
+struct HashedRange
+{
+    uint32_t startNonce;
+
+    uint32_t nonceCount;
+};
+
+using Clock = std::chrono::steady_clock;
+
+BenchmarkOptions getBenchmarkOptions(int argc, char **argv)
+{
+    BenchmarkOptions options;
+
+    bool help = false;
+
+    uint32_t jobInterval = options.jobInterval.count();
+    uint32_t unitDuration = options.scheduler.unitDuration.count();
+
+    cxxopts::Options parser(argv[0], "Measure work scheduling across simulated devices");
+
+    parser.add_options("Core")
+        ("h,help", "Display this help message",
+         cxxopts::value<bool>(help)->implicit_value("true"))
+
+        ("duration", "How many seconds to run each scenario for",
+         cxxopts::value<uint32_t>(options.duration)->default_value(std::to_string(options.duration)), "<seconds>")
+
+        ("jobInterval", "How many milliseconds between new jobs",
+         cxxopts::value<uint32_t>(jobInterval)->default_value(std::to_string(jobInterval)), "<ms>")
+
+        ("unitDuration", "How many milliseconds each unit of work should take",
+         cxxopts::value<uint32_t>(unitDuration)->default_value(std::to_string(unitDuration)), "<ms>")
+
+        ("unitsInFlight", "How many units to queue on each device at once",
+         cxxopts::value<uint32_t>(options.scheduler.unitsInFlight)->default_value(std::to_string(options.scheduler.unitsInFlight)), "<n>");
+
+    try
+    {
+        parser.parse(argc, argv);
+
+        if (help)
+        {
+            std::cout << parser.help({}) << std::endl;
+            exit(0);
+        }
+    }
+    catch (const cxxopts::OptionException &e)
+    {
+        std::cout << WarningMsg("Error: Unable to parse command line options: ") << WarningMsg(e.what())
+                  << std::endl << std::endl
+                  << parser.help({}) << std::endl;
+        exit(1);
+    }
+
+    options.duration = std::max<uint32_t>(options.duration, 1);
+    options.jobInterval = std::chrono::milliseconds(std::max<uint32_t>(jobInterval, 1));
+    options.scheduler.unitDuration = std::chrono::milliseconds(std::max<uint32_t>(unitDuration, 1));
+    options.scheduler.unitsInFlight = std::max<uint32_t>(options.scheduler.unitsInFlight, 1);
+
+    return options;
+}
+
+std::vector<Scenario> getScenarios()
+{
+    SimulatedDeviceConfig cpu;
+
+    cpu.name = "CPU";
+    cpu.hashrate = 2000;
+    cpu.shareProbability = 1.0 / 5000;
+    cpu.seed = 1;
+
+    SimulatedDeviceConfig fastGpu;
+
+    fastGpu.name = "GPU 0";
+    fastGpu.hashrate = 40000;
+    fastGpu.latency = std::chrono::milliseconds(2);
+    fastGpu.shareProbability = cpu.shareProbability;
+    fastGpu.interruptible = false;
+    fastGpu.seed = 2;
+
+    SimulatedDeviceConfig slowGpu = fastGpu;
+
+    slowGpu.name = "GPU 1";
+    slowGpu.hashrate = 15000;
+    slowGpu.seed = 3;
+
+    SimulatedDeviceConfig unreliableFastGpu = fastGpu;
+    SimulatedDeviceConfig unreliableSlowGpu = slowGpu;
+
+    unreliableFastGpu.failureRate = 0.05;
+    unreliableSlowGpu.failureRate = 0.05;
+
+    return {
+        { "CPU only", { cpu } },
+        { "CPU and GPUs", { cpu, fastGpu, slowGpu } },
+        { "Unreliable GPUs", { cpu, unreliableFastGpu, unreliableSlowGpu } },
+    };
+}
+
+Job makeJob(const uint64_t number)
+{
+    Job job;
+
+    job.jobID = std::to_string(number);
+    job.rawBlob.resize(76);
+    job.shareDifficulty = 5000;
+    job.target = std::numeric_limits<uint64_t>::max() / job.shareDifficulty;
+    job.algorithm = "chukwa";
+
+    return job;
+}
+
+/* Count nonces hashed more than once for the same job */
+uint64_t countOverlaps(std::map<uint64_t, std::vector<HashedRange>> &hashedRanges)
+{
+    uint64_t overlapping = 0;
+
+    for (auto &[epoch, ranges] : hashedRanges)
+    {
+        std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b)
+        {
+            return a.startNonce < b.startNonce;
+        });
+
+        uint64_t end = 0;
+
+        for (const auto &range : ranges)
+        {
+            if (range.startNonce < end)
+            {
+                overlapping += std::min<uint64_t>(end, range.startNonce + uint64_t(range.nonceCount)) - range.startNonce;
+            }
+
+            end = std::max<uint64_t>(end, range.startNonce + uint64_t(range.nonceCount));
+        }
+    }
+
+    return overlapping;
+}
+
+/* Returns false if any nonce was hashed twice for the same job */
+bool runScenario(const Scenario &scenario, const BenchmarkOptions &options)
+{
+    std::vector<std::shared_ptr<IAsyncBackend>> backends;
+
+    double configuredHashrate = 0;
+
+    for (const auto &device : scenario.devices)
+    {
+        backends.push_back(std::make_shared<SimulatedBackend>(device));
+        configuredHashrate += device.hashrate;
+    }
+
+    std::map<uint64_t, std::vector<HashedRange>> hashedRanges;
+
+    std::mutex rangesMutex;
+
+    WorkScheduler scheduler(
+        backends,
+        options.scheduler,
+        [&](const WorkCompletion &completion, const size_t, const bool)
+        {
+            if (completion.failed || completion.hashesPerformed == 0)
+            {
+                return;
+            }
+
+            std::scoped_lock lock(rangesMutex);
+
+            hashedRanges[completion.epoch].push_back({ completion.startNonce, completion.hashesPerformed });
+        }
+    );
+
+    std::mt19937 generator(0);
+
+    uint64_t jobNumber = 0;
+
+    scheduler.setJob(makeJob(jobNumber++), static_cast<uint32_t>(generator()));
+    scheduler.start();
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::seconds(options.duration);
+
+    auto nextJob = start + options.jobInterval;
+
+    while (nextJob < end)
+    {
+        std::this_thread::sleep_until(nextJob);
+        scheduler.setJob(makeJob(jobNumber++), static_cast<uint32_t>(generator()));
+        nextJob += options.jobInterval;
+    }
+
+    std::this_thread::sleep_until(end);
+
+    const auto stats = scheduler.getStats();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    scheduler.stop();
+
+    uint64_t totalHashes = 0;
+    uint64_t staleHashes = 0;
+
+    for (const auto &device : stats.devices)
+    {
+        totalHashes += device.hashes;
+        staleHashes += device.staleHashes;
+    }
+
+    std::cout << std::endl << InformationMsg("* ") << WhiteMsg(scenario.name) << std::endl;
+
+    for (size_t i = 0; i < stats.devices.size(); i++)
+    {
+        const auto &device = stats.devices[i];
+        const auto &config = scenario.devices[i];
+
+        const double share = totalHashes == 0 ? 0 : 100.0 * device.hashes / totalHashes;
+
+        std::cout << InformationMsg("  - ") << WhiteMsg(device.name, 18)
+                  << SuccessMsg(device.hashes / seconds) << SuccessMsg(" H/s")
+                  << InformationMsg(" of ") << InformationMsg(config.hashrate)
+                  << InformationMsg(", ") << InformationMsg(share) << InformationMsg("% of hashes (fair share ")
+                  << InformationMsg(100 * config.hashrate / configuredHashrate) << InformationMsg("%), ")
+                  << InformationMsg(device.unitsCompleted) << InformationMsg(" units of ")
+                  << InformationMsg(device.unitSize) << InformationMsg(", ")
+                  << InformationMsg(device.unitsFailed) << InformationMsg(" failed, ")
+                  << InformationMsg(device.sharesFound) << InformationMsg(" shares") << std::endl;
+    }
+
+    const double efficiency = 100 * (totalHashes / seconds) / configuredHashrate;
+    const double stalePercent = totalHashes + staleHashes == 0 ? 0 : 100.0 * staleHashes / (totalHashes + staleHashes);
+
+    std::cout << InformationMsg("  * ") << WhiteMsg("Efficiency", 18)
+              << SuccessMsg(efficiency) << SuccessMsg("% of the combined hashrate, ")
+              << InformationMsg(stalePercent) << InformationMsg("% of hashes stale") << std::endl;
+
+    std::cout << InformationMsg("  * ") << WhiteMsg("Job switches", 18)
+              << SuccessMsg(stats.averageJobSwitchLatency.count() / 1000.0) << SuccessMsg("ms average")
+              << InformationMsg(", ") << InformationMsg(stats.maxJobSwitchLatency.count() / 1000.0)
+              << InformationMsg("ms worst, over ") << InformationMsg(stats.jobSwitches) << InformationMsg(" jobs") << std::endl;
+
+    std::cout << InformationMsg("  * ") << WhiteMsg("Reissued ranges", 18)
+              << InformationMsg(stats.rangesReissued) << std::endl;
+
+    std::scoped_lock lock(rangesMutex);
+
+    const uint64_t overlapping = countOverlaps(hashedRanges);
+
+    if (overlapping != 0)
+    {
+        std::cout << WarningMsg(std::to_string(overlapping) + " nonces were hashed more than once for the same job!") << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const BenchmarkOptions options = getBenchmarkOptions(argc, argv);
+
+        std::cout << std::fixed << std::setprecision(1);
+
+        bool success = true;
+
+        for (const auto &scenario : getScenarios())
+        {
+            success &= runScenario(scenario, options);
+        }
+
+        return success ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Benchmark crashed with error: ") << WarningMsg(e.what()) << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,385 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////////
+#include "MinerManager/WorkScheduler.h"
+//////////////////////////////////////
+
+#include <algorithm>
+#include <limits>
+
+/* Weight given to the latest unit when updating a device's hashrate */
+constexpr double HASHRATE_SMOOTHING = 0.3;
+
+/* Most completions to take off the queue before handling them */
+constexpr size_t COMPLETION_BATCH_SIZE = 64;
+
+WorkScheduler::WorkScheduler(
+    const std::vector<std::shared_ptr<IAsyncBackend>> &backends,
+    const WorkSchedulerConfig &config,
+    const CompletionCallback &onCompletion):
+    m_config(config),
+    m_onCompletion(onCompletion)
+{
+    for (const auto &backend : backends)
+    {
+        Device device;
+
+        device.backend = backend;
+        device.stats.name = backend->getName();
+        device.stats.unitSize = std::max<uint32_t>(config.initialUnitSize, 1);
+
+        m_devices.push_back(device);
+    }
+
+    /* Room for every unit of a good few jobs, so the devices never wait
+       on us to make space */
+    const size_t capacity = std::max<size_t>(1024, m_devices.size() * config.unitsInFlight * 16);
+
+    m_completions = std::make_shared<CompletionQueue>(capacity);
+}
+
+WorkScheduler::~WorkScheduler()
+{
+    stop();
+}
+
+void WorkScheduler::start()
+{
+    stop();
+
+    m_shouldStop = false;
+
+    for (auto &device : m_devices)
+    {
+        device.backend->start(m_completions);
+    }
+
+    {
+        std::scoped_lock lock(m_mutex);
+        topUp();
+    }
+
+    m_thread = std::thread(&WorkScheduler::run, this);
+}
+
+void WorkScheduler::stop()
+{
+    m_shouldStop = true;
+    m_wake.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    for (auto &device : m_devices)
+    {
+        device.backend->stop();
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    /* Anything left in flight was dropped by the backends */
+    while (m_completions->tryPop())
+    {
+    }
+
+    m_leases.clear();
+
+    for (auto &device : m_devices)
+    {
+        device.stats.inFlight = 0;
+    }
+}
+
+void WorkScheduler::setJob(const Job &job, const uint32_t startNonce, const uint64_t nonceSpace)
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_epoch++;
+    m_job = std::make_shared<const Job>(job);
+
+    m_nonceSpace = std::clamp<uint64_t>(nonceSpace, 1, NONCE_SPACE);
+    m_nextNonce = startNonce % m_nonceSpace;
+    m_noncesLeased = 0;
+    m_reissue.clear();
+
+    m_stats.jobSwitches++;
+
+    m_jobSwitchTime = std::chrono::steady_clock::now();
+    m_devicesSwitching = m_devices.size();
+    m_slowestSwitch = std::chrono::microseconds(0);
+
+    for (auto &device : m_devices)
+    {
+        /* Anything still in flight is from the old job now */
+        device.stats.inFlight = 0;
+        device.switched = false;
+
+        device.backend->abandonBefore(m_epoch);
+    }
+
+    topUp();
+}
+
+SchedulerStats WorkScheduler::getStats()
+{
+    std::scoped_lock lock(m_mutex);
+
+    SchedulerStats stats = m_stats;
+
+    stats.epoch = m_epoch;
+    stats.noncesLeased = m_noncesLeased;
+
+    for (const auto &device : m_devices)
+    {
+        stats.devices.push_back(device.stats);
+    }
+
+    return stats;
+}
+
+void WorkScheduler::run()
+{
+    std::vector<WorkCompletion> batch;
+
+    std::vector<std::optional<std::pair<size_t, bool>>> handled;
+
+    while (!m_shouldStop)
+    {
+        batch.clear();
+        handled.clear();
+
+        while (batch.size() < COMPLETION_BATCH_SIZE)
+        {
+            auto completion = m_completions->tryPop();
+
+            if (!completion)
+            {
+                break;
+            }
+
+            batch.push_back(std::move(*completion));
+        }
+
+        if (batch.empty())
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_wake.wait_for(lock, m_config.pollInterval, [this]{ return m_shouldStop.load(); });
+
+            continue;
+        }
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            for (const auto &completion : batch)
+            {
+                handled.push_back(complete(completion));
+            }
+
+            topUp();
+        }
+
+        if (!m_onCompletion)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (handled[i])
+            {
+                const auto [deviceIndex, stale] = *handled[i];
+                m_onCompletion(batch[i], deviceIndex, stale);
+            }
+        }
+    }
+}
+
+std::optional<std::pair<size_t, bool>> WorkScheduler::complete(const WorkCompletion &completion)
+{
+    const auto lease = m_leases.find(completion.leaseID);
+
+    if (lease == m_leases.end())
+    {
+        return std::nullopt;
+    }
+
+    const size_t deviceIndex = lease->second;
+
+    m_leases.erase(lease);
+
+    Device &device = m_devices[deviceIndex];
+    DeviceScheduleStats &stats = device.stats;
+
+    const bool stale = completion.epoch != m_epoch;
+
+    if (stale)
+    {
+        stats.unitsStale++;
+        stats.staleHashes += completion.hashesPerformed;
+    }
+    else
+    {
+        stats.inFlight--;
+
+        if (completion.failed)
+        {
+            stats.unitsFailed++;
+
+            m_reissue.push_back({ completion.startNonce, completion.nonceCount });
+        }
+        else
+        {
+            stats.unitsCompleted++;
+            stats.hashes += completion.hashesPerformed;
+            stats.sharesFound += completion.found.size();
+
+            /* Cut short without the job changing, don't lose the rest */
+            if (completion.hashesPerformed < completion.nonceCount)
+            {
+                m_reissue.push_back({
+                    completion.startNonce + completion.hashesPerformed,
+                    completion.nonceCount - completion.hashesPerformed
+                });
+            }
+        }
+
+        if (!device.switched)
+        {
+            device.switched = true;
+
+            m_slowestSwitch = std::max(
+                m_slowestSwitch,
+                std::chrono::duration_cast<std::chrono::microseconds>(completion.started - m_jobSwitchTime)
+            );
+
+            m_devicesSwitching--;
+
+            if (m_devicesSwitching == 0)
+            {
+                m_measuredJobSwitches++;
+                m_totalJobSwitchLatency += m_slowestSwitch;
+
+                m_stats.lastJobSwitchLatency = m_slowestSwitch;
+                m_stats.averageJobSwitchLatency = m_totalJobSwitchLatency / m_measuredJobSwitches;
+                m_stats.maxJobSwitchLatency = std::max(m_stats.maxJobSwitchLatency, m_slowestSwitch);
+            }
+        }
+    }
+
+    /* Only whole units show the true speed, including the fixed cost */
+    const double seconds = std::chrono::duration<double>(completion.finished - completion.started).count();
+
+    if (!completion.failed && completion.hashesPerformed == completion.nonceCount && seconds > 0)
+    {
+        const double hashrate = completion.hashesPerformed / seconds;
+
+        stats.hashrate = device.measured
+            ? stats.hashrate + HASHRATE_SMOOTHING * (hashrate - stats.hashrate)
+            : hashrate;
+
+        device.measured = true;
+
+        const double unitSize = stats.hashrate * std::chrono::duration<double>(m_config.unitDuration).count();
+
+        stats.unitSize = static_cast<uint32_t>(
+            std::clamp(unitSize, 1.0, static_cast<double>(std::numeric_limits<uint32_t>::max()))
+        );
+    }
+
+    return std::make_pair(deviceIndex, stale);
+}
+
+void WorkScheduler::topUp()
+{
+    if (!m_job || m_shouldStop)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+        Device &device = m_devices[i];
+
+        const uint32_t unitsInFlight = m_config.unitsInFlight * std::max<uint32_t>(device.backend->concurrency(), 1);
+
+        while (device.stats.inFlight < unitsInFlight)
+        {
+            NonceRange range;
+
+            if (!leaseRange(device.stats.unitSize, range))
+            {
+                return;
+            }
+
+            WorkUnit unit;
+
+            unit.leaseID = m_nextLeaseID++;
+            unit.epoch = m_epoch;
+            unit.job = m_job;
+            unit.startNonce = range.startNonce;
+            unit.nonceCount = range.nonceCount;
+
+            m_leases[unit.leaseID] = i;
+            device.stats.inFlight++;
+
+            device.backend->submit(unit);
+        }
+    }
+}
+
+bool WorkScheduler::leaseRange(const uint32_t count, NonceRange &range)
+{
+    if (!m_reissue.empty())
+    {
+        NonceRange &front = m_reissue.front();
+
+        range.startNonce = front.startNonce;
+        range.nonceCount = std::min(count, front.nonceCount);
+
+        front.startNonce += range.nonceCount;
+        front.nonceCount -= range.nonceCount;
+
+        if (front.nonceCount == 0)
+        {
+            m_reissue.pop_front();
+        }
+
+        m_stats.rangesReissued++;
+
+        return true;
+    }
+
+    const uint64_t remaining = m_nonceSpace - m_noncesLeased;
+
+    if (remaining == 0)
+    {
+        return false;
+    }
+
+    /* Units never wrap past the top of the nonce space */
+    const uint64_t untilWrap = m_nonceSpace - m_nextNonce;
+
+    range.startNonce = static_cast<uint32_t>(m_nextNonce);
+    range.nonceCount = static_cast<uint32_t>(std::min<uint64_t>({ count, remaining, untilWrap }));
+
+    m_nextNonce += range.nonceCount;
+    m_noncesLeased += range.nonceCount;
+
+    if (m_nextNonce == m_nonceSpace)
+    {
+        m_nextNonce = 0;
+    }
+
+    if (m_noncesLeased == m_nonceSpace)
+    {
+        m_stats.nonceSpaceExhausted++;
+    }
+
+    return true;
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Backend/IAsyncBackend.h"
+
+struct WorkSchedulerConfig
+{
+    /* How long each unit should take on the device it is leased to. Shorter
+       units mean quicker job switches on devices which can't abandon a unit
+       part way, longer units mean less per unit overhead. */
+    std::chrono::milliseconds unitDuration {100};
+
+    /* Units of the current job queued on each device at once, for each unit
+       it works on at a time, so it always has the next one ready when it
+       finishes */
+    uint32_t unitsInFlight = 2;
+
+    /* Nonces in a unit, until we have measured the device's hashrate */
+    uint32_t initialUnitSize = 256;
+
+    /* How often to check for completions when there are none */
+    std::chrono::microseconds pollInterval {1000};
+};
+
+struct DeviceScheduleStats
+{
+    std::string name;
+
+    uint64_t unitsCompleted = 0;
+
+    uint64_t unitsFailed = 0;
+
+    /* Units completed after their job was replaced */
+    uint64_t unitsStale = 0;
+
+    /* Hashes of the job current at the time */
+    uint64_t hashes = 0;
+
+    /* Hashes of a job which had already been replaced */
+    uint64_t staleHashes = 0;
+
+    uint64_t sharesFound = 0;
+
+    /* Measured from the units completed, as hashes per second, of one of
+       the units the device works on at once */
+    double hashrate = 0;
+
+    /* Nonces leased to the device per unit */
+    uint32_t unitSize = 0;
+
+    /* Units of the current job leased and not yet completed */
+    uint32_t inFlight = 0;
+};
+
+struct SchedulerStats
+{
+    uint64_t epoch = 0;
+
+    std::vector<DeviceScheduleStats> devices;
+
+    /* Nonces of the current job leased so far */
+    uint64_t noncesLeased = 0;
+
+    /* Ranges leased again after the unit they were leased in failed, or was
+       cut short */
+    uint64_t rangesReissued = 0;
+
+    /* Times we ran out of nonces before the job changed */
+    uint64_t nonceSpaceExhausted = 0;
+
+    uint64_t jobSwitches = 0;
+
+    /* Time from a job change until every device had started on the new job.
+       Only counts switches where every device got that far before the next
+       switch. */
+    std::chrono::microseconds lastJobSwitchLatency {0};
+
+    std::chrono::microseconds averageJobSwitchLatency {0};
+
+    std::chrono::microseconds maxJobSwitchLatency {0};
+};
+
+/* Splits the nonces of the current job into units sized to each device's
+   speed, and leases them out to a set of async backends. Ranges from failed
+   units are leased again, and a new job abandons the old job's units. */
+class WorkScheduler
+{
+  public:
+    /* Every nonce of a job */
+    static constexpr uint64_t NONCE_SPACE = uint64_t(1) << 32;
+
+    /* Called on the scheduler thread for every completion, with the index of
+       the device that produced it, and whether its job had been replaced */
+    typedef std::function<void(
+        const WorkCompletion &completion,
+        const size_t deviceIndex,
+        const bool stale)> CompletionCallback;
+
+    WorkScheduler(
+        const std::vector<std::shared_ptr<IAsyncBackend>> &backends,
+        const WorkSchedulerConfig &config,
+        const CompletionCallback &onCompletion);
+
+    ~WorkScheduler();
+
+    void start();
+
+    void stop();
+
+    /* Abandon the current job, and begin leasing nonces of this one,
+       starting from startNonce. Only the nonces below nonceSpace are leased,
+       wrapping back to 0, so the rest can be left to other hardware. */
+    void setJob(const Job &job, const uint32_t startNonce, const uint64_t nonceSpace = NONCE_SPACE);
+
+    SchedulerStats getStats();
+
+  private:
+    /* A range of nonces not yet hashed */
+    struct NonceRange
+    {
+        uint32_t startNonce;
+
+        uint32_t nonceCount;
+    };
+
+    struct Device
+    {
+        std::shared_ptr<IAsyncBackend> backend;
+
+        DeviceScheduleStats stats;
+
+        /* Has the hashrate been measured yet */
+        bool measured = false;
+
+        /* Has it started a unit of the current job since the last switch */
+        bool switched = true;
+    };
+
+    void run();
+
+    /* Handle a completion, returning the device index and whether it is
+       stale. Nothing if the lease is unknown, e.g. from before a restart.
+       Called with m_mutex held. */
+    std::optional<std::pair<size_t, bool>> complete(const WorkCompletion &completion);
+
+    /* Lease units to each device until each has enough in flight. Called
+       with m_mutex held. */
+    void topUp();
+
+    /* Take up to count nonces, from a reissued range if there are any */
+    bool leaseRange(const uint32_t count, NonceRange &range);
+
+    std::vector<Device> m_devices;
+
+    const WorkSchedulerConfig m_config;
+
+    const CompletionCallback m_onCompletion;
+
+    std::shared_ptr<CompletionQueue> m_completions;
+
+    /* The job being leased out, null before the first */
+    std::shared_ptr<const Job> m_job;
+
+    uint64_t m_epoch = 0;
+
+    /* Nonces of the current job we may lease, from 0 */
+    uint64_t m_nonceSpace = NONCE_SPACE;
+
+    /* The next nonce to lease, and how many have been leased this epoch */
+    uint64_t m_nextNonce = 0;
+
+    uint64_t m_noncesLeased = 0;
+
+    /* Ranges of the current job that failed, to lease again */
+    std::deque<NonceRange> m_reissue;
+
+    /* Lease ID to device index, for leases not yet completed */
+    std::unordered_map<uint64_t, size_t> m_leases;
+
+    uint64_t m_nextLeaseID = 0;
+
+    std::chrono::steady_clock::time_point m_jobSwitchTime;
+
+    /* Devices yet to start on the current job */
+    size_t m_devicesSwitching = 0;
+
+    /* Longest any device has taken to start on the current job so far */
+    std::chrono::microseconds m_slowestSwitch {0};
+
+    std::chrono::microseconds m_totalJobSwitchLatency {0};
+
+    uint64_t m_measuredJobSwitches = 0;
+
+    SchedulerStats m_stats;
+
+    /* Guards everything above. The backends never take it, they only push
+       to the completion queue. */
+    std::mutex m_mutex;
+
+    std::atomic<bool> m_shouldStop = false;
+
+    std::condition_variable m_wake;
+
+    std::thread m_thread;
+};
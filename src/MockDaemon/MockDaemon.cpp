@@ -0,0 +1,541 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////
+#include "MockDaemon/MockDaemon.h"
+//////////////////////////////////
+
+#include <algorithm>
+#include <cctype>
+#include <random>
+#include <sstream>
+
+#include "Utilities/String.h"
+
+namespace
+{
+    /* How often the accept thread checks if we are stopping */
+    constexpr time_t POLL_INTERVAL_MICROSECONDS = 100000;
+
+    /* Largest request we'll read. Blocks are small, we make them. */
+    constexpr size_t MAX_REQUEST_SIZE = 1024 * 1024;
+
+    constexpr uint8_t BLOCK_MAJOR_VERSION = 1;
+
+    constexpr uint8_t BLOCK_MINOR_VERSION = 0;
+
+    /* Bytes of the hashing header before the nonce: versions, a 5 byte
+       timestamp varint, and the previous hash */
+    constexpr size_t NONCE_OFFSET = 39;
+
+    void writeVarint(std::vector<uint8_t> &output, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            output.push_back(static_cast<uint8_t>(value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+
+        output.push_back(static_cast<uint8_t>(value));
+    }
+
+    std::string makeResponse(const std::string &status, const std::string &body)
+    {
+        std::stringstream stream;
+
+        stream << "HTTP/1.1 " << status << "\r\n"
+               << "Content-Type: application/json\r\n"
+               << "Content-Length: " << body.size() << "\r\n"
+               << "Connection: close\r\n"
+               << "\r\n"
+               << body;
+
+        return stream.str();
+    }
+
+    nlohmann::json makeError(const nlohmann::json &id, const int32_t code, const std::string &message)
+    {
+        return {
+            {"jsonrpc", "2.0"},
+            {"id", id},
+            {"error", {
+                {"code", code},
+                {"message", message},
+            }},
+        };
+    }
+}
+
+MockDaemon::MockDaemon(const MockDaemonConfig &config):
+    m_config(config),
+    m_prevHash(32)
+{
+    std::scoped_lock lock(m_mutex);
+    makeTemplate();
+}
+
+MockDaemon::~MockDaemon()
+{
+    stop();
+}
+
+void MockDaemon::start()
+{
+    if (m_acceptThread.joinable())
+    {
+        stop();
+    }
+
+    m_port = m_config.port;
+
+    m_socket = sockwrapper::detail::create_listener(m_config.host.c_str(), m_port, 16);
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        throw std::runtime_error("Failed to bind mock daemon to " + m_config.host + ":" + std::to_string(m_config.port));
+    }
+
+    m_shouldStop = false;
+
+    m_acceptThread = std::thread(&MockDaemon::acceptConnections, this);
+    m_blockThread = std::thread(&MockDaemon::mineBlocks, this);
+}
+
+void MockDaemon::stop()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+    }
+
+    m_chainMoved.notify_all();
+
+    if (m_acceptThread.joinable())
+    {
+        m_acceptThread.join();
+    }
+
+    if (m_blockThread.joinable())
+    {
+        m_blockThread.join();
+    }
+
+    if (m_socket != INVALID_SOCKET)
+    {
+        sockwrapper::detail::close_socket(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+
+    std::vector<std::shared_ptr<Connection>> connections;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        connections.swap(m_connections);
+    }
+
+    for (auto &connection : connections)
+    {
+        if (connection->thread.joinable())
+        {
+            connection->thread.join();
+        }
+    }
+}
+
+uint16_t MockDaemon::port() const
+{
+    return m_port;
+}
+
+void MockDaemon::advanceChain()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        advanceChainLocked();
+    }
+
+    m_chainMoved.notify_all();
+}
+
+uint64_t MockDaemon::height() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_height;
+}
+
+void MockDaemon::onBlock(const std::function<void(const ReceivedBlock &block)> callback)
+{
+    m_onBlock = callback;
+}
+
+void MockDaemon::makeTemplate()
+{
+    std::mt19937_64 generator(m_height);
+
+    /* The header we hash: versions, timestamp, previous hash and nonce */
+    std::vector<uint8_t> header = { BLOCK_MAJOR_VERSION, BLOCK_MINOR_VERSION };
+
+    /* Any timestamp big enough to take 5 bytes, as real ones do */
+    writeVarint(header, 1500000000 + m_height * 30);
+
+    header.insert(header.end(), m_prevHash.begin(), m_prevHash.end());
+    header.insert(header.end(), 4, 0);
+
+    /* Stands in for the coinbase and the other transactions */
+    std::vector<uint8_t> transactions(64);
+
+    for (auto &byte : transactions)
+    {
+        byte = static_cast<uint8_t>(generator());
+    }
+
+    /* Not a real merkle root, but changes with the transactions */
+    std::vector<uint8_t> root(32);
+
+    for (size_t i = 0; i < transactions.size(); i++)
+    {
+        root[i % root.size()] ^= transactions[i];
+    }
+
+    m_template.height = m_height;
+
+    m_template.hashingBlob = header;
+    m_template.hashingBlob.insert(m_template.hashingBlob.end(), root.begin(), root.end());
+    m_template.hashingBlob.push_back(1);
+
+    m_template.blob.clear();
+
+    /* A block carrying a parent block has its own versions and previous
+       hash, and the header we hash lives in the parent */
+    if (m_config.parentBlock)
+    {
+        m_template.blob = { BLOCK_MAJOR_VERSION + 1, BLOCK_MINOR_VERSION };
+        m_template.blob.insert(m_template.blob.end(), m_prevHash.begin(), m_prevHash.end());
+    }
+
+    m_template.nonceOffset = m_template.blob.size() + NONCE_OFFSET;
+
+    m_template.blob.insert(m_template.blob.end(), header.begin(), header.end());
+    m_template.blob.insert(m_template.blob.end(), transactions.begin(), transactions.end());
+}
+
+void MockDaemon::advanceChainLocked()
+{
+    std::mt19937_64 generator(m_height * 31 + m_tipID);
+
+    for (auto &byte : m_prevHash)
+    {
+        byte = static_cast<uint8_t>(generator());
+    }
+
+    m_height++;
+    m_tipID++;
+
+    makeTemplate();
+}
+
+void MockDaemon::mineBlocks()
+{
+    if (m_config.blockInterval.count() == 0)
+    {
+        return;
+    }
+
+    std::unique_lock lock(m_mutex);
+
+    while (!m_shouldStop)
+    {
+        if (m_chainMoved.wait_for(lock, m_config.blockInterval, [this]{ return m_shouldStop.load(); }))
+        {
+            return;
+        }
+
+        advanceChainLocked();
+
+        lock.unlock();
+        m_chainMoved.notify_all();
+        lock.lock();
+    }
+}
+
+void MockDaemon::acceptConnections()
+{
+    while (!m_shouldStop)
+    {
+        reapConnections();
+
+        if (sockwrapper::detail::select_read(m_socket, 0, POLL_INTERVAL_MICROSECONDS) <= 0)
+        {
+            continue;
+        }
+
+        const socket_t socket = accept(m_socket, nullptr, nullptr);
+
+        if (socket == INVALID_SOCKET)
+        {
+            continue;
+        }
+
+        auto connection = std::make_shared<Connection>();
+
+        connection->socket = socket;
+
+        std::scoped_lock lock(m_mutex);
+
+        connection->thread = std::thread(&MockDaemon::serveConnection, this, connection);
+
+        m_connections.push_back(connection);
+    }
+}
+
+void MockDaemon::reapConnections()
+{
+    std::vector<std::shared_ptr<Connection>> finished;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = std::partition(m_connections.begin(), m_connections.end(), [](const auto &connection) {
+            return !connection->finished;
+        });
+
+        finished.assign(it, m_connections.end());
+        m_connections.erase(it, m_connections.end());
+    }
+
+    for (auto &connection : finished)
+    {
+        connection->thread.join();
+    }
+}
+
+void MockDaemon::serveConnection(const std::shared_ptr<Connection> connection)
+{
+    std::string request;
+
+    size_t headerEnd = std::string::npos;
+    size_t contentLength = 0;
+
+    char buffer[4096];
+
+    while (!m_shouldStop && request.size() < MAX_REQUEST_SIZE)
+    {
+        if (headerEnd != std::string::npos && request.size() >= headerEnd + contentLength)
+        {
+            break;
+        }
+
+        if (sockwrapper::detail::select_read(connection->socket, 0, POLL_INTERVAL_MICROSECONDS) <= 0)
+        {
+            continue;
+        }
+
+        const auto bytesRead = recv(connection->socket, buffer, sizeof(buffer), 0);
+
+        if (bytesRead <= 0)
+        {
+            break;
+        }
+
+        request.append(buffer, bytesRead);
+
+        if (headerEnd == std::string::npos && request.find("\r\n\r\n") != std::string::npos)
+        {
+            headerEnd = request.find("\r\n\r\n") + 4;
+
+            std::string headers = request.substr(0, headerEnd);
+
+            std::transform(headers.begin(), headers.end(), headers.begin(), [](const unsigned char c)
+            {
+                return std::tolower(c);
+            });
+
+            const size_t lengthHeader = headers.find("\r\ncontent-length:");
+
+            if (lengthHeader != std::string::npos)
+            {
+                contentLength = std::stoull(headers.substr(lengthHeader + 17));
+            }
+        }
+    }
+
+    if (headerEnd != std::string::npos && request.size() >= headerEnd + contentLength)
+    {
+        std::string response;
+
+        if (request.rfind("POST /json_rpc ", 0) != 0)
+        {
+            response = makeResponse("404 Not Found", "");
+        }
+        else
+        {
+            nlohmann::json body;
+
+            try
+            {
+                body = handleRequest(nlohmann::json::parse(request.substr(headerEnd, contentLength)));
+            }
+            catch (const std::exception &e)
+            {
+                body = makeError(nullptr, -32700, e.what());
+            }
+
+            response = makeResponse("200 OK", body.dump());
+        }
+
+        sockwrapper::detail::send_all(connection->socket, response);
+    }
+
+    sockwrapper::detail::close_socket(connection->socket);
+
+    connection->finished = true;
+}
+
+nlohmann::json MockDaemon::handleRequest(const nlohmann::json &request)
+{
+    const nlohmann::json id = request.value("id", nlohmann::json());
+
+    const std::string method = request.at("method").get<std::string>();
+
+    const nlohmann::json params = request.value("params", nlohmann::json::object());
+
+    try
+    {
+        nlohmann::json result;
+
+        if (method == "getblocktemplate")
+        {
+            result = getBlockTemplate(params);
+        }
+        else if (method == "submitblock")
+        {
+            result = submitBlock(params);
+        }
+        else
+        {
+            return makeError(id, -32601, "Method not found");
+        }
+
+        return {
+            {"jsonrpc", "2.0"},
+            {"id", id},
+            {"result", result},
+        };
+    }
+    catch (const std::exception &e)
+    {
+        return makeError(id, -1, e.what());
+    }
+}
+
+nlohmann::json MockDaemon::getBlockTemplate(const nlohmann::json &params)
+{
+    if (params.value("wallet_address", "") == "")
+    {
+        throw std::invalid_argument("Missing wallet_address");
+    }
+
+    std::unique_lock lock(m_mutex);
+
+    /* Hold the request until the chain moves, if they already have the
+       current template */
+    if (m_config.longPoll && params.find("longpollid") != params.end())
+    {
+        const std::string longPollID = params.at("longpollid").get<std::string>();
+
+        m_chainMoved.wait_for(lock, m_config.longPollTimeout, [&]{
+            return m_shouldStop || longPollID != std::to_string(m_tipID);
+        });
+    }
+
+    nlohmann::json result = {
+        {"blocktemplate_blob", Utilities::toHex(m_template.blob)},
+        {"blockhashing_blob", Utilities::toHex(m_template.hashingBlob)},
+        {"difficulty", m_config.difficulty},
+        {"height", m_template.height},
+        {"prev_hash", Utilities::toHex(m_prevHash)},
+        {"reserved_offset", 0},
+        {"status", "OK"},
+    };
+
+    if (m_config.longPoll)
+    {
+        result["longpollid"] = std::to_string(m_tipID);
+    }
+
+    return result;
+}
+
+nlohmann::json MockDaemon::submitBlock(const nlohmann::json &params)
+{
+    if (!params.is_array() || params.size() != 1)
+    {
+        throw std::invalid_argument("Expected a single block blob");
+    }
+
+    const std::string blobHex = params.at(0).get<std::string>();
+
+    const std::vector<uint8_t> blob = Utilities::fromHex(blobHex);
+
+    ReceivedBlock block;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        block.height = m_template.height;
+        block.accepted = false;
+
+        m_blocksReceived++;
+
+        const size_t nonceOffset = m_template.nonceOffset;
+
+        if (blobHex.size() != m_template.blob.size() * 2)
+        {
+            block.error = "Block is the wrong size";
+        }
+        /* Everything but the nonce must match the current template */
+        else if (!std::equal(blob.begin(), blob.begin() + nonceOffset, m_template.blob.begin())
+              || !std::equal(blob.begin() + nonceOffset + 4, blob.end(), m_template.blob.begin() + nonceOffset + 4))
+        {
+            block.error = "Block is not for the current template";
+        }
+        else if (m_config.rejectEvery != 0 && m_blocksReceived % m_config.rejectEvery == 0)
+        {
+            block.error = "Block is invalid";
+        }
+        else
+        {
+            block.accepted = true;
+        }
+
+        if (blob.size() >= nonceOffset + 4)
+        {
+            block.nonce = Utilities::toHex(blob.data() + nonceOffset, 4);
+        }
+
+        if (block.accepted)
+        {
+            advanceChainLocked();
+        }
+    }
+
+    if (block.accepted)
+    {
+        m_chainMoved.notify_all();
+    }
+
+    if (m_onBlock)
+    {
+        m_onBlock(block);
+    }
+
+    if (!block.accepted)
+    {
+        throw std::invalid_argument(block.error);
+    }
+
+    return {
+        {"status", "OK"},
+    };
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ExternalLibs/json.hpp"
+#include "SocketWrapper/SocketWrapper.h"
+
+struct MockDaemonConfig
+{
+    std::string host = "127.0.0.1";
+
+    /* 0 picks a free port, see MockDaemon::port() */
+    uint16_t port = 0;
+
+    /* Difficulty of every template */
+    uint64_t difficulty = 5000;
+
+    /* The rest of the network finds a block this often. 0 never does, so
+       the chain only moves when we are sent a block. */
+    std::chrono::milliseconds blockInterval {0};
+
+    /* Hand out a longpollid with each template, and hold requests carrying
+       the current one until the chain moves */
+    bool longPoll = false;
+
+    /* Longest to hold a long poll before answering with the same template */
+    std::chrono::milliseconds longPollTimeout {30000};
+
+    /* Put the hashing header inside a parent block, after the block's own
+       version and previous hash, rather than at the start of the block */
+    bool parentBlock = false;
+
+    /* Reject every nth block. 0 accepts every block. */
+    uint32_t rejectEvery = 0;
+};
+
+/* A block we were sent */
+struct ReceivedBlock
+{
+    uint64_t height;
+
+    /* The nonce, in hex, as it appears in the block */
+    std::string nonce;
+
+    bool accepted;
+
+    /* Why the block was rejected */
+    std::string error;
+};
+
+/* A local stand-in for a daemon's getblocktemplate / submitblock JSON-RPC,
+   for testing solo mining without a real node. The blocks are the right
+   shape, but only checked against the templates we handed out, not for
+   proof of work. Each connection is served by its own thread, so long polls
+   can be held open. */
+class MockDaemon
+{
+  public:
+    MockDaemon(const MockDaemonConfig &config);
+
+    ~MockDaemon();
+
+    /* Bind and start serving. Throws if we cannot bind. */
+    void start();
+
+    void stop();
+
+    /* The port we are listening on */
+    uint16_t port() const;
+
+    /* Move the chain on, as if another miner found a block */
+    void advanceChain();
+
+    uint64_t height() const;
+
+    /* Register a function to call when a block is submitted. Called from
+       the connection threads. */
+    void onBlock(const std::function<void(const ReceivedBlock &block)> callback);
+
+  private:
+    struct Connection
+    {
+        socket_t socket;
+
+        std::thread thread;
+
+        /* Set once the thread has exited and can be joined */
+        std::atomic<bool> finished = false;
+    };
+
+    /* The block we are handing out templates for */
+    struct BlockTemplate
+    {
+        std::vector<uint8_t> blob;
+
+        std::vector<uint8_t> hashingBlob;
+
+        size_t nonceOffset;
+
+        uint64_t height;
+    };
+
+    void acceptConnections();
+
+    /* Join the threads of connections which have closed */
+    void reapConnections();
+
+    void serveConnection(const std::shared_ptr<Connection> connection);
+
+    /* Handle a JSON-RPC request, returning the response */
+    nlohmann::json handleRequest(const nlohmann::json &request);
+
+    nlohmann::json getBlockTemplate(const nlohmann::json &params);
+
+    nlohmann::json submitBlock(const nlohmann::json &params);
+
+    /* Build the template for the current tip. Called with m_mutex held. */
+    void makeTemplate();
+
+    /* Move the chain on. Called with m_mutex held. */
+    void advanceChainLocked();
+
+    /* Find blocks at the configured pace */
+    void mineBlocks();
+
+    const MockDaemonConfig m_config;
+
+    /* The listening socket */
+    socket_t m_socket = INVALID_SOCKET;
+
+    uint16_t m_port = 0;
+
+    std::vector<std::shared_ptr<Connection>> m_connections;
+
+    uint64_t m_height = 1;
+
+    std::vector<uint8_t> m_prevHash;
+
+    /* Changes every time the chain moves, handed out as the longpollid */
+    uint64_t m_tipID = 0;
+
+    BlockTemplate m_template;
+
+    uint64_t m_blocksReceived = 0;
+
+    std::function<void(const ReceivedBlock &block)> m_onBlock;
+
+    std::thread m_acceptThread;
+
+    std::thread m_blockThread;
+
+    std::atomic<bool> m_shouldStop = false;
+
+    /* Wakes long polls when the chain moves, and the block thread when
+       stopping */
+    std::condition_variable m_chainMoved;
+
+    /* Guards the chain, the template, the connections and the counters */
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,112 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <future>
+#include <iostream>
+
+#include "ExternalLibs/cxxopts.hpp"
+#include "MockDaemon/MockDaemon.h"
+#include "Utilities/ColouredMsg.h"
+
+MockDaemonConfig getMockDaemonConfig(int argc, char **argv)
+{
+    MockDaemonConfig config;
+
+    config.port = 11898;
+
+    bool help = false;
+
+    uint64_t blockInterval = 0;
+    uint64_t longPollTimeout = config.longPollTimeout.count();
+
+    cxxopts::Options options(argv[0], "A local stand-in for a daemon's block template RPC, for testing solo mining");
+
+    options.add_options("Core")
+        ("h,help", "Display this help message",
+         cxxopts::value<bool>(help)->implicit_value("true"))
+
+        ("host", "The address to listen on",
+         cxxopts::value<std::string>(config.host)->default_value(config.host), "<host>")
+
+        ("port", "The port to listen on",
+         cxxopts::value<uint16_t>(config.port)->default_value(std::to_string(config.port)), "<port>");
+
+    options.add_options("Chain")
+        ("difficulty", "The difficulty of every block",
+         cxxopts::value<uint64_t>(config.difficulty)->default_value(std::to_string(config.difficulty)), "<difficulty>")
+
+        ("blockInterval", "Have the rest of the network find a block every this many milliseconds",
+         cxxopts::value<uint64_t>(blockInterval), "<ms>")
+
+        ("parentBlock", "Carry the header we hash in a parent block, rather than at the start of the block",
+         cxxopts::value<bool>(config.parentBlock)->implicit_value("true"));
+
+    options.add_options("RPC")
+        ("longPoll", "Hold template requests until the chain moves",
+         cxxopts::value<bool>(config.longPoll)->implicit_value("true"))
+
+        ("longPollTimeout", "Longest to hold a template request, in milliseconds",
+         cxxopts::value<uint64_t>(longPollTimeout)->default_value(std::to_string(longPollTimeout)), "<ms>")
+
+        ("rejectEvery", "Reject every nth block",
+         cxxopts::value<uint32_t>(config.rejectEvery), "<n>");
+
+    try
+    {
+        options.parse(argc, argv);
+
+        if (help)
+        {
+            std::cout << options.help({}) << std::endl;
+            exit(0);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Error parsing options: ") << WarningMsg(e.what()) << std::endl;
+        exit(1);
+    }
+
+    config.blockInterval = std::chrono::milliseconds(blockInterval);
+    config.longPollTimeout = std::chrono::milliseconds(longPollTimeout);
+
+    return config;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const MockDaemonConfig config = getMockDaemonConfig(argc, argv);
+
+        MockDaemon daemon(config);
+
+        daemon.onBlock([](const ReceivedBlock &block)
+        {
+            std::cout << InformationMsg("[daemon] ")
+                      << WhiteMsg("Block at height " + std::to_string(block.height) + ", nonce " + block.nonce + ": ");
+
+            if (block.accepted)
+            {
+                std::cout << SuccessMsg("accepted") << std::endl;
+            }
+            else
+            {
+                std::cout << WarningMsg("rejected, " + block.error) << std::endl;
+            }
+        });
+
+        daemon.start();
+
+        std::cout << SuccessMsg("Mock daemon listening on " + config.host + ":" + std::to_string(daemon.port())) << std::endl;
+
+        /* Run until killed */
+        std::promise<void>().get_future().wait();
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Mock daemon crashed with error: ") << WarningMsg(e.what()) << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,649 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "Config/Config.h"
+#include "Energy/Rapl.h"
+#include "ExternalLibs/cxxopts.hpp"
+#include "MinerManager/MinerManager.h"
+#include "MockPool/MockStratumServer.h"
+#include "PoolCommunication/PoolCommunication.h"
+#include "Types/MinerStats.h"
+#include "Utilities/ColouredMsg.h"
+
+/* Measures how quickly the miner reacts to the pool, against a local mock
+   pool, so networking changes can be checked offline:
+
+   - Job latency: from the pool sending a job, to the miner parsing it, to
+     the first share on that job being found. The mock pool accepts any
+     hash, so the first share is the first hash.
+   - Share latency: from a share being found, to the pool reading it.
+   - Failover: from the active pool dropping, to mining on the next pool.
+   - Reconnect: from the pool dropping us, to mining on it again. With
+     --ssl, this shows whether TLS sessions are being resumed.
+   - Efficiency: CPU hashes per joule while mining, if RAPL is readable. */
+
+struct BenchmarkOptions
+{
+    uint32_t samples = 20;
+
+    std::chrono::milliseconds jobInterval {250};
+
+    std::chrono::milliseconds latency {0};
+
+    uint32_t failovers = 3;
+
+    uint32_t threads = 1;
+
+    std::string algorithm = "chukwa";
+
+    std::vector<ReplayJob> replay;
+
+    std::string powercapRoot = Rapl::DEFAULT_ROOT;
+
+    /* Talk to the mock pools over TLS */
+    bool ssl = false;
+};
+
+/* How many reconnects resumed their TLS session */
+struct ResumptionStats
+{
+    uint32_t reconnects = 0;
+
+    uint32_t resumed = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+/* Latency samples in milliseconds, by what they measure */
+using BenchmarkResults = std::vector<std::pair<std::string, std::vector<double>>>;
+
+double millisecondsBetween(const Clock::time_point start, const Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void printSamples(const std::string &name, std::vector<double> samples)
+{
+    std::cout << InformationMsg("* ") << WhiteMsg(name, 35);
+
+    if (samples.empty())
+    {
+        std::cout << WarningMsg("No samples") << std::endl;
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const auto percentile = [&samples](const double p)
+    {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+    };
+
+    std::stringstream stream;
+
+    stream << std::fixed << std::setprecision(3)
+           << "min " << samples.front() << "ms, "
+           << "median " << percentile(0.5) << "ms, "
+           << "p95 " << percentile(0.95) << "ms, "
+           << "max " << samples.back() << "ms "
+           << "(" << samples.size() << " samples)";
+
+    std::cout << SuccessMsg(stream.str()) << std::endl;
+}
+
+Pool makePool(const MockStratumServer &server, const BenchmarkOptions &options, const size_t priority)
+{
+    Pool pool;
+
+    pool.host = "127.0.0.1";
+    pool.port = server.port();
+    pool.username = "benchmark";
+    pool.algorithm = options.algorithm;
+    pool.priority = priority;
+    pool.ssl = options.ssl;
+
+    return pool;
+}
+
+/* Sits between the pool and the miner manager, noting when each job reaches
+   the miner and when the first share of each job leaves it */
+class TimedJobSource : virtual public IJobSource
+{
+  public:
+    TimedJobSource(const std::shared_ptr<IJobSource> &pool):
+        m_pool(pool)
+    {
+    }
+
+    virtual void logout()
+    {
+        m_pool->logout();
+    }
+
+    virtual Job getJob()
+    {
+        return m_pool->getJob();
+    }
+
+    virtual bool submitShare(
+        const uint8_t *hash,
+        const std::string jobID,
+        const uint32_t nonce)
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_firstShare.emplace(jobID, Clock::now());
+        }
+
+        return m_pool->submitShare(hash, jobID, nonce);
+    }
+
+    virtual void startManaging()
+    {
+        m_pool->startManaging();
+    }
+
+    virtual void onNewJob(const std::function<void(const Job &job)> callback)
+    {
+        m_pool->onNewJob([this, callback](const Job &job)
+        {
+            {
+                std::scoped_lock lock(m_mutex);
+                m_jobReceived.emplace(job.jobID, Clock::now());
+            }
+
+            callback(job);
+        });
+    }
+
+    virtual void onHashAccepted(const std::function<void(const std::string &shareID)> callback)
+    {
+        m_pool->onHashAccepted(callback);
+    }
+
+    virtual void onPoolSwapped(const std::function<void(const Pool &pool)> callback)
+    {
+        m_pool->onPoolSwapped(callback);
+    }
+
+    virtual void onPoolDisconnected(const std::function<void(void)> callback)
+    {
+        m_pool->onPoolDisconnected(callback);
+    }
+
+    virtual void printPool() const
+    {
+        m_pool->printPool();
+    }
+
+    virtual PoolStats getPoolStats() const
+    {
+        return m_pool->getPoolStats();
+    }
+
+    /* When the job reached the miner, and when its first share was found.
+       Returns false if either hasn't happened. */
+    bool getTimes(const std::string &jobID, Clock::time_point &jobReceived, Clock::time_point &firstShare)
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto received = m_jobReceived.find(jobID);
+        const auto share = m_firstShare.find(jobID);
+
+        if (received == m_jobReceived.end() || share == m_firstShare.end())
+        {
+            return false;
+        }
+
+        jobReceived = received->second;
+        firstShare = share->second;
+
+        return true;
+    }
+
+  private:
+    const std::shared_ptr<IJobSource> m_pool;
+
+    /* Keyed by job ID */
+    std::map<std::string, Clock::time_point> m_jobReceived;
+
+    std::map<std::string, Clock::time_point> m_firstShare;
+
+    std::mutex m_mutex;
+};
+
+void printEfficiency(const EfficiencyStats &efficiency, const std::string &error)
+{
+    std::cout << InformationMsg("* ") << WhiteMsg("Efficiency", 35);
+
+    if (efficiency.joules == 0)
+    {
+        std::cout << WarningMsg(error == "" ? "No energy measured" : error) << std::endl;
+        return;
+    }
+
+    std::stringstream stream;
+
+    stream << std::fixed << std::setprecision(3)
+           << efficiency.hashesPerJoule() << " H/J, "
+           << efficiency.watts() << " W, "
+           << efficiency.hashes / efficiency.seconds << " H/s "
+           << "(" << efficiency.optimizationMethod << ", "
+           << efficiency.threadCount << " threads, "
+           << efficiency.algorithm << ")";
+
+    std::cout << SuccessMsg(stream.str()) << std::endl;
+}
+
+EfficiencyStats benchmarkJobsAndShares(const BenchmarkOptions &options, BenchmarkResults &results, Rapl &rapl)
+{
+    MockPoolConfig serverConfig;
+
+    serverConfig.responseDelay = options.latency;
+    serverConfig.algorithm = options.algorithm;
+    serverConfig.replay = options.replay;
+    serverConfig.ssl = options.ssl;
+
+    MockStratumServer server(serverConfig);
+
+    /* Keyed by job ID, as we only time the first share of each job */
+    std::map<std::string, Clock::time_point> shareReceived;
+
+    std::mutex mutex;
+    std::condition_variable shareArrived;
+
+    server.onShare([&](const ReceivedShare &share)
+    {
+        std::scoped_lock lock(mutex);
+        shareReceived.emplace(share.jobID, share.receivedAt);
+        shareArrived.notify_all();
+    });
+
+    server.start();
+
+    const auto pool = std::make_shared<TimedJobSource>(
+        std::make_shared<PoolCommunication>(std::vector<Pool>{ makePool(server, options, 0) })
+    );
+
+    const auto hardwareConfig = std::make_shared<HardwareConfig>();
+
+    hardwareConfig->cpu.threadCount = options.threads;
+    hardwareConfig->cpu.powercapRoot = options.powercapRoot;
+
+    /* Mine just as the miner would, shares and all */
+    MinerManager minerManager(pool, hardwareConfig, true);
+
+    minerManager.start();
+
+    std::vector<double> jobToMiner;
+    std::vector<double> jobToFirstShare;
+    std::vector<double> shareToPool;
+
+    const auto timeout = std::chrono::seconds(30);
+
+    EfficiencyStats efficiency;
+
+    efficiency.optimizationMethod = Constants::optimizationMethodToString(Config::config.optimizationMethod);
+    efficiency.threadCount = options.threads;
+    efficiency.algorithm = options.algorithm;
+
+    /* Only count the energy used while hashing */
+    uint64_t startHashes = 0;
+
+    for (uint32_t i = 0; i < options.samples; i++)
+    {
+        /* Wait until we're logged in and hashing before sending a job */
+        {
+            std::unique_lock lock(mutex);
+
+            if (!shareArrived.wait_for(lock, timeout, [&]{ return !shareReceived.empty(); }))
+            {
+                std::cout << WarningMsg("Timed out waiting for the miner to submit a share") << std::endl;
+                break;
+            }
+        }
+
+        if (i == 0)
+        {
+            rapl.sample();
+            startHashes = minerManager.getStats().total.totalHashes;
+        }
+
+        const SentJob sent = server.pushJob();
+
+        std::unique_lock lock(mutex);
+
+        if (!shareArrived.wait_for(lock, timeout, [&]{ return shareReceived.count(sent.jobID) != 0; }))
+        {
+            std::cout << WarningMsg("Timed out waiting for a share for job " + sent.jobID) << std::endl;
+            break;
+        }
+
+        Clock::time_point jobReceived;
+        Clock::time_point firstShare;
+
+        if (pool->getTimes(sent.jobID, jobReceived, firstShare))
+        {
+            jobToMiner.push_back(millisecondsBetween(sent.sentAt, jobReceived));
+            jobToFirstShare.push_back(millisecondsBetween(jobReceived, firstShare));
+            shareToPool.push_back(millisecondsBetween(firstShare, shareReceived.at(sent.jobID)));
+        }
+
+        lock.unlock();
+
+        std::this_thread::sleep_for(options.jobInterval);
+    }
+
+    const EnergySample energy = rapl.sample();
+
+    efficiency.hashes = minerManager.getStats().total.totalHashes - startHashes;
+    efficiency.joules = energy.totalJoules();
+    efficiency.seconds = energy.seconds;
+
+    minerManager.stop();
+    pool->logout();
+    server.stop();
+
+    results.emplace_back("Job sent -> job received", jobToMiner);
+    results.emplace_back("Job received -> first share", jobToFirstShare);
+    results.emplace_back("Share found -> share received", shareToPool);
+
+    return efficiency;
+}
+
+std::vector<double> benchmarkFailover(const BenchmarkOptions &options, const size_t standbyPoolCount)
+{
+    std::vector<double> samples;
+
+    for (uint32_t i = 0; i < options.failovers; i++)
+    {
+        MockPoolConfig serverConfig;
+
+        serverConfig.responseDelay = options.latency;
+        serverConfig.algorithm = options.algorithm;
+        serverConfig.replay = options.replay;
+        serverConfig.ssl = options.ssl;
+
+        MockStratumServer primary(serverConfig);
+        MockStratumServer backup(serverConfig);
+
+        primary.start();
+        backup.start();
+
+        PoolManagerConfig managerConfig;
+        managerConfig.standbyPoolCount = standbyPoolCount;
+
+        PoolCommunication pool(
+            { makePool(primary, options, 0), makePool(backup, options, 1) },
+            managerConfig
+        );
+
+        std::mutex mutex;
+        std::condition_variable swapped;
+
+        uint16_t currentPort = 0;
+        Clock::time_point swapTime;
+
+        pool.onPoolSwapped([&](const Pool &newPool)
+        {
+            std::scoped_lock lock(mutex);
+            currentPort = newPool.port;
+            swapTime = Clock::now();
+            swapped.notify_all();
+        });
+
+        pool.startManaging();
+
+        const auto timeout = std::chrono::seconds(60);
+
+        {
+            std::unique_lock lock(mutex);
+
+            if (!swapped.wait_for(lock, timeout, [&]{ return currentPort == primary.port(); }))
+            {
+                std::cout << WarningMsg("Timed out waiting for the miner to connect") << std::endl;
+                break;
+            }
+        }
+
+        /* Give the standby pool time to login, so we measure the best case */
+        while (standbyPoolCount != 0 && backup.loggedInCount() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        const auto failTime = Clock::now();
+
+        primary.stop();
+
+        std::unique_lock lock(mutex);
+
+        if (!swapped.wait_for(lock, timeout, [&]{ return currentPort == backup.port(); }))
+        {
+            std::cout << WarningMsg("Timed out waiting for the miner to fail over") << std::endl;
+            break;
+        }
+
+        samples.push_back(millisecondsBetween(failTime, swapTime));
+
+        lock.unlock();
+
+        pool.logout();
+    }
+
+    return samples;
+}
+
+std::vector<double> benchmarkReconnect(const BenchmarkOptions &options, ResumptionStats &resumption)
+{
+    std::vector<double> samples;
+
+    MockPoolConfig serverConfig;
+
+    serverConfig.responseDelay = options.latency;
+    serverConfig.algorithm = options.algorithm;
+    serverConfig.replay = options.replay;
+    serverConfig.ssl = options.ssl;
+
+    MockStratumServer server(serverConfig);
+
+    std::mutex mutex;
+    std::condition_variable swapped;
+
+    uint32_t logins = 0;
+    Clock::time_point swapTime;
+
+    server.onConnection([&](const AcceptedConnection &connection)
+    {
+        std::scoped_lock lock(mutex);
+
+        /* The first connection has nothing to resume */
+        if (connection.clientID != 0)
+        {
+            resumption.reconnects++;
+
+            if (connection.resumed)
+            {
+                resumption.resumed++;
+            }
+        }
+    });
+
+    server.start();
+
+    PoolCommunication pool({ makePool(server, options, 0) });
+
+    pool.onPoolSwapped([&](const Pool &)
+    {
+        std::scoped_lock lock(mutex);
+        logins++;
+        swapTime = Clock::now();
+        swapped.notify_all();
+    });
+
+    pool.startManaging();
+
+    const auto timeout = std::chrono::seconds(60);
+
+    Clock::time_point failTime;
+
+    /* The first login is just getting connected */
+    for (uint32_t i = 0; i <= options.failovers; i++)
+    {
+        {
+            std::unique_lock lock(mutex);
+
+            if (!swapped.wait_for(lock, timeout, [&]{ return logins > i; }))
+            {
+                std::cout << WarningMsg("Timed out waiting for the miner to reconnect") << std::endl;
+                break;
+            }
+
+            if (i != 0)
+            {
+                samples.push_back(millisecondsBetween(failTime, swapTime));
+            }
+        }
+
+        if (i == options.failovers)
+        {
+            break;
+        }
+
+        /* A connection which drops straight after login is retried with a
+           backoff, so let it settle, and measure the best case */
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+        failTime = Clock::now();
+
+        server.disconnectAll();
+    }
+
+    pool.logout();
+    server.stop();
+
+    return samples;
+}
+
+BenchmarkOptions getBenchmarkOptions(int argc, char **argv)
+{
+    BenchmarkOptions options;
+
+    bool help = false;
+
+    uint64_t jobInterval = options.jobInterval.count();
+    uint64_t latency = options.latency.count();
+
+    std::string replayFile;
+
+    cxxopts::Options parser(argv[0], "Measure job, share and failover latency against a local mock pool");
+
+    parser.add_options("Core")
+        ("h,help", "Display this help message",
+         cxxopts::value<bool>(help)->implicit_value("true"))
+
+        ("samples", "How many jobs to time",
+         cxxopts::value<uint32_t>(options.samples)->default_value(std::to_string(options.samples)), "<n>")
+
+        ("jobInterval", "Milliseconds between jobs",
+         cxxopts::value<uint64_t>(jobInterval)->default_value(std::to_string(jobInterval)), "<ms>")
+
+        ("latency", "Delay every message from the mock pool by this many milliseconds",
+         cxxopts::value<uint64_t>(latency)->default_value(std::to_string(latency)), "<ms>")
+
+        ("failovers", "How many failovers and reconnects to time, with and without a standby pool",
+         cxxopts::value<uint32_t>(options.failovers)->default_value(std::to_string(options.failovers)), "<n>")
+
+        ("threads", "The number of mining threads to use",
+         cxxopts::value<uint32_t>(options.threads)->default_value(std::to_string(options.threads)), "<threads>")
+
+        ("algorithm", "The mining algorithm to use",
+         cxxopts::value<std::string>(options.algorithm)->default_value(options.algorithm), "<algorithm>")
+
+        ("replay", "Send the jobs from a recorded session, one JSON message per line",
+         cxxopts::value<std::string>(replayFile), "<file>")
+
+        ("powercapRoot", "Where to read the CPU energy counters from",
+         cxxopts::value<std::string>(options.powercapRoot)->default_value(options.powercapRoot), "<path>")
+
+        ("ssl", "Connect to the mock pools over TLS",
+         cxxopts::value<bool>(options.ssl)->implicit_value("true"));
+
+    try
+    {
+        parser.parse(argc, argv);
+
+        if (help)
+        {
+            std::cout << parser.help({}) << std::endl;
+            exit(0);
+        }
+
+        if (replayFile != "")
+        {
+            options.replay = loadReplay(replayFile);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Error parsing options: ") << WarningMsg(e.what()) << std::endl;
+        exit(1);
+    }
+
+    options.jobInterval = std::chrono::milliseconds(jobInterval);
+    options.latency = std::chrono::milliseconds(latency);
+
+    return options;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const BenchmarkOptions options = getBenchmarkOptions(argc, argv);
+
+        Config::config.optimizationMethod = Constants::AUTO;
+
+        BenchmarkResults results;
+
+        Rapl rapl(options.powercapRoot);
+
+        const EfficiencyStats efficiency = benchmarkJobsAndShares(options, results, rapl);
+
+        results.emplace_back("Failover, no standby pool", benchmarkFailover(options, 0));
+        results.emplace_back("Failover, standby pool", benchmarkFailover(options, 1));
+
+        ResumptionStats resumption;
+
+        results.emplace_back("Reconnect, same pool", benchmarkReconnect(options, resumption));
+
+        std::cout << std::endl;
+
+        for (const auto &[name, samples] : results)
+        {
+            printSamples(name, samples);
+        }
+
+        if (options.ssl)
+        {
+            std::cout << InformationMsg("* ") << WhiteMsg("TLS sessions resumed", 35)
+                      << SuccessMsg(std::to_string(resumption.resumed) + "/" + std::to_string(resumption.reconnects))
+                      << std::endl;
+        }
+
+        printEfficiency(efficiency, rapl.error());
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Benchmark crashed with error: ") << WarningMsg(e.what()) << std::endl;
+        return 1;
+    }
+}
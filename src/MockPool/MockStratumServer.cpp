@@ -0,0 +1,836 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+///////////////////////////////////////
+#include "MockPool/MockStratumServer.h"
+///////////////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <netinet/tcp.h>
+#endif
+
+#include "Utilities/String.h"
+
+namespace
+{
+    /* Size of a generated job blob, the same as a real block hashing blob */
+    constexpr size_t BLOB_SIZE = 76;
+
+    /* Height of the first generated job */
+    constexpr uint64_t FIRST_HEIGHT = 1000;
+
+    /* How long to block in select before checking if we should stop */
+    constexpr time_t POLL_INTERVAL_MICROSECONDS = 100000;
+
+    nlohmann::json makeResponse(const nlohmann::json &id, const nlohmann::json &result)
+    {
+        return {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"error", nullptr},
+            {"result", result},
+        };
+    }
+
+    nlohmann::json makeError(const nlohmann::json &id, const std::string &message)
+    {
+        return {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"error", {{"code", -1}, {"message", message}}},
+            {"result", nullptr},
+        };
+    }
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    /* How long to wait for a miner to finish the TLS handshake */
+    constexpr time_t HANDSHAKE_TIMEOUT_SECONDS = 5;
+
+    /* A server context with a freshly generated key and self signed
+       certificate. The miner doesn't verify pool certificates unless told
+       to, so this is enough for testing. Throws on failure. */
+    SSL_CTX *makeServerContext()
+    {
+        SSL_CTX *context = SSL_CTX_new(SSLv23_server_method());
+
+        EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+
+        EVP_PKEY *key = nullptr;
+
+        if (!context
+         || !keyContext
+         || EVP_PKEY_keygen_init(keyContext) != 1
+         || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) != 1
+         || EVP_PKEY_keygen(keyContext, &key) != 1)
+        {
+            EVP_PKEY_CTX_free(keyContext);
+            SSL_CTX_free(context);
+            throw std::runtime_error("Failed to generate a TLS key for the mock pool");
+        }
+
+        EVP_PKEY_CTX_free(keyContext);
+
+        X509 *certificate = X509_new();
+
+        X509_set_version(certificate, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+        X509_gmtime_adj(X509_get_notAfter(certificate), 60 * 60 * 24);
+        X509_set_pubkey(certificate, key);
+
+        X509_NAME *name = X509_get_subject_name(certificate);
+
+        X509_NAME_add_entry_by_txt(
+            name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("mock-pool"), -1, -1, 0
+        );
+
+        X509_set_issuer_name(certificate, name);
+
+        const bool success = X509_sign(certificate, key, EVP_sha256()) != 0
+                          && SSL_CTX_use_certificate(context, certificate) == 1
+                          && SSL_CTX_use_PrivateKey(context, key) == 1;
+
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+
+        if (!success)
+        {
+            SSL_CTX_free(context);
+            throw std::runtime_error("Failed to create a TLS certificate for the mock pool");
+        }
+
+        /* Needed to resume sessions by ID. Tickets are enabled by default. */
+        const unsigned char sessionContext[] = "mock-pool";
+
+        SSL_CTX_set_session_id_context(context, sessionContext, sizeof(sessionContext) - 1);
+
+        return context;
+    }
+
+    bool sendAllTls(SSL *ssl, const socket_t socket, const std::string &data)
+    {
+        size_t sent = 0;
+
+        /* The socket is non blocking, so retry with the same arguments until
+           each record is written */
+        while (sent < data.size())
+        {
+            const int result = SSL_write(ssl, data.data() + sent, static_cast<int>(data.size() - sent));
+
+            if (result > 0)
+            {
+                sent += result;
+                continue;
+            }
+
+            const int error = SSL_get_error(ssl, result);
+
+            if (error == SSL_ERROR_WANT_WRITE && sockwrapper::detail::select_write(socket, 1, 0) > 0)
+            {
+                continue;
+            }
+
+            if (error == SSL_ERROR_WANT_READ && sockwrapper::detail::select_read(socket, 1, 0) > 0)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        return true;
+    }
+#endif
+}
+
+std::vector<ReplayJob> loadReplay(const std::string &filename)
+{
+    std::ifstream file(filename);
+
+    if (!file)
+    {
+        throw std::invalid_argument("Failed to open replay file " + filename);
+    }
+
+    std::vector<ReplayJob> jobs;
+
+    std::string line;
+
+    size_t lineNumber = 0;
+
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+
+        Utilities::trim(line);
+
+        if (line.empty())
+        {
+            continue;
+        }
+
+        const auto message = nlohmann::json::parse(line, nullptr, false);
+
+        if (message.is_discarded() || !message.is_object())
+        {
+            throw std::invalid_argument("Invalid JSON on line " + std::to_string(lineNumber) + " of " + filename);
+        }
+
+        ReplayJob job;
+
+        if (message.find("params") != message.end())
+        {
+            job.params = message.at("params");
+        }
+        else if (message.find("result") != message.end() && message.at("result").is_object()
+              && message.at("result").find("job") != message.at("result").end())
+        {
+            job.params = message.at("result").at("job");
+        }
+        else
+        {
+            job.params = message;
+        }
+
+        /* Not a job, e.g. a share response in the recording */
+        if (!job.params.is_object() || job.params.find("blob") == job.params.end())
+        {
+            continue;
+        }
+
+        job.params.erase("delay");
+
+        if (message.find("delay") != message.end())
+        {
+            job.delay = std::chrono::milliseconds(message.at("delay").get<uint64_t>());
+        }
+
+        jobs.push_back(job);
+    }
+
+    if (jobs.empty())
+    {
+        throw std::invalid_argument("Replay file " + filename + " contains no jobs");
+    }
+
+    return jobs;
+}
+
+MockStratumServer::MockStratumServer(const MockPoolConfig &config):
+    m_config(config)
+{
+}
+
+MockStratumServer::~MockStratumServer()
+{
+    stop();
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (m_sslContext)
+    {
+        SSL_CTX_free(m_sslContext);
+    }
+#endif
+}
+
+void MockStratumServer::start()
+{
+    if (m_acceptThread.joinable())
+    {
+        stop();
+    }
+
+    if (m_config.ssl)
+    {
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+        if (!m_sslContext)
+        {
+            m_sslContext = makeServerContext();
+        }
+#else
+        throw std::runtime_error("The mock pool was compiled without SSL support");
+#endif
+    }
+
+    m_port = m_config.port;
+
+    m_socket = sockwrapper::detail::create_listener(m_config.host.c_str(), m_port, 16);
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        throw std::runtime_error("Failed to bind mock pool to " + m_config.host + ":" + std::to_string(m_config.port));
+    }
+
+    m_shouldStop = false;
+
+    m_acceptThread = std::thread(&MockStratumServer::acceptConnections, this);
+    m_jobThread = std::thread(&MockStratumServer::sendJobs, this);
+}
+
+void MockStratumServer::stop()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+    }
+
+    m_stopCondition.notify_all();
+
+    /* Drop the miners straight away. Anyone reconnecting before the accept
+       thread notices we are stopping is dropped as soon as they connect. */
+    disconnectAll();
+
+    if (m_acceptThread.joinable())
+    {
+        m_acceptThread.join();
+    }
+
+    if (m_jobThread.joinable())
+    {
+        m_jobThread.join();
+    }
+
+    if (m_socket != INVALID_SOCKET)
+    {
+        sockwrapper::detail::close_socket(m_socket);
+        m_socket = INVALID_SOCKET;
+    }
+
+    std::vector<std::shared_ptr<Client>> clients;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        clients.swap(m_clients);
+    }
+
+    for (auto &client : clients)
+    {
+        if (client->thread.joinable())
+        {
+            client->thread.join();
+        }
+    }
+}
+
+uint16_t MockStratumServer::port() const
+{
+    return m_port;
+}
+
+SentJob MockStratumServer::pushJob()
+{
+    SentJob sentJob;
+
+    nlohmann::json notification;
+
+    std::vector<std::shared_ptr<Client>> clients;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        notification = nextJob(sentJob);
+
+        for (const auto &client : m_clients)
+        {
+            if (client->loggedIn)
+            {
+                clients.push_back(client);
+            }
+        }
+    }
+
+    std::this_thread::sleep_for(m_config.responseDelay);
+
+    sentJob.sentAt = std::chrono::steady_clock::now();
+
+    for (const auto &client : clients)
+    {
+        sendMessage(client, notification);
+    }
+
+    return sentJob;
+}
+
+void MockStratumServer::disconnectAll()
+{
+    std::scoped_lock lock(m_mutex);
+
+    for (const auto &client : m_clients)
+    {
+        std::scoped_lock writeLock(client->writeMutex);
+
+        /* Wakes up the connection thread, which closes the socket */
+        if (client->socket != INVALID_SOCKET)
+        {
+            shutdown(client->socket, 2);
+        }
+    }
+}
+
+size_t MockStratumServer::loggedInCount() const
+{
+    std::scoped_lock lock(m_mutex);
+
+    return std::count_if(m_clients.begin(), m_clients.end(), [](const auto &client) {
+        return client->loggedIn;
+    });
+}
+
+void MockStratumServer::onShare(const std::function<void(const ReceivedShare &share)> callback)
+{
+    m_onShare = callback;
+}
+
+void MockStratumServer::onConnection(const std::function<void(const AcceptedConnection &connection)> callback)
+{
+    m_onConnection = callback;
+}
+
+void MockStratumServer::acceptConnections()
+{
+    while (!m_shouldStop)
+    {
+        reapClients();
+
+        if (sockwrapper::detail::select_read(m_socket, 0, POLL_INTERVAL_MICROSECONDS) <= 0)
+        {
+            continue;
+        }
+
+        const socket_t socket = accept(m_socket, nullptr, nullptr);
+
+        if (socket == INVALID_SOCKET)
+        {
+            continue;
+        }
+
+        /* Don't let Nagle's algorithm add its own latency to our responses */
+        int yes = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char *>(&yes), sizeof(yes));
+
+        auto client = std::make_shared<Client>();
+
+        client->socket = socket;
+        client->connectedAt = std::chrono::steady_clock::now();
+
+        std::scoped_lock lock(m_mutex);
+
+        client->id = m_nextClientID++;
+        client->thread = std::thread(&MockStratumServer::serveClient, this, client);
+
+        m_clients.push_back(client);
+    }
+}
+
+void MockStratumServer::reapClients()
+{
+    std::vector<std::shared_ptr<Client>> finished;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = std::partition(m_clients.begin(), m_clients.end(), [](const auto &client) {
+            return !client->finished;
+        });
+
+        finished.assign(it, m_clients.end());
+        m_clients.erase(it, m_clients.end());
+    }
+
+    for (auto &client : finished)
+    {
+        client->thread.join();
+    }
+}
+
+bool MockStratumServer::acceptClient(const std::shared_ptr<Client> &client)
+{
+    AcceptedConnection connection;
+
+    connection.clientID = client->id;
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (m_sslContext)
+    {
+        SSL *ssl = SSL_new(m_sslContext);
+
+        if (!ssl)
+        {
+            return false;
+        }
+
+        SSL_set_fd(ssl, static_cast<int>(client->socket));
+
+        /* Handshake blocking, but don't wait forever on a miner which
+           connected and went quiet */
+        sockwrapper::detail::set_socket_timeout(client->socket, HANDSHAKE_TIMEOUT_SECONDS);
+
+        const auto handshakeStart = std::chrono::steady_clock::now();
+
+        if (SSL_accept(ssl) != 1)
+        {
+            SSL_free(ssl);
+            return false;
+        }
+
+        connection.tls = true;
+        connection.resumed = SSL_session_reused(ssl) == 1;
+        connection.handshakeTime = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - handshakeStart
+        );
+
+        /* Reads are done under the write lock, so must not block */
+        sockwrapper::detail::set_socket_timeout(client->socket, 0);
+        sockwrapper::detail::set_nonblocking(client->socket, true);
+
+        std::scoped_lock lock(client->writeMutex);
+        client->ssl = ssl;
+    }
+#endif
+
+    if (m_onConnection)
+    {
+        m_onConnection(connection);
+    }
+
+    return true;
+}
+
+int MockStratumServer::receive(const std::shared_ptr<Client> &client, char *buffer, const size_t size)
+{
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (client->ssl)
+    {
+        std::scoped_lock lock(client->writeMutex);
+
+        const int bytesRead = SSL_read(client->ssl, buffer, static_cast<int>(size));
+
+        if (bytesRead > 0)
+        {
+            return bytesRead;
+        }
+
+        const int error = SSL_get_error(client->ssl, bytesRead);
+
+        /* Only part of a record has arrived */
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        {
+            return -1;
+        }
+
+        return 0;
+    }
+#endif
+
+    const auto bytesRead = recv(client->socket, buffer, static_cast<int>(size), 0);
+
+    return bytesRead < 0 ? 0 : static_cast<int>(bytesRead);
+}
+
+bool MockStratumServer::hasPendingData(const std::shared_ptr<Client> &client)
+{
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (client->ssl)
+    {
+        std::scoped_lock lock(client->writeMutex);
+        return SSL_pending(client->ssl) > 0;
+    }
+#endif
+
+    return false;
+}
+
+void MockStratumServer::closeClient(const std::shared_ptr<Client> &client)
+{
+    std::scoped_lock lock(client->writeMutex);
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (client->ssl)
+    {
+        /* Best effort, the miner may already be gone */
+        SSL_shutdown(client->ssl);
+        SSL_free(client->ssl);
+        client->ssl = nullptr;
+    }
+#endif
+
+    sockwrapper::detail::close_socket(client->socket);
+    client->socket = INVALID_SOCKET;
+}
+
+void MockStratumServer::serveClient(const std::shared_ptr<Client> client)
+{
+    std::string buffer;
+
+    char readBuffer[4096];
+
+    if (!acceptClient(client))
+    {
+        closeClient(client);
+        client->finished = true;
+        return;
+    }
+
+    while (!m_shouldStop)
+    {
+        if (m_config.disconnectAfter.count() != 0
+         && std::chrono::steady_clock::now() - client->connectedAt > m_config.disconnectAfter)
+        {
+            break;
+        }
+
+        if (!hasPendingData(client))
+        {
+            const int ready = sockwrapper::detail::select_read(client->socket, 0, POLL_INTERVAL_MICROSECONDS);
+
+            if (ready < 0)
+            {
+                break;
+            }
+
+            if (ready == 0)
+            {
+                continue;
+            }
+        }
+
+        const int bytesRead = receive(client, readBuffer, sizeof(readBuffer));
+
+        if (bytesRead == 0)
+        {
+            break;
+        }
+
+        if (bytesRead < 0)
+        {
+            continue;
+        }
+
+        const auto receivedAt = std::chrono::steady_clock::now();
+
+        buffer.append(readBuffer, bytesRead);
+
+        size_t lineEnd;
+
+        while ((lineEnd = buffer.find('\n')) != std::string::npos)
+        {
+            const std::string line = buffer.substr(0, lineEnd);
+
+            buffer.erase(0, lineEnd + 1);
+
+            handleMessage(client, line, receivedAt);
+        }
+    }
+
+    {
+        std::scoped_lock lock(m_mutex);
+        client->loggedIn = false;
+    }
+
+    closeClient(client);
+
+    client->finished = true;
+}
+
+void MockStratumServer::handleMessage(
+    const std::shared_ptr<Client> &client,
+    const std::string &line,
+    const std::chrono::steady_clock::time_point receivedAt)
+{
+    const auto message = nlohmann::json::parse(line, nullptr, false);
+
+    if (message.is_discarded() || !message.is_object() || message.find("method") == message.end())
+    {
+        return;
+    }
+
+    const std::string method = message.at("method").get<std::string>();
+
+    const nlohmann::json id = message.find("id") != message.end() ? message.at("id") : nlohmann::json();
+
+    nlohmann::json response;
+
+    if (method == "login")
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if (m_currentJob.is_null())
+        {
+            SentJob sentJob;
+            nextJob(sentJob);
+        }
+
+        client->loggedIn = true;
+
+        response = makeResponse(id, {
+            {"id", "miner" + std::to_string(client->id)},
+            {"job", m_currentJob},
+            {"status", "OK"},
+        });
+    }
+    else if (method == "submit")
+    {
+        ReceivedShare share;
+
+        share.clientID = client->id;
+        share.receivedAt = receivedAt;
+
+        const auto params = message.find("params");
+
+        if (params != message.end() && params->is_object())
+        {
+            share.jobID = params->value("job_id", "");
+            share.nonce = params->value("nonce", "");
+        }
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            m_shareCount++;
+
+            share.accepted = m_config.rejectEvery == 0 || m_shareCount % m_config.rejectEvery != 0;
+        }
+
+        if (m_onShare)
+        {
+            m_onShare(share);
+        }
+
+        response = share.accepted
+            ? makeResponse(id, {{"status", "OK"}})
+            : makeError(id, "Low difficulty share");
+    }
+    else if (method == "keepalived")
+    {
+        response = makeResponse(id, {{"status", "KEEPALIVED"}});
+    }
+    else if (method == "getjob")
+    {
+        std::scoped_lock lock(m_mutex);
+
+        response = {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"method", "job"},
+            {"params", m_currentJob},
+        };
+    }
+    else
+    {
+        response = makeError(id, "Unknown method " + method);
+    }
+
+    std::this_thread::sleep_for(m_config.responseDelay);
+
+    sendMessage(client, response);
+}
+
+void MockStratumServer::sendJobs()
+{
+    std::unique_lock lock(m_mutex);
+
+    while (!m_shouldStop)
+    {
+        std::chrono::milliseconds delay = m_config.jobInterval;
+
+        if (delay.count() == 0 && !m_config.replay.empty())
+        {
+            delay = m_config.replay[m_jobCount % m_config.replay.size()].delay;
+        }
+
+        /* Nothing to pace, jobs are only sent on request */
+        if (delay.count() == 0)
+        {
+            m_stopCondition.wait(lock, [this]{ return m_shouldStop.load(); });
+            break;
+        }
+
+        if (m_stopCondition.wait_for(lock, delay, [this]{ return m_shouldStop.load(); }))
+        {
+            break;
+        }
+
+        lock.unlock();
+        pushJob();
+        lock.lock();
+    }
+}
+
+nlohmann::json MockStratumServer::nextJob(SentJob &sentJob)
+{
+    nlohmann::json params;
+
+    if (!m_config.replay.empty())
+    {
+        const size_t index = m_jobCount % m_config.replay.size();
+        const uint64_t pass = m_jobCount / m_config.replay.size();
+
+        params = m_config.replay[index].params;
+
+        /* Job IDs must stay unique when we loop around the recording */
+        if (pass != 0)
+        {
+            params["job_id"] = params.value("job_id", "") + "." + std::to_string(pass);
+        }
+    }
+    else
+    {
+        std::vector<uint8_t> blob(BLOB_SIZE, 0);
+
+        /* Major and minor block version */
+        blob[0] = 1;
+        blob[1] = 1;
+
+        /* Make each blob unique */
+        for (size_t i = 0; i < sizeof(m_jobCount); i++)
+        {
+            blob[2 + i] = static_cast<uint8_t>(m_jobCount >> (i * 8));
+        }
+
+        params = {
+            {"blob", Utilities::toHex(blob)},
+            {"job_id", "job" + std::to_string(m_jobCount)},
+            {"target", m_config.target},
+            {"height", FIRST_HEIGHT + m_jobCount},
+            {"algo", m_config.algorithm},
+        };
+    }
+
+    m_jobCount++;
+
+    m_currentJob = params;
+
+    sentJob.jobID = params.value("job_id", "");
+
+    return {
+        {"jsonrpc", "2.0"},
+        {"method", "job"},
+        {"params", params},
+    };
+}
+
+void MockStratumServer::sendMessage(
+    const std::shared_ptr<Client> &client,
+    const nlohmann::json &message)
+{
+    std::scoped_lock lock(client->writeMutex);
+
+    if (client->socket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (client->ssl)
+    {
+        sendAllTls(client->ssl, client->socket, message.dump() + "\n");
+        return;
+    }
+#endif
+
+    sockwrapper::detail::send_all(client->socket, message.dump() + "\n");
+}
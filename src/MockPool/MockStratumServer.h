@@ -0,0 +1,255 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ExternalLibs/json.hpp"
+#include "SocketWrapper/SocketWrapper.h"
+
+/* A job to send to the miner, and how long to wait after the previous job
+   before sending it */
+struct ReplayJob
+{
+    /* The job params, as they appear in a job notification */
+    nlohmann::json params;
+
+    std::chrono::milliseconds delay {0};
+};
+
+/* A share the miner submitted to us */
+struct ReceivedShare
+{
+    /* Which connection submitted it */
+    uint64_t clientID;
+
+    std::string jobID;
+
+    /* The nonce, in hex, as sent by the miner */
+    std::string nonce;
+
+    /* Did we accept the share */
+    bool accepted;
+
+    /* When we finished reading the submit message */
+    std::chrono::steady_clock::time_point receivedAt;
+};
+
+/* A miner which connected to us */
+struct AcceptedConnection
+{
+    uint64_t clientID;
+
+    /* Did the miner connect with TLS */
+    bool tls = false;
+
+    /* Did the miner resume an earlier TLS session, rather than doing a full
+       handshake */
+    bool resumed = false;
+
+    /* How long the TLS handshake took */
+    std::chrono::microseconds handshakeTime {0};
+};
+
+/* A job we sent to the miners */
+struct SentJob
+{
+    std::string jobID;
+
+    std::chrono::steady_clock::time_point sentAt;
+};
+
+struct MockPoolConfig
+{
+    std::string host = "127.0.0.1";
+
+    /* 0 picks a free port, see MockStratumServer::port() */
+    uint16_t port = 0;
+
+    /* How often to send a new job. 0 only sends jobs on request, or at the
+       pace recorded in the replay. */
+    std::chrono::milliseconds jobInterval {0};
+
+    /* Delay before sending any message to the miner, to simulate a distant
+       pool */
+    std::chrono::milliseconds responseDelay {0};
+
+    /* Drop each connection after this long. 0 never drops connections. */
+    std::chrono::milliseconds disconnectAfter {0};
+
+    /* Target sent with generated jobs. ffffffff accepts every hash. */
+    std::string target = "ffffffff";
+
+    /* Algorithm sent with generated jobs */
+    std::string algorithm = "chukwa";
+
+    /* Reject every nth share as low difficulty. 0 accepts every share. */
+    uint32_t rejectEvery = 0;
+
+    /* Serve stratum over TLS, with a throwaway self signed certificate.
+       Needs SSL support. */
+    bool ssl = false;
+
+    /* Jobs to send, in order, looping when we reach the end. If empty, we
+       generate jobs with increasing heights. */
+    std::vector<ReplayJob> replay;
+};
+
+/* Read a recorded session, one JSON message per line. Each line may be a job
+   notification, a login response containing a job, or bare job params, and
+   may have a "delay" in milliseconds since the previous job. Throws if the
+   file cannot be read or contains no jobs. */
+std::vector<ReplayJob> loadReplay(const std::string &filename);
+
+/* A local stratum pool speaking the login / job / submit / keepalived
+   protocol, for testing and benchmarking the pool code without a live pool.
+   Each connection is served by its own thread. */
+class MockStratumServer
+{
+  public:
+    MockStratumServer(const MockPoolConfig &config);
+
+    ~MockStratumServer();
+
+    /* Bind and start accepting miners. Throws if we cannot bind. */
+    void start();
+
+    /* Stop listening and drop every connection. Miners trying to reconnect
+       will be refused. */
+    void stop();
+
+    /* The port we are listening on */
+    uint16_t port() const;
+
+    /* Send a new job to every logged in miner right away */
+    SentJob pushJob();
+
+    /* Drop every connection, but keep accepting new ones */
+    void disconnectAll();
+
+    /* Number of logged in miners */
+    size_t loggedInCount() const;
+
+    /* Register a function to call when a share is submitted. Called from
+       the connection threads. */
+    void onShare(const std::function<void(const ReceivedShare &share)> callback);
+
+    /* Register a function to call when a miner connects, after the TLS
+       handshake if using TLS. Called from the connection threads. */
+    void onConnection(const std::function<void(const AcceptedConnection &connection)> callback);
+
+  private:
+    struct Client
+    {
+        uint64_t id;
+
+        socket_t socket;
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+        /* Null unless using TLS */
+        SSL *ssl = nullptr;
+#endif
+
+        bool loggedIn = false;
+
+        /* Set once the connection thread has exited and can be joined */
+        std::atomic<bool> finished = false;
+
+        std::chrono::steady_clock::time_point connectedAt;
+
+        std::thread thread;
+
+        /* Job notifications and responses come from different threads. Also
+           guards reads when using TLS, as an SSL object can't be read and
+           written at once. */
+        std::mutex writeMutex;
+    };
+
+    /* Accept new connections until stopped */
+    void acceptConnections();
+
+    /* Join the threads of connections which have closed */
+    void reapClients();
+
+    /* Read and respond to messages from a single miner */
+    void serveClient(const std::shared_ptr<Client> client);
+
+    /* Do the TLS handshake, if using TLS. Returns false if it failed. */
+    bool acceptClient(const std::shared_ptr<Client> &client);
+
+    /* Read what the miner has sent. Returns the number of bytes read, 0 if
+       the connection is closed, or -1 if there is nothing to read yet. */
+    int receive(const std::shared_ptr<Client> &client, char *buffer, const size_t size);
+
+    /* Is data already buffered, which select won't tell us about */
+    bool hasPendingData(const std::shared_ptr<Client> &client);
+
+    /* Close the connection to the miner */
+    void closeClient(const std::shared_ptr<Client> &client);
+
+    void handleMessage(
+        const std::shared_ptr<Client> &client,
+        const std::string &line,
+        const std::chrono::steady_clock::time_point receivedAt);
+
+    /* Send jobs at the configured pace */
+    void sendJobs();
+
+    /* Make the next job the current job, and return the notification */
+    nlohmann::json nextJob(SentJob &sentJob);
+
+    void sendMessage(
+        const std::shared_ptr<Client> &client,
+        const nlohmann::json &message);
+
+    const MockPoolConfig m_config;
+
+    /* The listening socket */
+    socket_t m_socket = INVALID_SOCKET;
+
+    uint16_t m_port = 0;
+
+    std::vector<std::shared_ptr<Client>> m_clients;
+
+    uint64_t m_nextClientID = 0;
+
+    /* The params of the latest job */
+    nlohmann::json m_currentJob;
+
+    /* How many jobs we have made */
+    uint64_t m_jobCount = 0;
+
+    /* How many shares we have been sent */
+    uint64_t m_shareCount = 0;
+
+    std::function<void(const ReceivedShare &share)> m_onShare;
+
+    std::function<void(const AcceptedConnection &connection)> m_onConnection;
+
+#if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    /* Null unless using TLS */
+    SSL_CTX *m_sslContext = nullptr;
+#endif
+
+    std::thread m_acceptThread;
+
+    std::thread m_jobThread;
+
+    std::atomic<bool> m_shouldStop = false;
+
+    /* Wakes the job thread when stopping */
+    std::condition_variable m_stopCondition;
+
+    /* Guards the clients, the current job, and the counters */
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,141 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <future>
+#include <iostream>
+
+#include "ExternalLibs/cxxopts.hpp"
+#include "MockPool/MockStratumServer.h"
+#include "Utilities/ColouredMsg.h"
+
+MockPoolConfig getMockPoolConfig(int argc, char **argv)
+{
+    MockPoolConfig config;
+
+    config.port = 3333;
+
+    bool help = false;
+
+    uint64_t jobInterval = 0;
+    uint64_t responseDelay = 0;
+    uint64_t disconnectAfter = 0;
+
+    std::string replayFile;
+
+    cxxopts::Options options(argv[0], "A local stratum pool for testing and benchmarking the miner");
+
+    options.add_options("Core")
+        ("h,help", "Display this help message",
+         cxxopts::value<bool>(help)->implicit_value("true"))
+
+        ("host", "The address to listen on",
+         cxxopts::value<std::string>(config.host)->default_value(config.host), "<host>")
+
+        ("port", "The port to listen on",
+         cxxopts::value<uint16_t>(config.port)->default_value(std::to_string(config.port)), "<port>")
+
+        ("ssl", "Serve stratum over TLS, with a throwaway self signed certificate",
+         cxxopts::value<bool>(config.ssl)->implicit_value("true"));
+
+    options.add_options("Jobs")
+        ("jobInterval", "Send a new job every this many milliseconds. Overrides the pace of the replay",
+         cxxopts::value<uint64_t>(jobInterval), "<ms>")
+
+        ("replay", "Replay the jobs from a recorded session, one JSON message per line",
+         cxxopts::value<std::string>(replayFile), "<file>")
+
+        ("target", "The target to send with generated jobs",
+         cxxopts::value<std::string>(config.target)->default_value(config.target), "<hex>")
+
+        ("algorithm", "The algorithm to send with generated jobs",
+         cxxopts::value<std::string>(config.algorithm)->default_value(config.algorithm), "<algorithm>");
+
+    options.add_options("Faults")
+        ("latency", "Delay every message to the miner by this many milliseconds",
+         cxxopts::value<uint64_t>(responseDelay), "<ms>")
+
+        ("disconnectAfter", "Drop each connection after this many milliseconds",
+         cxxopts::value<uint64_t>(disconnectAfter), "<ms>")
+
+        ("rejectEvery", "Reject every nth share",
+         cxxopts::value<uint32_t>(config.rejectEvery), "<n>");
+
+    try
+    {
+        options.parse(argc, argv);
+
+        if (help)
+        {
+            std::cout << options.help({}) << std::endl;
+            exit(0);
+        }
+
+        if (replayFile != "")
+        {
+            config.replay = loadReplay(replayFile);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Error parsing options: ") << WarningMsg(e.what()) << std::endl;
+        exit(1);
+    }
+
+    config.jobInterval = std::chrono::milliseconds(jobInterval);
+    config.responseDelay = std::chrono::milliseconds(responseDelay);
+    config.disconnectAfter = std::chrono::milliseconds(disconnectAfter);
+
+    return config;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const MockPoolConfig config = getMockPoolConfig(argc, argv);
+
+        MockStratumServer server(config);
+
+        server.onShare([](const ReceivedShare &share)
+        {
+            std::cout << InformationMsg("[miner" + std::to_string(share.clientID) + "] ")
+                      << WhiteMsg("Share for job " + share.jobID + ", nonce " + share.nonce + ": ");
+
+            if (share.accepted)
+            {
+                std::cout << SuccessMsg("accepted") << std::endl;
+            }
+            else
+            {
+                std::cout << WarningMsg("rejected") << std::endl;
+            }
+        });
+
+        server.onConnection([](const AcceptedConnection &connection)
+        {
+            std::cout << InformationMsg("[miner" + std::to_string(connection.clientID) + "] ")
+                      << WhiteMsg("Connected");
+
+            if (connection.tls)
+            {
+                std::cout << WhiteMsg(connection.resumed ? ", resumed TLS session" : ", full TLS handshake")
+                          << WhiteMsg(" in " + std::to_string(connection.handshakeTime.count()) + "us");
+            }
+
+            std::cout << std::endl;
+        });
+
+        server.start();
+
+        std::cout << SuccessMsg("Mock pool listening on " + config.host + ":" + std::to_string(server.port())) << std::endl;
+
+        /* Run until killed */
+        std::promise<void>().get_future().wait();
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Mock pool crashed with error: ") << WarningMsg(e.what()) << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,695 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////////////////
+#include "PoolCommunication/DaemonJobSource.h"
+//////////////////////////////////////////////
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "PoolCommunication/PoolConnection.h"
+#include "SocketWrapper/SocketWrapper.h"
+#include "Utilities/ColouredMsg.h"
+#include "Utilities/String.h"
+
+namespace
+{
+    /* Templates kept around for blocks found just after the next arrives */
+    constexpr size_t MAX_TEMPLATES = 4;
+
+    /* How long to wait before trying an unreachable daemon again */
+    constexpr std::chrono::seconds RETRY_INTERVAL {5};
+
+    constexpr time_t CONNECT_TIMEOUT_SECONDS = 5;
+
+    /* Anything but a long poll should be answered quickly */
+    constexpr std::chrono::seconds REQUEST_TIMEOUT {10};
+
+    /* Templates with a lot of transactions can be large */
+    constexpr size_t MAX_RESPONSE_SIZE = 16 * 1024 * 1024;
+
+    /* Bytes of the hashing blob before the nonce, see Job::nonce() */
+    constexpr size_t NONCE_OFFSET = 39;
+
+    /* The daemon didn't answer in time. For a long poll, this just means the
+       chain hasn't moved. */
+    class TimedOut : public std::runtime_error
+    {
+      public:
+        TimedOut(): std::runtime_error("Timed out waiting for the daemon to respond")
+        {
+        }
+    };
+
+    socket_t connectTo(const std::string &host, const uint16_t port)
+    {
+        const socket_t socket = sockwrapper::detail::create_socket(host.c_str(), port, [](socket_t sock, struct addrinfo &ai) {
+            sockwrapper::detail::set_nonblocking(sock, true);
+
+            if (connect(sock, ai.ai_addr, static_cast<int>(ai.ai_addrlen)) < 0)
+            {
+                if (sockwrapper::detail::is_connection_error()
+                 || !sockwrapper::detail::wait_until_socket_is_ready(sock, CONNECT_TIMEOUT_SECONDS, 0))
+                {
+                    return false;
+                }
+            }
+
+            sockwrapper::detail::set_nonblocking(sock, false);
+
+            return true;
+        });
+
+        if (socket == INVALID_SOCKET)
+        {
+            throw std::runtime_error("Failed to connect to the daemon at " + host + ":" + std::to_string(port));
+        }
+
+        return socket;
+    }
+
+    /* Read an HTTP response, returning the body. Throws on errors, timeouts,
+       or if we are stopped while waiting. */
+    std::string readResponse(
+        const socket_t socket,
+        const std::chrono::steady_clock::time_point deadline,
+        const std::atomic<bool> &shouldStop)
+    {
+        std::string response;
+
+        size_t headerEnd = std::string::npos;
+
+        std::optional<size_t> contentLength;
+
+        char buffer[16384];
+
+        while (headerEnd == std::string::npos || !contentLength || response.size() < headerEnd + *contentLength)
+        {
+            if (shouldStop)
+            {
+                throw std::runtime_error("Stopped");
+            }
+
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                throw TimedOut();
+            }
+
+            /* Wake up regularly so we notice when we are stopped */
+            const int ready = sockwrapper::detail::select_read(socket, 0, 250000);
+
+            if (ready < 0)
+            {
+                throw std::runtime_error("Lost connection to the daemon");
+            }
+
+            if (ready == 0)
+            {
+                continue;
+            }
+
+            const auto bytesRead = recv(socket, buffer, sizeof(buffer), 0);
+
+            if (bytesRead < 0)
+            {
+                throw std::runtime_error("Lost connection to the daemon");
+            }
+
+            /* We asked the daemon to close the connection when it's done */
+            if (bytesRead == 0)
+            {
+                break;
+            }
+
+            response.append(buffer, bytesRead);
+
+            if (response.size() > MAX_RESPONSE_SIZE)
+            {
+                throw std::runtime_error("Daemon response is too large");
+            }
+
+            if (headerEnd != std::string::npos)
+            {
+                continue;
+            }
+
+            const size_t end = response.find("\r\n\r\n");
+
+            if (end == std::string::npos)
+            {
+                continue;
+            }
+
+            headerEnd = end + 4;
+
+            std::string headers = response.substr(0, end);
+
+            std::transform(headers.begin(), headers.end(), headers.begin(), [](const unsigned char c)
+            {
+                return std::tolower(c);
+            });
+
+            std::stringstream statusLine(headers.substr(0, headers.find("\r\n")));
+
+            std::string version;
+            int status = 0;
+
+            statusLine >> version >> status;
+
+            if (status != 200)
+            {
+                throw std::runtime_error("Daemon responded with HTTP status " + std::to_string(status));
+            }
+
+            if (headers.find("transfer-encoding: chunked") != std::string::npos)
+            {
+                throw std::runtime_error("Chunked responses from the daemon are not supported");
+            }
+
+            const size_t lengthHeader = headers.find("\r\ncontent-length:");
+
+            if (lengthHeader != std::string::npos)
+            {
+                contentLength = std::stoull(headers.substr(lengthHeader + 17));
+            }
+        }
+
+        if (headerEnd == std::string::npos)
+        {
+            throw std::runtime_error("Daemon closed the connection without responding");
+        }
+
+        return response.substr(headerEnd, contentLength.value_or(std::string::npos));
+    }
+}
+
+DaemonJobSource::DaemonJobSource(const DaemonConfig &config):
+    m_config(config)
+{
+    m_pool.host = config.host;
+    m_pool.port = config.port;
+    m_pool.username = config.walletAddress;
+    m_pool.algorithm = config.algorithm;
+}
+
+DaemonJobSource::~DaemonJobSource()
+{
+    logout();
+}
+
+void DaemonJobSource::logout()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+    }
+
+    m_wake.notify_all();
+    m_blockFound.notify_all();
+
+    if (m_pollThread.joinable())
+    {
+        m_pollThread.join();
+    }
+
+    if (m_submitThread.joinable())
+    {
+        m_submitThread.join();
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    m_connected = false;
+    m_longPollID = "";
+
+    /* For jobs we're done with */
+    m_foundBlocks.clear();
+}
+
+Job DaemonJobSource::getJob()
+{
+    std::scoped_lock lock(m_mutex);
+    return m_currentJob;
+}
+
+bool DaemonJobSource::submitShare(
+    const uint8_t *,
+    const std::string jobID,
+    const uint32_t nonce)
+{
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto blockTemplate = std::find_if(m_templates.begin(), m_templates.end(), [&](const auto &t)
+        {
+            return t.jobID == jobID;
+        });
+
+        if (blockTemplate == m_templates.end())
+        {
+            m_staleBlocksDropped++;
+            return false;
+        }
+
+        FoundBlock found { jobID, blockTemplate->blob, blockTemplate->height };
+
+        std::memcpy(found.block.data() + blockTemplate->nonceOffset, &nonce, sizeof(nonce));
+
+        m_foundBlocks.push_back(std::move(found));
+    }
+
+    /* The daemon can take a while, don't hold up the caller */
+    m_blockFound.notify_all();
+
+    return true;
+}
+
+void DaemonJobSource::submitBlocks()
+{
+    while (true)
+    {
+        FoundBlock found;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_blockFound.wait(lock, [this]{ return m_shouldStop || !m_foundBlocks.empty(); });
+
+            if (m_shouldStop)
+            {
+                return;
+            }
+
+            found = std::move(m_foundBlocks.front());
+            m_foundBlocks.pop_front();
+        }
+
+        submitBlock(found);
+    }
+}
+
+void DaemonJobSource::submitBlock(const FoundBlock &found)
+{
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        call("submitblock", nlohmann::json::array({ Utilities::toHex(found.block) }), REQUEST_TIMEOUT);
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            m_roundTripMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            m_acceptedBlocks++;
+
+            /* The chain has moved on, don't wait for the next poll */
+            m_refreshNow = true;
+        }
+
+        m_wake.notify_all();
+
+        printPool();
+        std::cout << SuccessMsg("Found a block at height " + std::to_string(found.height) + "!") << std::endl;
+
+        if (m_onHashAccepted)
+        {
+            m_onHashAccepted(found.jobID);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+
+            m_rejectedBlocks++;
+            m_rejectReasons[e.what()]++;
+        }
+
+        printPool();
+        std::cout << WarningMsg("Block at height " + std::to_string(found.height) + " was rejected: " + e.what()) << std::endl;
+    }
+}
+
+void DaemonJobSource::startManaging()
+{
+    if (m_pollThread.joinable())
+    {
+        logout();
+    }
+
+    m_shouldStop = false;
+
+    printPool();
+    std::cout << WhiteMsg("Fetching a block template from the daemon...") << std::endl;
+
+    m_pollThread = std::thread(&DaemonJobSource::pollTemplates, this);
+    m_submitThread = std::thread(&DaemonJobSource::submitBlocks, this);
+}
+
+void DaemonJobSource::pollTemplates()
+{
+    std::string lastError;
+
+    while (!m_shouldStop)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        bool succeeded = true;
+
+        try
+        {
+            fetchTemplate();
+
+            lastError = "";
+        }
+        catch (const std::exception &e)
+        {
+            if (m_shouldStop)
+            {
+                return;
+            }
+
+            succeeded = false;
+
+            bool wasConnected = false;
+
+            {
+                std::scoped_lock lock(m_mutex);
+
+                wasConnected = m_connected;
+
+                m_connected = false;
+
+                /* The daemon may have restarted without long polling */
+                m_longPollID = "";
+            }
+
+            /* Don't repeat ourselves every retry */
+            if (wasConnected || e.what() != lastError)
+            {
+                printPool();
+                std::cout << WarningMsg("Failed to get a block template: " + std::string(e.what())) << std::endl;
+
+                lastError = e.what();
+            }
+
+            if (wasConnected && m_onPoolDisconnected)
+            {
+                m_onPoolDisconnected();
+            }
+        }
+
+        std::unique_lock lock(m_mutex);
+
+        /* A long poll has already waited for the daemon, this stops us
+           spinning if it answers them straight away */
+        const auto nextPoll = start + (succeeded ? std::chrono::milliseconds(m_config.pollInterval) : RETRY_INTERVAL);
+
+        m_wake.wait_until(lock, nextPoll, [this]{ return m_shouldStop || m_refreshNow; });
+
+        m_refreshNow = false;
+    }
+}
+
+void DaemonJobSource::fetchTemplate()
+{
+    nlohmann::json params = {
+        {"wallet_address", m_config.walletAddress},
+        {"reserve_size", 0},
+    };
+
+    /* Only written by this thread */
+    bool longPoll = m_longPollID != "";
+
+    auto start = std::chrono::steady_clock::now();
+
+    nlohmann::json result;
+
+    if (longPoll)
+    {
+        /* A long poll only returns when the chain moves, so come back in
+           time to refresh the template with the latest transactions */
+        std::chrono::steady_clock::time_point refreshDue;
+
+        {
+            std::scoped_lock lock(m_mutex);
+            refreshDue = m_jobReceived + std::chrono::seconds(m_config.refreshInterval);
+        }
+
+        const auto timeout = std::clamp<std::chrono::milliseconds>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(refreshDue - start),
+            std::chrono::seconds(1),
+            std::chrono::seconds(m_config.longPollTimeout)
+        );
+
+        params["longpollid"] = m_longPollID;
+
+        try
+        {
+            result = call("getblocktemplate", params, timeout);
+        }
+        catch (const TimedOut &)
+        {
+            /* Nothing has changed. Keep the longpollid and poll again, unless
+               the template is due a refresh. */
+            if (std::chrono::steady_clock::now() < refreshDue)
+            {
+                return;
+            }
+
+            params.erase("longpollid");
+
+            longPoll = false;
+            start = std::chrono::steady_clock::now();
+
+            result = call("getblocktemplate", params, REQUEST_TIMEOUT);
+        }
+    }
+    else
+    {
+        result = call("getblocktemplate", params, REQUEST_TIMEOUT);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    Job job;
+
+    std::string error;
+
+    if (!parseJobBlob(result.at("blockhashing_blob").get<std::string>(), job, error))
+    {
+        throw std::invalid_argument("Daemon sent an invalid template: " + error);
+    }
+
+    const uint64_t difficulty = result.at("difficulty").get<uint64_t>();
+
+    if (difficulty == 0)
+    {
+        throw std::invalid_argument("Daemon sent a template with zero difficulty");
+    }
+
+    job.shareDifficulty = difficulty;
+    job.target = 0xFFFFFFFFFFFFFFFFULL / difficulty;
+    job.height = result.at("height").get<uint64_t>();
+    job.algorithm = m_config.algorithm;
+
+    BlockTemplate blockTemplate;
+
+    blockTemplate.blob = Utilities::fromHex(result.at("blocktemplate_blob").get<std::string>());
+    blockTemplate.height = *job.height;
+
+    /* The header we hash is in the block somewhere, with the nonce after it.
+       Usually at the start, but blocks with a parent block carry it there. */
+    const auto header = std::search(
+        blockTemplate.blob.begin(),
+        blockTemplate.blob.end(),
+        job.rawBlob.begin(),
+        job.rawBlob.begin() + NONCE_OFFSET
+    );
+
+    if (header == blockTemplate.blob.end()
+     || static_cast<size_t>(blockTemplate.blob.end() - header) < NONCE_OFFSET + sizeof(uint32_t))
+    {
+        throw std::invalid_argument("Can't find the nonce in the block template, unsupported block format");
+    }
+
+    blockTemplate.nonceOffset = (header - blockTemplate.blob.begin()) + NONCE_OFFSET;
+
+    const std::string prevHash = result.value("prev_hash", "");
+    const std::string longPollID = result.value("longpollid", "");
+
+    bool wasConnected = false;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        /* A long poll measures how long until the next block instead */
+        if (!longPoll)
+        {
+            m_roundTripMilliseconds = std::chrono::duration<double, std::milli>(now - start).count();
+        }
+
+        const bool refreshDue = now - m_jobReceived >= std::chrono::seconds(m_config.refreshInterval);
+
+        const bool changed = !m_connected
+                          || m_templates.empty()
+                          || *job.height != m_height
+                          || prevHash != m_prevHash
+                          || longPollID != m_longPollID
+                          || refreshDue;
+
+        m_longPollID = longPollID;
+
+        if (!changed)
+        {
+            return;
+        }
+
+        m_jobCount++;
+
+        job.jobID = std::to_string(m_jobCount);
+        blockTemplate.jobID = job.jobID;
+
+        m_templates.push_back(blockTemplate);
+
+        if (m_templates.size() > MAX_TEMPLATES)
+        {
+            m_templates.pop_front();
+        }
+
+        m_currentJob = job;
+        m_height = *job.height;
+        m_prevHash = prevHash;
+        m_jobReceived = now;
+
+        wasConnected = m_connected;
+        m_connected = true;
+    }
+
+    if (!wasConnected)
+    {
+        printPool();
+        std::cout << SuccessMsg("Solo mining at height " + std::to_string(*job.height)) << std::endl;
+
+        if (m_onPoolSwapped)
+        {
+            m_onPoolSwapped(m_pool);
+        }
+    }
+    else if (m_onNewJob)
+    {
+        m_onNewJob(job);
+    }
+}
+
+nlohmann::json DaemonJobSource::call(
+    const std::string &method,
+    const nlohmann::json &params,
+    const std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    const std::string body = nlohmann::json {
+        {"jsonrpc", "2.0"},
+        {"id", "0"},
+        {"method", method},
+        {"params", params},
+    }.dump();
+
+    std::stringstream request;
+
+    request << "POST /json_rpc HTTP/1.1\r\n"
+            << "Host: " << m_config.host << ":" << m_config.port << "\r\n"
+            << "Content-Type: application/json\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: close\r\n"
+            << "\r\n"
+            << body;
+
+    const socket_t socket = connectTo(m_config.host, m_config.port);
+
+    std::string response;
+
+    try
+    {
+        if (!sockwrapper::detail::send_all(socket, request.str()))
+        {
+            throw std::runtime_error("Lost connection to the daemon");
+        }
+
+        response = readResponse(socket, deadline, m_shouldStop);
+    }
+    catch (...)
+    {
+        sockwrapper::detail::close_socket(socket);
+        throw;
+    }
+
+    sockwrapper::detail::close_socket(socket);
+
+    const auto json = nlohmann::json::parse(response);
+
+    if (json.find("error") != json.end() && !json.at("error").is_null())
+    {
+        const auto &error = json.at("error");
+
+        throw std::runtime_error(
+            error.is_object() && error.find("message") != error.end()
+                ? error.at("message").get<std::string>()
+                : error.dump()
+        );
+    }
+
+    return json.at("result");
+}
+
+void DaemonJobSource::onNewJob(const std::function<void(const Job &job)> callback)
+{
+    m_onNewJob = callback;
+}
+
+void DaemonJobSource::onHashAccepted(const std::function<void(const std::string &shareID)> callback)
+{
+    m_onHashAccepted = callback;
+}
+
+void DaemonJobSource::onPoolSwapped(const std::function<void(const Pool &pool)> callback)
+{
+    m_onPoolSwapped = callback;
+}
+
+void DaemonJobSource::onPoolDisconnected(const std::function<void(void)> callback)
+{
+    m_onPoolDisconnected = callback;
+}
+
+void DaemonJobSource::printPool() const
+{
+    std::cout << InformationMsg(formatPool(m_pool));
+}
+
+PoolStats DaemonJobSource::getPoolStats() const
+{
+    std::scoped_lock lock(m_mutex);
+
+    PoolStats stats;
+
+    stats.pool = m_config.host + ":" + std::to_string(m_config.port);
+    stats.connected = m_connected;
+    stats.roundTripMilliseconds = m_roundTripMilliseconds;
+    stats.smoothedRoundTripMilliseconds = m_roundTripMilliseconds;
+    stats.jobAgeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_jobReceived).count();
+    stats.shareDifficulty = m_currentJob.shareDifficulty;
+    stats.algorithm = m_config.algorithm;
+    stats.acceptedShares = m_acceptedBlocks;
+    stats.rejectedShares = m_rejectedBlocks;
+    stats.rejectReasons = m_rejectReasons;
+    stats.staleSharesDropped = m_staleBlocksDropped;
+
+    return stats;
+}
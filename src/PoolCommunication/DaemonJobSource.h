@@ -0,0 +1,162 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "PoolCommunication/IJobSource.h"
+#include "Types/DaemonConfig.h"
+
+/* Solo mines against a daemon, with no pool in between. Block templates are
+   fetched with getblocktemplate over JSON-RPC, long polling if the daemon
+   hands out a longpollid, and polling otherwise. Each template becomes a job
+   at the network difficulty, and every share found is a block, which is sent
+   straight back with submitblock, from a thread of its own so the caller
+   never waits on the daemon. */
+class DaemonJobSource : virtual public IJobSource
+{
+  public:
+    DaemonJobSource(const DaemonConfig &config);
+
+    ~DaemonJobSource();
+
+    virtual void logout();
+
+    virtual Job getJob();
+
+    virtual bool submitShare(
+        const uint8_t *hash,
+        const std::string jobID,
+        const uint32_t nonce);
+
+    virtual void startManaging();
+
+    virtual void onNewJob(const std::function<void(const Job &job)>);
+
+    virtual void onHashAccepted(const std::function<void(const std::string &shareID)>);
+
+    virtual void onPoolSwapped(const std::function<void(const Pool &pool)>);
+
+    virtual void onPoolDisconnected(const std::function<void(void)>);
+
+    virtual void printPool() const;
+
+    virtual PoolStats getPoolStats() const;
+
+  private:
+    /* A template we have handed out as a job, which blocks may still be
+       found for */
+    struct BlockTemplate
+    {
+        std::string jobID;
+
+        /* The full block, to write the nonce into and submit */
+        std::vector<uint8_t> blob;
+
+        /* Where the nonce goes in the full block */
+        size_t nonceOffset;
+
+        uint64_t height;
+    };
+
+    /* A block waiting to be sent to the daemon */
+    struct FoundBlock
+    {
+        std::string jobID;
+
+        std::vector<uint8_t> block;
+
+        uint64_t height;
+    };
+
+    /* Fetch templates until stopped */
+    void pollTemplates();
+
+    /* Fetch a template, and hand it out if it differs from the current one.
+       Throws if the daemon can't be reached or sends something invalid. */
+    void fetchTemplate();
+
+    /* Send found blocks to the daemon until stopped */
+    void submitBlocks();
+
+    void submitBlock(const FoundBlock &block);
+
+    /* Make a JSON-RPC call to the daemon, returning the result. Throws on
+       failure, or if the daemon returns an error. */
+    nlohmann::json call(
+        const std::string &method,
+        const nlohmann::json &params,
+        const std::chrono::milliseconds timeout);
+
+    const DaemonConfig m_config;
+
+    /* The daemon, dressed up as a pool for the rest of the miner */
+    Pool m_pool;
+
+    Job m_currentJob {};
+
+    /* Newest last */
+    std::deque<BlockTemplate> m_templates;
+
+    uint64_t m_jobCount = 0;
+
+    /* What the current template was built on, to spot the chain moving */
+    std::string m_prevHash;
+
+    uint64_t m_height = 0;
+
+    /* Set if the daemon supports long polling */
+    std::string m_longPollID;
+
+    std::chrono::steady_clock::time_point m_jobReceived;
+
+    bool m_connected = false;
+
+    double m_roundTripMilliseconds = 0;
+
+    uint64_t m_acceptedBlocks = 0;
+
+    uint64_t m_rejectedBlocks = 0;
+
+    std::map<std::string, uint64_t> m_rejectReasons;
+
+    /* Blocks found for a template we no longer have */
+    uint64_t m_staleBlocksDropped = 0;
+
+    std::function<void(const Job &job)> m_onNewJob;
+
+    std::function<void(const std::string &shareID)> m_onHashAccepted;
+
+    std::function<void(const Pool &pool)> m_onPoolSwapped;
+
+    std::function<void(void)> m_onPoolDisconnected;
+
+    std::thread m_pollThread;
+
+    std::thread m_submitThread;
+
+    /* Blocks found which we haven't sent yet, oldest first */
+    std::deque<FoundBlock> m_foundBlocks;
+
+    /* Wakes the submit thread when stopping, or when a block is found */
+    std::condition_variable m_blockFound;
+
+    std::atomic<bool> m_shouldStop = false;
+
+    /* Set when we found a block, to fetch the next template straight away */
+    bool m_refreshNow = false;
+
+    /* Wakes the poll thread when stopping, or to refresh */
+    std::condition_variable m_wake;
+
+    /* Guards the job, templates and stats */
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "Types/MinerStats.h"
+#include "Types/Pool.h"
+#include "Types/PoolMessage.h"
+
+/* Where the miner gets jobs from and sends shares to. Normally a pool, but
+   can be anything which hands out jobs, such as the offline benchmark. */
+class IJobSource
+{
+  public:
+    /* Stop handing out jobs, and close any connections */
+    virtual void logout() = 0;
+
+    /* Get the current job */
+    virtual Job getJob() = 0;
+
+    /* Submit a *valid* share. Returns false if the share was dropped, for
+       example as it was for a stale job. */
+    virtual bool submitShare(
+        const uint8_t *hash,
+        const std::string jobID,
+        const uint32_t nonce) = 0;
+
+    /* Start handing out jobs */
+    virtual void startManaging() = 0;
+
+    /* Register a function to call when a new job is available */
+    virtual void onNewJob(const std::function<void(const Job &job)>) = 0;
+
+    /* Register a function to call when a share is accepted */
+    virtual void onHashAccepted(const std::function<void(const std::string &shareID)>) = 0;
+
+    /* Register a function to call when we start getting jobs from a
+       different source, including the first */
+    virtual void onPoolSwapped(const std::function<void(const Pool &pool)>) = 0;
+
+    /* Register a function to call when we stop getting jobs */
+    virtual void onPoolDisconnected(const std::function<void(void)>) = 0;
+
+    /* Prints the current job source for formatting purposes */
+    virtual void printPool() const = 0;
+
+    /* Get the round trip time, job age, etc of the current job source */
+    virtual PoolStats getPoolStats() const = 0;
+
+    virtual ~IJobSource() {};
+};
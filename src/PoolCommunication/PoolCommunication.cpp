@@ -6,18 +6,18 @@
 #include "PoolCommunication/PoolCommunication.h"
 ////////////////////////////////////////////////
 
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <thread>
 
-#include "Config/Constants.h"
-#include "ExternalLibs/json.hpp"
-#include "SocketWrapper/SocketWrapper.h"
-#include "Types/PoolMessage.h"
 #include "Utilities/ColouredMsg.h"
-#include "Utilities/Utilities.h"
 
-PoolCommunication::PoolCommunication(std::vector<Pool> allPools)
+PoolCommunication::PoolCommunication(
+    std::vector<Pool> allPools,
+    const PoolManagerConfig config):
+    m_config(config)
 {
     /* Sort pools based on their priority */
     std::sort(allPools.begin(), allPools.end(), [](const auto a, const auto b)
@@ -26,47 +26,22 @@ PoolCommunication::PoolCommunication(std::vector<Pool> allPools)
     });
 
     m_allPools = allPools;
-}
-
-std::string formatPool(const Pool pool)
-{
-    return "[" + pool.host + ":" + std::to_string(pool.port) + "] ";
-}
-
-void loginFailed(
-    const Pool pool,
-    const int loginAttempt,
-    const bool connectFail,
-    const std::string customMessage = "")
-{
-    std::stringstream stream;
-
-    stream << "Failed to " << (connectFail ? "connect" : "login")
-           << " to pool, attempt ";
-
-    std::cout << InformationMsg(formatPool(pool)) << WarningMsg(stream.str())
-              << InformationMsg(loginAttempt)
-              << InformationMsg("/")
-              << InformationMsg(Constants::MAX_LOGIN_ATTEMPTS) << std::endl;
+    m_connections.resize(m_allPools.size());
 
-    if (customMessage != "")
+    for (size_t i = 0; i < m_allPools.size(); i++)
     {
-        std::cout << InformationMsg(formatPool(pool))
-                  << WarningMsg("Error: " + customMessage) << std::endl;
-    }
+        m_health.push_back(std::make_shared<PoolHealth>());
 
-    if (loginAttempt != Constants::MAX_LOGIN_ATTEMPTS)
-    {
-        std::cout << InformationMsg(formatPool(pool)) << "Will try again in "
-                  << InformationMsg(Constants::POOL_LOGIN_RETRY_INTERVAL / 1000)
-                  << " seconds." << std::endl;
+        m_backoff.emplace_back(
+            std::chrono::milliseconds(m_config.reconnectDelay),
+            std::chrono::milliseconds(m_config.maxReconnectDelay)
+        );
     }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(Constants::POOL_LOGIN_RETRY_INTERVAL));
 }
 
 void PoolCommunication::printPool() const
 {
+    std::scoped_lock lock(m_mutex);
     std::cout << InformationMsg(formatPool(m_currentPool));
 }
 
@@ -77,150 +52,181 @@ PoolCommunication::~PoolCommunication()
 
 void PoolCommunication::logout()
 {
-    m_shouldStop = true;
-
-    m_findNewPool.notify_all();
-
-    if (m_socket)
     {
-        m_socket->stop();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_shouldStop = true;
+        m_findNewPool.notify_all();
     }
 
     if (m_managerThread.joinable())
     {
         m_managerThread.join();
     }
+
+    std::vector<std::shared_ptr<PoolConnection>> connections;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        connections.swap(m_connections);
+        m_connections.resize(m_allPools.size());
+        m_activeConnection = nullptr;
+    }
+
+    /* Must not hold the lock while stopping, as stopping waits for any
+       running socket callbacks, which may take the lock */
+    for (auto &connection : connections)
+    {
+        if (connection)
+        {
+            connection->stop();
+        }
+    }
 }
 
-void PoolCommunication::getNewJob()
+std::shared_ptr<PoolConnection> PoolCommunication::createConnection(const size_t poolIndex)
 {
-    const nlohmann::json newJobMsg = {
-        {"method", "getjob"},
-        {"params", {
-            {"id", m_currentPool.loginID},
-            {"rigid", m_currentPool.rigID},
-            {"agent", m_currentPool.getAgent()},
-        }},
-        {"id", 1}
-    };
+    auto connection = std::make_shared<PoolConnection>(
+        m_allPools[poolIndex],
+        m_health[poolIndex]
+    );
+
+    /* Weak, as the connection owns the callbacks. Locking it in the callback
+       keeps the connection alive if the manager drops it meanwhile. */
+    const std::weak_ptr<PoolConnection> weakConnection = connection;
+
+    connection->onNewJob([this, weakConnection](const Job &job) {
+        bool isActive = false;
 
-    m_socket->sendMessage(newJobMsg.dump() + "\n");
+        {
+            std::scoped_lock lock(m_mutex);
+            isActive = m_activeConnection != nullptr && m_activeConnection == weakConnection.lock();
+        }
+
+        /* Standby pools just keep their latest job ready for if we swap to
+           them */
+        if (isActive && m_onNewJob)
+        {
+            m_onNewJob(job);
+        }
+    });
+
+    connection->onHashAccepted([this](const std::string &shareID) {
+        if (m_onHashAccepted)
+        {
+            m_onHashAccepted(shareID);
+        }
+    });
+
+    connection->onClosed([this, weakConnection]() {
+        if (const auto connection = weakConnection.lock())
+        {
+            handleConnectionClosed(connection);
+        }
+    });
+
+    return connection;
 }
 
-void PoolCommunication::registerHandlers()
+void PoolCommunication::handleConnectionClosed(const std::shared_ptr<PoolConnection> &connection)
 {
-    m_socket->onMessage([this](std::string message) {
-        try
-        {
-            Utilities::trim(message);
-            Utilities::removeCharFromString(message, '\n');
-            Utilities::removeCharFromString(message, '\0');
+    std::shared_ptr<PoolConnection> promoted;
 
-            if (message == "")
-            {
-                return;
-            }
+    bool wasActive = false;
 
-            auto poolMessage = parsePoolMessage(message);
+    {
+        std::scoped_lock lock(m_mutex);
 
-            if (auto job = std::get_if<JobMessage>(&poolMessage))
-            {
-                updateJobInfoFromPool(job->job);
+        if (m_activeConnection == connection)
+        {
+            wasActive = true;
 
-                m_currentJob = job->job;
+            m_activeConnection = nullptr;
 
-                if (m_onNewJob)
-                {
-                    m_onNewJob(job->job);
-                }
-            }
-            else if (auto status = std::get_if<StatusMessage>(&poolMessage))
-            {
-                if (status->status == "OK" && m_onHashAccepted)
-                {
-                    m_onHashAccepted(status->ID);
-                }
-                else if (status->status == "KEEPALIVED")
-                {
-                    // kept alive
-                }
-                else
-                {
-                    std::cout << WarningMsg("Unknown status message: " + status->status);
-                }
-            }
-            else if (auto error = std::get_if<ErrorMessage>(&poolMessage))
-            {
-                const auto errorMessage = error->error.errorMessage;
+            std::string reason;
 
-                std::cout << InformationMsg("Error message received from pool: ") << WarningMsg(errorMessage) << std::endl;
+            /* Swap to the best standby pool, if we have one. The closed
+               connection is no longer connected, so won't be chosen. */
+            const size_t best = choosePool(reason);
 
-                if (errorMessage == "Low difficulty share")
-                {
-                    std::cout << WarningMsg("Probably a stale job, unless you are only getting rejected shares") << std::endl
-                              << WarningMsg("If this is the case, ensure you are using the correct mining algorithm for this pool.") << std::endl;
-                }
-                else if (errorMessage == "Invalid nonce; is miner not compatible with NiceHash?")
-                {
-                    std::cout << WarningMsg("Make sure \"niceHash\" is set to true in your config file.") << std::endl;
-                }
-                else if (errorMessage == "Invalid job id")
-                {
-                    getNewJob();
-                }
-            }
-            else
+            if (best != m_allPools.size())
             {
-                std::cout << WarningMsg("Unexpected message: " + message) << std::endl;
+                promoted = m_connections[best];
+                m_activeConnection = promoted;
+                m_currentPool = promoted->getPool();
             }
         }
-        catch (const std::exception &e)
-        {
-            std::cout << WarningMsg(e.what()) << std::endl;
-        }
-    });
+    }
 
-    /* Socket closed */
-    m_socket->onSocketClosed([this]() {
+    if (!wasActive)
+    {
+        std::cout << InformationMsg(formatPool(connection->getPool()))
+                  << WarningMsg("Lost connection with standby pool.") << std::endl;
+    }
+    else
+    {
         std::cout << WarningMsg("Lost connection with pool.") << std::endl;
 
+        if (promoted)
+        {
+            std::cout << InformationMsg(formatPool(promoted->getPool()))
+                      << SuccessMsg("Switched to standby pool.") << std::endl;
+
+            if (m_onPoolSwapped)
+            {
+                m_onPoolSwapped(promoted->getPool());
+            }
+        }
         /* Let the miner know to stop mining */
-        if (m_onPoolDisconnected) {
+        else if (m_onPoolDisconnected)
+        {
             m_onPoolDisconnected();
         }
+    }
 
-        std::unique_lock<std::mutex> lock(m_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-        m_shouldFindNewPool = true;
+    /* Get the manager to reconnect */
+    m_shouldFindNewPool = true;
 
-        m_findNewPool.notify_all();
-    });
+    m_findNewPool.notify_all();
 }
 
 Job PoolCommunication::getJob()
 {
-    return m_currentJob;
+    std::shared_ptr<PoolConnection> connection;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        connection = m_activeConnection;
+    }
+
+    if (!connection)
+    {
+        return Job();
+    }
+
+    return connection->getJob();
 }
 
-void PoolCommunication::submitShare(
+bool PoolCommunication::submitShare(
     const uint8_t *hash,
     const std::string jobID,
     const uint32_t nonce)
 {
-    const nlohmann::json submitMsg = {
-        {"method", "submit"},
-        {"params", {
-            {"id", m_currentPool.loginID},
-            {"job_id", jobID},
-            {"nonce", Utilities::toHex(nonce)},
-            {"result", Utilities::toHex(hash, 32)},
-            {"rigid", m_currentPool.rigID},
-            {"agent", m_currentPool.getAgent()},
-        }},
-        {"id", 1}
-    };
+    std::shared_ptr<PoolConnection> connection;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        connection = m_activeConnection;
+    }
 
-    m_socket->sendMessage(submitMsg.dump() + "\n");
+    /* Not connected to a pool, nowhere to send it */
+    if (!connection)
+    {
+        return false;
+    }
+
+    return connection->submitShare(hash, jobID, nonce);
 }
 
 void PoolCommunication::onNewJob(const std::function<void(const Job &job)> callback)
@@ -262,175 +268,308 @@ void PoolCommunication::startManaging()
     m_managerThread = std::thread(&PoolCommunication::managePools, this);
 }
 
-bool PoolCommunication::tryLogin(const Pool &pool)
+std::chrono::steady_clock::time_point PoolCommunication::maintainConnections()
 {
-    std::shared_ptr<sockwrapper::SocketWrapper> socket;
+    auto nextRetry = std::chrono::steady_clock::time_point::max();
 
-    #if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
-    if (pool.ssl)
-    {
-        socket = std::make_shared<sockwrapper::SSLSocketWrapper>(
-            pool.host.c_str(), pool.port, '\n', Constants::POOL_LOGIN_RETRY_INTERVAL / 1000
-        );
-    }
-    else
-    {
-    #endif
-        socket = std::make_shared<sockwrapper::SocketWrapper>(
-            pool.host.c_str(), pool.port, '\n', Constants::POOL_LOGIN_RETRY_INTERVAL / 1000
-        );
-    #if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
-    }
-    #endif
+    /* The pool we mine on, plus the standbys */
+    const size_t wantedConnections = 1 + m_config.standbyPoolCount;
 
-    std::cout << InformationMsg(formatPool(pool)) << SuccessMsg("Attempting to connect to pool...") << std::endl;
+    size_t connected = 0;
 
-    for (int i = 1; i <= Constants::MAX_LOGIN_ATTEMPTS; i++)
-    {
-        const bool success = socket->start();
+    /* Priority of the most preferred pool we are connected to. With latency
+       aware selection, we want every pool of this priority connected. */
+    std::optional<size_t> tierPriority;
 
-        if (!success)
+    /* Most preferred pool = 0. We step down the list, in order of preference,
+       until we have enough pools connected. Anything less preferred than that
+       gets disconnected. */
+    for (size_t poolPreference = 0; poolPreference < m_allPools.size(); poolPreference++)
+    {
+        if (m_shouldStop)
         {
-            loginFailed(pool, i, true);
-            continue;
+            return nextRetry;
         }
 
-        const nlohmann::json loginMsg = {
-            {"method", "login"},
-            {"params", {
-                {"login", pool.username},
-                {"pass", pool.password},
-                {"rigid", pool.rigID},
-                {"agent", pool.getAgent()}
-            }},
-            {"id", 1},
-            {"jsonrpc", "2.0"}
-        };
-
-        const auto res = socket->sendMessageAndGetResponse(loginMsg.dump() + "\n");
-
-        if (res)
+        std::shared_ptr<PoolConnection> connection;
+
         {
-            LoginMessage message;
+            std::scoped_lock lock(m_mutex);
+            connection = m_connections[poolPreference];
+        }
 
-            try
+        /* Dropped since we last looked */
+        if (connection && !connection->isConnected())
+        {
             {
-                message = nlohmann::json::parse(*res);
+                std::scoped_lock lock(m_mutex);
+                m_connections[poolPreference] = nullptr;
             }
-            catch (const std::exception &e)
+
+            connection->stop();
+            connection = nullptr;
+
+            m_backoff[poolPreference].disconnected(std::chrono::steady_clock::now());
+        }
+
+        const bool isConnected = connection != nullptr;
+
+        const bool inTier = m_config.latencyAwareSelection
+                         && tierPriority
+                         && *tierPriority == m_allPools[poolPreference].priority;
+
+        const bool wanted = connected < wantedConnections || inTier;
+
+        if (isConnected && wanted)
+        {
+            connected++;
+
+            if (!tierPriority)
             {
-                try
-                {
-                    /* Failed to parse as LoginMessage. Maybe it's an error message? */
-                    const ErrorMessage errMessage = nlohmann::json::parse(*res);
-                    loginFailed(pool, i, false, errMessage.error.errorMessage);
-                }
-                catch (const std::exception &)
-                {
-                    loginFailed(pool, i, false, "Failed to parse message from pool (" + std::string(e.what()) + ") (" + *res + ")");
-                }
+                tierPriority = m_allPools[poolPreference].priority;
+            }
 
+            continue;
+        }
+
+        if (!isConnected && wanted)
+        {
+            ReconnectBackoff &backoff = m_backoff[poolPreference];
+
+            /* Failed recently, fall through to the next pool in the meantime,
+               rather than holding everything up retrying this one */
+            if (!backoff.ready(std::chrono::steady_clock::now()))
+            {
+                nextRetry = std::min(nextRetry, backoff.nextAttempt());
                 continue;
             }
 
-            try
+            auto newConnection = createConnection(poolPreference);
+
+            const bool loginSuccess = newConnection->login();
+
             {
-                std::cout << InformationMsg(formatPool(pool)) << SuccessMsg("Logged in.") << std::endl;
+                std::scoped_lock lock(m_mutex);
+                m_connections[poolPreference] = loginSuccess ? newConnection : nullptr;
+            }
 
-                if (m_socket)
-                {
-                    m_socket->stop();
-                }
+            if (!loginSuccess)
+            {
+                const auto wait = backoff.failed(std::chrono::steady_clock::now());
 
-                m_socket = socket;
-                m_currentPool = pool;
-                m_currentPool.loginID = message.loginID;
-                updateJobInfoFromPool(message.job);
-                m_currentJob = message.job;
+                nextRetry = std::min(nextRetry, backoff.nextAttempt());
 
-                if (*message.job.nonce() != 0)
-                {
-                    m_currentPool.niceHash = true;
-                }
+                std::cout << InformationMsg(formatPool(m_allPools[poolPreference])) << "Will try again in "
+                          << InformationMsg(wait.count()) << "ms." << std::endl;
+            }
+            else
+            {
+                backoff.connected(std::chrono::steady_clock::now());
 
-                registerHandlers();
+                connected++;
 
-                if (m_onPoolSwapped)
+                if (!tierPriority)
                 {
-                    m_onPoolSwapped(pool);
+                    tierPriority = m_allPools[poolPreference].priority;
                 }
 
-                return true;
+                /* Mine on this pool straight away if it's more preferred */
+                updateActivePool();
             }
-            catch (const std::exception &e)
+
+            continue;
+        }
+
+        if (!connection)
+        {
+            continue;
+        }
+
+        /* Not wanted, a less preferred pool than we need */
+        {
+            std::scoped_lock lock(m_mutex);
+
+            /* The active pool is always one of the wanted pools, so this
+               shouldn't happen, but don't pull the rug from under it */
+            if (m_activeConnection == connection)
             {
-                loginFailed(pool, i, false, std::string(e.what()));
                 continue;
             }
+
+            m_connections[poolPreference] = nullptr;
         }
-        else
+
+        connection->stop();
+    }
+
+    return nextRetry;
+}
+
+void PoolCommunication::updateActivePool()
+{
+    std::shared_ptr<PoolConnection> newActive;
+
+    std::string reason;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const size_t best = choosePool(reason);
+
+        if (best == m_allPools.size() || m_connections[best] == m_activeConnection)
         {
-            loginFailed(pool, i, false);
-            continue;
+            return;
         }
+
+        newActive = m_connections[best];
+
+        m_activeConnection = newActive;
+        m_currentPool = newActive->getPool();
     }
 
-    std::cout << InformationMsg(formatPool(pool)) << WarningMsg("All login/connect attempts failed.") << std::endl;
+    if (!reason.empty())
+    {
+        std::cout << InformationMsg(formatPool(newActive->getPool()))
+                  << SuccessMsg("Switching to pool, " + reason) << std::endl;
+    }
 
-    return false;
+    if (m_onPoolSwapped)
+    {
+        m_onPoolSwapped(newActive->getPool());
+    }
 }
 
-void PoolCommunication::managePools()
+size_t PoolCommunication::choosePool(std::string &reason)
 {
-    auto lastKeptAlive = std::chrono::high_resolution_clock::now();
+    const size_t none = m_allPools.size();
 
-    while (!m_shouldStop)
+    const auto isConnected = [this](const size_t i)
     {
-        if (m_shouldFindNewPool) {
-            m_currentPoolIndex = m_allPools.size();
-        }
+        return m_connections[i] && m_connections[i]->isConnected();
+    };
 
-        /* Most preferred pool = 0, current pool is = current pool index, so if we're
-           not connected to the most preferred pool, we step down the list, in
-           order of preference, trying to reconnect to each. */
-        for (size_t poolPreference = 0; poolPreference < m_currentPoolIndex; poolPreference++)
+    size_t preferred = none;
+
+    for (size_t i = 0; i < m_allPools.size(); i++)
+    {
+        if (isConnected(i))
         {
-            if (m_shouldStop)
-            {
-                return;
-            }
+            preferred = i;
+            break;
+        }
+    }
 
-            /* Grab the pool */
-            const auto pool = m_allPools[poolPreference];
+    if (preferred == none || !m_config.latencyAwareSelection)
+    {
+        return preferred;
+    }
 
-            /* Try and login */
-            const bool loginSuccess = tryLogin(pool);
+    const auto isHealthy = [this](const size_t i)
+    {
+        return m_health[i]->rejectRate() <= m_config.maxRejectRate;
+    };
 
-            if (loginSuccess)
-            {
-                /* Cool, got a more preferred pool. */
-                m_currentPoolIndex = poolPreference;
-                m_shouldFindNewPool = false;
-                break;
-            }
-        }
+    const auto roundTrip = [this](const size_t i)
+    {
+        return m_health[i]->roundTripMilliseconds().value_or(std::numeric_limits<double>::max());
+    };
+
+    size_t fastest = none;
+    size_t fastestHealthy = none;
+    size_t active = none;
 
-        /* Still not found a pool. Go again. */
-        if (m_shouldFindNewPool)
+    /* Pools are sorted by priority, so the pools of equal priority follow
+       on from the most preferred */
+    for (size_t i = preferred; i < m_allPools.size() && m_allPools[i].priority == m_allPools[preferred].priority; i++)
+    {
+        if (!isConnected(i))
         {
             continue;
         }
-        else if (lastKeptAlive + std::chrono::seconds(120) < std::chrono::high_resolution_clock::now())
+
+        if (m_connections[i] == m_activeConnection)
+        {
+            active = i;
+        }
+
+        if (fastest == none || roundTrip(i) < roundTrip(fastest))
+        {
+            fastest = i;
+        }
+
+        if (isHealthy(i) && (fastestHealthy == none || roundTrip(i) < roundTrip(fastestHealthy)))
+        {
+            fastestHealthy = i;
+        }
+    }
+
+    const size_t best = fastestHealthy != none ? fastestHealthy : fastest;
+
+    /* Not mining on a pool of this priority, so no need to be sticky */
+    if (active == none || active == best)
+    {
+        return best;
+    }
+
+    std::stringstream stream;
+
+    stream << std::fixed << std::setprecision(1);
+
+    if (!isHealthy(active) && isHealthy(best))
+    {
+        stream << "current pool is rejecting " << m_health[active]->rejectRate() << "% of shares";
+        reason = stream.str();
+        return best;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    if (now - m_lastLatencySwitch < std::chrono::seconds(m_config.minSwitchInterval))
+    {
+        return active;
+    }
+
+    if (roundTrip(best) < roundTrip(active) * (1 - m_config.roundTripSwitchThreshold / 100))
+    {
+        stream << "round trip time " << roundTrip(best) << "ms vs " << roundTrip(active) << "ms";
+        reason = stream.str();
+        m_lastLatencySwitch = now;
+        return best;
+    }
+
+    return active;
+}
+
+void PoolCommunication::managePools()
+{
+    auto lastKeptAlive = std::chrono::steady_clock::now();
+
+    /* Keepalives double as our round trip time measurement, so send them
+       more often if we're picking pools based on it */
+    const auto keepAliveInterval = m_config.latencyAwareSelection
+        ? std::chrono::seconds(m_config.latencyProbeInterval)
+        : std::chrono::seconds(120);
+
+    while (!m_shouldStop)
+    {
+        const auto nextRetry = maintainConnections();
+
+        if (lastKeptAlive + keepAliveInterval < std::chrono::steady_clock::now())
         {
             keepAlive();
-            lastKeptAlive = std::chrono::high_resolution_clock::now();
+            lastKeptAlive = std::chrono::steady_clock::now();
         }
 
+        /* Round trip times or reject rates may have changed */
+        updateActivePool();
+
         std::unique_lock<std::mutex> lock(m_mutex);
 
-        /* Nice, found a pool. Wait for the timeout, or for a pool to disconnect,
-           then we'll retry any possibly more preferred pools. */
-        m_findNewPool.wait_for(lock, std::chrono::seconds(5), [&]{
+        /* Wait for the timeout, a pool to be due a retry, or a pool to
+           disconnect, then we'll retry any possibly more preferred pools. */
+        const auto wakeTime = std::min(std::chrono::steady_clock::now() + std::chrono::seconds(5), nextRetry);
+
+        m_findNewPool.wait_until(lock, wakeTime, [&]{
             if (m_shouldStop)
             {
                 return true;
@@ -438,35 +577,73 @@ void PoolCommunication::managePools()
 
             return m_shouldFindNewPool;
         });
+
+        m_shouldFindNewPool = false;
     }
 }
 
 void PoolCommunication::keepAlive()
 {
-    const nlohmann::json pingMsg = {
-        {"method", "keepalived"},
-        {"params", {
-            {"id", m_currentPool.loginID},
-            {"rigid", m_currentPool.rigID},
-            {"agent", m_currentPool.getAgent()},
-        }},
-        {"id", 1}
-    };
+    std::vector<std::shared_ptr<PoolConnection>> connections;
 
-    m_socket->sendMessage(pingMsg.dump() + "\n");
-}
-
-void PoolCommunication::updateJobInfoFromPool(Job &job) const
-{
-    job.isNiceHash = isNiceHash();
+    {
+        std::scoped_lock lock(m_mutex);
+        connections = m_connections;
+    }
 
-    if (job.algorithm.empty() || m_currentPool.disableAutoAlgoSelect)
+    /* Standby pools need keeping alive too, or they'll drop us before we
+       ever get to use them */
+    for (const auto &connection : connections)
     {
-        job.algorithm = m_currentPool.algorithm;
+        if (connection && connection->isConnected())
+        {
+            connection->keepAlive();
+        }
     }
 }
 
 bool PoolCommunication::isNiceHash() const
 {
+    std::scoped_lock lock(m_mutex);
     return m_currentPool.niceHash;
 }
+
+PoolStats PoolCommunication::getPoolStats() const
+{
+    std::shared_ptr<PoolConnection> connection;
+
+    PoolStats stats;
+
+    size_t standbyPools = 0;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        /* Not logged in to any pool yet */
+        if (m_currentPool.host.empty())
+        {
+            return stats;
+        }
+
+        connection = m_activeConnection;
+
+        for (const auto &standby : m_connections)
+        {
+            if (standby && standby != connection && standby->isConnected())
+            {
+                standbyPools++;
+            }
+        }
+
+        stats.pool = m_currentPool.host + ":" + std::to_string(m_currentPool.port);
+    }
+
+    if (connection)
+    {
+        stats = connection->getStats();
+    }
+
+    stats.standbyPools = standbyPools;
+
+    return stats;
+}
@@ -4,87 +4,118 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 
-#include "SocketWrapper/SocketWrapper.h"
+#include "PoolCommunication/IJobSource.h"
+#include "PoolCommunication/PoolConnection.h"
+#include "PoolCommunication/ReconnectBackoff.h"
+#include "Types/MinerStats.h"
 #include "Types/Pool.h"
+#include "Types/PoolManagerConfig.h"
 #include "Types/PoolMessage.h"
 
-class PoolCommunication
+class PoolCommunication : virtual public IJobSource
 {
   public:
-    PoolCommunication(const std::vector<Pool> pools);
+    PoolCommunication(
+        const std::vector<Pool> pools,
+        const PoolManagerConfig config = PoolManagerConfig());
 
     ~PoolCommunication();
 
-    /* Open socket and connect to one of the pools */
-    void login(const bool initialLogin);
-
-    /* Close current socket connection */
-    void logout();
+    /* Close all pool connections */
+    virtual void logout();
 
     /* Get the next job */
-    Job getJob();
+    virtual Job getJob();
 
-    /* Submit a *valid* share to the pool. */
-    void submitShare(
+    /* Submit a *valid* share to the pool. Returns false if the share was
+       dropped, as we're not connected, or it was for a stale job. */
+    virtual bool submitShare(
         const uint8_t *hash,
         const std::string jobID,
         const uint32_t nonce);
 
     /* Triggers us to start listening for messages and handling them */
-    void startManaging();
+    virtual void startManaging();
 
     /* Register a function to call when a new job is discovered */
-    void onNewJob(const std::function<void(const Job &job)>);
+    virtual void onNewJob(const std::function<void(const Job &job)>);
 
     /* Register a function to call when a share is accepted */
-    void onHashAccepted(const std::function<void(const std::string &shareID)>);
+    virtual void onHashAccepted(const std::function<void(const std::string &shareID)>);
 
     /* Register a function to call when the current pool is disconnected and
        a new pool is connected */
-    void onPoolSwapped(const std::function<void(const Pool &pool)>);
+    virtual void onPoolSwapped(const std::function<void(const Pool &pool)>);
 
     /* Register a function to call when the current pool is disconnected */
-    void onPoolDisconnected(const std::function<void(void)>);
+    virtual void onPoolDisconnected(const std::function<void(void)>);
 
     /* Prints the currently connected pool for formatting purposes */
-    void printPool() const;
-
-    /* Gets the name of the current algorithm */
-    std::string getAlgorithmName() const;
+    virtual void printPool() const;
 
     /* Whether we should use nicehash style nonces */
     bool isNiceHash() const;
 
+    /* Get the round trip time, job age, etc of the current pool */
+    virtual PoolStats getPoolStats() const;
+
   private:
     /* Connect to pools when necessary */
     void managePools();
 
-    /* Keep the pool connection alive */
-    void keepAlive();
+    /* Login to the most preferred pools, keeping the active pool plus the
+       configured number of standby pools connected. Pools we recently failed
+       to reach are skipped until their backoff expires. Returns when the
+       next of those is due a retry. */
+    std::chrono::steady_clock::time_point maintainConnections();
+
+    /* Mine on the best connected pool, if we aren't already */
+    void updateActivePool();
 
-    void registerHandlers();
+    /* Pick the connected pool we should be mining on. Normally the most
+       preferred, but with latency aware selection, the fastest healthy pool
+       of that priority. Fills in reason if swapping for being faster or
+       healthier. Returns m_allPools.size() if no pools are connected. Must be
+       called with m_mutex held. */
+    size_t choosePool(std::string &reason);
 
-    /* Request the latest job from the pool */
-    void getNewJob();
+    /* Keep every pool connection alive */
+    void keepAlive();
 
-    bool tryLogin(const Pool &pool);
+    /* Create a connection to the given pool, hooked up to our callbacks */
+    std::shared_ptr<PoolConnection> createConnection(const size_t poolIndex);
 
-    /* Set nicehash, algo name, etc on the job info based on the current pool */
-    void updateJobInfoFromPool(Job &job) const;
+    /* Called from the socket thread when a connection drops */
+    void handleConnectionClosed(const std::shared_ptr<PoolConnection> &connection);
 
-    /* The current pool we are connected to */
+    /* The current pool we are mining on, or last mined on */
     Pool m_currentPool;
 
     /* All the pools available to connect to */
     std::vector<Pool> m_allPools;
 
-    /* The socket instance for the pool we are talking to */
-    std::shared_ptr<sockwrapper::SocketWrapper> m_socket;
+    const PoolManagerConfig m_config;
 
-    /* The current job to be working on */
-    Job m_currentJob;
+    /* Connections to each pool, in order of preference. Null if we are not
+       connected to that pool. */
+    std::vector<std::shared_ptr<PoolConnection>> m_connections;
+
+    /* Share latencies, rejects and round trip times for each pool, in order
+       of preference */
+    std::vector<std::shared_ptr<PoolHealth>> m_health;
+
+    /* When to next try connecting to each pool, in order of preference. Only
+       used from the manager thread. */
+    std::vector<ReconnectBackoff> m_backoff;
+
+    /* The connection we are mining on. One of m_connections. */
+    std::shared_ptr<PoolConnection> m_activeConnection;
+
+    /* When we last swapped to a faster pool */
+    std::chrono::steady_clock::time_point m_lastLatencySwitch;
 
     /* We call this callback every time a new job is given to us */
     std::function<void(const Job &job)> m_onNewJob;
@@ -110,9 +141,7 @@ class PoolCommunication
     /* Handle stopping the manager thread */
     std::atomic<bool> m_shouldStop;
 
-    /* Handle signaling between threads */
-    std::mutex m_mutex;
-
-    /* Which pool are we mining on? 0 = most preferred */
-    size_t m_currentPoolIndex;
+    /* Guards the connections, the current pool, and signalling between
+       threads */
+    mutable std::mutex m_mutex;
 };
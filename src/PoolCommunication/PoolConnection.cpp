@@ -0,0 +1,646 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////////////////////
+#include "PoolCommunication/PoolConnection.h"
+/////////////////////////////////////////////
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "Config/Constants.h"
+#include "ExternalLibs/json.hpp"
+#include "Logger/Logger.h"
+#include "Utilities/ColouredMsg.h"
+#include "Utilities/Utilities.h"
+
+std::string formatPool(const Pool &pool)
+{
+    return "[" + pool.host + ":" + std::to_string(pool.port) + "] ";
+}
+
+namespace
+{
+    /* Shared between connections, so every request we send is unique */
+    std::atomic<uint64_t> nextRequestID {1};
+
+    /* How many jobs to remember. Shares for jobs older than this are
+       considered stale, even if for the current block. */
+    const size_t MAX_RECENT_JOBS = 16;
+
+    void loginFailed(
+        const Pool &pool,
+        const bool connectFail,
+        const std::string customMessage = "")
+    {
+        std::cout << InformationMsg(formatPool(pool))
+                  << WarningMsg(connectFail ? "Failed to connect to pool." : "Failed to login to pool.")
+                  << std::endl;
+
+        if (customMessage != "")
+        {
+            std::cout << InformationMsg(formatPool(pool))
+                      << WarningMsg("Error: " + customMessage) << std::endl;
+        }
+    }
+}
+
+PoolConnection::PoolConnection(
+    const Pool &pool,
+    const std::shared_ptr<PoolHealth> health):
+    m_pool(pool),
+    m_health(health)
+{
+}
+
+PoolConnection::~PoolConnection()
+{
+    stop();
+}
+
+bool PoolConnection::login()
+{
+    std::shared_ptr<sockwrapper::SocketWrapper> socket;
+
+    #if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    std::shared_ptr<sockwrapper::SSLSocketWrapper> sslSocket;
+
+    if (m_pool.ssl)
+    {
+        sslSocket = std::make_shared<sockwrapper::SSLSocketWrapper>(
+            m_pool.host.c_str(), m_pool.port, '\n', Constants::POOL_CONNECT_TIMEOUT / 1000
+        );
+
+        socket = sslSocket;
+    }
+    else
+    {
+    #endif
+        socket = std::make_shared<sockwrapper::SocketWrapper>(
+            m_pool.host.c_str(), m_pool.port, '\n', Constants::POOL_CONNECT_TIMEOUT / 1000
+        );
+    #if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    }
+    #endif
+
+    std::cout << InformationMsg(formatPool(m_pool)) << SuccessMsg("Attempting to connect to pool...") << std::endl;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        m_socketClosed = false;
+        m_jobBeforeLogin.reset();
+    }
+
+    /* Before starting the socket, so we can't miss a job or it closing */
+    registerHandlers(socket);
+
+    const bool success = socket->start();
+
+    if (!success)
+    {
+        loginFailed(m_pool, true);
+        return false;
+    }
+
+    #if defined(SOCKETWRAPPER_OPENSSL_SUPPORT)
+    if (sslSocket)
+    {
+        LOG(Logger::INFO, Logger::NETWORK, formatPool(m_pool)
+            << (sslSocket->sessionReused() ? "Resumed TLS session" : "Full TLS handshake"));
+    }
+    #endif
+
+    const nlohmann::json loginMsg = {
+        {"method", "login"},
+        {"params", {
+            {"login", m_pool.username},
+            {"pass", m_pool.password},
+            {"rigid", m_pool.rigID},
+            {"agent", m_pool.getAgent()}
+        }},
+        {"id", nextRequestID++},
+        {"jsonrpc", "2.0"}
+    };
+
+    const auto loginSentTime = std::chrono::steady_clock::now();
+
+    const auto res = socket->sendMessageAndGetResponse(loginMsg.dump() + "\n");
+
+    const auto loginRoundTrip = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - loginSentTime
+    );
+
+    if (!res)
+    {
+        socket->stop();
+        loginFailed(m_pool, false);
+        return false;
+    }
+
+    LoginMessage message;
+
+    const auto poolMessage = parsePoolMessage(*res);
+
+    if (auto login = std::get_if<LoginMessage>(&poolMessage))
+    {
+        message = *login;
+    }
+    else if (auto error = std::get_if<ErrorMessage>(&poolMessage))
+    {
+        socket->stop();
+        loginFailed(m_pool, false, error->error.errorMessage);
+        return false;
+    }
+    else if (auto invalid = std::get_if<InvalidMessage>(&poolMessage))
+    {
+        socket->stop();
+        loginFailed(m_pool, false, "Failed to parse message from pool (" + invalid->reason + ") (" + *res + ")");
+        return false;
+    }
+    else
+    {
+        socket->stop();
+        loginFailed(m_pool, false, "Unexpected message from pool (" + *res + ")");
+        return false;
+    }
+
+    try
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+
+            /* Dropped straight after sending the login response */
+            if (m_socketClosed)
+            {
+                loginFailed(m_pool, false, "Pool closed the connection");
+                return false;
+            }
+
+            m_socket = socket;
+
+            m_pool.loginID = message.loginID;
+
+            if (*message.job.nonce() != 0)
+            {
+                m_pool.niceHash = true;
+            }
+
+            updateJobInfoFromPool(message.job);
+            setCurrentJob(message.job);
+
+            /* Newer than the job in the login response */
+            if (m_jobBeforeLogin)
+            {
+                updateJobInfoFromPool(*m_jobBeforeLogin);
+                setCurrentJob(*m_jobBeforeLogin);
+                m_jobBeforeLogin.reset();
+            }
+
+            m_connected = true;
+            m_roundTripTime = loginRoundTrip;
+            m_jobReceivedTime = std::chrono::steady_clock::now();
+        }
+
+        std::cout << InformationMsg(formatPool(m_pool)) << SuccessMsg("Logged in.") << std::endl;
+
+        m_health->recordRoundTrip(loginRoundTrip);
+
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        socket->stop();
+        loginFailed(m_pool, false, std::string(e.what()));
+        return false;
+    }
+}
+
+void PoolConnection::stop()
+{
+    std::shared_ptr<sockwrapper::SocketWrapper> socket;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        socket = m_socket;
+    }
+
+    /* Not under the lock, as this waits for the callbacks, which take it */
+    if (socket)
+    {
+        socket->stop();
+    }
+
+    std::scoped_lock lock(m_mutex);
+    m_connected = false;
+}
+
+bool PoolConnection::isConnected() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_connected;
+}
+
+void PoolConnection::registerHandlers(const std::shared_ptr<sockwrapper::SocketWrapper> &socket)
+{
+    socket->onMessage([this](const std::string &message) {
+        try
+        {
+            if (message.empty())
+            {
+                return;
+            }
+
+            LOG(Logger::DEBUG, Logger::NETWORK, formatPool(m_pool) << "Received: " << message);
+
+            auto poolMessage = parsePoolMessage(message);
+
+            if (auto job = std::get_if<JobMessage>(&poolMessage))
+            {
+                {
+                    std::scoped_lock lock(m_mutex);
+
+                    /* Still logging in, login() will pick it up */
+                    if (!m_connected)
+                    {
+                        m_jobBeforeLogin = job->job;
+                        return;
+                    }
+
+                    updateJobInfoFromPool(job->job);
+                    setCurrentJob(job->job);
+                    m_jobReceivedTime = std::chrono::steady_clock::now();
+                }
+
+                if (m_onNewJob)
+                {
+                    m_onNewJob(job->job);
+                }
+            }
+            else if (auto status = std::get_if<StatusMessage>(&poolMessage))
+            {
+                const auto request = completeRequest(status->ID);
+
+                const auto latency = request
+                    ? std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request->sentTime)
+                    : std::chrono::microseconds(0);
+
+                if (status->status == "OK")
+                {
+                    /* Some pools don't echo our ID back, so if we don't know
+                       the request, assume it was a share */
+                    if (request && request->type == RequestType::Submit)
+                    {
+                        m_health->recordAccepted(latency);
+
+                        LOG(Logger::DEBUG, Logger::POOL, formatPool(m_pool) << "Share " << status->ID
+                            << " accepted after " << latency.count() / 1000.0 << "ms");
+                    }
+
+                    if ((!request || request->type == RequestType::Submit) && m_onHashAccepted)
+                    {
+                        m_onHashAccepted(status->ID);
+                    }
+                }
+                else if (status->status == "KEEPALIVED")
+                {
+                    if (request)
+                    {
+                        m_health->recordRoundTrip(latency);
+
+                        std::scoped_lock lock(m_mutex);
+                        m_roundTripTime = latency;
+                    }
+                }
+                else
+                {
+                    std::cout << WarningMsg("Unknown status message: " + status->status);
+                }
+            }
+            else if (auto error = std::get_if<ErrorMessage>(&poolMessage))
+            {
+                const auto errorMessage = error->error.errorMessage;
+
+                const auto request = completeRequest(error->ID);
+
+                if (request && request->type == RequestType::Submit)
+                {
+                    m_health->recordRejected(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - request->sentTime
+                        ),
+                        errorMessage
+                    );
+                }
+
+                std::cout << InformationMsg("Error message received from pool: ") << WarningMsg(errorMessage) << std::endl;
+
+                if (errorMessage == "Low difficulty share")
+                {
+                    std::cout << WarningMsg("Probably a stale job, unless you are only getting rejected shares") << std::endl
+                              << WarningMsg("If this is the case, ensure you are using the correct mining algorithm for this pool.") << std::endl;
+                }
+                else if (errorMessage == "Invalid nonce; is miner not compatible with NiceHash?")
+                {
+                    std::cout << WarningMsg("Make sure \"niceHash\" is set to true in your config file.") << std::endl;
+                }
+                else if (errorMessage == "Invalid job id")
+                {
+                    getNewJob();
+                }
+            }
+            else if (auto invalid = std::get_if<InvalidMessage>(&poolMessage))
+            {
+                std::cout << WarningMsg("Failed to parse pool message (" + invalid->reason + "): " + message) << std::endl;
+            }
+            else
+            {
+                std::cout << WarningMsg("Unexpected message: " + message) << std::endl;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << WarningMsg(e.what()) << std::endl;
+        }
+    });
+
+    /* Socket closed */
+    socket->onSocketClosed([this]() {
+        bool wasConnected;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            wasConnected = m_connected;
+
+            m_connected = false;
+            m_socketClosed = true;
+        }
+
+        /* If we were still logging in, login() fails instead */
+        if (wasConnected && m_onClosed)
+        {
+            m_onClosed();
+        }
+    });
+}
+
+void PoolConnection::keepAlive()
+{
+    const Pool pool = getPool();
+
+    const nlohmann::json pingMsg = {
+        {"method", "keepalived"},
+        {"params", {
+            {"id", pool.loginID},
+            {"rigid", pool.rigID},
+            {"agent", pool.getAgent()},
+        }},
+        {"id", trackRequest(RequestType::KeepAlive)}
+    };
+
+    LOG(Logger::DEBUG, Logger::NETWORK, formatPool(pool) << "Sent: " << pingMsg.dump());
+
+    sendMessage(pingMsg.dump());
+}
+
+void PoolConnection::getNewJob()
+{
+    const Pool pool = getPool();
+
+    const nlohmann::json newJobMsg = {
+        {"method", "getjob"},
+        {"params", {
+            {"id", pool.loginID},
+            {"rigid", pool.rigID},
+            {"agent", pool.getAgent()},
+        }},
+        {"id", nextRequestID++}
+    };
+
+    LOG(Logger::DEBUG, Logger::NETWORK, formatPool(pool) << "Sent: " << newJobMsg.dump());
+
+    sendMessage(newJobMsg.dump());
+}
+
+bool PoolConnection::submitShare(
+    const uint8_t *hash,
+    const std::string &jobID,
+    const uint32_t nonce)
+{
+    const Pool pool = getPool();
+
+    bool stale = false;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        stale = isStale(jobID);
+    }
+
+    /* Don't waste bandwidth, and skew our reject rate, with shares the pool
+       will just reject */
+    if (stale)
+    {
+        m_health->recordStale(pool.submitStaleShares);
+
+        if (!pool.submitStaleShares)
+        {
+            LOG(Logger::DEBUG, Logger::POOL, formatPool(pool) << "Dropped share for stale job " << jobID);
+            return false;
+        }
+    }
+
+    const nlohmann::json submitMsg = {
+        {"method", "submit"},
+        {"params", {
+            {"id", pool.loginID},
+            {"job_id", jobID},
+            {"nonce", Utilities::toHex(nonce)},
+            {"result", Utilities::toHex(hash, 32)},
+            {"rigid", pool.rigID},
+            {"agent", pool.getAgent()},
+        }},
+        {"id", trackRequest(RequestType::Submit)}
+    };
+
+    const std::string message = submitMsg.dump();
+
+    LOG(Logger::DEBUG, Logger::NETWORK, formatPool(pool) << "Sent: " << message);
+
+    sendMessage(message);
+
+    return true;
+}
+
+void PoolConnection::sendMessage(const std::string &message)
+{
+    std::shared_ptr<sockwrapper::SocketWrapper> socket;
+
+    {
+        std::scoped_lock lock(m_mutex);
+        socket = m_socket;
+    }
+
+    if (socket)
+    {
+        socket->sendMessage(message + "\n");
+    }
+}
+
+Job PoolConnection::getJob() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_currentJob;
+}
+
+Pool PoolConnection::getPool() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_pool;
+}
+
+PoolStats PoolConnection::getStats() const
+{
+    std::scoped_lock lock(m_mutex);
+
+    PoolStats stats;
+
+    stats.pool = m_pool.host + ":" + std::to_string(m_pool.port);
+    stats.connected = m_connected;
+    stats.roundTripMilliseconds = m_roundTripTime.count() / 1000.0;
+    stats.shareDifficulty = m_currentJob.shareDifficulty;
+    stats.algorithm = m_currentJob.algorithm;
+
+    stats.inFlightRequests = m_inFlightRequests.size();
+
+    m_health->fill(stats);
+
+    if (m_connected)
+    {
+        stats.jobAgeSeconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - m_jobReceivedTime
+        ).count();
+    }
+
+    return stats;
+}
+
+void PoolConnection::setCurrentJob(const Job &job)
+{
+    m_currentJob = job;
+
+    m_recentJobs.push_back({ job.jobID, job.height });
+
+    if (m_recentJobs.size() > MAX_RECENT_JOBS)
+    {
+        m_recentJobs.pop_front();
+    }
+}
+
+bool PoolConnection::isStale(const std::string &jobID) const
+{
+    const auto it = std::find_if(m_recentJobs.begin(), m_recentJobs.end(), [&jobID](const auto &job)
+    {
+        return job.jobID == jobID;
+    });
+
+    /* Too old, or from a different pool or connection */
+    if (it == m_recentJobs.end())
+    {
+        return true;
+    }
+
+    const auto &latestHeight = m_recentJobs.back().height;
+
+    /* A new block has been found since this job. Jobs at the same height
+       (for example, with new transactions included) are still valid. Without
+       heights, we can only go on the job being recent. */
+    if (it->height && latestHeight && *it->height < *latestHeight)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t PoolConnection::trackRequest(const RequestType type)
+{
+    const uint64_t requestID = nextRequestID++;
+
+    const auto now = std::chrono::steady_clock::now();
+
+    std::scoped_lock lock(m_mutex);
+
+    for (auto it = m_inFlightRequests.begin(); it != m_inFlightRequests.end();)
+    {
+        if (now - it->second.sentTime > std::chrono::milliseconds(Constants::POOL_REQUEST_TIMEOUT))
+        {
+            m_health->recordTimedOut();
+            it = m_inFlightRequests.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    m_inFlightRequests[requestID] = { type, now };
+
+    return requestID;
+}
+
+std::optional<PoolConnection::InFlightRequest> PoolConnection::completeRequest(const std::string &requestID)
+{
+    uint64_t id = 0;
+
+    try
+    {
+        id = std::stoull(requestID);
+    }
+    catch (const std::exception &)
+    {
+        return std::nullopt;
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    const auto it = m_inFlightRequests.find(id);
+
+    if (it == m_inFlightRequests.end())
+    {
+        return std::nullopt;
+    }
+
+    const InFlightRequest request = it->second;
+
+    m_inFlightRequests.erase(it);
+
+    return request;
+}
+
+void PoolConnection::onNewJob(const std::function<void(const Job &job)> callback)
+{
+    m_onNewJob = callback;
+}
+
+void PoolConnection::onHashAccepted(const std::function<void(const std::string &shareID)> callback)
+{
+    m_onHashAccepted = callback;
+}
+
+void PoolConnection::onClosed(const std::function<void(void)> callback)
+{
+    m_onClosed = callback;
+}
+
+void PoolConnection::updateJobInfoFromPool(Job &job) const
+{
+    job.isNiceHash = m_pool.niceHash;
+
+    if (job.algorithm.empty() || m_pool.disableAutoAlgoSelect)
+    {
+        job.algorithm = m_pool.algorithm;
+    }
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include "PoolCommunication/PoolHealth.h"
+#include "SocketWrapper/SocketWrapper.h"
+#include "Types/MinerStats.h"
+#include "Types/Pool.h"
+#include "Types/PoolMessage.h"
+
+/* A single logged in connection to a pool. Tracks the latest job the pool
+   has given us, and the connection health. */
+class PoolConnection
+{
+  public:
+    PoolConnection(
+        const Pool &pool,
+        const std::shared_ptr<PoolHealth> health);
+
+    ~PoolConnection();
+
+    /* Make a single attempt to connect and login to the pool. Callbacks
+       should be registered before calling this. */
+    bool login();
+
+    /* Close the connection. No callbacks will be called once this returns. */
+    void stop();
+
+    /* Are we currently logged in */
+    bool isConnected() const;
+
+    /* Keep the connection alive */
+    void keepAlive();
+
+    /* Request the latest job from the pool */
+    void getNewJob();
+
+    /* Submit a *valid* share to the pool. Shares for jobs which have been
+       superseded are dropped, unless the pool is configured to accept them.
+       Returns whether the share was sent. */
+    bool submitShare(
+        const uint8_t *hash,
+        const std::string &jobID,
+        const uint32_t nonce);
+
+    /* The latest job the pool has given us */
+    Job getJob() const;
+
+    /* The pool we are connected to, with the login ID filled in */
+    Pool getPool() const;
+
+    /* Get the round trip time, job age, etc of the pool */
+    PoolStats getStats() const;
+
+    /* Register a function to call when the pool sends us a new job */
+    void onNewJob(const std::function<void(const Job &job)> callback);
+
+    /* Register a function to call when a share is accepted */
+    void onHashAccepted(const std::function<void(const std::string &shareID)> callback);
+
+    /* Register a function to call when the connection drops */
+    void onClosed(const std::function<void(void)> callback);
+
+  private:
+    enum class RequestType
+    {
+        Submit,
+        KeepAlive,
+    };
+
+    struct InFlightRequest
+    {
+        RequestType type;
+
+        std::chrono::steady_clock::time_point sentTime;
+    };
+
+    struct RecentJob
+    {
+        std::string jobID;
+
+        std::optional<uint64_t> height;
+    };
+
+    /* Must be called before the socket is started */
+    void registerHandlers(const std::shared_ptr<sockwrapper::SocketWrapper> &socket);
+
+    /* Send a message down the current socket, if we have one */
+    void sendMessage(const std::string &message);
+
+    /* Get a new ID to send a request with, and remember when we sent it.
+       Also expires any requests the pool has never responded to. */
+    uint64_t trackRequest(const RequestType type);
+
+    /* Find and remove the request the pool is responding to, if we know it */
+    std::optional<InFlightRequest> completeRequest(const std::string &requestID);
+
+    /* Set nicehash, algo name, etc on the job info based on the pool */
+    void updateJobInfoFromPool(Job &job) const;
+
+    /* Make the job the current job, and remember it for checking shares
+       against. Must be called with m_mutex held. */
+    void setCurrentJob(const Job &job);
+
+    /* Is the job unknown to us, or for an older block than the latest job.
+       Must be called with m_mutex held. */
+    bool isStale(const std::string &jobID) const;
+
+    /* The pool we are connected to */
+    Pool m_pool;
+
+    /* The socket instance for the pool we are talking to */
+    std::shared_ptr<sockwrapper::SocketWrapper> m_socket;
+
+    /* The latest job from the pool */
+    Job m_currentJob;
+
+    /* The most recent jobs the pool has given us, newest last. Shares for
+       any other jobs are stale. */
+    std::deque<RecentJob> m_recentJobs;
+
+    /* Are we currently logged in to the pool */
+    bool m_connected = false;
+
+    /* Did the socket close before we finished logging in */
+    bool m_socketClosed = false;
+
+    /* A job the pool sent before we finished logging in */
+    std::optional<Job> m_jobBeforeLogin;
+
+    /* When we last received a job from the pool */
+    std::chrono::steady_clock::time_point m_jobReceivedTime;
+
+    /* Requests awaiting a response from the pool, by request ID */
+    std::unordered_map<uint64_t, InFlightRequest> m_inFlightRequests;
+
+    /* Share latencies, rejects and round trip times for this pool */
+    const std::shared_ptr<PoolHealth> m_health;
+
+    /* Round trip time of the last login or keepalive */
+    std::chrono::microseconds m_roundTripTime {0};
+
+    std::function<void(const Job &job)> m_onNewJob;
+
+    std::function<void(const std::string &shareID)> m_onHashAccepted;
+
+    std::function<void(void)> m_onClosed;
+
+    /* Guards the above state, which is written from the socket thread */
+    mutable std::mutex m_mutex;
+};
+
+/* Prefix for log messages about the given pool, e.g. [host:port] */
+std::string formatPool(const Pool &pool);
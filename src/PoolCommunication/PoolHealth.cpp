@@ -0,0 +1,118 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////////////////
+#include "PoolCommunication/PoolHealth.h"
+/////////////////////////////////////////
+
+namespace
+{
+    /* How much weight a new round trip sample gets. RTTs are jittery, but we
+       only sample every keepalive, so we can't smooth too heavily. */
+    const double ROUND_TRIP_WEIGHT = 0.3;
+
+    /* How much weight each share result gets, roughly the last 20 shares */
+    const double SHARE_RESULT_WEIGHT = 0.05;
+}
+
+void PoolHealth::recordAccepted(const std::chrono::microseconds latency)
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_acceptedShares++;
+
+    recordLatency(latency);
+    recordShareResult(false);
+}
+
+void PoolHealth::recordRejected(const std::chrono::microseconds latency, const std::string &reason)
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_rejectedShares++;
+    m_rejectReasons[reason]++;
+
+    recordLatency(latency);
+    recordShareResult(true);
+}
+
+void PoolHealth::recordTimedOut()
+{
+    std::scoped_lock lock(m_mutex);
+
+    m_timedOutRequests++;
+}
+
+void PoolHealth::recordStale(const bool submitted)
+{
+    std::scoped_lock lock(m_mutex);
+
+    if (submitted)
+    {
+        m_staleSharesSubmitted++;
+    }
+    else
+    {
+        m_staleSharesDropped++;
+    }
+}
+
+void PoolHealth::recordRoundTrip(const std::chrono::microseconds roundTrip)
+{
+    std::scoped_lock lock(m_mutex);
+
+    const double milliseconds = roundTrip.count() / 1000.0;
+
+    if (!m_roundTripMilliseconds)
+    {
+        m_roundTripMilliseconds = milliseconds;
+    }
+    else
+    {
+        m_roundTripMilliseconds = *m_roundTripMilliseconds * (1 - ROUND_TRIP_WEIGHT)
+                                + milliseconds * ROUND_TRIP_WEIGHT;
+    }
+}
+
+std::optional<double> PoolHealth::roundTripMilliseconds() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_roundTripMilliseconds;
+}
+
+double PoolHealth::rejectRate() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_rejectRate;
+}
+
+void PoolHealth::recordLatency(const std::chrono::microseconds latency)
+{
+    const uint64_t micros = latency.count() > 0 ? latency.count() : 0;
+
+    m_latencyHistogram[latencyBucket(micros)]++;
+    m_latencySumMicroseconds += micros;
+}
+
+void PoolHealth::recordShareResult(const bool rejected)
+{
+    m_rejectRate = m_rejectRate * (1 - SHARE_RESULT_WEIGHT)
+                 + (rejected ? 100 : 0) * SHARE_RESULT_WEIGHT;
+}
+
+void PoolHealth::fill(PoolStats &stats) const
+{
+    std::scoped_lock lock(m_mutex);
+
+    stats.acceptedShares = m_acceptedShares;
+    stats.rejectedShares = m_rejectedShares;
+    stats.rejectReasons = m_rejectReasons;
+    stats.timedOutRequests = m_timedOutRequests;
+    stats.staleSharesDropped = m_staleSharesDropped;
+    stats.staleSharesSubmitted = m_staleSharesSubmitted;
+    stats.shareLatencyHistogram = m_latencyHistogram;
+    stats.shareLatencySumMicroseconds = m_latencySumMicroseconds;
+    stats.smoothedRoundTripMilliseconds = m_roundTripMilliseconds.value_or(0);
+    stats.rejectRate = m_rejectRate;
+}
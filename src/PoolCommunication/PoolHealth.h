@@ -0,0 +1,70 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "Types/MinerStats.h"
+
+/* Share latencies, rejects and round trip times for a single pool. Owned by
+   the pool manager, so the history survives reconnecting to the pool, and
+   can be used to pick between pools. Thread safe. */
+class PoolHealth
+{
+  public:
+    void recordAccepted(const std::chrono::microseconds latency);
+
+    void recordRejected(const std::chrono::microseconds latency, const std::string &reason);
+
+    void recordTimedOut();
+
+    /* Record a share for a superseded job, and whether we submitted it */
+    void recordStale(const bool submitted);
+
+    /* Record the round trip time of a login or keepalive */
+    void recordRoundTrip(const std::chrono::microseconds roundTrip);
+
+    /* Smoothed round trip time in milliseconds, or nullopt if we have never
+       measured it */
+    std::optional<double> roundTripMilliseconds() const;
+
+    /* Percentage of recent shares which were rejected */
+    double rejectRate() const;
+
+    /* Copy the share stats into the given pool stats */
+    void fill(PoolStats &stats) const;
+
+  private:
+    void recordLatency(const std::chrono::microseconds latency);
+
+    void recordShareResult(const bool rejected);
+
+    uint64_t m_acceptedShares = 0;
+
+    uint64_t m_rejectedShares = 0;
+
+    std::map<std::string, uint64_t> m_rejectReasons;
+
+    uint64_t m_timedOutRequests = 0;
+
+    uint64_t m_staleSharesDropped = 0;
+
+    uint64_t m_staleSharesSubmitted = 0;
+
+    std::array<uint64_t, LATENCY_HISTOGRAM_BUCKETS> m_latencyHistogram {};
+
+    uint64_t m_latencySumMicroseconds = 0;
+
+    /* Exponentially weighted round trip time, in milliseconds */
+    std::optional<double> m_roundTripMilliseconds;
+
+    /* Exponentially weighted percentage of shares rejected */
+    double m_rejectRate = 0;
+
+    mutable std::mutex m_mutex;
+};
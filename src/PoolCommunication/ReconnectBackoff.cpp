@@ -0,0 +1,67 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+///////////////////////////////////////////////
+#include "PoolCommunication/ReconnectBackoff.h"
+///////////////////////////////////////////////
+
+#include <algorithm>
+
+namespace
+{
+    /* A connection which stays up this long means the pool is working */
+    const std::chrono::seconds STABLE_CONNECTION_TIME {1};
+}
+
+ReconnectBackoff::ReconnectBackoff(
+    const std::chrono::milliseconds initialDelay,
+    const std::chrono::milliseconds maxDelay):
+    /* A zero delay would never grow, and we'd retry a dead pool in a loop */
+    m_initialDelay(std::max(initialDelay, std::chrono::milliseconds(1))),
+    m_maxDelay(std::max(m_initialDelay, maxDelay))
+{
+}
+
+bool ReconnectBackoff::ready(const std::chrono::steady_clock::time_point now) const
+{
+    return now >= m_nextAttempt;
+}
+
+std::chrono::steady_clock::time_point ReconnectBackoff::nextAttempt() const
+{
+    return m_nextAttempt;
+}
+
+std::chrono::milliseconds ReconnectBackoff::failed(const std::chrono::steady_clock::time_point now)
+{
+    m_delay = m_delay.count() == 0
+        ? m_initialDelay
+        : std::min(m_delay * 2, m_maxDelay);
+
+    /* Wait somewhere between half and all of the delay, and never not at all */
+    std::uniform_int_distribution<int64_t> jitter(std::max<int64_t>(m_delay.count() / 2, 1), m_delay.count());
+
+    const std::chrono::milliseconds wait(jitter(m_random));
+
+    m_nextAttempt = now + wait;
+
+    return wait;
+}
+
+void ReconnectBackoff::connected(const std::chrono::steady_clock::time_point now)
+{
+    m_connectedAt = now;
+}
+
+void ReconnectBackoff::disconnected(const std::chrono::steady_clock::time_point now)
+{
+    if (now - m_connectedAt < STABLE_CONNECTION_TIME)
+    {
+        failed(now);
+        return;
+    }
+
+    m_delay = std::chrono::milliseconds(0);
+    m_nextAttempt = now;
+}
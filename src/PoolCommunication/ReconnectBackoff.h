@@ -0,0 +1,53 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <chrono>
+#include <random>
+
+/* Paces reconnecting to a single pool. The first attempt after losing a
+   working connection is immediate, then each failure doubles the wait, up to
+   a limit. The wait is jittered, so a crowd of miners doesn't hammer a pool
+   which just restarted all at once. Only used from the pool manager thread,
+   so not thread safe. */
+class ReconnectBackoff
+{
+  public:
+    ReconnectBackoff(
+        const std::chrono::milliseconds initialDelay,
+        const std::chrono::milliseconds maxDelay);
+
+    /* Is an attempt due */
+    bool ready(const std::chrono::steady_clock::time_point now) const;
+
+    /* When the next attempt is due */
+    std::chrono::steady_clock::time_point nextAttempt() const;
+
+    /* Record a failed attempt, returning how long until the next one */
+    std::chrono::milliseconds failed(const std::chrono::steady_clock::time_point now);
+
+    /* Record a successful login */
+    void connected(const std::chrono::steady_clock::time_point now);
+
+    /* Record a logged in connection dropping. We retry straight away if it
+       had been up a while, otherwise it counts as a failure, so a pool which
+       kicks us right after login isn't hammered. */
+    void disconnected(const std::chrono::steady_clock::time_point now);
+
+  private:
+    const std::chrono::milliseconds m_initialDelay;
+
+    const std::chrono::milliseconds m_maxDelay;
+
+    /* The wait before jitter, doubled on each failure. Zero once we've had
+       a stable connection. */
+    std::chrono::milliseconds m_delay {0};
+
+    std::chrono::steady_clock::time_point m_nextAttempt {};
+
+    std::chrono::steady_clock::time_point m_connectedAt {};
+
+    std::mt19937 m_random {std::random_device{}()};
+};
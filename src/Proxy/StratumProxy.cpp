@@ -0,0 +1,783 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+////////////////////////////////
+#include "Proxy/StratumProxy.h"
+////////////////////////////////
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#if !defined(_WIN32)
+#include <netinet/tcp.h>
+#endif
+
+#include "Utilities/ColouredMsg.h"
+#include "Utilities/String.h"
+#include "Utilities/Utilities.h"
+
+namespace
+{
+    /* Where the nonce sits in the job blob */
+    constexpr size_t NONCE_OFFSET = 39;
+
+    /* The top byte of the nonce, which nicehash style miners leave alone */
+    constexpr size_t NONCE_PREFIX_OFFSET = NONCE_OFFSET + 3;
+
+    /* Jobs rigs may still be submitting shares for */
+    constexpr size_t MAX_RECENT_JOBS = 4;
+
+    /* A rig with this much waiting to be sent isn't reading, drop it */
+    constexpr size_t MAX_QUEUED_BYTES = 1024 * 1024;
+
+    nlohmann::json makeResponse(const nlohmann::json &id, const nlohmann::json &result)
+    {
+        return {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"error", nullptr},
+            {"result", result},
+        };
+    }
+
+    nlohmann::json makeError(const nlohmann::json &id, const std::string &message)
+    {
+        return {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"error", {{"code", -1}, {"message", message}}},
+            {"result", nullptr},
+        };
+    }
+
+    void printProxy()
+    {
+        std::cout << InformationMsg("[Proxy] ");
+    }
+}
+
+StratumProxy::StratumProxy(
+    const std::shared_ptr<IJobSource> upstream,
+    const std::string &host,
+    const uint16_t port):
+    m_upstream(upstream),
+    m_host(host),
+    m_requestedPort(port)
+{
+    /* Never handed out */
+    m_usedPrefixes[0] = true;
+}
+
+StratumProxy::Connection::Connection(const socket_t socket):
+    socket(socket)
+{
+}
+
+StratumProxy::Connection::~Connection()
+{
+    sockwrapper::detail::close_socket(socket);
+}
+
+StratumProxy::~StratumProxy()
+{
+    stop();
+}
+
+void StratumProxy::start()
+{
+    if (m_socket != INVALID_SOCKET)
+    {
+        stop();
+    }
+
+    m_port = m_requestedPort;
+
+    m_socket = sockwrapper::detail::create_listener(m_host.c_str(), m_port, 64);
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        throw std::runtime_error("Failed to bind proxy to " + m_host + ":" + std::to_string(m_requestedPort));
+    }
+
+    sockwrapper::detail::set_nonblocking(m_socket, true);
+
+    m_upstream->onNewJob([this](const Job &job) {
+        broadcastJob(job);
+    });
+
+    m_upstream->onPoolSwapped([this](const Pool &) {
+        broadcastJob(m_upstream->getJob());
+    });
+
+    /* Rigs keep their job, their shares will be dropped as stale until we
+       reconnect */
+    m_upstream->onPoolDisconnected([]() {
+    });
+
+    m_upstream->onHashAccepted([this](const std::string &) {
+        std::scoped_lock lock(m_mutex);
+        m_stats.sharesAccepted++;
+    });
+
+    m_listenReactorID = sockwrapper::Reactor::instance().add(m_socket, [this]() {
+        acceptRigs();
+    });
+
+    if (m_listenReactorID == 0)
+    {
+        sockwrapper::detail::close_socket(m_socket);
+        m_socket = INVALID_SOCKET;
+
+        throw std::runtime_error("Failed to watch the proxy socket for rigs");
+    }
+
+    m_upstream->startManaging();
+}
+
+void StratumProxy::stop()
+{
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    /* No new rigs from here on */
+    sockwrapper::Reactor::instance().remove(m_socket, m_listenReactorID);
+
+    m_listenReactorID = 0;
+
+    std::vector<std::shared_ptr<Connection>> connections;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        for (const auto &[id, rig] : m_rigs)
+        {
+            connections.push_back(rig.connection);
+        }
+    }
+
+    /* Waits for any of their handlers which are running, so can't hold the
+       lock, which the handlers take */
+    for (const auto &connection : connections)
+    {
+        sockwrapper::Reactor::instance().remove(connection->socket, connection->reactorID);
+    }
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        m_rigs.clear();
+        m_usedPrefixes.reset();
+        m_usedPrefixes[0] = true;
+    }
+
+    sockwrapper::detail::close_socket(m_socket);
+    m_socket = INVALID_SOCKET;
+
+    m_upstream->logout();
+}
+
+uint16_t StratumProxy::port() const
+{
+    return m_port;
+}
+
+ProxyStats StratumProxy::getStats()
+{
+    std::scoped_lock lock(m_mutex);
+
+    ProxyStats stats = m_stats;
+
+    const auto now = std::chrono::steady_clock::now();
+
+    for (const auto &[id, rig] : m_rigs)
+    {
+        if (!rig.loggedIn)
+        {
+            continue;
+        }
+
+        ProxyRigStats rigStats = rig.stats;
+
+        const double seconds = std::chrono::duration<double>(now - rig.connectedAt).count();
+
+        if (seconds > 0)
+        {
+            rigStats.hashrate = rig.hashesForwarded / seconds;
+        }
+
+        stats.rigs.push_back(rigStats);
+    }
+
+    return stats;
+}
+
+void StratumProxy::printStats()
+{
+    const ProxyStats stats = getStats();
+
+    for (const auto &rig : stats.rigs)
+    {
+        m_upstream->printPool();
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << WhiteMsg(rig.name, 20) << "| "
+                  << WhiteMsg(rig.hashrate) << WhiteMsg(" H/s")
+                  << InformationMsg(" (") << InformationMsg(rig.sharesForwarded)
+                  << InformationMsg(" of ") << InformationMsg(rig.sharesSubmitted)
+                  << InformationMsg(" shares forwarded)") << std::endl;
+    }
+
+    m_upstream->printPool();
+
+    std::cout << WhiteMsg("Proxy", 20) << "| "
+              << WhiteMsg(stats.rigs.size()) << WhiteMsg(" rigs, ")
+              << WhiteMsg(stats.sharesAccepted) << WhiteMsg(" / ") << WhiteMsg(stats.sharesForwarded)
+              << WhiteMsg(" shares accepted")
+              << InformationMsg(" (") << InformationMsg(stats.sharesRefused)
+              << InformationMsg(" refused, ") << InformationMsg(stats.jobsSent)
+              << InformationMsg(" jobs sent)") << std::endl;
+}
+
+void StratumProxy::acceptRigs()
+{
+    while (true)
+    {
+        sockaddr_storage address {};
+        socklen_t addressLength = sizeof(address);
+
+        const socket_t socket = accept(m_socket, reinterpret_cast<sockaddr *>(&address), &addressLength);
+
+        /* None left waiting */
+        if (socket == INVALID_SOCKET)
+        {
+            return;
+        }
+
+        sockwrapper::detail::set_nonblocking(socket, true);
+
+        /* Jobs should reach the rigs as fast as possible */
+        int yes = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char *>(&yes), sizeof(yes));
+
+        char host[NI_MAXHOST] = "unknown";
+
+        getnameinfo(reinterpret_cast<sockaddr *>(&address), addressLength, host, sizeof(host), nullptr, 0, NI_NUMERICHOST);
+
+        auto connection = std::make_shared<Connection>(socket);
+
+        uint64_t rigID;
+
+        {
+            std::scoped_lock lock(m_mutex);
+            rigID = m_nextRigID++;
+        }
+
+        /* Its handler can't run until we return, we're on the reactor thread */
+        connection->reactorID = sockwrapper::Reactor::instance().add(socket, [this, rigID]() {
+            serviceRig(rigID);
+        });
+
+        if (connection->reactorID == 0)
+        {
+            continue;
+        }
+
+        std::scoped_lock lock(m_mutex);
+
+        Rig &rig = m_rigs[rigID];
+
+        rig.connection = connection;
+        rig.address = host;
+        rig.connectedAt = std::chrono::steady_clock::now();
+        rig.stats.name = host;
+    }
+}
+
+void StratumProxy::serviceRig(const uint64_t rigID)
+{
+    std::shared_ptr<Connection> connection;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = m_rigs.find(rigID);
+
+        if (it == m_rigs.end())
+        {
+            return;
+        }
+
+        connection = it->second.connection;
+    }
+
+    {
+        std::scoped_lock lock(connection->mutex);
+        flush(*connection);
+    }
+
+    if (!readRig(rigID))
+    {
+        removeRig(rigID);
+    }
+}
+
+bool StratumProxy::readRig(const uint64_t rigID)
+{
+    std::shared_ptr<Connection> connection;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = m_rigs.find(rigID);
+
+        /* Removed by stop() */
+        if (it == m_rigs.end())
+        {
+            return true;
+        }
+
+        connection = it->second.connection;
+    }
+
+    char readBuffer[4096];
+
+    while (true)
+    {
+        const auto bytesRead = recv(connection->socket, readBuffer, sizeof(readBuffer), 0);
+
+        if (bytesRead == 0)
+        {
+            return false;
+        }
+
+        /* Read everything it has sent so far */
+        if (bytesRead < 0)
+        {
+            return sockwrapper::detail::would_block();
+        }
+
+        std::vector<std::string> lines;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            const auto it = m_rigs.find(rigID);
+
+            if (it == m_rigs.end())
+            {
+                return true;
+            }
+
+            std::string &buffer = it->second.buffer;
+
+            buffer.append(readBuffer, bytesRead);
+
+            size_t lineEnd;
+
+            while ((lineEnd = buffer.find('\n')) != std::string::npos)
+            {
+                lines.push_back(buffer.substr(0, lineEnd));
+                buffer.erase(0, lineEnd + 1);
+            }
+
+            /* Nobody sends a line this long, drop them */
+            if (buffer.size() > sizeof(readBuffer) * 4)
+            {
+                return false;
+            }
+        }
+
+        for (const auto &line : lines)
+        {
+            if (const auto response = handleMessage(rigID, line))
+            {
+                sendMessage(connection, *response);
+            }
+        }
+    }
+}
+
+std::optional<nlohmann::json> StratumProxy::handleMessage(const uint64_t rigID, const std::string &line)
+{
+    const auto message = nlohmann::json::parse(line, nullptr, false);
+
+    if (message.is_discarded() || !message.is_object() || message.find("method") == message.end())
+    {
+        return std::nullopt;
+    }
+
+    const std::string method = message.value("method", "");
+
+    const nlohmann::json id = message.find("id") != message.end() ? message.at("id") : nlohmann::json();
+
+    const nlohmann::json params = message.find("params") != message.end() && message.at("params").is_object()
+        ? message.at("params")
+        : nlohmann::json::object();
+
+    if (method == "submit")
+    {
+        const auto error = handleShare(rigID, params);
+
+        return error ? makeError(id, *error) : makeResponse(id, {{"status", "OK"}});
+    }
+
+    std::scoped_lock lock(m_mutex);
+
+    const auto it = m_rigs.find(rigID);
+
+    /* Disconnected while we were reading its message */
+    if (it == m_rigs.end())
+    {
+        return std::nullopt;
+    }
+
+    Rig &rig = it->second;
+
+    if (method == "login")
+    {
+        if (m_currentJob.rawBlob.empty())
+        {
+            return makeError(id, "Proxy is not connected to the pool yet");
+        }
+
+        if (rig.stats.noncePrefix == 0)
+        {
+            size_t prefix = 1;
+
+            while (prefix < m_usedPrefixes.size() && m_usedPrefixes[prefix])
+            {
+                prefix++;
+            }
+
+            if (prefix == m_usedPrefixes.size())
+            {
+                return makeError(id, "Proxy is full");
+            }
+
+            m_usedPrefixes[prefix] = true;
+            rig.stats.noncePrefix = static_cast<uint8_t>(prefix);
+        }
+
+        const std::string rigName = params.value("rigid", "");
+        const std::string login = params.value("login", "");
+
+        rig.stats.name = !rigName.empty() ? rigName : !login.empty() ? login : rig.address;
+        rig.loggedIn = true;
+
+        printProxy();
+
+        std::cout << SuccessMsg("Rig " + rig.stats.name + " connected from " + rig.address
+                                + ", nonce prefix " + std::to_string(rig.stats.noncePrefix)) << std::endl;
+
+        return makeResponse(id, {
+            {"id", "rig" + std::to_string(rigID)},
+            {"job", jobParams(rig)},
+            {"status", "OK"},
+        });
+    }
+    else if (method == "keepalived")
+    {
+        return makeResponse(id, {{"status", "KEEPALIVED"}});
+    }
+    else if (method == "getjob")
+    {
+        if (!rig.loggedIn)
+        {
+            return makeError(id, "Unauthenticated");
+        }
+
+        return nlohmann::json {
+            {"id", id},
+            {"jsonrpc", "2.0"},
+            {"method", "job"},
+            {"params", jobParams(rig)},
+        };
+    }
+
+    return makeError(id, "Unknown method " + method);
+}
+
+std::optional<std::string> StratumProxy::handleShare(const uint64_t rigID, const nlohmann::json &params)
+{
+    const std::string jobID = params.value("job_id", "");
+    const std::string nonceHex = params.value("nonce", "");
+    const std::string resultHex = params.value("result", "");
+
+    uint32_t nonce = 0;
+    std::vector<uint8_t> hash;
+    uint64_t target = 0;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = m_rigs.find(rigID);
+
+        if (it == m_rigs.end())
+        {
+            return "Unauthenticated";
+        }
+
+        Rig &rig = it->second;
+
+        const auto refuse = [this](const std::string &reason)
+        {
+            m_stats.sharesRefused++;
+            return reason;
+        };
+
+        if (!rig.loggedIn)
+        {
+            return refuse("Unauthenticated");
+        }
+
+        rig.stats.sharesSubmitted++;
+        m_stats.sharesSubmitted++;
+
+        if (nonceHex.size() != sizeof(nonce) * 2 || resultHex.size() != 64)
+        {
+            return refuse("Malformed share");
+        }
+
+        Utilities::fromHex(nonceHex.data(), nonceHex.size(), reinterpret_cast<unsigned char *>(&nonce));
+
+        hash = Utilities::fromHex(resultHex);
+
+        const auto job = std::find_if(m_recentJobs.begin(), m_recentJobs.end(), [&jobID](const auto &recent)
+        {
+            return recent.jobID == jobID;
+        });
+
+        if (job == m_recentJobs.end())
+        {
+            return refuse("Invalid job id");
+        }
+
+        target = job->target;
+
+        /* Hashing some other rig's nonces */
+        if (canPrefixNonces() && (nonce >> 24) != rig.stats.noncePrefix)
+        {
+            return refuse("Invalid nonce; is miner not compatible with NiceHash?");
+        }
+
+        if (!Utilities::isHashValidForTarget(hash.data(), target))
+        {
+            return refuse("Low difficulty share");
+        }
+
+        if (!job->submittedNonces.insert(nonce).second)
+        {
+            return refuse("Duplicate share");
+        }
+    }
+
+    const bool forwarded = m_upstream->submitShare(hash.data(), jobID, nonce);
+
+    std::scoped_lock lock(m_mutex);
+
+    if (!forwarded)
+    {
+        m_stats.sharesRefused++;
+        return "Stale share";
+    }
+
+    m_stats.sharesForwarded++;
+
+    /* Removed while we were talking to the pool */
+    const auto it = m_rigs.find(rigID);
+
+    if (it == m_rigs.end())
+    {
+        return std::nullopt;
+    }
+
+    it->second.stats.sharesForwarded++;
+    it->second.hashesForwarded += std::numeric_limits<uint64_t>::max() / target;
+
+    return std::nullopt;
+}
+
+void StratumProxy::removeRig(const uint64_t rigID)
+{
+    std::shared_ptr<Connection> connection;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        const auto it = m_rigs.find(rigID);
+
+        if (it == m_rigs.end())
+        {
+            return;
+        }
+
+        Rig &rig = it->second;
+
+        connection = rig.connection;
+
+        if (rig.stats.noncePrefix != 0)
+        {
+            m_usedPrefixes[rig.stats.noncePrefix] = false;
+        }
+
+        if (rig.loggedIn)
+        {
+            printProxy();
+            std::cout << WarningMsg("Rig " + rig.stats.name + " disconnected") << std::endl;
+        }
+
+        m_rigs.erase(it);
+    }
+
+    /* The socket is closed once any broadcast still sending to it is done */
+    sockwrapper::Reactor::instance().remove(connection->socket, connection->reactorID);
+}
+
+void StratumProxy::broadcastJob(const Job &job)
+{
+    if (job.rawBlob.size() <= NONCE_PREFIX_OFFSET)
+    {
+        return;
+    }
+
+    std::vector<std::pair<std::shared_ptr<Connection>, nlohmann::json>> messages;
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        if (job.jobID != m_currentJob.jobID)
+        {
+            /* Shares for the job dropped here are refused as an invalid job,
+               so its nonces go with it */
+            m_recentJobs.push_back({ job.jobID, job.target, {} });
+
+            if (m_recentJobs.size() > MAX_RECENT_JOBS)
+            {
+                m_recentJobs.pop_front();
+            }
+        }
+
+        m_currentJob = job;
+
+        if (!canPrefixNonces() && !m_warnedSharedNonces)
+        {
+            m_warnedSharedNonces = true;
+
+            printProxy();
+
+            std::cout << WarningMsg("The pool reserves the nonce prefix byte, rigs will hash overlapping nonces. "
+                                    "Disable niceHash for this pool if it doesn't need it.") << std::endl;
+        }
+
+        for (const auto &[id, rig] : m_rigs)
+        {
+            if (!rig.loggedIn)
+            {
+                continue;
+            }
+
+            messages.emplace_back(rig.connection, nlohmann::json {
+                {"jsonrpc", "2.0"},
+                {"method", "job"},
+                {"params", jobParams(rig)},
+            });
+
+            m_stats.jobsSent++;
+        }
+    }
+
+    /* We may be on the pool's reactor thread, so don't hold up the pool, or
+       the rigs sending shares, while we send */
+    for (const auto &[connection, message] : messages)
+    {
+        sendMessage(connection, message);
+    }
+}
+
+nlohmann::json StratumProxy::jobParams(const Rig &rig) const
+{
+    std::vector<uint8_t> blob = m_currentJob.rawBlob;
+
+    if (canPrefixNonces())
+    {
+        blob[NONCE_PREFIX_OFFSET] = rig.stats.noncePrefix;
+    }
+
+    nlohmann::json params = {
+        {"blob", Utilities::toHex(blob)},
+        {"job_id", m_currentJob.jobID},
+        {"target", Utilities::toHex(reinterpret_cast<const uint8_t *>(&m_currentJob.target), sizeof(m_currentJob.target))},
+        {"algo", m_currentJob.algorithm},
+    };
+
+    if (m_currentJob.height)
+    {
+        params["height"] = *m_currentJob.height;
+    }
+
+    return params;
+}
+
+void StratumProxy::sendMessage(const std::shared_ptr<Connection> &connection, const nlohmann::json &message)
+{
+    const std::string data = message.dump() + "\n";
+
+    std::scoped_lock lock(connection->mutex);
+
+    connection->outgoing += data;
+
+    flush(*connection);
+}
+
+void StratumProxy::flush(Connection &connection)
+{
+    while (!connection.outgoing.empty())
+    {
+        const auto sent = send(
+            connection.socket,
+            connection.outgoing.data(),
+            static_cast<int>(connection.outgoing.size()),
+            MSG_NOSIGNAL
+        );
+
+        if (sent > 0)
+        {
+            connection.outgoing.erase(0, sent);
+            continue;
+        }
+
+        /* The rig has gone, the reactor will see it hang up and drop it */
+        if (sent == 0 || !sockwrapper::detail::would_block())
+        {
+            connection.outgoing.clear();
+        }
+
+        break;
+    }
+
+    /* Hang up, so the reactor drops it */
+    if (connection.outgoing.size() > MAX_QUEUED_BYTES)
+    {
+        connection.outgoing.clear();
+        sockwrapper::detail::shutdown_socket(connection.socket);
+    }
+
+    /* Carry on sending once it has room */
+    const bool watchWritable = !connection.outgoing.empty();
+
+    if (watchWritable != connection.watchingWritable)
+    {
+        sockwrapper::Reactor::instance().watchWritable(connection.socket, connection.reactorID, watchWritable);
+        connection.watchingWritable = watchWritable;
+    }
+}
+
+bool StratumProxy::canPrefixNonces() const
+{
+    return !m_currentJob.isNiceHash;
+}
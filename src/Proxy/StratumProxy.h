@@ -0,0 +1,211 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <bitset>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+#include "ExternalLibs/json.hpp"
+#include "PoolCommunication/IJobSource.h"
+#include "SocketWrapper/SocketWrapper.h"
+
+struct ProxyRigStats
+{
+    std::string name;
+
+    /* Top byte of every nonce this rig hashes, unless the pool reserves it */
+    uint8_t noncePrefix = 0;
+
+    uint64_t sharesSubmitted = 0;
+
+    /* Shares we forwarded to the pool */
+    uint64_t sharesForwarded = 0;
+
+    /* Estimated from the difficulty of the shares forwarded */
+    double hashrate = 0;
+};
+
+struct ProxyStats
+{
+    std::vector<ProxyRigStats> rigs;
+
+    uint64_t jobsSent = 0;
+
+    uint64_t sharesSubmitted = 0;
+
+    uint64_t sharesForwarded = 0;
+
+    /* Shares the pool accepted */
+    uint64_t sharesAccepted = 0;
+
+    /* Shares we refused without bothering the pool, e.g. for a bad nonce */
+    uint64_t sharesRefused = 0;
+};
+
+/* Serves a single pool connection to many miners on the LAN. Each miner is
+   given the pool's jobs with its own nonce prefix in the byte nicehash style
+   pools reserve, so the rigs never hash the same nonces. Their shares are
+   checked and forwarded to the pool. The rigs' sockets are non blocking and
+   driven by the socket reactor, and messages to a rig queue up until it can
+   take them, so a slow rig never holds up the others or the pool. */
+class StratumProxy
+{
+  public:
+    StratumProxy(
+        const std::shared_ptr<IJobSource> upstream,
+        const std::string &host,
+        const uint16_t port);
+
+    ~StratumProxy();
+
+    /* Bind, and start connecting to the pool. Throws if we cannot bind. */
+    void start();
+
+    /* Drop every rig and the pool connection */
+    void stop();
+
+    /* The port we are listening on */
+    uint16_t port() const;
+
+    ProxyStats getStats();
+
+    void printStats();
+
+  private:
+    /* A rig's socket, and the messages waiting to be sent to it. Shared, so
+       we can send to a rig without holding m_mutex. The socket is closed
+       once the last sender lets go. */
+    struct Connection
+    {
+        Connection(const socket_t socket);
+
+        ~Connection();
+
+        const socket_t socket;
+
+        uint64_t reactorID = 0;
+
+        /* Guards the rest */
+        std::mutex mutex;
+
+        /* Bytes the socket hasn't taken yet */
+        std::string outgoing;
+
+        /* Are we asking the reactor to tell us when we can send more */
+        bool watchingWritable = false;
+    };
+
+    struct Rig
+    {
+        std::shared_ptr<Connection> connection;
+
+        std::string address;
+
+        /* Unparsed data, up to the next newline */
+        std::string buffer;
+
+        bool loggedIn = false;
+
+        std::chrono::steady_clock::time_point connectedAt;
+
+        ProxyRigStats stats;
+
+        /* Sum of the difficulty of the shares forwarded */
+        uint64_t hashesForwarded = 0;
+    };
+
+    /* A job we have sent to the rigs, which they may submit shares for */
+    struct RecentJob
+    {
+        std::string jobID;
+
+        uint64_t target;
+
+        /* Nonces submitted for this job, to catch duplicates */
+        std::unordered_set<uint32_t> submittedNonces;
+    };
+
+    /* Accept every rig waiting to connect. Called on the reactor thread. */
+    void acceptRigs();
+
+    /* Send what we can of the rig's queued messages, and handle whatever it
+       has sent. Called on the reactor thread. */
+    void serviceRig(const uint64_t rigID);
+
+    /* Read whatever the rig has sent. Returns false if it disconnected. */
+    bool readRig(const uint64_t rigID);
+
+    /* Returns the response to send the rig, if any */
+    std::optional<nlohmann::json> handleMessage(const uint64_t rigID, const std::string &line);
+
+    /* Returns an error to send the rig, or nothing if the share was forwarded */
+    std::optional<std::string> handleShare(const uint64_t rigID, const nlohmann::json &params);
+
+    void removeRig(const uint64_t rigID);
+
+    /* A new job from the pool, send it to every rig. Called from the pool
+       thread. */
+    void broadcastJob(const Job &job);
+
+    /* The job params for a rig, with its nonce prefix written in. Must be
+       called with m_mutex held. */
+    nlohmann::json jobParams(const Rig &rig) const;
+
+    /* Queue a message for the rig and send what we can without blocking.
+       Must not be called with m_mutex held. */
+    void sendMessage(const std::shared_ptr<Connection> &connection, const nlohmann::json &message);
+
+    /* Send as much of the queue as the socket will take. Must be called with
+       the connection's mutex held. */
+    void flush(Connection &connection);
+
+    /* Can we give each rig its own nonce prefix. Not if the pool reserves the
+       byte for itself. Must be called with m_mutex held. */
+    bool canPrefixNonces() const;
+
+    const std::shared_ptr<IJobSource> m_upstream;
+
+    /* Where to accept rigs. Port 0 picks any free port. */
+    const std::string m_host;
+
+    const uint16_t m_requestedPort;
+
+    /* The listening socket */
+    socket_t m_socket = INVALID_SOCKET;
+
+    uint64_t m_listenReactorID = 0;
+
+    uint16_t m_port = 0;
+
+    std::map<uint64_t, Rig> m_rigs;
+
+    uint64_t m_nextRigID = 0;
+
+    /* Which nonce prefixes are in use. 0 is never handed out, so rigs spot
+       the prefix and keep it, as they would with a nicehash pool. */
+    std::bitset<256> m_usedPrefixes;
+
+    /* The latest job from the pool. Empty blob until we connect. */
+    Job m_currentJob;
+
+    /* Jobs which rigs may still be submitting shares for, newest last */
+    std::deque<RecentJob> m_recentJobs;
+
+    ProxyStats m_stats;
+
+    /* Have we warned that the pool reserves the nonce byte, so the rigs
+       have to share the nonce space */
+    bool m_warnedSharedNonces = false;
+
+    /* Guards the rigs, jobs and stats */
+    mutable std::mutex m_mutex;
+};
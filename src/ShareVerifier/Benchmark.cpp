@@ -0,0 +1,225 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "ArgonVariants/Variants.h"
+#include "Config/Config.h"
+#include "ExternalLibs/cxxopts.hpp"
+#include "ShareVerifier/ShareVerifier.h"
+#include "Utilities/ColouredMsg.h"
+
+/* Measures how many shares per second ShareVerifier can check, and how that
+   scales with the number of threads. Ideally doubling the threads doubles
+   the throughput, up to the number of physical cores. */
+
+struct BenchmarkOptions
+{
+    std::string algorithm = "chukwa";
+
+    /* Shares to verify at each thread count */
+    uint32_t shares = 256;
+
+    /* Shares handed to the verifier at once */
+    uint32_t batchSize = 64;
+
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+};
+
+using Clock = std::chrono::steady_clock;
+
+BenchmarkOptions getBenchmarkOptions(int argc, char **argv)
+{
+    BenchmarkOptions options;
+
+    bool help = false;
+
+    cxxopts::Options parser(argv[0], "Measure share verification throughput at increasing thread counts");
+
+    parser.add_options("Core")
+        ("h,help", "Display this help message",
+         cxxopts::value<bool>(help)->implicit_value("true"))
+
+        ("algorithm", "The algorithm to verify shares for",
+         cxxopts::value<std::string>(options.algorithm)->default_value(options.algorithm), "<algorithm>")
+
+        ("shares", "How many shares to verify at each thread count",
+         cxxopts::value<uint32_t>(options.shares)->default_value(std::to_string(options.shares)), "<n>")
+
+        ("batchSize", "How many shares to verify at once",
+         cxxopts::value<uint32_t>(options.batchSize)->default_value(std::to_string(options.batchSize)), "<n>")
+
+        ("threads", "The most verifying threads to try",
+         cxxopts::value<uint32_t>(options.maxThreads)->default_value(std::to_string(options.maxThreads)), "<threads>");
+
+    try
+    {
+        parser.parse(argc, argv);
+
+        if (help)
+        {
+            std::cout << parser.help({}) << std::endl;
+            exit(0);
+        }
+    }
+    catch (const cxxopts::OptionException &e)
+    {
+        std::cout << WarningMsg("Error: Unable to parse command line options: ") << WarningMsg(e.what())
+                  << std::endl << std::endl
+                  << parser.help({}) << std::endl;
+        exit(1);
+    }
+
+    options.shares = std::max<uint32_t>(options.shares, 1);
+    options.batchSize = std::max<uint32_t>(options.batchSize, 1);
+    options.maxThreads = std::max<uint32_t>(options.maxThreads, 1);
+
+    return options;
+}
+
+/* Valid shares on random jobs, hashed the same way the miner does */
+std::vector<ShareSubmission> makeShares(const BenchmarkOptions &options)
+{
+    std::mt19937 generator(0);
+
+    const auto algorithm = ArgonVariant::getCPUMiningAlgorithm(options.algorithm);
+
+    std::vector<ShareSubmission> shares(options.shares);
+
+    for (auto &share : shares)
+    {
+        share.blob.resize(76);
+
+        for (auto &byte : share.blob)
+        {
+            byte = static_cast<uint8_t>(generator());
+        }
+
+        share.nonce = static_cast<uint32_t>(generator());
+        share.target = std::numeric_limits<uint64_t>::max();
+
+        std::memcpy(share.blob.data() + 39, &share.nonce, sizeof(share.nonce));
+
+        algorithm->reinit(share.blob);
+        share.hash = algorithm->hash(share.blob);
+    }
+
+    return shares;
+}
+
+/* Returns shares per second, and how many weren't accepted */
+std::pair<double, size_t> timeVerification(
+    ShareVerifier &verifier,
+    const std::vector<ShareSubmission> &shares,
+    const uint32_t batchSize)
+{
+    std::vector<std::future<std::vector<ShareVerdict>>> futures;
+
+    const auto start = Clock::now();
+
+    for (size_t i = 0; i < shares.size(); i += batchSize)
+    {
+        const auto end = shares.begin() + std::min<size_t>(i + batchSize, shares.size());
+
+        futures.push_back(verifier.verify({ shares.begin() + i, end }));
+    }
+
+    size_t rejected = 0;
+
+    for (auto &future : futures)
+    {
+        for (const auto verdict : future.get())
+        {
+            if (verdict != VALID)
+            {
+                rejected++;
+            }
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return { shares.size() / seconds, rejected };
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        const BenchmarkOptions options = getBenchmarkOptions(argc, argv);
+
+        Config::config.optimizationMethod = Constants::AUTO;
+
+        std::cout << InformationMsg("Hashing " + std::to_string(options.shares) + " shares to verify...") << std::endl;
+
+        std::vector<ShareSubmission> shares = makeShares(options);
+
+        std::cout << std::endl << std::fixed << std::setprecision(2);
+
+        /* Powers of two, and the exact count asked for */
+        std::vector<uint32_t> threadCounts;
+
+        for (uint32_t threads = 1; threads < options.maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+
+        threadCounts.push_back(options.maxThreads);
+
+        double singleThreaded = 0;
+
+        for (const uint32_t threads : threadCounts)
+        {
+            ShareVerifier verifier(options.algorithm, threads);
+
+            const auto [sharesPerSecond, rejected] = timeVerification(verifier, shares, options.batchSize);
+
+            if (threads == 1)
+            {
+                singleThreaded = sharesPerSecond;
+            }
+
+            const double speedup = sharesPerSecond / singleThreaded;
+
+            std::cout << InformationMsg("* ") << WhiteMsg(std::to_string(threads) + " threads", 20)
+                      << SuccessMsg(sharesPerSecond) << SuccessMsg(" shares/s")
+                      << InformationMsg(", ") << InformationMsg(speedup) << InformationMsg("x, ")
+                      << InformationMsg(100 * speedup / threads) << InformationMsg("% scaling") << std::endl;
+
+            if (rejected != 0)
+            {
+                std::cout << WarningMsg(std::to_string(rejected) + " valid shares were rejected!") << std::endl;
+            }
+        }
+
+        /* Shares rejected before hashing, as a pool flooded with junk would see */
+        for (auto &share : shares)
+        {
+            share.target = 0;
+        }
+
+        ShareVerifier verifier(options.algorithm, options.maxThreads);
+
+        const auto [sharesPerSecond, rejected] = timeVerification(verifier, shares, options.batchSize);
+
+        std::cout << InformationMsg("* ") << WhiteMsg("Low difficulty", 20)
+                  << SuccessMsg(sharesPerSecond) << SuccessMsg(" shares/s rejected") << std::endl;
+
+        if (rejected != shares.size())
+        {
+            std::cout << WarningMsg(std::to_string(shares.size() - rejected) + " low difficulty shares were accepted!") << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << WarningMsg("Benchmark crashed with error: ") << WarningMsg(e.what()) << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,184 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+//////////////////////////////////////
+#include "ShareVerifier/ShareVerifier.h"
+//////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+
+#include "ArgonVariants/Variants.h"
+#include "Utilities/Utilities.h"
+
+namespace
+{
+    /* Where the miner puts the nonce in the hashing blob */
+    const size_t NONCE_OFFSET = 39;
+
+    const size_t HASH_SIZE = 32;
+}
+
+std::string shareVerdictToString(const ShareVerdict verdict)
+{
+    switch (verdict)
+    {
+        case VALID:
+        {
+            return "valid";
+        }
+        case MALFORMED:
+        {
+            return "malformed";
+        }
+        case LOW_DIFFICULTY:
+        {
+            return "low difficulty";
+        }
+        case WRONG_HASH:
+        {
+            return "wrong hash";
+        }
+    }
+
+    throw std::invalid_argument("Invalid share verdict given");
+}
+
+ShareVerifier::ShareVerifier(
+    const std::string &algorithm,
+    const uint32_t threadCount):
+    m_algorithm(algorithm)
+{
+    /* Throws if the algorithm is unknown, before starting any threads */
+    ArgonVariant::algorithmNameToCanonical(algorithm);
+
+    for (uint32_t i = 0; i < std::max<uint32_t>(threadCount, 1); i++)
+    {
+        m_threads.emplace_back(&ShareVerifier::verifyShares, this);
+    }
+}
+
+ShareVerifier::~ShareVerifier()
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+        m_tasks.clear();
+    }
+
+    m_haveTasks.notify_all();
+
+    for (auto &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+uint32_t ShareVerifier::threadCount() const
+{
+    return static_cast<uint32_t>(m_threads.size());
+}
+
+ShareVerdict ShareVerifier::quickCheck(const ShareSubmission &share)
+{
+    if (share.blob.size() < NONCE_OFFSET + sizeof(share.nonce) || share.hash.size() != HASH_SIZE)
+    {
+        return MALFORMED;
+    }
+
+    if (!Utilities::isHashValidForTarget(share.hash.data(), share.target))
+    {
+        return LOW_DIFFICULTY;
+    }
+
+    return VALID;
+}
+
+std::future<std::vector<ShareVerdict>> ShareVerifier::verify(std::vector<ShareSubmission> shares)
+{
+    auto batch = std::make_shared<Batch>();
+
+    batch->verdicts.resize(shares.size());
+    batch->shares = std::move(shares);
+
+    std::vector<size_t> toHash;
+
+    for (size_t i = 0; i < batch->shares.size(); i++)
+    {
+        batch->verdicts[i] = quickCheck(batch->shares[i]);
+
+        if (batch->verdicts[i] == VALID)
+        {
+            toHash.push_back(i);
+        }
+    }
+
+    auto future = batch->promise.get_future();
+
+    if (toHash.empty())
+    {
+        batch->promise.set_value(std::move(batch->verdicts));
+        return future;
+    }
+
+    batch->remaining = toHash.size();
+
+    {
+        std::scoped_lock lock(m_mutex);
+
+        for (const size_t index : toHash)
+        {
+            m_tasks.push_back({ batch, index });
+        }
+    }
+
+    m_haveTasks.notify_all();
+
+    return future;
+}
+
+void ShareVerifier::verifyShares()
+{
+    const auto algorithm = ArgonVariant::getCPUMiningAlgorithm(m_algorithm);
+
+    std::vector<uint8_t> blob;
+
+    while (true)
+    {
+        Task task;
+
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_haveTasks.wait(lock, [this]{ return m_shouldStop || !m_tasks.empty(); });
+
+            if (m_shouldStop)
+            {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        const ShareSubmission &share = task.batch->shares[task.index];
+
+        blob = share.blob;
+
+        std::memcpy(blob.data() + NONCE_OFFSET, &share.nonce, sizeof(share.nonce));
+
+        algorithm->reinit(blob);
+
+        const auto hash = algorithm->hash(blob);
+
+        task.batch->verdicts[task.index] = hash == share.hash ? VALID : WRONG_HASH;
+
+        /* The last thread to finish a share of the batch hands the verdicts
+           over. The decrement orders the other threads' verdicts before it. */
+        if (--task.batch->remaining == 0)
+        {
+            task.batch->promise.set_value(std::move(task.batch->verdicts));
+        }
+    }
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A share submitted to a pool by a miner */
+struct ShareSubmission
+{
+    /* The hashing blob of the job the share is for, as sent to the miner */
+    std::vector<uint8_t> blob;
+
+    uint32_t nonce = 0;
+
+    /* The hash the miner says the nonce gives */
+    std::vector<uint8_t> hash;
+
+    /* The target of the job, as sent to the miner */
+    uint64_t target = 0;
+};
+
+enum ShareVerdict
+{
+    VALID,
+
+    /* The blob is too short to hold a nonce, or the hash isn't 32 bytes */
+    MALFORMED,
+
+    /* The claimed hash doesn't meet the target */
+    LOW_DIFFICULTY,
+
+    /* The claimed hash meets the target, but isn't what the nonce hashes to */
+    WRONG_HASH,
+};
+
+std::string shareVerdictToString(const ShareVerdict verdict);
+
+/* Checks shares for a pool, on a fixed set of threads. Each thread keeps its
+   own Argon2 instance, so the scratchpad is allocated once per thread rather
+   than once per share. */
+class ShareVerifier
+{
+  public:
+    ShareVerifier(
+        const std::string &algorithm,
+        const uint32_t threadCount = std::thread::hardware_concurrency());
+
+    /* Batches which have not finished verifying are abandoned, and their
+       futures throw std::future_error */
+    ~ShareVerifier();
+
+    /* Verify a batch of shares. The verdicts are in the same order as the
+       shares. Malformed and low difficulty shares are rejected before any
+       hashing is done. */
+    std::future<std::vector<ShareVerdict>> verify(std::vector<ShareSubmission> shares);
+
+    /* The checks that need no hashing. Returns VALID if the share should be
+       hashed. */
+    static ShareVerdict quickCheck(const ShareSubmission &share);
+
+    uint32_t threadCount() const;
+
+  private:
+    struct Batch
+    {
+        std::vector<ShareSubmission> shares;
+
+        std::vector<ShareVerdict> verdicts;
+
+        /* Shares still to be hashed */
+        std::atomic<size_t> remaining = 0;
+
+        std::promise<std::vector<ShareVerdict>> promise;
+    };
+
+    /* A share of a batch, waiting to be hashed */
+    struct Task
+    {
+        std::shared_ptr<Batch> batch;
+
+        size_t index = 0;
+    };
+
+    /* Hash queued shares until stopped */
+    void verifyShares();
+
+    const std::string m_algorithm;
+
+    std::vector<std::thread> m_threads;
+
+    std::deque<Task> m_tasks;
+
+    bool m_shouldStop = false;
+
+    std::condition_variable m_haveTasks;
+
+    /* Guards m_tasks and m_shouldStop */
+    std::mutex m_mutex;
+};
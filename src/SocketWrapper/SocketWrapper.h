@@ -29,9 +29,11 @@
 typedef SOCKET socket_t;
 #else
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/select.h>
@@ -42,12 +44,28 @@ typedef int socket_t;
 #define INVALID_SOCKET (-1)
 #endif //_WIN32
 
+/* On linux, every socket is driven by a single epoll reactor thread. Elsewhere,
+   each socket gets its own listen thread, and the reactor falls back to poll. */
+#if defined(__linux__)
+#define SOCKETWRAPPER_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <fcntl.h>
+#include <functional>
 #include <future>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef SOCKETWRAPPER_OPENSSL_SUPPORT
@@ -61,6 +79,12 @@ inline const unsigned char *ASN1_STRING_get0_data(const ASN1_STRING *asn1)
 {
     return M_ASN1_STRING_data(asn1);
 }
+
+inline int SSL_SESSION_up_ref(SSL_SESSION *session)
+{
+    CRYPTO_add(&session->references, 1, CRYPTO_LOCK_SSL_SESSION);
+    return 1;
+}
 #endif
 #endif
 
@@ -81,6 +105,21 @@ inline const unsigned char *ASN1_STRING_get0_data(const ASN1_STRING *asn1)
 #define SOCKETWRAPPER_READ_TIMEOUT_SECOND 5
 #define SOCKETWRAPPER_READ_TIMEOUT_USECOND 0
 
+/* How much we read from the socket in one go */
+#define SOCKETWRAPPER_READ_CHUNK_SIZE 16384
+
+/* Drop the connection if a single message grows beyond this without a
+   delimiter, rather than buffering forever */
+#define SOCKETWRAPPER_MAX_MESSAGE_SIZE (1024 * 1024)
+
+/* Start probing an idle connection after this many seconds, then probe every
+   interval, giving up after this many unanswered probes. Notices a peer which
+   vanished without closing the connection in under a minute, rather than the
+   OS default of hours. */
+#define SOCKETWRAPPER_KEEPALIVE_IDLE_SECOND 30
+#define SOCKETWRAPPER_KEEPALIVE_INTERVAL_SECOND 5
+#define SOCKETWRAPPER_KEEPALIVE_PROBES 3
+
 namespace sockwrapper
 {
     class Stream
@@ -88,6 +127,12 @@ namespace sockwrapper
       public:
         virtual ~Stream() {}
         virtual int read(char *ptr, size_t size) = 0;
+
+        /* Read whatever is available without blocking. Returns the number of
+           bytes read, 0 if the connection is closed or broken, or -1 if there
+           is nothing more to read right now. */
+        virtual int read_nonblocking(char *ptr, size_t size) = 0;
+
         virtual int write(const char *ptr, size_t size1) = 0;
         virtual int write(const char *ptr) = 0;
         virtual int write(const std::string &s) = 0;
@@ -97,16 +142,18 @@ namespace sockwrapper
     {
       public:
         SocketStream() {};
-        SocketStream(socket_t sock);
+        SocketStream(socket_t sock, time_t write_timeout_sec);
         virtual ~SocketStream();
 
         virtual int read(char *ptr, size_t size);
+        virtual int read_nonblocking(char *ptr, size_t size);
         virtual int write(const char *ptr, size_t size);
         virtual int write(const char *ptr);
         virtual int write(const std::string &s);
 
       private:
         socket_t sock_;
+        time_t write_timeout_sec_;
     };
 
     class BufferStream : public Stream
@@ -116,6 +163,7 @@ namespace sockwrapper
         virtual ~BufferStream() {}
 
         virtual int read(char *ptr, size_t size);
+        virtual int read_nonblocking(char *ptr, size_t size);
         virtual int write(const char *ptr, size_t size);
         virtual int write(const char *ptr);
         virtual int write(const std::string &s);
@@ -126,6 +174,141 @@ namespace sockwrapper
         std::string buffer;
     };
 
+    namespace detail
+    {
+        /* Accumulates bytes read from the socket, and splits them into
+           delimited messages. Consumed bytes are only compacted away once
+           they make up most of the buffer, so a read containing many messages
+           doesn't shift the remainder down once per message. */
+        class frame_buffer
+        {
+          public:
+            void append(const char *data, size_t size)
+            {
+                buffer_.append(data, size);
+            }
+
+            /* Pop the next complete message, without the delimiter */
+            std::optional<std::string> next(const char delimiter)
+            {
+                const size_t end = buffer_.find(delimiter, head_);
+
+                if (end == std::string::npos)
+                {
+                    compact();
+                    return std::nullopt;
+                }
+
+                std::string message = buffer_.substr(head_, end - head_);
+
+                head_ = end + 1;
+
+                return message;
+            }
+
+            /* Bytes of the incomplete message we are waiting on */
+            size_t pending() const
+            {
+                return buffer_.size() - head_;
+            }
+
+            void clear()
+            {
+                buffer_.clear();
+                head_ = 0;
+            }
+
+          private:
+            void compact()
+            {
+                if (head_ == buffer_.size())
+                {
+                    buffer_.clear();
+                    head_ = 0;
+                }
+                else if (head_ > buffer_.size() / 2)
+                {
+                    buffer_.erase(0, head_);
+                    head_ = 0;
+                }
+            }
+
+            std::string buffer_;
+
+            size_t head_ = 0;
+        };
+    } // namespace detail
+
+    /* Drives every socket from one I/O thread, using epoll on linux and poll
+       elsewhere. Handlers are called on the reactor thread when their socket
+       is readable, or writable if asked, so they must not block waiting on
+       another socket. */
+    class Reactor
+    {
+      public:
+        static Reactor &instance();
+
+        ~Reactor();
+
+        /* Start calling handler whenever sock is readable. Returns an ID to
+           remove the socket with, or 0 on failure. */
+        uint64_t add(socket_t sock, const std::function<void(void)> &handler);
+
+        /* Also call the handler whenever sock is writable, e.g. while we have
+           data queued for a non blocking socket. Level triggered, so turn it
+           off once the queue is empty. */
+        void watchWritable(socket_t sock, uint64_t id, bool writable);
+
+        /* Stop watching a socket. Must be called before the socket is closed.
+           Once this returns the handler is not running and won't be called
+           again - unless called from the reactor thread itself, in which case
+           we can't wait on ourselves, and just prevent any further calls. */
+        void remove(socket_t sock, uint64_t id);
+
+        bool isReactorThread() const;
+
+      private:
+        Reactor();
+
+        void run();
+
+        /* Call the handler of a socket which is ready, if it hasn't been removed */
+        void dispatch(uint64_t id);
+
+#ifdef SOCKETWRAPPER_USE_EPOLL
+        int m_epoll = -1;
+
+        /* Used to wake the reactor when stopping */
+        int m_wakeFd = -1;
+#else
+        struct WatchedSocket
+        {
+            socket_t sock;
+
+            bool writable = false;
+        };
+
+        /* poll takes the whole list every time, so keep it here */
+        std::unordered_map<uint64_t, WatchedSocket> m_sockets;
+#endif
+
+        std::thread m_thread;
+
+        std::atomic<bool> m_shouldStop = false;
+
+        std::unordered_map<uint64_t, std::function<void(void)>> m_handlers;
+
+        uint64_t m_nextID = 1;
+
+        /* Handler currently executing, 0 if none */
+        uint64_t m_runningID = 0;
+
+        std::mutex m_mutex;
+
+        /* Notified when a handler finishes running */
+        std::condition_variable m_handlerFinished;
+    };
+
     class SocketWrapper
     {
       public:
@@ -156,19 +339,47 @@ namespace sockwrapper
         /* Send a message down the socket */
         bool sendMessage(const std::string &message);
 
-        /* Send a message down the socket and wait for the next response (Can time out) */
+        /* Send a message down the socket and wait for the next response (Can time out).
+           Must not be called from within a message or socket closed callback. */
         std::optional<std::string> sendMessageAndGetResponse(const std::string &message, const bool timeout = true);
 
-        /* Register a function to be called when a message is received */
+        /* Register a function to be called when a message is received. The
+           message does not include the delimiter. Messages returned by
+           sendMessageAndGetResponse are not passed on. Must be registered
+           before start(), as the callback is read from the listen thread. */
         void onMessage(const std::function<void(const std::string &message)> callback);
 
-        /* Register a function to be called when the socket is closed */
+        /* Register a function to be called when the socket is closed. Must
+           be registered before start(). */
         void onSocketClosed(const std::function<void(void)> callback);
 
       protected:
         /* PRIVATE MEMBER FUNCTIONS */
 
-        /* The function which grabs and processes messages from the socket */
+        /* Connect the socket, leaving it in non blocking mode */
+        bool connectSocket();
+
+        /* Begin delivering messages, via the reactor or a listen thread */
+        void startListening();
+
+        /* Stop delivering messages. Waits for any in progress callback. */
+        void stopListening();
+
+        /* Read everything available and dispatch any complete messages.
+           Returns false if the socket was closed. */
+        bool handleReadable();
+
+        /* Pass a complete message to the waiting response or callback */
+        void dispatchMessage(const std::string &message);
+
+        /* The remote end closed the connection */
+        void handleClosed();
+
+        /* Close the underlying connection */
+        virtual void closeConnection();
+
+        /* The function which grabs and processes messages from the socket,
+           when we are not using the reactor */
         void waitForMessages();
 
         /* PRIVATE MEMBER VARIABLES */
@@ -191,21 +402,32 @@ namespace sockwrapper
         /* The socket reader/writer */
         std::shared_ptr<Stream> m_socketStream;
 
+        /* Bytes read but not yet split into messages */
+        detail::frame_buffer m_frameBuffer;
+
         /* The function to call upon message receieval */
         std::function<void(const std::string &message)> m_messageCallback;
 
         /* The function to call upon socket closed */
         std::function<void(void)> m_socketClosedCallback;
 
+#ifdef SOCKETWRAPPER_USE_EPOLL
+        /* Our registration with the reactor, 0 if not registered */
+        std::atomic<uint64_t> m_reactorID = 0;
+#else
         /* The thread that listens for messages */
         std::thread m_listenThread;
+#endif
 
         /* This will be set to the next message to arrive when sendMessageAndGetResponse
            is set */
         std::promise<std::string> m_nextMessagePromise;
 
         /* Should we pass the next message to sendMessageAndGetResponse */
-        std::atomic<bool> m_giveMeTheNextMessagePlease;
+        bool m_giveMeTheNextMessagePlease = false;
+
+        /* Guards m_nextMessagePromise and m_giveMeTheNextMessagePlease */
+        std::mutex m_responseMutex;
 
         /* Should we stop the listen thread */
         std::atomic<bool> m_shouldStop;
@@ -213,19 +435,49 @@ namespace sockwrapper
         /* Has the listen thread been started */
         std::atomic<bool> m_started = false;
 
-        /* Used to synchronize writes */
+        /* Used to synchronize writes, and closing the socket */
         std::mutex m_sendMutex;
     };
 
 #ifdef SOCKETWRAPPER_OPENSSL_SUPPORT
+    /* The most recent TLS session for each server we have connected to, so
+       reconnecting can resume it with a session ticket or ID, skipping the
+       key exchange and certificate checks of a full handshake. Shared by
+       every SSL socket. Thread safe. */
+    class SSLSessionCache
+    {
+      public:
+        static SSLSessionCache &instance();
+
+        ~SSLSessionCache();
+
+        /* The session to resume with the server, or nullptr. The caller must
+           free the returned session. */
+        SSL_SESSION *get(const std::string &server);
+
+        /* Remember a session for the server, taking ownership of it */
+        void set(const std::string &server, SSL_SESSION *session);
+
+        /* Forget the session for the server, e.g. if resuming it failed */
+        void remove(const std::string &server);
+
+      private:
+        SSLSessionCache() {}
+
+        std::unordered_map<std::string, SSL_SESSION *> m_sessions;
+
+        std::mutex m_mutex;
+    };
+
     class SSLSocketStream : public Stream
     {
       public:
         SSLSocketStream() {};
-        SSLSocketStream(socket_t sock, SSL *ssl);
+        SSLSocketStream(socket_t sock, SSL *ssl, time_t write_timeout_sec);
         virtual ~SSLSocketStream();
 
         virtual int read(char *ptr, size_t size);
+        virtual int read_nonblocking(char *ptr, size_t size);
         virtual int write(const char *ptr, size_t size);
         virtual int write(const char *ptr);
         virtual int write(const std::string &s);
@@ -233,6 +485,10 @@ namespace sockwrapper
       private:
         socket_t sock_;
         SSL *m_ssl;
+        time_t write_timeout_sec_;
+
+        /* An SSL object cannot be read and written from two threads at once */
+        std::mutex m_sslMutex;
     };
 
     class SSLSocketWrapper : public SocketWrapper
@@ -252,11 +508,23 @@ namespace sockwrapper
 
         bool start();
 
-        void stop();
+        /* Did the last handshake resume a cached session */
+        bool sessionReused() const;
 
       private:
+        virtual void closeConnection();
+
         void shutdownSSL();
 
+        /* Called by OpenSSL when the server gives us a session we can resume
+           later. With TLS 1.3 this arrives after the handshake. */
+        static int storeSession(SSL *ssl, SSL_SESSION *session);
+
+        /* What we cache our session under */
+        const std::string m_sessionKey;
+
+        std::atomic<bool> m_sessionReused = false;
+
         SSL_CTX *ctx_;
 
         std::mutex ctx_mutex_;
@@ -276,105 +544,6 @@ namespace sockwrapper
      */
     namespace detail
     {
-        // NOTE: until the read size reaches `fixed_buffer_size`, use `fixed_buffer`
-        // to store data. The call can set memory on stack for performance.
-        class stream_line_reader
-        {
-          public:
-            stream_line_reader(Stream &strm, char *fixed_buffer, size_t fixed_buffer_size):
-                strm_(strm),
-                fixed_buffer_(fixed_buffer),
-                fixed_buffer_size_(fixed_buffer_size)
-            {
-            }
-
-            const char *ptr() const
-            {
-                if (glowable_buffer_.empty())
-                {
-                    return fixed_buffer_;
-                }
-                else
-                {
-                    return glowable_buffer_.data();
-                }
-            }
-
-            size_t size() const
-            {
-                if (glowable_buffer_.empty())
-                {
-                    return fixed_buffer_used_size_;
-                }
-                else
-                {
-                    return glowable_buffer_.size();
-                }
-            }
-
-            std::optional<std::string> getline(const char delimiter, const std::atomic<bool> &shouldStop)
-            {
-                fixed_buffer_used_size_ = 0;
-                glowable_buffer_.clear();
-
-                while (!shouldStop)
-                {
-                    char byte;
-
-                    /* Read a byte */
-                    auto n = strm_.read(&byte, 1);
-
-                    /* Zero bytes read = socket closed */
-                    if (n == 0)
-                    {
-                        return std::nullopt;
-                    }
-
-                    /* < zero bytes = timeout or error */
-                    if (n < 0)
-                    {
-                        continue;
-                    }
-
-                    /* Append the byte to the buffer */
-                    append(byte);
-
-                    /* Message complete */
-                    if (byte == delimiter)
-                    {
-                        return std::string(ptr(), size());
-                    }
-                }
-
-                return std::nullopt;
-            }
-
-          private:
-            void append(char c)
-            {
-                if (fixed_buffer_used_size_ < fixed_buffer_size_ - 1)
-                {
-                    fixed_buffer_[fixed_buffer_used_size_++] = c;
-                    fixed_buffer_[fixed_buffer_used_size_] = '\0';
-                }
-                else
-                {
-                    if (glowable_buffer_.empty())
-                    {
-                        assert(fixed_buffer_[fixed_buffer_used_size_] == '\0');
-                        glowable_buffer_.assign(fixed_buffer_, fixed_buffer_used_size_);
-                    }
-                    glowable_buffer_ += c;
-                }
-            }
-
-            Stream &strm_;
-            char *fixed_buffer_;
-            const size_t fixed_buffer_size_;
-            size_t fixed_buffer_used_size_;
-            std::string glowable_buffer_;
-        };
-
         inline int close_socket(socket_t sock)
         {
 #ifdef _WIN32
@@ -397,6 +566,19 @@ namespace sockwrapper
             return select(static_cast<int>(sock + 1), &fds, nullptr, nullptr, &tv);
         }
 
+        inline int select_write(socket_t sock, time_t sec, time_t usec)
+        {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(sock, &fds);
+
+            timeval tv;
+            tv.tv_sec = static_cast<long>(sec);
+            tv.tv_usec = static_cast<long>(usec);
+
+            return select(static_cast<int>(sock + 1), nullptr, &fds, nullptr, &tv);
+        }
+
         inline bool wait_until_socket_is_ready(socket_t sock, time_t sec, time_t usec)
         {
             fd_set fdsr;
@@ -529,6 +711,133 @@ namespace sockwrapper
 #endif
         }
 
+        /* Did the last operation on a non blocking socket fail only because
+           it would have blocked */
+        inline bool would_block()
+        {
+#ifdef _WIN32
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+        }
+
+        /* Send small messages like shares straight away, rather than letting
+           Nagle's algorithm hold them back, and probe idle connections so a
+           dead peer is noticed */
+        inline void set_tcp_options(socket_t sock)
+        {
+            int yes = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&yes, sizeof(yes));
+            setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&yes, sizeof(yes));
+
+            int idle = SOCKETWRAPPER_KEEPALIVE_IDLE_SECOND;
+            int interval = SOCKETWRAPPER_KEEPALIVE_INTERVAL_SECOND;
+            int probes = SOCKETWRAPPER_KEEPALIVE_PROBES;
+
+#if defined(TCP_KEEPIDLE)
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, (char *)&idle, sizeof(idle));
+#elif defined(TCP_KEEPALIVE)
+            /* OSX */
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPALIVE, (char *)&idle, sizeof(idle));
+#else
+            (void)idle;
+#endif
+
+#if defined(TCP_KEEPINTVL)
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, (char *)&interval, sizeof(interval));
+#else
+            (void)interval;
+#endif
+
+#if defined(TCP_KEEPCNT)
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, (char *)&probes, sizeof(probes));
+#else
+            (void)probes;
+#endif
+        }
+
+        /* Limit how long a blocking send or receive can take. 0 waits
+           forever. */
+        inline void set_socket_timeout(socket_t sock, time_t sec)
+        {
+#ifdef _WIN32
+            DWORD timeout = static_cast<DWORD>(sec * 1000);
+#else
+            timeval timeout;
+            timeout.tv_sec = static_cast<long>(sec);
+            timeout.tv_usec = 0;
+#endif
+
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
+            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout));
+        }
+
+        /* Send all of the data down a blocking socket. Returns false if the
+           connection fails, or the send times out, first. */
+        inline bool send_all(socket_t sock, const std::string &data)
+        {
+            size_t sent = 0;
+
+            while (sent < data.size())
+            {
+                const auto result = send(
+                    sock,
+                    data.data() + sent,
+                    static_cast<int>(data.size() - sent),
+                    MSG_NOSIGNAL
+                );
+
+                if (result <= 0)
+                {
+                    return false;
+                }
+
+                sent += result;
+            }
+
+            return true;
+        }
+
+        /* Bind to the address and start listening. Port 0 picks any free
+           port, and port is set to the one we got. Returns INVALID_SOCKET if
+           we cannot bind. */
+        inline socket_t create_listener(const char *host, uint16_t &port, int backlog)
+        {
+            const socket_t sock = create_socket(host, port, [backlog](socket_t sock, struct addrinfo &ai) {
+                int yes = 1;
+                setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char *)&yes, sizeof(yes));
+
+                if (bind(sock, ai.ai_addr, static_cast<int>(ai.ai_addrlen)) != 0)
+                {
+                    return false;
+                }
+
+                return listen(sock, backlog) == 0;
+            }, AI_PASSIVE);
+
+            if (sock == INVALID_SOCKET)
+            {
+                return INVALID_SOCKET;
+            }
+
+            sockaddr_storage address {};
+            socklen_t addressLength = sizeof(address);
+
+            getsockname(sock, reinterpret_cast<sockaddr *>(&address), &addressLength);
+
+            if (address.ss_family == AF_INET6)
+            {
+                port = ntohs(reinterpret_cast<sockaddr_in6 *>(&address)->sin6_port);
+            }
+            else
+            {
+                port = ntohs(reinterpret_cast<sockaddr_in *>(&address)->sin_port);
+            }
+
+            return sock;
+        }
+
 #ifdef _WIN32
         class WSInit
         {
@@ -550,31 +859,339 @@ namespace sockwrapper
 
     } // namespace detail
 
-    // Socket stream implementation
-    inline SocketStream::SocketStream(socket_t sock): sock_(sock) {}
+    // Reactor implementation
+    inline Reactor &Reactor::instance()
+    {
+        static Reactor reactor;
+        return reactor;
+    }
 
-    inline SocketStream::~SocketStream() {}
+#ifdef SOCKETWRAPPER_USE_EPOLL
+    inline Reactor::Reactor()
+    {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 
-    inline int SocketStream::read(char *ptr, size_t size)
+        epoll_event event {};
+        event.events = EPOLLIN;
+
+        /* ID 0 is reserved for the wakeup fd */
+        event.data.u64 = 0;
+
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeFd, &event);
+
+        m_thread = std::thread(&Reactor::run, this);
+    }
+
+    inline Reactor::~Reactor()
     {
-        if (detail::select_read(sock_, SOCKETWRAPPER_READ_TIMEOUT_SECOND, SOCKETWRAPPER_READ_TIMEOUT_USECOND) > 0)
+        m_shouldStop = true;
+
+        const uint64_t one = 1;
+
+        if (write(m_wakeFd, &one, sizeof(one)) < 0)
         {
-            return recv(sock_, ptr, static_cast<int>(size), 0);
+            /* Counter is already non zero, so the reactor will wake anyway */
         }
-        return -1;
-    }
 
-    inline int SocketStream::write(const char *ptr, size_t size)
-    {
-        return send(sock_, ptr, static_cast<int>(size), MSG_NOSIGNAL);
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+
+        close(m_wakeFd);
+        close(m_epoll);
     }
 
-    inline int SocketStream::write(const char *ptr)
+    inline uint64_t Reactor::add(socket_t sock, const std::function<void(void)> &handler)
     {
-        return write(ptr, strlen(ptr));
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        const uint64_t id = m_nextID++;
+
+        epoll_event event {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = id;
+
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, sock, &event) != 0)
+        {
+            return 0;
+        }
+
+        m_handlers[id] = handler;
+
+        return id;
     }
 
-    inline int SocketStream::write(const std::string &s)
+    inline void Reactor::watchWritable(socket_t sock, uint64_t id, bool writable)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        /* Already removed, and maybe closed */
+        if (m_handlers.find(id) == m_handlers.end())
+        {
+            return;
+        }
+
+        epoll_event event {};
+        event.events = EPOLLIN | EPOLLRDHUP | (writable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.u64 = id;
+
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, sock, &event);
+    }
+
+    inline void Reactor::remove(socket_t sock, uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_handlers.erase(id);
+
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, sock, nullptr);
+
+        if (isReactorThread())
+        {
+            return;
+        }
+
+        m_handlerFinished.wait(lock, [&]{
+            return m_runningID != id;
+        });
+    }
+
+    inline void Reactor::run()
+    {
+        const int maxEvents = 64;
+
+        epoll_event events[maxEvents];
+
+        while (!m_shouldStop)
+        {
+            const int numEvents = epoll_wait(m_epoll, events, maxEvents, -1);
+
+            for (int i = 0; i < numEvents; i++)
+            {
+                const uint64_t id = events[i].data.u64;
+
+                if (id == 0)
+                {
+                    uint64_t value;
+
+                    if (read(m_wakeFd, &value, sizeof(value)) < 0)
+                    {
+                        /* Already drained */
+                    }
+
+                    continue;
+                }
+
+                dispatch(id);
+            }
+        }
+    }
+#else
+    inline Reactor::Reactor()
+    {
+        m_thread = std::thread(&Reactor::run, this);
+    }
+
+    inline Reactor::~Reactor()
+    {
+        m_shouldStop = true;
+
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    inline uint64_t Reactor::add(socket_t sock, const std::function<void(void)> &handler)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        const uint64_t id = m_nextID++;
+
+        m_sockets[id] = { sock, false };
+        m_handlers[id] = handler;
+
+        return id;
+    }
+
+    inline void Reactor::watchWritable(socket_t, uint64_t id, bool writable)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        const auto it = m_sockets.find(id);
+
+        if (it != m_sockets.end())
+        {
+            it->second.writable = writable;
+        }
+    }
+
+    inline void Reactor::remove(socket_t, uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_handlers.erase(id);
+        m_sockets.erase(id);
+
+        if (isReactorThread())
+        {
+            return;
+        }
+
+        m_handlerFinished.wait(lock, [&]{
+            return m_runningID != id;
+        });
+    }
+
+    inline void Reactor::run()
+    {
+        /* Sockets added while we are waiting are picked up on the next pass */
+        const int pollIntervalMilliseconds = 100;
+
+        std::vector<pollfd> fds;
+        std::vector<uint64_t> ids;
+
+        while (!m_shouldStop)
+        {
+            fds.clear();
+            ids.clear();
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                for (const auto &[id, watched] : m_sockets)
+                {
+                    pollfd fd {};
+                    fd.fd = watched.sock;
+                    fd.events = POLLIN | (watched.writable ? POLLOUT : 0);
+
+                    fds.push_back(fd);
+                    ids.push_back(id);
+                }
+            }
+
+            if (fds.empty())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMilliseconds));
+                continue;
+            }
+
+#ifdef _WIN32
+            const int ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), pollIntervalMilliseconds);
+#else
+            const int ready = poll(fds.data(), static_cast<nfds_t>(fds.size()), pollIntervalMilliseconds);
+#endif
+
+            for (size_t i = 0; ready > 0 && i < fds.size(); i++)
+            {
+                if (fds[i].revents != 0)
+                {
+                    dispatch(ids[i]);
+                }
+            }
+        }
+    }
+#endif
+
+    inline bool Reactor::isReactorThread() const
+    {
+        return std::this_thread::get_id() == m_thread.get_id();
+    }
+
+    inline void Reactor::dispatch(uint64_t id)
+    {
+        std::function<void(void)> handler;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            const auto it = m_handlers.find(id);
+
+            /* Removed since we found it was ready */
+            if (it == m_handlers.end())
+            {
+                return;
+            }
+
+            handler = it->second;
+            m_runningID = id;
+        }
+
+        handler();
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_runningID = 0;
+        }
+
+        m_handlerFinished.notify_all();
+    }
+
+    // Socket stream implementation
+    inline SocketStream::SocketStream(socket_t sock, time_t write_timeout_sec):
+        sock_(sock),
+        write_timeout_sec_(write_timeout_sec)
+    {
+    }
+
+    inline SocketStream::~SocketStream() {}
+
+    inline int SocketStream::read(char *ptr, size_t size)
+    {
+        if (detail::select_read(sock_, SOCKETWRAPPER_READ_TIMEOUT_SECOND, SOCKETWRAPPER_READ_TIMEOUT_USECOND) > 0)
+        {
+            return recv(sock_, ptr, static_cast<int>(size), 0);
+        }
+        return -1;
+    }
+
+    inline int SocketStream::read_nonblocking(char *ptr, size_t size)
+    {
+        const auto n = recv(sock_, ptr, static_cast<int>(size), 0);
+
+        if (n < 0)
+        {
+            return detail::would_block() ? -1 : 0;
+        }
+
+        return static_cast<int>(n);
+    }
+
+    inline int SocketStream::write(const char *ptr, size_t size)
+    {
+        size_t written = 0;
+
+        /* The socket is non blocking, so a full send buffer can give us a
+           partial write */
+        while (written < size)
+        {
+            const auto n = send(sock_, ptr + written, static_cast<int>(size - written), MSG_NOSIGNAL);
+
+            if (n > 0)
+            {
+                written += n;
+                continue;
+            }
+
+            if (n < 0 && detail::would_block() && detail::select_write(sock_, write_timeout_sec_, 0) > 0)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+
+        return static_cast<int>(written);
+    }
+
+    inline int SocketStream::write(const char *ptr)
+    {
+        return write(ptr, strlen(ptr));
+    }
+
+    inline int SocketStream::write(const std::string &s)
     {
         return write(s.data(), s.size());
     }
@@ -589,6 +1206,11 @@ namespace sockwrapper
 #endif
     }
 
+    inline int BufferStream::read_nonblocking(char *ptr, size_t size)
+    {
+        return read(ptr, size);
+    }
+
     inline int BufferStream::write(const char *ptr, size_t size)
     {
         buffer.append(ptr, size);
@@ -632,15 +1254,8 @@ namespace sockwrapper
         return true;
     }
 
-    inline bool SocketWrapper::start()
+    inline bool SocketWrapper::connectSocket()
     {
-        /* Already started */
-        if (m_started)
-        {
-            return true;
-        }
-
-        /* Create the socket */
         m_socket = detail::create_socket(m_host.c_str(), m_port, [=](socket_t sock, struct addrinfo &ai) {
             detail::set_nonblocking(sock, true);
 
@@ -654,7 +1269,6 @@ namespace sockwrapper
                 }
             }
 
-            detail::set_nonblocking(sock, false);
             return true;
         });
 
@@ -663,68 +1277,124 @@ namespace sockwrapper
             return false;
         }
 
-        if (m_listenThread.joinable())
+        detail::set_tcp_options(m_socket);
+
+        return true;
+    }
+
+    inline bool SocketWrapper::start()
+    {
+        /* Already started */
+        if (m_started)
         {
-            m_listenThread.join();
+            return true;
         }
 
-        m_socketStream = std::make_shared<SocketStream>(m_socket);
+        /* Create the socket */
+        if (!connectSocket())
+        {
+            return false;
+        }
+
+        m_socketStream = std::make_shared<SocketStream>(m_socket, timeout_sec_);
+
+        startListening();
+
+        return true;
+    }
+
+    inline void SocketWrapper::startListening()
+    {
+        stopListening();
+
+        m_frameBuffer.clear();
         m_shouldStop = false;
         m_started = true;
 
+#ifdef SOCKETWRAPPER_USE_EPOLL
+        m_reactorID = Reactor::instance().add(m_socket, [this]() {
+            handleReadable();
+        });
+#else
         /* Start listening for messages */
         m_listenThread = std::thread(&SocketWrapper::waitForMessages, this);
-
-        return true;
+#endif
     }
 
-    inline void SocketWrapper::stop()
+    inline void SocketWrapper::stopListening()
     {
-        m_shouldStop = true;
+#ifdef SOCKETWRAPPER_USE_EPOLL
+        const uint64_t reactorID = m_reactorID.exchange(0);
 
-        if (m_socket != INVALID_SOCKET)
+        if (reactorID != 0)
         {
-            detail::close_socket(m_socket);
-            m_socket = INVALID_SOCKET;
+            Reactor::instance().remove(m_socket, reactorID);
         }
-
+#else
         if (m_listenThread.joinable())
         {
             m_listenThread.join();
         }
+#endif
+    }
+
+    inline void SocketWrapper::stop()
+    {
+        m_shouldStop = true;
+
+        stopListening();
+
+        closeConnection();
 
         m_started = false;
     }
 
-    inline bool SocketWrapper::sendMessage(const std::string &message)
+    inline void SocketWrapper::closeConnection()
     {
-        if (m_socket == INVALID_SOCKET)
+        std::scoped_lock<std::mutex> lock(m_sendMutex);
+
+        if (m_socket != INVALID_SOCKET)
         {
-            return false;
+            detail::close_socket(m_socket);
+            m_socket = INVALID_SOCKET;
         }
+    }
 
+    inline bool SocketWrapper::sendMessage(const std::string &message)
+    {
         std::scoped_lock<std::mutex> lock(m_sendMutex);
 
-        m_socketStream->write(message);
+        if (m_socket == INVALID_SOCKET)
+        {
+            return false;
+        }
 
-        return true;
+        return m_socketStream->write(message) == static_cast<int>(message.size());
     }
 
     inline std::optional<std::string> SocketWrapper::sendMessageAndGetResponse(const std::string &message, const bool timeout)
     {
+        std::future<std::string> futureMessage;
+
+        /* Must be waiting for the response before we send, otherwise it can
+           arrive and be passed to the message callback before we're ready */
+        {
+            std::scoped_lock<std::mutex> lock(m_responseMutex);
+
+            m_nextMessagePromise = std::promise<std::string>();
+            futureMessage = m_nextMessagePromise.get_future();
+            m_giveMeTheNextMessagePlease = true;
+        }
+
         const bool success = sendMessage(message);
 
         if (!success)
         {
+            std::scoped_lock<std::mutex> lock(m_responseMutex);
+            m_giveMeTheNextMessagePlease = false;
             return std::nullopt;
         }
 
-        m_nextMessagePromise = std::promise<std::string>();
-
-        std::future<std::string> futureMessage = m_nextMessagePromise.get_future();
-
-        m_giveMeTheNextMessagePlease = true;
-
         /* Wait forever */
         if (!timeout)
         {
@@ -741,6 +1411,8 @@ namespace sockwrapper
             }
             else
             {
+                std::scoped_lock<std::mutex> lock(m_responseMutex);
+                m_giveMeTheNextMessagePlease = false;
                 return std::nullopt;
             }
         }
@@ -756,47 +1428,108 @@ namespace sockwrapper
         m_socketClosedCallback = callback;
     }
 
-    inline void SocketWrapper::waitForMessages()
+    inline bool SocketWrapper::handleReadable()
     {
-        const auto bufsiz = 4096;
-        char buf[bufsiz];
+        char buf[SOCKETWRAPPER_READ_CHUNK_SIZE];
 
-        while (!m_shouldStop)
-        {
-            detail::stream_line_reader reader(*m_socketStream, buf, bufsiz);
+        bool closed = false;
 
-            const auto message = reader.getline(m_messageDelimiter, m_shouldStop);
+        /* Drain everything available, so a burst of messages costs a couple
+           of syscalls rather than one per byte */
+        while (true)
+        {
+            const int n = m_socketStream->read_nonblocking(buf, sizeof(buf));
 
-            if (m_shouldStop)
+            if (n > 0)
             {
-                break;
+                m_frameBuffer.append(buf, n);
+                continue;
             }
 
-            if (!message)
-            {
-                if (m_socket != INVALID_SOCKET)
-                {
-                    detail::close_socket(m_socket);
-                    m_socket = INVALID_SOCKET;
-                }
+            closed = n == 0;
 
-                if (m_socketClosedCallback)
-                {
-                    m_socketClosedCallback();
-                }
+            break;
+        }
+
+        while (!m_shouldStop)
+        {
+            const auto message = m_frameBuffer.next(m_messageDelimiter);
 
+            if (!message)
+            {
                 break;
             }
 
+            dispatchMessage(*message);
+        }
+
+        if (m_frameBuffer.pending() > SOCKETWRAPPER_MAX_MESSAGE_SIZE)
+        {
+            closed = true;
+        }
+
+        if (closed && !m_shouldStop)
+        {
+            handleClosed();
+        }
+
+        return !closed;
+    }
+
+    inline void SocketWrapper::dispatchMessage(const std::string &message)
+    {
+        {
+            std::scoped_lock<std::mutex> lock(m_responseMutex);
+
             if (m_giveMeTheNextMessagePlease)
             {
-                m_nextMessagePromise.set_value(*message);
+                m_nextMessagePromise.set_value(message);
                 m_giveMeTheNextMessagePlease = false;
+
+                /* It's the response, don't hand it out twice */
+                return;
             }
+        }
+
+        if (m_messageCallback)
+        {
+            m_messageCallback(message);
+        }
+    }
 
-            if (m_messageCallback)
+    inline void SocketWrapper::handleClosed()
+    {
+#ifdef SOCKETWRAPPER_USE_EPOLL
+        /* We're on the reactor thread, so this won't wait on ourselves */
+        const uint64_t reactorID = m_reactorID.exchange(0);
+
+        if (reactorID != 0)
+        {
+            Reactor::instance().remove(m_socket, reactorID);
+        }
+#endif
+
+        closeConnection();
+
+        if (m_socketClosedCallback)
+        {
+            m_socketClosedCallback();
+        }
+    }
+
+    inline void SocketWrapper::waitForMessages()
+    {
+        while (!m_shouldStop)
+        {
+            /* Wake up regularly to check if we should stop */
+            if (detail::select_read(m_socket, 0, 500000) <= 0)
             {
-                m_messageCallback(*message);
+                continue;
+            }
+
+            if (!handleReadable())
+            {
+                break;
             }
         }
     }
@@ -848,6 +1581,13 @@ namespace sockwrapper
             {
                 SSL_load_error_strings();
                 SSL_library_init();
+
+#ifndef _WIN32
+                /* OpenSSL writes to the socket with write(), so unlike our
+                   own sends, writing the close notify or a share to a peer
+                   which has gone would kill us with SIGPIPE */
+                signal(SIGPIPE, SIG_IGN);
+#endif
             }
 
             ~SSLInit()
@@ -865,8 +1605,71 @@ namespace sockwrapper
 
     } // namespace detail
 
+    // SSL session cache implementation
+    inline SSLSessionCache &SSLSessionCache::instance()
+    {
+        static SSLSessionCache cache;
+        return cache;
+    }
+
+    inline SSLSessionCache::~SSLSessionCache()
+    {
+        for (auto &[server, session] : m_sessions)
+        {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    inline SSL_SESSION *SSLSessionCache::get(const std::string &server)
+    {
+        std::scoped_lock<std::mutex> lock(m_mutex);
+
+        const auto it = m_sessions.find(server);
+
+        if (it == m_sessions.end())
+        {
+            return nullptr;
+        }
+
+        SSL_SESSION_up_ref(it->second);
+
+        return it->second;
+    }
+
+    inline void SSLSessionCache::set(const std::string &server, SSL_SESSION *session)
+    {
+        std::scoped_lock<std::mutex> lock(m_mutex);
+
+        auto &cached = m_sessions[server];
+
+        if (cached)
+        {
+            SSL_SESSION_free(cached);
+        }
+
+        cached = session;
+    }
+
+    inline void SSLSessionCache::remove(const std::string &server)
+    {
+        std::scoped_lock<std::mutex> lock(m_mutex);
+
+        const auto it = m_sessions.find(server);
+
+        if (it != m_sessions.end())
+        {
+            SSL_SESSION_free(it->second);
+            m_sessions.erase(it);
+        }
+    }
+
     // SSL socket stream implementation
-    inline SSLSocketStream::SSLSocketStream(socket_t sock, SSL *ssl): sock_(sock), m_ssl(ssl) {}
+    inline SSLSocketStream::SSLSocketStream(socket_t sock, SSL *ssl, time_t write_timeout_sec):
+        sock_(sock),
+        m_ssl(ssl),
+        write_timeout_sec_(write_timeout_sec)
+    {
+    }
 
     inline SSLSocketStream::~SSLSocketStream() {}
 
@@ -875,14 +1678,62 @@ namespace sockwrapper
         if (SSL_pending(m_ssl) > 0
             || detail::select_read(sock_, SOCKETWRAPPER_READ_TIMEOUT_SECOND, SOCKETWRAPPER_READ_TIMEOUT_USECOND) > 0)
         {
-            return SSL_read(m_ssl, ptr, size);
+            return read_nonblocking(ptr, size);
         }
         return -1;
     }
 
+    inline int SSLSocketStream::read_nonblocking(char *ptr, size_t size)
+    {
+        std::scoped_lock<std::mutex> lock(m_sslMutex);
+
+        const int n = SSL_read(m_ssl, ptr, static_cast<int>(size));
+
+        if (n > 0)
+        {
+            return n;
+        }
+
+        const int error = SSL_get_error(m_ssl, n);
+
+        /* Waiting on the rest of a record, or a renegotiation */
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        {
+            return -1;
+        }
+
+        return 0;
+    }
+
     inline int SSLSocketStream::write(const char *ptr, size_t size)
     {
-        return SSL_write(m_ssl, ptr, size);
+        std::scoped_lock<std::mutex> lock(m_sslMutex);
+
+        /* The socket is non blocking, so retry with the same arguments until
+           the record is written */
+        while (true)
+        {
+            const int n = SSL_write(m_ssl, ptr, static_cast<int>(size));
+
+            if (n > 0)
+            {
+                return n;
+            }
+
+            const int error = SSL_get_error(m_ssl, n);
+
+            if (error == SSL_ERROR_WANT_WRITE && detail::select_write(sock_, write_timeout_sec_, 0) > 0)
+            {
+                continue;
+            }
+
+            if (error == SSL_ERROR_WANT_READ && detail::select_read(sock_, write_timeout_sec_, 0) > 0)
+            {
+                continue;
+            }
+
+            return -1;
+        }
     }
 
     inline int SSLSocketStream::write(const char *ptr)
@@ -903,10 +1754,27 @@ namespace sockwrapper
         time_t timeout_sec,
         const char *client_cert_path,
         const char *client_key_path):
-        SocketWrapper(host, port, messageDelimiter, timeout_sec)
+        SocketWrapper(host, port, messageDelimiter, timeout_sec),
+        m_sessionKey(std::string(host) + ":" + std::to_string(port))
     {
         ctx_ = SSL_CTX_new(SSLv23_client_method());
 
+        if (!ctx_)
+        {
+            return;
+        }
+
+        /* We keep the sessions ourselves, as each socket has its own context */
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx_, &SSLSocketWrapper::storeSession);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        /* Pools often drop the connection without a close notify. Our
+           messages are delimited, so that's harmless, but by default OpenSSL
+           treats it as fatal, and won't let us resume the session. */
+        SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
         if (client_cert_path && client_key_path)
         {
             if (SSL_CTX_use_certificate_file(ctx_, client_cert_path, SSL_FILETYPE_PEM) != 1
@@ -927,28 +1795,15 @@ namespace sockwrapper
         }
 
         /* Create the socket */
-        m_socket = detail::create_socket(m_host.c_str(), m_port, [=](socket_t sock, struct addrinfo &ai) {
-            detail::set_nonblocking(sock, true);
-
-            auto ret = connect(sock, ai.ai_addr, static_cast<int>(ai.ai_addrlen));
-            if (ret < 0)
-            {
-                if (detail::is_connection_error() || !detail::wait_until_socket_is_ready(sock, timeout_sec_, 0))
-                {
-                    detail::close_socket(sock);
-                    return false;
-                }
-            }
-
-            detail::set_nonblocking(sock, false);
-            return true;
-        });
-
-        if (m_socket == INVALID_SOCKET)
+        if (!connectSocket())
         {
             return false;
         }
 
+        /* Perform the handshake blocking, then swap back to non blocking for
+           the reactor */
+        detail::set_nonblocking(m_socket, false);
+
         {
             std::lock_guard<std::mutex> guard(ctx_mutex_);
             m_ssl = SSL_new(ctx_);
@@ -956,7 +1811,7 @@ namespace sockwrapper
 
         if (!m_ssl)
         {
-            detail::close_socket(m_socket);
+            closeConnection();
             return false;
         }
 
@@ -965,6 +1820,14 @@ namespace sockwrapper
 
         SSL_set_tlsext_host_name(m_ssl, m_host.c_str());
 
+        SSL_set_app_data(m_ssl, this);
+
+        if (SSL_SESSION *session = SSLSessionCache::instance().get(m_sessionKey))
+        {
+            SSL_set_session(m_ssl, session);
+            SSL_SESSION_free(session);
+        }
+
         if (ca_cert_file_path_.empty())
         {
             SSL_CTX_set_verify(ctx_, SSL_VERIFY_NONE, nullptr);
@@ -973,60 +1836,74 @@ namespace sockwrapper
         {
             if (!SSL_CTX_load_verify_locations(ctx_, ca_cert_file_path_.c_str(), nullptr))
             {
-                shutdownSSL();
+                closeConnection();
                 return false;
             }
 
             SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
         }
 
+        /* Don't let a server which accepts the connection, then never
+           answers, hang us forever */
+        detail::set_socket_timeout(m_socket, timeout_sec_);
+
         if (SSL_connect(m_ssl) != 1)
         {
-            shutdownSSL();
+            /* Don't try the same session again, in case it was the cause */
+            SSLSessionCache::instance().remove(m_sessionKey);
+            closeConnection();
             return false;
         }
 
-        if (m_listenThread.joinable())
-        {
-            m_listenThread.join();
-        }
+        m_sessionReused = SSL_session_reused(m_ssl) == 1;
 
-        m_socketStream = std::make_shared<SSLSocketStream>(m_socket, m_ssl);
-        m_shouldStop = false;
-        m_started = true;
+        detail::set_socket_timeout(m_socket, 0);
+        detail::set_nonblocking(m_socket, true);
 
-        /* Start listening for messages */
-        m_listenThread = std::thread(&SSLSocketWrapper::waitForMessages, this);
+        m_socketStream = std::make_shared<SSLSocketStream>(m_socket, m_ssl, timeout_sec_);
+
+        startListening();
 
         return true;
     }
 
-    inline void SSLSocketWrapper::stop()
+    inline void SSLSocketWrapper::closeConnection()
     {
-        SocketWrapper::stop();
+        std::scoped_lock<std::mutex> lock(m_sendMutex);
+
         shutdownSSL();
     }
 
     inline void SSLSocketWrapper::shutdownSSL()
     {
-        if (m_socket != INVALID_SOCKET)
-        {
-            detail::close_socket(m_socket);
-        }
-
+        /* Send the close notify before closing the socket underneath it */
         if (m_ssl != nullptr)
         {
-            SSL_shutdown(m_ssl);
+            if (m_socket != INVALID_SOCKET)
+            {
+                SSL_shutdown(m_ssl);
+            }
 
             {
                 std::lock_guard<std::mutex> guard(ctx_mutex_);
                 SSL_free(m_ssl);
             }
+
+            m_ssl = nullptr;
+        }
+
+        if (m_socket != INVALID_SOCKET)
+        {
+            detail::close_socket(m_socket);
+            m_socket = INVALID_SOCKET;
         }
     }
 
     inline SSLSocketWrapper::~SSLSocketWrapper()
     {
+        /* Must shutdown here, while closeConnection() still refers to us */
+        stop();
+
         if (ctx_)
         {
             SSL_CTX_free(ctx_);
@@ -1038,6 +1915,26 @@ namespace sockwrapper
         return ctx_;
     }
 
+    inline bool SSLSocketWrapper::sessionReused() const
+    {
+        return m_sessionReused;
+    }
+
+    inline int SSLSocketWrapper::storeSession(SSL *ssl, SSL_SESSION *session)
+    {
+        const auto socket = static_cast<SSLSocketWrapper *>(SSL_get_app_data(ssl));
+
+        if (!socket)
+        {
+            return 0;
+        }
+
+        SSLSessionCache::instance().set(socket->m_sessionKey, session);
+
+        /* Tell OpenSSL we kept the reference */
+        return 1;
+    }
+
 #endif
 
 } // namespace sockwrapper
@@ -0,0 +1,98 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "ExternalLibs/json.hpp"
+
+/* Solo mining straight against a daemon's block template RPC, rather than
+   through a pool */
+struct DaemonConfig
+{
+    bool enabled = false;
+
+    /* The daemon's RPC address. Should be local, or at least trusted, as the
+       RPC is plain HTTP. */
+    std::string host = "127.0.0.1";
+
+    uint16_t port = 11898;
+
+    /* Where the block rewards go */
+    std::string walletAddress;
+
+    /* The daemon doesn't tell us, so this must be set */
+    std::string algorithm = "chukwa";
+
+    /* How often to ask for a new template, in milliseconds, when the daemon
+       doesn't support long polling */
+    uint32_t pollInterval = 1000;
+
+    /* Fetch a new template at least this often, in seconds, even if the
+       chain hasn't moved, to include the latest transactions */
+    uint32_t refreshInterval = 30;
+
+    /* Longest to wait for the daemon to answer a long poll, in seconds. If
+       it doesn't, the chain hasn't moved, and we poll again. */
+    uint32_t longPollTimeout = 90;
+};
+
+inline void to_json(nlohmann::json &j, const DaemonConfig &config)
+{
+    j = {
+        {"enabled", config.enabled},
+        {"host", config.host},
+        {"port", config.port},
+        {"walletAddress", config.walletAddress},
+        {"algorithm", config.algorithm},
+        {"pollInterval", config.pollInterval},
+        {"refreshInterval", config.refreshInterval},
+        {"longPollTimeout", config.longPollTimeout},
+    };
+}
+
+inline void from_json(const nlohmann::json &j, DaemonConfig &config)
+{
+    if (j.find("enabled") != j.end())
+    {
+        config.enabled = j.at("enabled").get<bool>();
+    }
+
+    if (j.find("host") != j.end())
+    {
+        config.host = j.at("host").get<std::string>();
+    }
+
+    if (j.find("port") != j.end())
+    {
+        config.port = j.at("port").get<uint16_t>();
+    }
+
+    if (j.find("walletAddress") != j.end())
+    {
+        config.walletAddress = j.at("walletAddress").get<std::string>();
+    }
+
+    if (j.find("algorithm") != j.end())
+    {
+        config.algorithm = j.at("algorithm").get<std::string>();
+    }
+
+    if (j.find("pollInterval") != j.end())
+    {
+        config.pollInterval = j.at("pollInterval").get<uint32_t>();
+    }
+
+    if (j.find("refreshInterval") != j.end())
+    {
+        config.refreshInterval = j.at("refreshInterval").get<uint32_t>();
+    }
+
+    if (j.find("longPollTimeout") != j.end())
+    {
+        config.longPollTimeout = j.at("longPollTimeout").get<uint32_t>();
+    }
+}
@@ -6,7 +6,12 @@
 
 #include <atomic>
 
+#include "Types/PerformanceStats.h"
+
 struct HashDevice
 {
     std::atomic<uint64_t> totalHashes;
+
+    /* Decayed hashrate of this device. Only touched by the stats thread. */
+    RollingHashrate hashrate;
 };
@@ -0,0 +1,233 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+/////////////////////////////
+#include "Types/MinerStats.h"
+/////////////////////////////
+
+void to_json(nlohmann::json &j, const DeviceStats &stats)
+{
+    j = {
+        {"device", stats.deviceName},
+        {"totalHashes", stats.totalHashes},
+        {"hashrate", {
+            {"average", stats.hashrateAverage},
+            {"10s", stats.hashrate10s},
+            {"60s", stats.hashrate60s},
+            {"15m", stats.hashrate15m}
+        }}
+    };
+}
+
+void to_json(nlohmann::json &j, const PoolStats &stats)
+{
+    j = {
+        {"pool", stats.pool},
+        {"connected", stats.connected},
+        {"roundTripMilliseconds", stats.roundTripMilliseconds},
+        {"smoothedRoundTripMilliseconds", stats.smoothedRoundTripMilliseconds},
+        {"jobAgeSeconds", stats.jobAgeSeconds},
+        {"shareDifficulty", stats.shareDifficulty},
+        {"algorithm", stats.algorithm},
+        {"standbyPools", stats.standbyPools},
+        {"shares", {
+            {"accepted", stats.acceptedShares},
+            {"rejected", stats.rejectedShares},
+            {"rejectReasons", stats.rejectReasons},
+            {"recentRejectRate", stats.rejectRate},
+            {"stale", {
+                {"dropped", stats.staleSharesDropped},
+                {"submitted", stats.staleSharesSubmitted}
+            }},
+            {"latencyMilliseconds", {
+                {"p50", histogramPercentile(stats.shareLatencyHistogram, 50) / 1000.0},
+                {"p99", histogramPercentile(stats.shareLatencyHistogram, 99) / 1000.0}
+            }}
+        }},
+        {"requests", {
+            {"inFlight", stats.inFlightRequests},
+            {"timedOut", stats.timedOutRequests}
+        }}
+    };
+}
+
+namespace
+{
+    nlohmann::json argon2ProfileToJSON(const Instrumentation::Counters &profile)
+    {
+        nlohmann::json phaseCycles;
+
+        for (size_t phase = 0; phase < Instrumentation::PHASE_COUNT; phase++)
+        {
+            phaseCycles[Instrumentation::phaseToString(static_cast<Instrumentation::Phase>(phase))] = profile.phaseCycles[phase];
+        }
+
+        nlohmann::json kernelCalls;
+
+        for (size_t kernel = 0; kernel < Instrumentation::KERNEL_COUNT; kernel++)
+        {
+            kernelCalls[Instrumentation::kernelToString(static_cast<Instrumentation::Kernel>(kernel))] = profile.kernelCalls[kernel];
+        }
+
+        return {
+            {"hashes", profile.hashes},
+            {"phaseCycles", phaseCycles},
+            {"segmentCycles", profile.segmentCycles},
+            {"kernelCalls", kernelCalls}
+        };
+    }
+}
+
+void to_json(nlohmann::json &j, const HardwareCounters &counters)
+{
+    j = {
+        {"available", counters.available()}
+    };
+
+    if (!counters.available())
+    {
+        j["error"] = counters.error;
+        return;
+    }
+
+    nlohmann::json counts;
+
+    for (size_t event = 0; event < HARDWARE_EVENT_COUNT; event++)
+    {
+        if (counters.supported[event])
+        {
+            counts[hardwareEventToString(static_cast<HardwareEvent>(event))] = counters.counts[event];
+        }
+    }
+
+    j["hashes"] = counters.hashes;
+    j["counts"] = counts;
+    j["instructionsPerCycle"] = counters.instructionsPerCycle();
+    j["llcMissesPerHash"] = counters.perHash(LLC_MISSES);
+    j["dtlbMissesPerHash"] = counters.perHash(DTLB_MISSES);
+    j["memoryBandwidthBytesPerSecond"] = counters.memoryBandwidth();
+}
+
+double EfficiencyStats::hashesPerJoule() const
+{
+    if (joules == 0)
+    {
+        return 0;
+    }
+
+    return hashes / joules;
+}
+
+double EfficiencyStats::watts() const
+{
+    if (seconds == 0)
+    {
+        return 0;
+    }
+
+    return joules / seconds;
+}
+
+void to_json(nlohmann::json &j, const EfficiencyStats &stats)
+{
+    j = {
+        {"optimizationMethod", stats.optimizationMethod},
+        {"threadCount", stats.threadCount},
+        {"algorithm", stats.algorithm},
+        {"hashes", stats.hashes},
+        {"joules", stats.joules},
+        {"seconds", stats.seconds},
+        {"hashesPerJoule", stats.hashesPerJoule()},
+        {"watts", stats.watts()}
+    };
+}
+
+void to_json(nlohmann::json &j, const EnergyStats &stats)
+{
+    j = {
+        {"available", stats.available}
+    };
+
+    if (!stats.available)
+    {
+        j["error"] = stats.error;
+        return;
+    }
+
+    j["packageJoules"] = stats.packageJoules;
+    j["dramJoules"] = stats.dramJoules;
+    j["configurations"] = stats.configurations;
+}
+
+void to_json(nlohmann::json &j, const GovernorStats &stats)
+{
+    j = {
+        {"enabled", stats.enabled}
+    };
+
+    if (!stats.enabled)
+    {
+        return;
+    }
+
+    j["activeThreads"] = stats.activeThreads;
+    j["threadCount"] = stats.threadCount;
+    j["temperature"] = stats.haveTemperature ? nlohmann::json(stats.temperature) : nlohmann::json();
+    j["frequencyMHz"] = stats.haveFrequency ? nlohmann::json(stats.frequency) : nlohmann::json();
+    j["watts"] = stats.watts;
+    j["throttleEvents"] = stats.throttleEvents;
+    j["lastChange"] = stats.lastChange;
+}
+
+void to_json(nlohmann::json &j, const MinerStats &stats)
+{
+    nlohmann::json threads = nlohmann::json::array();
+
+    for (const auto &thread : stats.threads)
+    {
+        nlohmann::json threadJSON = {
+            {"device", thread.deviceName},
+            {"thread", thread.threadNumber},
+            {"totalHashes", thread.totalHashes},
+            {"jobSwitches", thread.jobSwitches},
+            {"parked", thread.parked},
+            {"hashrate", {
+                {"10s", thread.hashrate10s},
+                {"60s", thread.hashrate60s},
+                {"15m", thread.hashrate15m}
+            }},
+            {"latencyMicroseconds", {
+                {"p50", thread.latencyPercentile(50)},
+                {"p99", thread.latencyPercentile(99)}
+            }}
+        };
+
+        if (thread.hardwareCounters.enabled)
+        {
+            threadJSON["hardwareCounters"] = thread.hardwareCounters;
+        }
+
+        /* Only present in instrumentation builds */
+        if (thread.argon2Profile.hashes != 0)
+        {
+            threadJSON["argon2Profile"] = argon2ProfileToJSON(thread.argon2Profile);
+        }
+
+        threads.push_back(threadJSON);
+    }
+
+    j = {
+        {"devices", stats.devices},
+        {"total", stats.total},
+        {"threads", threads},
+        {"shares", {
+            {"submitted", stats.submittedShares},
+            {"accepted", stats.acceptedShares}
+        }},
+        {"pool", stats.pool},
+        {"optimizationMethod", stats.optimizationMethod},
+        {"energy", stats.energy},
+        {"governor", stats.governor}
+    };
+}
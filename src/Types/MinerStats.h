@@ -0,0 +1,189 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ExternalLibs/json.hpp"
+#include "Types/PerformanceStats.h"
+
+/* Hashrate of a single device, such as 'CPU' or 'GTX 1070-0' */
+struct DeviceStats
+{
+    std::string deviceName;
+
+    uint64_t totalHashes = 0;
+
+    /* Average hashrate since we started mining */
+    double hashrateAverage = 0;
+
+    /* Decayed hashrates */
+    double hashrate10s = 0;
+    double hashrate60s = 0;
+    double hashrate15m = 0;
+};
+
+/* Info about the pool we are currently connected to */
+struct PoolStats
+{
+    /* host:port */
+    std::string pool;
+
+    bool connected = false;
+
+    /* Round trip time of the most recent login or keepalive, in milliseconds.
+       Zero if not yet measured. */
+    double roundTripMilliseconds = 0;
+
+    /* How long since the pool last sent us a job */
+    double jobAgeSeconds = 0;
+
+    uint64_t shareDifficulty = 0;
+
+    std::string algorithm;
+
+    /* How many standby pools we are logged in to, ready to fail over to */
+    size_t standbyPools = 0;
+
+    /* Shares this pool has responded to, over all connections to it */
+    uint64_t acceptedShares = 0;
+    uint64_t rejectedShares = 0;
+
+    /* Rejected shares, by the error message the pool gave */
+    std::map<std::string, uint64_t> rejectReasons;
+
+    /* Shares found for jobs superseded by a newer block or job */
+    uint64_t staleSharesDropped = 0;
+    uint64_t staleSharesSubmitted = 0;
+
+    /* Requests the pool never responded to */
+    uint64_t timedOutRequests = 0;
+
+    /* Requests sent which we are still awaiting a response for */
+    size_t inFlightRequests = 0;
+
+    /* Time from submitting a share to the pool accepting or rejecting it, see
+       LATENCY_HISTOGRAM_BUCKETS */
+    std::array<uint64_t, LATENCY_HISTOGRAM_BUCKETS> shareLatencyHistogram {};
+
+    /* Sum of all the share latencies, in microseconds */
+    uint64_t shareLatencySumMicroseconds = 0;
+
+    /* Exponentially weighted round trip time, used to pick between pools */
+    double smoothedRoundTripMilliseconds = 0;
+
+    /* Percentage of recent shares which were rejected */
+    double rejectRate = 0;
+};
+
+/* CPU hashes and energy used while mining with a given configuration */
+struct EfficiencyStats
+{
+    /* The hashing kernel in use, for example AVX2 */
+    std::string optimizationMethod;
+
+    uint32_t threadCount = 0;
+
+    std::string algorithm;
+
+    uint64_t hashes = 0;
+
+    /* Package and DRAM energy used */
+    double joules = 0;
+
+    double seconds = 0;
+
+    double hashesPerJoule() const;
+
+    double watts() const;
+};
+
+/* Energy used by the CPU, from the RAPL counters */
+struct EnergyStats
+{
+    /* Could we read the energy counters */
+    bool available = false;
+
+    /* Why not, if we couldn't */
+    std::string error;
+
+    double packageJoules = 0;
+
+    /* Zero if the CPU does not report DRAM energy */
+    double dramJoules = 0;
+
+    /* Broken down by each configuration we have mined with */
+    std::vector<EfficiencyStats> configurations;
+};
+
+/* What the CPU governor is doing, and the readings it is going off */
+struct GovernorStats
+{
+    bool enabled = false;
+
+    /* Threads hashing, the rest are parked */
+    uint32_t activeThreads = 0;
+
+    uint32_t threadCount = 0;
+
+    bool haveTemperature = false;
+
+    double temperature = 0;
+
+    bool haveFrequency = false;
+
+    /* Average core frequency, in MHz */
+    double frequency = 0;
+
+    /* Zero if the RAPL counters can't be read */
+    double watts = 0;
+
+    /* Times the CPU throttled itself while we were mining */
+    uint64_t throttleEvents = 0;
+
+    /* Why we last parked or unparked a thread */
+    std::string lastChange;
+};
+
+/* A snapshot of everything the miner is doing, for exposing to monitoring */
+struct MinerStats
+{
+    std::vector<DeviceStats> devices;
+
+    /* Combined over all devices */
+    DeviceStats total;
+
+    /* Latest stats for each hashing thread */
+    std::vector<PerformanceStats> threads;
+
+    uint64_t submittedShares = 0;
+
+    uint64_t acceptedShares = 0;
+
+    PoolStats pool;
+
+    /* The hashing kernel in use, for example AVX2 */
+    std::string optimizationMethod;
+
+    EnergyStats energy;
+
+    GovernorStats governor;
+};
+
+void to_json(nlohmann::json &j, const DeviceStats &stats);
+
+void to_json(nlohmann::json &j, const PoolStats &stats);
+
+void to_json(nlohmann::json &j, const HardwareCounters &counters);
+
+void to_json(nlohmann::json &j, const EfficiencyStats &stats);
+
+void to_json(nlohmann::json &j, const EnergyStats &stats);
+
+void to_json(nlohmann::json &j, const GovernorStats &stats);
+
+void to_json(nlohmann::json &j, const MinerStats &stats);
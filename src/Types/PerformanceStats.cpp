@@ -0,0 +1,275 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+///////////////////////////////////
+#include "Types/PerformanceStats.h"
+///////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+void RollingHashrate::update(
+    const uint64_t totalHashes,
+    const std::chrono::steady_clock::time_point now)
+{
+    if (!m_initialized)
+    {
+        m_initialized = true;
+        m_lastTotalHashes = totalHashes;
+        m_lastUpdate = now;
+        return;
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - m_lastUpdate).count();
+
+    if (elapsed <= 0)
+    {
+        return;
+    }
+
+    /* Counters can be reset, for example if a backend is recreated */
+    const uint64_t hashes = totalHashes >= m_lastTotalHashes
+        ? totalHashes - m_lastTotalHashes
+        : totalHashes;
+
+    const double hashrate = hashes / elapsed;
+
+    for (auto &window : m_windows)
+    {
+        /* Scale the decay by the time elapsed, so irregular sampling doesn't
+           skew the average */
+        const double decay = std::exp(-elapsed / window.length);
+
+        window.value = window.value * decay + (1 - decay) * hashrate;
+        window.weight = window.weight * decay + (1 - decay);
+    }
+
+    m_lastTotalHashes = totalHashes;
+    m_lastUpdate = now;
+}
+
+double RollingHashrate::Window::hashrate() const
+{
+    if (weight == 0)
+    {
+        return 0;
+    }
+
+    return value / weight;
+}
+
+double RollingHashrate::tenSeconds() const
+{
+    return m_windows[0].hashrate();
+}
+
+double RollingHashrate::sixtySeconds() const
+{
+    return m_windows[1].hashrate();
+}
+
+double RollingHashrate::fifteenMinutes() const
+{
+    return m_windows[2].hashrate();
+}
+
+size_t latencyBucket(const uint64_t latencyMicroseconds)
+{
+    size_t bucket = 0;
+
+    for (uint64_t latency = latencyMicroseconds; latency > 0 && bucket < LATENCY_HISTOGRAM_BUCKETS - 1; latency >>= 1)
+    {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+uint64_t histogramPercentile(
+    const std::array<uint64_t, LATENCY_HISTOGRAM_BUCKETS> &histogram,
+    const double percentile)
+{
+    uint64_t total = 0;
+
+    for (const auto count : histogram)
+    {
+        total += count;
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    const double threshold = total * (percentile / 100);
+
+    uint64_t seen = 0;
+
+    for (size_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram[bucket];
+
+        if (seen >= threshold)
+        {
+            return bucket == 0 ? 0 : 1ULL << bucket;
+        }
+    }
+
+    return 1ULL << (LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+void ThreadCounters::recordHashes(const uint64_t hashes, const uint64_t latencyMicroseconds)
+{
+    const size_t bucket = latencyBucket(latencyMicroseconds);
+
+    /* We are the only writer, so no need for a locked read-modify-write */
+    latencyHistogram[bucket].store(latencyHistogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totalHashes.store(totalHashes.load(std::memory_order_relaxed) + hashes, std::memory_order_relaxed);
+}
+
+void ThreadCounters::recordJobSwitch()
+{
+    jobSwitches.store(jobSwitches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void ThreadCounters::recordArgon2Profile(const Instrumentation::Counters &profile)
+{
+    std::scoped_lock lock(argon2ProfileMutex);
+    argon2Profile += profile;
+}
+
+void ThreadCounters::recordHardwareCounters(const HardwareCounters &counters)
+{
+    std::scoped_lock lock(hardwareCountersMutex);
+    hardwareCounters += counters;
+}
+
+std::string hardwareEventToString(const HardwareEvent event)
+{
+    switch (event)
+    {
+        case CYCLES:
+        {
+            return "cycles";
+        }
+        case INSTRUCTIONS:
+        {
+            return "instructions";
+        }
+        case LLC_MISSES:
+        {
+            return "llcMisses";
+        }
+        case DTLB_MISSES:
+        {
+            return "dtlbMisses";
+        }
+        case HARDWARE_EVENT_COUNT:
+        {
+            break;
+        }
+    }
+
+    throw std::invalid_argument("Invalid hardware event given");
+}
+
+HardwareCounters &HardwareCounters::operator+=(const HardwareCounters &other)
+{
+    enabled = enabled || other.enabled;
+
+    if (other.error != "")
+    {
+        error = other.error;
+    }
+
+    for (size_t i = 0; i < HARDWARE_EVENT_COUNT; i++)
+    {
+        supported[i] = supported[i] || other.supported[i];
+        counts[i] += other.counts[i];
+    }
+
+    hashes += other.hashes;
+    nanoseconds += other.nanoseconds;
+
+    return *this;
+}
+
+bool HardwareCounters::available() const
+{
+    return std::any_of(supported.begin(), supported.end(), [](const bool isSupported) { return isSupported; });
+}
+
+double HardwareCounters::instructionsPerCycle() const
+{
+    if (!supported[CYCLES] || !supported[INSTRUCTIONS] || counts[CYCLES] == 0)
+    {
+        return 0;
+    }
+
+    return static_cast<double>(counts[INSTRUCTIONS]) / counts[CYCLES];
+}
+
+double HardwareCounters::perHash(const HardwareEvent event) const
+{
+    if (!supported[event] || hashes == 0)
+    {
+        return 0;
+    }
+
+    return static_cast<double>(counts[event]) / hashes;
+}
+
+double HardwareCounters::memoryBandwidth() const
+{
+    if (!supported[LLC_MISSES] || nanoseconds == 0)
+    {
+        return 0;
+    }
+
+    return counts[LLC_MISSES] * 64.0 / (nanoseconds / 1e9);
+}
+
+uint64_t PerformanceStats::latencyPercentile(const double percentile) const
+{
+    return histogramPercentile(latencyHistogram, percentile);
+}
+
+PerformanceStats snapshotCounters(
+    const ThreadCounters &counters,
+    RollingHashrate &hashrate,
+    const std::string &deviceName,
+    const uint32_t threadNumber)
+{
+    PerformanceStats stats;
+
+    stats.deviceName = deviceName;
+    stats.threadNumber = threadNumber;
+    stats.totalHashes = counters.totalHashes.load(std::memory_order_relaxed);
+    stats.jobSwitches = counters.jobSwitches.load(std::memory_order_relaxed);
+    stats.parked = counters.parked.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+        stats.latencyHistogram[i] = counters.latencyHistogram[i].load(std::memory_order_relaxed);
+    }
+
+    {
+        std::scoped_lock lock(counters.argon2ProfileMutex);
+        stats.argon2Profile = counters.argon2Profile;
+    }
+
+    {
+        std::scoped_lock lock(counters.hardwareCountersMutex);
+        stats.hardwareCounters = counters.hardwareCounters;
+    }
+
+    hashrate.update(stats.totalHashes);
+
+    stats.hashrate10s = hashrate.tenSeconds();
+    stats.hashrate60s = hashrate.sixtySeconds();
+    stats.hashrate15m = hashrate.fifteenMinutes();
+
+    return stats;
+}
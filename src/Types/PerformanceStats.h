@@ -4,6 +4,202 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "Argon2/Instrumentation.h"
+
+/* Per hash latencies are bucketed in powers of two microseconds. Bucket 0 is
+   a latency of 0us, bucket n holds latencies in [2^(n-1), 2^n) microseconds,
+   and the final bucket holds everything slower than that. */
+constexpr size_t LATENCY_HISTOGRAM_BUCKETS = 24;
+
+/* Which histogram bucket the given latency falls in */
+size_t latencyBucket(const uint64_t latencyMicroseconds);
+
+/* Approximate latency of the given percentile (0 - 100) in microseconds,
+   taken from the upper bound of the histogram bucket it falls in */
+uint64_t histogramPercentile(
+    const std::array<uint64_t, LATENCY_HISTOGRAM_BUCKETS> &histogram,
+    const double percentile);
+
+/* Hashrates decayed exponentially over a 10 second, 60 second and 15 minute
+   window, in the same manner as the unix load average. Not thread safe, should
+   be updated and read from the stats thread only. */
+class RollingHashrate
+{
+  public:
+    /* Feed in the total number of hashes performed so far. Should be called
+       regularly, roughly once a second. */
+    void update(
+        const uint64_t totalHashes,
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    double tenSeconds() const;
+
+    double sixtySeconds() const;
+
+    double fifteenMinutes() const;
+
+  private:
+    struct Window
+    {
+        /* Window length in seconds */
+        double length;
+
+        /* Decayed sum of the hashrate samples */
+        double value = 0;
+
+        /* Decayed sum of the sample weights. Dividing by this stops the
+           hashrate starting from zero and slowly creeping up. */
+        double weight = 0;
+
+        double hashrate() const;
+    };
+
+    std::array<Window, 3> m_windows {{ { 10 }, { 60 }, { 15 * 60 } }};
+
+    bool m_initialized = false;
+
+    uint64_t m_lastTotalHashes = 0;
+
+    std::chrono::steady_clock::time_point m_lastUpdate;
+};
+
+/* Hardware events counted for a hashing thread, from perf_event_open */
+enum HardwareEvent
+{
+    CYCLES,
+    INSTRUCTIONS,
+    /* Last level cache misses, roughly one 64 byte line read from memory each */
+    LLC_MISSES,
+    DTLB_MISSES,
+    HARDWARE_EVENT_COUNT,
+};
+
+std::string hardwareEventToString(const HardwareEvent event);
+
+/* Hardware performance counters of a hashing thread. Only collected when the
+   cpu hardwareCounters option is set. */
+struct HardwareCounters
+{
+    /* Were hardware counters requested for this thread */
+    bool enabled = false;
+
+    /* Why the counters could not be opened, if they could not */
+    std::string error;
+
+    /* Was each event available on this CPU and kernel */
+    std::array<bool, HARDWARE_EVENT_COUNT> supported {};
+
+    /* Event counts, scaled up to cover any time the kernel had to multiplex
+       the counter with others */
+    std::array<uint64_t, HARDWARE_EVENT_COUNT> counts {};
+
+    /* Hashes performed while counting */
+    uint64_t hashes = 0;
+
+    /* Nanoseconds spent counting */
+    uint64_t nanoseconds = 0;
+
+    HardwareCounters &operator+=(const HardwareCounters &other);
+
+    bool available() const;
+
+    /* Zero if either event is unsupported */
+    double instructionsPerCycle() const;
+
+    double perHash(const HardwareEvent event) const;
+
+    /* Estimated memory bandwidth in bytes per second, from the LLC misses */
+    double memoryBandwidth() const;
+};
+
+/* Counters updated by a single hashing thread and read by the stats thread.
+   Only the owning thread writes to them, so relaxed loads and stores suffice
+   and the hashing path never takes a lock. Cache line aligned so threads
+   sitting next to each other in memory don't fight over the same line. */
+struct alignas(64) ThreadCounters
+{
+    /* Record a batch of hashes which took latencyMicroseconds to compute */
+    void recordHashes(const uint64_t hashes, const uint64_t latencyMicroseconds);
+
+    /* Record that we switched to a new job */
+    void recordJobSwitch();
+
+    /* Add the Argon2 phase timings of the hashes since the last call. Only
+       used in instrumentation builds, about once a second. */
+    void recordArgon2Profile(const Instrumentation::Counters &profile);
+
+    std::atomic<uint64_t> totalHashes {0};
+
+    std::atomic<uint64_t> jobSwitches {0};
+
+    /* Is the thread parked by the governor */
+    std::atomic<bool> parked {false};
+
+    std::array<std::atomic<uint64_t>, LATENCY_HISTOGRAM_BUCKETS> latencyHistogram {};
+
+    /* Too big to update atomically, but only added to about once a second,
+       so a lock is fine */
+    Instrumentation::Counters argon2Profile;
+
+    mutable std::mutex argon2ProfileMutex;
+
+    /* Add the hardware counts since the last call. Called about once a
+       second, so again a lock is fine. */
+    void recordHardwareCounters(const HardwareCounters &counters);
+
+    HardwareCounters hardwareCounters;
+
+    mutable std::mutex hardwareCountersMutex;
+};
+
+/* A snapshot of the performance of a single hashing thread */
 struct PerformanceStats
 {
+    /* An identifier for the hardware, for example 'CPU' or 'GTX 1070-0' */
+    std::string deviceName;
+
+    /* Which thread of the device this is */
+    uint32_t threadNumber = 0;
+
+    /* Total hashes performed by this thread */
+    uint64_t totalHashes = 0;
+
+    /* How many times this thread has swapped to a new job */
+    uint64_t jobSwitches = 0;
+
+    /* Parked threads are idle, to stay within the thermal or power limits */
+    bool parked = false;
+
+    /* Decayed hashrates */
+    double hashrate10s = 0;
+    double hashrate60s = 0;
+    double hashrate15m = 0;
+
+    /* Histogram of per hash latencies, see LATENCY_HISTOGRAM_BUCKETS */
+    std::array<uint64_t, LATENCY_HISTOGRAM_BUCKETS> latencyHistogram {};
+
+    /* Cycles spent in each phase of the Argon2 hash. Empty unless built with
+       ARGON2_INSTRUMENTATION. */
+    Instrumentation::Counters argon2Profile;
+
+    /* Cache, TLB and instruction counts. Empty unless enabled. */
+    HardwareCounters hardwareCounters;
+
+    /* Approximate latency of the given percentile (0 - 100) in microseconds,
+       taken from the upper bound of the histogram bucket it falls in */
+    uint64_t latencyPercentile(const double percentile) const;
 };
+
+/* Take a snapshot of the given counters, updating the decayed hashrate */
+PerformanceStats snapshotCounters(
+    const ThreadCounters &counters,
+    RollingHashrate &hashrate,
+    const std::string &deviceName,
+    const uint32_t threadNumber);
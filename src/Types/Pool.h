@@ -57,6 +57,10 @@ struct Pool
      * This may be desired if the pool is returning the incorrect value. */
     bool disableAutoAlgoSelect = false;
 
+    /* Submit shares for jobs which have been superseded by a newer block,
+       rather than dropping them. Only useful if the pool accepts them. */
+    bool submitStaleShares = false;
+
     std::string getAgent() const
     {
         return agent == "" ? "TRRXITTEminer/" + Constants::VERSION_NUMBER : agent;
@@ -95,6 +99,7 @@ inline void to_json(nlohmann::json &j, const Pool &pool)
         {"priority", pool.priority},
         {"ssl", pool.ssl},
         {"disableAutoAlgoSelect", pool.disableAutoAlgoSelect},
+        {"submitStaleShares", pool.submitStaleShares},
     };
 }
 
@@ -157,4 +162,9 @@ inline void from_json(const nlohmann::json &j, Pool &pool)
     {
         pool.disableAutoAlgoSelect = j.at("disableAutoAlgoSelect").get<bool>();
     }
+
+    if (j.find("submitStaleShares") != j.end())
+    {
+        pool.submitStaleShares = j.at("submitStaleShares").get<bool>();
+    }
 }
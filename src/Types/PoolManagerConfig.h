@@ -0,0 +1,114 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "ExternalLibs/json.hpp"
+
+/* How we manage connections to the list of pools */
+struct PoolManagerConfig
+{
+    /* How many of the next preferred pools to keep connected and logged in
+       alongside the pool we are mining on. If the current pool drops, we
+       switch to a standby straight away, rather than pausing mining while we
+       reconnect. 0 disables standby connections. */
+    size_t standbyPoolCount = 0;
+
+    /* Among pools with the same priority, mine on the one with the lowest
+       round trip time. All pools sharing the current priority are kept
+       connected so we can measure them. */
+    bool latencyAwareSelection = false;
+
+    /* How often to measure the round trip time to each connected pool, in
+       seconds */
+    uint32_t latencyProbeInterval = 30;
+
+    /* Only switch to a faster pool if its round trip time is at least this
+       percentage lower than the current pool, to avoid flapping between
+       pools with similar latencies */
+    double roundTripSwitchThreshold = 25;
+
+    /* Switch away from a pool once more than this percentage of recent shares
+       are rejected, if an equal priority pool is doing better */
+    double maxRejectRate = 10;
+
+    /* Minimum time between switching pools for being faster, in seconds */
+    uint32_t minSwitchInterval = 120;
+
+    /* How long to wait before retrying a pool we failed to connect to, in
+       milliseconds. Doubles with each failure. A pool which drops a working
+       connection is retried straight away. */
+    uint32_t reconnectDelay = 100;
+
+    /* The most we wait between attempts to connect to a pool, in
+       milliseconds */
+    uint32_t maxReconnectDelay = 5000;
+};
+
+inline void to_json(nlohmann::json &j, const PoolManagerConfig &config)
+{
+    j = {
+        {"standbyPoolCount", config.standbyPoolCount},
+        {"latencyAwareSelection", config.latencyAwareSelection},
+        {"latencyProbeInterval", config.latencyProbeInterval},
+        {"roundTripSwitchThreshold", config.roundTripSwitchThreshold},
+        {"maxRejectRate", config.maxRejectRate},
+        {"minSwitchInterval", config.minSwitchInterval},
+        {"reconnectDelay", config.reconnectDelay},
+        {"maxReconnectDelay", config.maxReconnectDelay},
+    };
+}
+
+inline void from_json(const nlohmann::json &j, PoolManagerConfig &config)
+{
+    if (j.find("standbyPoolCount") != j.end())
+    {
+        config.standbyPoolCount = j.at("standbyPoolCount").get<size_t>();
+    }
+
+    if (j.find("latencyAwareSelection") != j.end())
+    {
+        config.latencyAwareSelection = j.at("latencyAwareSelection").get<bool>();
+    }
+
+    if (j.find("latencyProbeInterval") != j.end())
+    {
+        config.latencyProbeInterval = j.at("latencyProbeInterval").get<uint32_t>();
+    }
+
+    if (j.find("roundTripSwitchThreshold") != j.end())
+    {
+        config.roundTripSwitchThreshold = j.at("roundTripSwitchThreshold").get<double>();
+    }
+
+    if (j.find("maxRejectRate") != j.end())
+    {
+        config.maxRejectRate = j.at("maxRejectRate").get<double>();
+    }
+
+    if (j.find("minSwitchInterval") != j.end())
+    {
+        config.minSwitchInterval = j.at("minSwitchInterval").get<uint32_t>();
+    }
+
+    if (j.find("reconnectDelay") != j.end())
+    {
+        config.reconnectDelay = j.at("reconnectDelay").get<uint32_t>();
+
+        /* With no delay, a dead pool would be retried in a tight loop */
+        if (config.reconnectDelay == 0)
+        {
+            throw std::invalid_argument("poolManager reconnectDelay must be at least 1 millisecond");
+        }
+    }
+
+    if (j.find("maxReconnectDelay") != j.end())
+    {
+        config.maxReconnectDelay = j.at("maxReconnectDelay").get<uint32_t>();
+    }
+}
@@ -6,48 +6,524 @@
 #include "Types/PoolMessage.h"
 //////////////////////////////
 
-std::variant<
-    JobMessage,
-    ErrorMessage,
-    LoginMessage,
-    StatusMessage
-> parsePoolMessage(const std::string &message)
+namespace
 {
-    try
+    bool isWhitespace(const char c)
     {
-        const JobMessage result = nlohmann::json::parse(message);
-        return result;
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\0';
     }
-    catch (const std::exception &)
+
+    size_t skipWhitespace(const std::string_view message, size_t pos)
     {
+        while (pos < message.size() && isWhitespace(message[pos]))
+        {
+            pos++;
+        }
+
+        return pos;
     }
 
-    try
+    /* Find the position of the value belonging to "key", or npos. Assumes
+       the key is unique in the message, which holds for the flat job
+       notifications we use this on. */
+    size_t findValue(const std::string_view message, const std::string_view key)
     {
-        const StatusMessage result = nlohmann::json::parse(message);
-        return result;
+        size_t pos = 0;
+
+        while ((pos = message.find(key, pos)) != std::string_view::npos)
+        {
+            const size_t keyStart = pos;
+
+            pos += key.size();
+
+            /* Must be a whole quoted key, followed by a colon */
+            if (keyStart == 0 || message[keyStart - 1] != '"' || pos >= message.size() || message[pos] != '"')
+            {
+                continue;
+            }
+
+            pos = skipWhitespace(message, pos + 1);
+
+            if (pos >= message.size() || message[pos] != ':')
+            {
+                continue;
+            }
+
+            return skipWhitespace(message, pos + 1);
+        }
+
+        return std::string_view::npos;
     }
-    catch (const std::exception &)
+
+    /* Get the string value of "key". Returns nullopt if not present, or if
+       it contains escapes, which we leave to the full parser. */
+    std::optional<std::string_view> findString(const std::string_view message, const std::string_view key)
     {
+        const size_t start = findValue(message, key);
+
+        if (start == std::string_view::npos || message[start] != '"')
+        {
+            return std::nullopt;
+        }
+
+        const size_t end = message.find('"', start + 1);
+
+        if (end == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+
+        const std::string_view value = message.substr(start + 1, end - start - 1);
+
+        if (value.find('\\') != std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+
+        return value;
     }
 
-    try
+    /* Get the unsigned integer value of "key", if present */
+    std::optional<uint64_t> findInteger(const std::string_view message, const std::string_view key)
     {
+        size_t pos = findValue(message, key);
+
+        if (pos == std::string_view::npos || pos >= message.size() || message[pos] < '0' || message[pos] > '9')
+        {
+            return std::nullopt;
+        }
+
+        uint64_t value = 0;
+
+        while (pos < message.size() && message[pos] >= '0' && message[pos] <= '9')
+        {
+            value = value * 10 + (message[pos] - '0');
+            pos++;
+        }
+
+        return value;
     }
-    catch (const std::exception &)
+
+    /* Only take the pool's algorithm if we can mine it */
+    void setAlgorithm(const std::string &poolAlgorithm, Job &job)
     {
-        const LoginMessage result = nlohmann::json::parse(message);
-        return result;
+        if (ArgonVariant::isSupportedAlgorithm(poolAlgorithm))
+        {
+            job.algorithm = poolAlgorithm;
+        }
     }
 
-    try
+    /* Parses the common case of a job notification by scanning for the keys
+       we need, rather than building a JSON document. Returns nothing if the
+       message is not a job, or is anything out of the ordinary, in which
+       case the full parser should be used. */
+    std::optional<ParsedPoolMessage> tryParseJobNotification(const std::string_view message)
     {
-        const ErrorMessage result = nlohmann::json::parse(message);
+        const auto method = findString(message, "method");
+
+        if (!method || *method != "job")
+        {
+            return std::nullopt;
+        }
+
+        /* Nested objects or arrays other than params could contain duplicate
+           keys, leave anything unusual to the full parser */
+        if (message.find('[') != std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+
+        const auto blob = findString(message, "blob");
+        const auto jobID = findString(message, "job_id");
+        const auto target = findString(message, "target");
+
+        if (!blob || !jobID || !target)
+        {
+            return std::nullopt;
+        }
+
+        JobMessage result;
+
+        result.method = *method;
+
+        if (const auto jsonRpc = findString(message, "jsonrpc"))
+        {
+            result.jsonRpc = *jsonRpc;
+        }
+
+        Job &job = result.job;
+
+        job.jobID = *jobID;
+
+        std::string error;
+
+        if (!parseJobBlob(*blob, job, error) || !parseJobTarget(*target, job, error))
+        {
+            return InvalidMessage { error };
+        }
+
+        if (const auto height = findInteger(message, "height"))
+        {
+            job.height = *height;
+        }
+
+        if (const auto version = findInteger(message, "blockMajorVersion"))
+        {
+            job.blockMajorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = findInteger(message, "blockMinorVersion"))
+        {
+            job.blockMinorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = findInteger(message, "rootMajorVersion"))
+        {
+            job.rootMajorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = findInteger(message, "rootMinorVersion"))
+        {
+            job.rootMinorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto algorithm = findString(message, "algo"))
+        {
+            setAlgorithm(std::string(*algorithm), job);
+        }
+
         return result;
     }
-    catch (const std::exception &)
+
+    /* The rest read a parsed document, checking each type before getting
+       it, so nothing throws */
+
+    const nlohmann::json *findKey(const nlohmann::json &j, const char *key)
+    {
+        if (!j.is_object())
+        {
+            return nullptr;
+        }
+
+        const auto it = j.find(key);
+
+        return it == j.end() ? nullptr : &*it;
+    }
+
+    std::optional<std::string> readString(const nlohmann::json &j, const char *key)
+    {
+        const auto value = findKey(j, key);
+
+        if (!value || !value->is_string())
+        {
+            return std::nullopt;
+        }
+
+        return value->get<std::string>();
+    }
+
+    std::optional<uint64_t> readUnsigned(const nlohmann::json &j, const char *key)
+    {
+        const auto value = findKey(j, key);
+
+        if (!value || !value->is_number_unsigned())
+        {
+            return std::nullopt;
+        }
+
+        return value->get<uint64_t>();
+    }
+
+    /* Pools echo back the id we sent, as a string or a number */
+    std::string readID(const nlohmann::json &j)
+    {
+        const auto id = findKey(j, "id");
+
+        if (!id)
+        {
+            return "";
+        }
+
+        if (id->is_string())
+        {
+            return id->get<std::string>();
+        }
+
+        if (id->is_number_unsigned())
+        {
+            return std::to_string(id->get<uint64_t>());
+        }
+
+        if (id->is_number_integer())
+        {
+            return std::to_string(id->get<int64_t>());
+        }
+
+        return "";
+    }
+
+    void readPoolMessage(const nlohmann::json &j, PoolMessage &message)
+    {
+        if (const auto jsonRpc = readString(j, "jsonrpc"))
+        {
+            message.jsonRpc = *jsonRpc;
+        }
+    }
+
+    bool readJob(const nlohmann::json &j, Job &job, std::string &error)
+    {
+        const auto jobID = readString(j, "job_id");
+        const auto blob = readString(j, "blob");
+        const auto target = readString(j, "target");
+
+        if (!jobID || !blob || !target)
+        {
+            error = "Job is missing its job_id, blob or target";
+            return false;
+        }
+
+        job.jobID = *jobID;
+
+        if (!parseJobBlob(*blob, job, error) || !parseJobTarget(*target, job, error))
+        {
+            return false;
+        }
+
+        job.height = readUnsigned(j, "height");
+
+        if (const auto version = readUnsigned(j, "blockMajorVersion"))
+        {
+            job.blockMajorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = readUnsigned(j, "blockMinorVersion"))
+        {
+            job.blockMinorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = readUnsigned(j, "rootMajorVersion"))
+        {
+            job.rootMajorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto version = readUnsigned(j, "rootMinorVersion"))
+        {
+            job.rootMinorVersion = static_cast<uint8_t>(*version);
+        }
+
+        if (const auto algorithm = readString(j, "algo"))
+        {
+            setAlgorithm(*algorithm, job);
+        }
+
+        return true;
+    }
+
+    ParsedPoolMessage readJobMessage(const nlohmann::json &j)
+    {
+        JobMessage message;
+
+        readPoolMessage(j, message);
+
+        message.method = "job";
+
+        const auto params = findKey(j, "params");
+
+        std::string error;
+
+        if (!params || !readJob(*params, message.job, error))
+        {
+            return InvalidMessage { params ? error : "Job has no params" };
+        }
+
+        return message;
+    }
+
+    ParsedPoolMessage readErrorMessage(const nlohmann::json &j, const nlohmann::json &error)
+    {
+        ErrorMessage message;
+
+        readPoolMessage(j, message);
+
+        message.ID = readID(j);
+
+        const auto code = findKey(error, "code");
+        const auto errorMessage = readString(error, "message");
+
+        if (!code || !code->is_number_integer() || !errorMessage)
+        {
+            return InvalidMessage { "Error is missing its code or message" };
+        }
+
+        message.error.errorCode = code->get<int32_t>();
+        message.error.errorMessage = *errorMessage;
+
+        return message;
+    }
+
+    ParsedPoolMessage readLoginMessage(const nlohmann::json &j, const nlohmann::json &result)
+    {
+        LoginMessage message;
+
+        readPoolMessage(j, message);
+
+        message.ID = readID(j);
+
+        const auto loginID = readString(result, "id");
+
+        if (!loginID)
+        {
+            return InvalidMessage { "Login response has no id" };
+        }
+
+        message.loginID = *loginID;
+
+        if (const auto status = readString(result, "status"))
+        {
+            message.status = *status;
+        }
+
+        std::string error;
+
+        if (!readJob(*findKey(result, "job"), message.job, error))
+        {
+            return InvalidMessage { error };
+        }
+
+        return message;
+    }
+
+    ParsedPoolMessage readStatusMessage(const nlohmann::json &j, const nlohmann::json &result)
+    {
+        StatusMessage message;
+
+        readPoolMessage(j, message);
+
+        message.ID = readID(j);
+
+        const auto status = readString(result, "status");
+
+        if (!status)
+        {
+            return InvalidMessage { "Status is not a string" };
+        }
+
+        message.status = *status;
+
+        return message;
+    }
+}
+
+bool parseJobBlob(const std::string_view blob, Job &job, std::string &error)
+{
+    if (blob.size() % 2 != 0)
+    {
+        error = "Blob length must be multiple of 2!";
+        return false;
+    }
+
+    if (blob.size() < 76)
+    {
+        error = "Blob length must be at least 76 bytes!";
+        return false;
+    }
+
+    job.rawBlob.resize(blob.size() / 2);
+
+    Utilities::fromHex(blob.data(), blob.size(), job.rawBlob.data());
+
+    return true;
+}
+
+bool parseJobTarget(const std::string_view target, Job &job, std::string &error)
+{
+    if (target.length() <= 8)
+    {
+        uint32_t tmp = 0;
+
+        Utilities::fromHex(target.data(), target.size(), reinterpret_cast<unsigned char *>(&tmp));
+
+        if (tmp == 0)
+        {
+            error = "Target cannot be zero!";
+            return false;
+        }
+
+        job.target = 0xFFFFFFFFFFFFFFFFULL / (0xFFFFFFFFULL / static_cast<uint64_t>(tmp));
+    }
+    else if (target.length() <= 16)
     {
+        job.target = 0;
+
+        Utilities::fromHex(target.data(), target.size(), reinterpret_cast<unsigned char *>(&job.target));
+    }
+    else
+    {
+        error = "Target cannot be longer than 16 bytes!";
+        return false;
+    }
+
+    if (job.target == 0)
+    {
+        error = "Target cannot be zero!";
+        return false;
+    }
+
+    job.shareDifficulty = 0xFFFFFFFFFFFFFFFFULL / job.target;
+
+    return true;
+}
+
+ParsedPoolMessage parsePoolMessage(const std::string &message)
+{
+    std::string_view view(message);
+
+    /* Pools sometimes pad messages with nulls or newlines */
+    while (!view.empty() && isWhitespace(view.back()))
+    {
+        view.remove_suffix(1);
+    }
+
+    if (auto jobMessage = tryParseJobNotification(view))
+    {
+        return *jobMessage;
+    }
+
+    /* Parse without exceptions, we'll check the result ourselves */
+    const auto j = nlohmann::json::parse(view.begin(), view.end(), nullptr, false);
+
+    if (j.is_discarded() || !j.is_object())
+    {
+        return InvalidMessage { "Not a JSON object" };
+    }
+
+    if (const auto method = findKey(j, "method"))
+    {
+        if (*method == "job")
+        {
+            return readJobMessage(j);
+        }
+
+        return InvalidMessage { "Unknown method" };
+    }
+
+    if (const auto error = findKey(j, "error"); error && !error->is_null())
+    {
+        return readErrorMessage(j, *error);
+    }
+
+    if (const auto result = findKey(j, "result"); result && result->is_object())
+    {
+        if (findKey(*result, "job"))
+        {
+            return readLoginMessage(j, *result);
+        }
+
+        if (findKey(*result, "status"))
+        {
+            return readStatusMessage(j, *result);
+        }
     }
 
-    throw std::invalid_argument("Failed to parse pool message: " + message);
+    return InvalidMessage { "Unknown message" };
 }
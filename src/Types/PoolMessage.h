@@ -6,6 +6,7 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 
 #include "ArgonVariants/Variants.h"
@@ -110,181 +111,30 @@ struct StatusMessage : PoolMessage
     std::string status;
 };
 
-inline void from_json(const nlohmann::json &j, PoolError &p)
+/* A message which isn't valid, or which we don't understand */
+struct InvalidMessage
 {
-    p.errorCode = j.at("code").get<int32_t>();
-    p.errorMessage = j.at("message").get<std::string>();
-}
-
-inline void from_json(const nlohmann::json &j, Job &job)
-{
-    std::string blob = j.at("blob").get<std::string>();
-
-    job.jobID = j.at("job_id").get<std::string>();
-
-    if (blob.size() % 2 != 0)
-    {
-        throw std::invalid_argument("Blob length must be multiple of 2!");
-    }
-
-    if (blob.size() < 76)
-    {
-        throw std::invalid_argument("Blob length must be at least 76 bytes!");
-    }
-
-    job.rawBlob = Utilities::fromHex(blob);
-
-    const std::string target = j.at("target").get<std::string>();
-
-    if (target.length() <= 8)
-    {
-        uint32_t tmp = 0;
-
-        char str[8];
-
-        std::memcpy(str, target.data(), target.size());
-
-        Utilities::fromHex(str, 8, reinterpret_cast<unsigned char *>(&tmp));
-
-        job.target = 0xFFFFFFFFFFFFFFFFULL / (0xFFFFFFFFULL / static_cast<uint64_t>(tmp));
-    }
-    else if (target.length() <= 16)
-    {
-        job.target = 0;
-
-        char str[16];
-
-        std::memcpy(str, target.data(), target.size());
-
-        Utilities::fromHex(str, 16, reinterpret_cast<unsigned char *>(&job.target));
-    }
-    else
-    {
-        throw std::invalid_argument("Target cannot be longer than 16 bytes!");
-    }
-
-    job.shareDifficulty = 0xFFFFFFFFFFFFFFFFULL / job.target;
-
-    if (j.find("height") != j.end())
-    {
-        job.height = j.at("height").get<uint64_t>();
-    }
-
-    if (j.find("blockMajorVersion") != j.end())
-    {
-        job.blockMajorVersion = j.at("blockMajorVersion").get<uint8_t>();
-    }
-
-    if (j.find("blockMinorVersion") != j.end())
-    {
-        job.blockMinorVersion = j.at("blockMinorVersion").get<uint8_t>();
-    }
-
-    if (j.find("rootMajorVersion") != j.end())
-    {
-        job.rootMajorVersion = j.at("rootMajorVersion").get<uint8_t>();
-    }
-
-    if (j.find("rootMinorVersion") != j.end())
-    {
-        job.rootMinorVersion = j.at("rootMinorVersion").get<uint8_t>();
-    }
-
-    if (j.find("algo") != j.end())
-    {
-        const auto poolAlgorithm = j.at("algo").get<std::string>();
-
-        if (ArgonVariant::isSupportedAlgorithm(poolAlgorithm))
-        {
-            job.algorithm = poolAlgorithm;
-        }
-    }
-}
-
-inline void from_json(const nlohmann::json &j, PoolMessage &p)
-{
-    p.jsonRpc = j.at("jsonrpc").get<std::string>();
-}
-
-inline void from_json(const nlohmann::json &j, LoginMessage &l)
-{
-    from_json(j, static_cast<PoolMessage &>(l));
-
-    if (j.find("id") != j.end())
-    {
-        if (j.at("id").is_string())
-        {
-            l.ID = j.at("id").get<std::string>();
-        }
-        else
-        {
-            l.ID = std::to_string(j.at("id").get<uint32_t>());
-        }
-    }
-
-    const auto result = j.at("result");
-
-    l.loginID = result.at("id").get<std::string>();
-
-    if (result.find("status") != result.end())
-    {
-        l.status = result.at("status").get<std::string>();
-    }
-
-    l.job = result.at("job").get<Job>();
-}
-
-inline void from_json(const nlohmann::json &j, JobMessage &job)
-{
-    from_json(j, static_cast<PoolMessage &>(job));
-
-    job.method = j.at("method").get<std::string>();
-    job.job = j.at("params").get<Job>();
-}
-
-inline void from_json(const nlohmann::json &j, ErrorMessage &e)
-{
-    from_json(j, static_cast<PoolMessage &>(e));
-
-    if (j.find("id") != j.end())
-    {
-        if (j.at("id").is_string())
-        {
-            e.ID = j.at("id").get<std::string>();
-        }
-        else
-        {
-            e.ID = std::to_string(j.at("id").get<uint32_t>());
-        }
-    }
-
-    e.error = j.at("error").get<PoolError>();
-}
-
-inline void from_json(const nlohmann::json &j, StatusMessage &s)
-{
-    from_json(j, static_cast<PoolMessage &>(s));
-
-    if (j.find("id") != j.end())
-    {
-        if (j.at("id").is_string())
-        {
-            s.ID = j.at("id").get<std::string>();
-        }
-        else
-        {
-            s.ID = std::to_string(j.at("id").get<uint32_t>());
-        }
-    }
+    std::string reason;
+};
 
-    const auto result = j.at("result");
+/* Decode the hex blob into the job. Returns false, with the reason in error,
+   if the blob is invalid. */
+bool parseJobBlob(const std::string_view blob, Job &job, std::string &error);
 
-    s.status = result.at("status").get<std::string>();
-}
+/* Decode the hex target into the job, and set the share difficulty. Returns
+   false, with the reason in error, if the target is invalid. */
+bool parseJobTarget(const std::string_view target, Job &job, std::string &error);
 
-std::variant<
+typedef std::variant<
     JobMessage,
     ErrorMessage,
     LoginMessage,
-    StatusMessage
-> parsePoolMessage(const std::string &message);
+    StatusMessage,
+    InvalidMessage
+> ParsedPoolMessage;
+
+/* Parse a message from the pool, dispatching on the method, error and result
+   keys. Job notifications take a fast path which avoids building a JSON
+   document. Never throws, messages we can't parse come back as an
+   InvalidMessage. */
+ParsedPoolMessage parsePoolMessage(const std::string &message);
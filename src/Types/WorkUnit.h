@@ -0,0 +1,73 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Types/PoolMessage.h"
+
+/* A range of nonces of a job, leased to a device by the WorkScheduler */
+struct WorkUnit
+{
+    /* Identifies the lease, handed back in the completion */
+    uint64_t leaseID = 0;
+
+    /* Bumped every time the job changes. Units from an older epoch are
+       stale, and may be abandoned. */
+    uint64_t epoch = 0;
+
+    /* Shared, as every unit of an epoch hashes the same job */
+    std::shared_ptr<const Job> job;
+
+    uint32_t startNonce = 0;
+
+    /* Nonces to hash, starting at startNonce. Never wraps past 2^32. */
+    uint32_t nonceCount = 0;
+};
+
+/* A nonce whose hash met the job target */
+struct FoundNonce
+{
+    uint32_t nonce = 0;
+
+    /* Empty if the device doesn't produce real hashes, e.g. when simulated */
+    std::vector<uint8_t> hash;
+};
+
+/* What became of a WorkUnit. Every unit submitted to a running device gets
+   exactly one. */
+struct WorkCompletion
+{
+    uint64_t leaseID = 0;
+
+    uint64_t epoch = 0;
+
+    std::shared_ptr<const Job> job;
+
+    uint32_t startNonce = 0;
+
+    uint32_t nonceCount = 0;
+
+    /* Nonces actually hashed, from startNonce. Fewer than nonceCount if the
+       unit was abandoned part way through, and 0 if it failed. */
+    uint32_t hashesPerformed = 0;
+
+    /* The device failed, and none of the range can be trusted as hashed */
+    bool failed = false;
+
+    std::string error;
+
+    std::vector<FoundNonce> found;
+
+    /* When the device began and finished the unit. Equal if it was
+       abandoned before being started. */
+    std::chrono::steady_clock::time_point started;
+
+    std::chrono::steady_clock::time_point finished;
+};
@@ -0,0 +1,153 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+/* A fixed size queue which any number of threads can push to and pop from
+   without locking. Each slot carries a sequence number saying whether it is
+   ready to be written or read, so producers and consumers only contend on
+   their own position counter. See Dmitry Vyukov's bounded MPMC queue. */
+template<typename T>
+class BoundedQueue
+{
+  public:
+    /* Capacity is rounded up to a power of two */
+    explicit BoundedQueue(const size_t capacity):
+        m_capacity(roundUpToPowerOfTwo(capacity)),
+        m_mask(m_capacity - 1),
+        m_slots(std::make_unique<Slot[]>(m_capacity))
+    {
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /* Returns false, leaving item untouched, if the queue is full */
+    bool tryPush(T &item)
+    {
+        size_t position = m_pushPosition.load(std::memory_order_relaxed);
+
+        Slot *slot;
+
+        while (true)
+        {
+            slot = &m_slots[position & m_mask];
+
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            /* Slot is free, try and claim it */
+            if (difference == 0)
+            {
+                if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            /* Slot still holds an item from a lap ago, we're full */
+            else if (difference < 0)
+            {
+                return false;
+            }
+            /* Another producer beat us to it */
+            else
+            {
+                position = m_pushPosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = std::move(item);
+        slot->sequence.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    std::optional<T> tryPop()
+    {
+        size_t position = m_popPosition.load(std::memory_order_relaxed);
+
+        Slot *slot;
+
+        while (true)
+        {
+            slot = &m_slots[position & m_mask];
+
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            /* Nothing written here yet, we're empty */
+            else if (difference < 0)
+            {
+                return std::nullopt;
+            }
+            else
+            {
+                position = m_popPosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::optional<T> item = std::move(slot->item);
+
+        /* Ready to be written on the next lap */
+        slot->sequence.store(position + m_capacity, std::memory_order_release);
+
+        return item;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+  private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+
+        T item;
+    };
+
+    static size_t roundUpToPowerOfTwo(const size_t value)
+    {
+        size_t result = 2;
+
+        while (result < value)
+        {
+            result *= 2;
+        }
+
+        return result;
+    }
+
+    const size_t m_capacity;
+
+    const size_t m_mask;
+
+    std::unique_ptr<Slot[]> m_slots;
+
+    /* On separate cache lines so producers and consumers don't fight */
+    alignas(64) std::atomic<size_t> m_pushPosition {0};
+
+    alignas(64) std::atomic<size_t> m_popPosition {0};
+};
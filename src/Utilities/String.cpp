@@ -9,6 +9,10 @@
 #include <algorithm>
 #include <sstream>
 
+#if defined(X86_OPTIMIZATIONS)
+#include <emmintrin.h>
+#endif
+
 namespace Utilities
 {
     /* Erases all instances of c from the string. E.g. 2,000,000 becomes 2000000 */
@@ -138,27 +142,52 @@ namespace Utilities
 
     std::vector<uint8_t> fromHex(const std::string &input)
     {
-        const size_t outputLength = input.size() / 2;
-
-        std::vector<uint8_t> output(outputLength);
+        std::vector<uint8_t> output(input.size() / 2);
 
-        for (int i = 0; i < outputLength; i++)
-        {
-            output[i] = char2int(input[i * 2]) * 16 
-                      + char2int(input[(i * 2) + 1]);
-        }
+        fromHex(input.data(), input.size(), output.data());
 
         return output;
     }
 
     void fromHex(const char *input, size_t inputLength, unsigned char *output)
     {
-        for (int i = 0; i < inputLength / 2; i++)
+        size_t i = 0;
+
+#if defined(X86_OPTIMIZATIONS)
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        const __m128i nine = _mm_set1_epi8('9');
+        const __m128i zero = _mm_set1_epi8('0');
+        const __m128i letterOffset = _mm_set1_epi8('a' - '0' - 10);
+        const __m128i lowByte = _mm_set1_epi16(0x00FF);
+
+        /* Decode 32 characters into 16 bytes at a time. Lower casing the
+           input lets us treat 'A-F' and 'a-f' the same, then anything above
+           '9' is a letter and needs a further offset. Each pair of characters
+           sits in a 16 bit lane, high nibble first, which we combine and
+           pack down into bytes. */
+        for (; i + 32 <= inputLength; i += 32, output += 16)
+        {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i + 16));
+
+            lo = _mm_or_si128(lo, caseBit);
+            hi = _mm_or_si128(hi, caseBit);
+
+            lo = _mm_sub_epi8(_mm_sub_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letterOffset));
+            hi = _mm_sub_epi8(_mm_sub_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letterOffset));
+
+            lo = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(lo, lowByte), 4), _mm_srli_epi16(lo, 8));
+            hi = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(hi, lowByte), 4), _mm_srli_epi16(hi, 8));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_packus_epi16(lo, hi));
+        }
+#endif
+
+        for (; i + 1 < inputLength; i += 2, output++)
         {
-            output[i] = char2int(input[i * 2]) * 16
-                      + char2int(input[(i * 2) + 1]);
+            *output = char2int(input[i]) * 16
+                    + char2int(input[i + 1]);
         }
     }
 
-
 } // namespace Utilities
@@ -24,4 +24,9 @@ namespace Utilities
             sleptFor += sleepDuration;
         }
     }
+
+    bool isHashValidForTarget(const uint8_t *hash, const uint64_t target)
+    {
+        return *reinterpret_cast<const uint64_t *>(hash + 24) < target;
+    }
 }
@@ -6,8 +6,12 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 
 namespace Utilities
 {
     void sleepUnlessStopping(const std::chrono::milliseconds duration, std::atomic<bool> &condition);
+
+    /* Is the 32 byte hash below the target. Only the last 8 bytes are compared. */
+    bool isHashValidForTarget(const uint8_t *hash, const uint64_t target);
 }
@@ -0,0 +1,1134 @@
+// Copyright (c) 2019, Zpalmtree
+//
+// Please see the included LICENSE file for more information.
+
+#include <iostream>
+
+#include <chrono>
+
+#include <functional>
+
+#include <vector>
+
+#include <algorithm>
+
+#include <stdexcept>
+
+#include <filesystem>
+
+#include <fstream>
+
+#include <limits>
+
+#include <condition_variable>
+
+#include <deque>
+
+#include <mutex>
+
+#include <cstring>
+
+#include <thread>
+
+#include "ArgonVariants/Variants.h"
+#include "Config/Config.h"
+#include "Container/CgroupLimits.h"
+#include "Energy/CpuSensors.h"
+#include "Energy/Rapl.h"
+#include "MinerManager/CpuGovernor.h"
+#include "MinerManager/WorkScheduler.h"
+#include "MockPool/MockStratumServer.h"
+#include "PoolCommunication/PoolConnection.h"
+#include "PoolCommunication/ReconnectBackoff.h"
+#include "ShareVerifier/ShareVerifier.h"
+#include "Types/PoolManagerConfig.h"
+#include "Types/PoolMessage.h"
+
+bool testCondition(std::string testName, std::function<bool(void)> condition)
+{
+    if (!condition())
+    {
+        std::cout << "❌ Failed test for " << testName << std::endl;
+
+        return false;
+    }
+    else
+    {
+        std::cout << "✔️  Passed test for " << testName << std::endl;
+
+        return true;
+    }
+}
+
+/* A scratch copy of a sysfs or cgroup layout, removed again when done */
+class FixtureDirectory
+{
+  public:
+    FixtureDirectory(const std::string &name):
+        m_root(std::filesystem::temp_directory_path() / ("miner-test-" + name))
+    {
+        std::filesystem::remove_all(m_root);
+        std::filesystem::create_directories(m_root);
+    }
+
+    ~FixtureDirectory()
+    {
+        std::error_code ignored;
+        std::filesystem::remove_all(m_root, ignored);
+    }
+
+    /* Write a file, relative to the root, making its directories */
+    void write(const std::string &filename, const std::string &contents) const
+    {
+        const std::filesystem::path path = m_root / filename;
+
+        std::filesystem::create_directories(path.parent_path());
+
+        std::ofstream(path) << contents << "\n";
+    }
+
+    std::string path(const std::string &filename = "") const
+    {
+        return (m_root / filename).string();
+    }
+
+  private:
+    const std::filesystem::path m_root;
+};
+
+/* A job notification with a 76 byte blob, with extra inserted into params */
+std::string makeJobNotification(const std::string &jobID, const std::string &extra = "")
+{
+    return "{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":{"
+           "\"blob\":\"" + std::string(152, '1') + "\","
+           "\"job_id\":\"" + jobID + "\","
+           "\"target\":\"ffff0000\","
+           "\"height\":1234" + extra + "}}";
+}
+
+/* An async backend which hashes nothing, and completes its units when told */
+class ManualBackend : virtual public IAsyncBackend
+{
+  public:
+    virtual void start(const std::shared_ptr<CompletionQueue> &completions)
+    {
+        m_completions = completions;
+    }
+
+    virtual void stop()
+    {
+    }
+
+    virtual void submit(const WorkUnit &unit)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_units.push_back(unit);
+        m_submitted.notify_all();
+    }
+
+    virtual void abandonBefore(const uint64_t)
+    {
+    }
+
+    virtual std::string getName() const
+    {
+        return "Manual";
+    }
+
+    /* Wait for the next unit leased to us. False if none arrives in time. */
+    bool nextUnit(WorkUnit &unit, const std::chrono::milliseconds timeout = std::chrono::seconds(5))
+    {
+        std::unique_lock lock(m_mutex);
+
+        if (!m_submitted.wait_for(lock, timeout, [this]{ return !m_units.empty(); }))
+        {
+            return false;
+        }
+
+        unit = m_units.front();
+        m_units.pop_front();
+
+        return true;
+    }
+
+    /* Hand back the unit, with the first hashesPerformed of its nonces done */
+    void complete(const WorkUnit &unit, const uint32_t hashesPerformed, const bool failed = false)
+    {
+        WorkCompletion completion;
+
+        completion.leaseID = unit.leaseID;
+        completion.epoch = unit.epoch;
+        completion.job = unit.job;
+        completion.startNonce = unit.startNonce;
+        completion.nonceCount = unit.nonceCount;
+        completion.hashesPerformed = hashesPerformed;
+        completion.failed = failed;
+
+        /* Takes no time, so the unit size stays put */
+        completion.started = std::chrono::steady_clock::now();
+        completion.finished = completion.started;
+
+        m_completions->tryPush(completion);
+    }
+
+  private:
+    std::shared_ptr<CompletionQueue> m_completions;
+
+    std::deque<WorkUnit> m_units;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_submitted;
+};
+
+/* A share for a job with every byte of the blob set to blobByte, hashed the
+   same way the miner does. Meets any target but zero. */
+ShareSubmission makeShare(const uint8_t blobByte, const uint32_t nonce)
+{
+    ShareSubmission share;
+
+    share.blob.assign(76, blobByte);
+    share.nonce = nonce;
+    share.target = std::numeric_limits<uint64_t>::max();
+
+    std::memcpy(share.blob.data() + 39, &nonce, sizeof(nonce));
+
+    const auto algorithm = ArgonVariant::getCPUMiningAlgorithm("chukwa");
+
+    algorithm->reinit(share.blob);
+    share.hash = algorithm->hash(share.blob);
+
+    return share;
+}
+
+/* A job for the mock pool to send, at the given height */
+ReplayJob makeReplayJob(const std::string &jobID, const uint64_t height)
+{
+    ReplayJob job;
+
+    job.params = {
+        {"blob", std::string(152, '1')},
+        {"job_id", jobID},
+        {"target", "ffffffff"},
+        {"height", height},
+        {"algo", "chukwa"},
+    };
+
+    return job;
+}
+
+/* Wait for the condition to hold. False if it doesn't in time. */
+bool waitFor(const std::function<bool(void)> &condition, const std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+/* Log in to a mock pool sending jobs a and b at height 10, then c at
+   height 11, and submit shares for the given jobs once each job arrives.
+   Returns which shares submitShare sent, and the job IDs the pool got. */
+std::pair<std::vector<bool>, std::vector<std::string>> submitAcrossJobs(
+    const bool submitStaleShares,
+    const std::vector<std::vector<std::string>> &sharesPerJob,
+    PoolStats &stats)
+{
+    MockPoolConfig config;
+
+    /* No delays, so the pool only sends a job when we push one */
+    config.replay = { makeReplayJob("a", 10), makeReplayJob("b", 10), makeReplayJob("c", 11) };
+
+    MockStratumServer server(config);
+
+    std::mutex mutex;
+
+    std::vector<std::string> received;
+
+    server.onShare([&](const ReceivedShare &share) {
+        std::scoped_lock lock(mutex);
+        received.push_back(share.jobID);
+    });
+
+    server.start();
+
+    Pool pool;
+
+    pool.host = "127.0.0.1";
+    pool.port = server.port();
+    pool.username = "miner-test";
+    pool.algorithm = "chukwa";
+    pool.submitStaleShares = submitStaleShares;
+
+    const auto health = std::make_shared<PoolHealth>();
+
+    PoolConnection connection(pool, health);
+
+    std::vector<bool> sent;
+
+    if (!connection.login())
+    {
+        return { sent, received };
+    }
+
+    const std::vector<uint8_t> hash(32, 0);
+
+    uint32_t nonce = 0;
+
+    for (size_t i = 0; i < sharesPerJob.size(); i++)
+    {
+        if (i != 0)
+        {
+            const std::string jobID = server.pushJob().jobID;
+
+            if (!waitFor([&]{ return connection.getJob().jobID == jobID; }))
+            {
+                return { sent, received };
+            }
+        }
+
+        for (const auto &jobID : sharesPerJob[i])
+        {
+            sent.push_back(connection.submitShare(hash.data(), jobID, nonce++));
+        }
+    }
+
+    const size_t expected = std::count(sent.begin(), sent.end(), true);
+
+    waitFor([&]{
+        std::scoped_lock lock(mutex);
+        return received.size() >= expected;
+    });
+
+    connection.stop();
+    server.stop();
+
+    health->fill(stats);
+
+    return { sent, received };
+}
+
+int main()
+{
+    std::vector<bool> results;
+
+    using std::chrono::milliseconds;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    results.push_back(testCondition("ReconnectBackoff doubles each failure", [&start](){
+        ReconnectBackoff backoff(milliseconds(100), milliseconds(100000));
+
+        for (int64_t delay = 100; delay <= 6400; delay *= 2)
+        {
+            const milliseconds wait = backoff.failed(start);
+
+            if (wait.count() < delay / 2 || wait.count() > delay || backoff.nextAttempt() != start + wait)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }));
+
+    results.push_back(testCondition("ReconnectBackoff stops at the maximum delay", [&start](){
+        ReconnectBackoff backoff(milliseconds(100), milliseconds(1000));
+
+        for (int i = 0; i < 50; i++)
+        {
+            const milliseconds wait = backoff.failed(start);
+
+            if (wait > milliseconds(1000))
+            {
+                return false;
+            }
+
+            if (i >= 4 && wait < milliseconds(500))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }));
+
+    results.push_back(testCondition("ReconnectBackoff jitter covers half to all of the delay", [&start](){
+        std::vector<int64_t> waits;
+
+        for (int i = 0; i < 1000; i++)
+        {
+            ReconnectBackoff backoff(milliseconds(1000), milliseconds(5000));
+
+            waits.push_back(backoff.failed(start).count());
+        }
+
+        const auto [min, max] = std::minmax_element(waits.begin(), waits.end());
+
+        /* In range, and actually spread out over it */
+        return *min >= 500 && *max <= 1000 && *min < 600 && *max > 900;
+    }));
+
+    results.push_back(testCondition("ReconnectBackoff retries straight away after a stable connection", [&start](){
+        ReconnectBackoff backoff(milliseconds(100), milliseconds(5000));
+
+        for (int i = 0; i < 5; i++)
+        {
+            backoff.failed(start);
+        }
+
+        const auto connectedAt = start + std::chrono::seconds(10);
+        const auto droppedAt = connectedAt + std::chrono::seconds(60);
+
+        backoff.connected(connectedAt);
+        backoff.disconnected(droppedAt);
+
+        if (!backoff.ready(droppedAt))
+        {
+            return false;
+        }
+
+        /* The delay starts over too */
+        const milliseconds wait = backoff.failed(droppedAt);
+
+        return wait >= milliseconds(50) && wait <= milliseconds(100);
+    }));
+
+    results.push_back(testCondition("ReconnectBackoff backs off when dropped right after login", [&start](){
+        ReconnectBackoff backoff(milliseconds(100), milliseconds(5000));
+
+        backoff.connected(start);
+        backoff.disconnected(start + milliseconds(10));
+
+        return !backoff.ready(start + milliseconds(10))
+            && backoff.nextAttempt() >= start + milliseconds(60);
+    }));
+
+    results.push_back(testCondition("ReconnectBackoff never retries with no delay", [&start](){
+        ReconnectBackoff backoff(milliseconds(0), milliseconds(0));
+
+        for (int i = 0; i < 10; i++)
+        {
+            if (backoff.failed(start) <= milliseconds(0) || backoff.ready(start))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }));
+
+    results.push_back(testCondition("PoolManagerConfig rejects a reconnectDelay of 0", [](){
+        try
+        {
+            nlohmann::json::parse(R"({ "reconnectDelay": 0 })").get<PoolManagerConfig>();
+            return false;
+        }
+        catch (const std::invalid_argument &)
+        {
+            return nlohmann::json::parse(R"({ "reconnectDelay": 1 })").get<PoolManagerConfig>().reconnectDelay == 1;
+        }
+    }));
+
+    results.push_back(testCondition("countCpuList", [](){
+        uint32_t count = 0;
+
+        return countCpuList("0-3,8,10-11", count) && count == 7
+            && countCpuList("5", count) && count == 1
+            && !countCpuList("3-1", count)
+            && !countCpuList("", count)
+            && !countCpuList("zero", count);
+    }));
+
+    results.push_back(testCondition("CgroupLimits v2 takes the tightest of our cgroup and its parents", [](){
+        FixtureDirectory fixture("cgroup-v2");
+
+        fixture.write("proc/self/cgroup", "0::/docker/abc");
+        fixture.write("sys/fs/cgroup/cgroup.controllers", "cpuset cpu memory");
+        fixture.write("sys/fs/cgroup/cpuset.cpus.effective", "0-15");
+        fixture.write("sys/fs/cgroup/docker/cpu.max", "100000 100000");
+        fixture.write("sys/fs/cgroup/docker/memory.max", "max");
+        fixture.write("sys/fs/cgroup/docker/abc/cpuset.cpus.effective", "0-2,5");
+        fixture.write("sys/fs/cgroup/docker/abc/cpu.max", "150000 100000");
+        fixture.write("sys/fs/cgroup/docker/abc/memory.max", "268435456");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        return limits.cgroupVersion == 2
+            && limits.haveCpuset && limits.cpusetCpus == 4
+            && limits.haveCpuQuota && limits.cpuQuota == 1.0
+            && limits.haveMemoryLimit && limits.memoryLimit == 268435456
+            && limits.threadLimit(16) == 1
+            && limits.scratchpadBudget() == 268435456 - ContainerLimits::MEMORY_HEADROOM;
+    }));
+
+    results.push_back(testCondition("CgroupLimits v2 without limits", [](){
+        FixtureDirectory fixture("cgroup-v2-unlimited");
+
+        fixture.write("proc/self/cgroup", "0::/user.slice");
+        fixture.write("sys/fs/cgroup/cgroup.controllers", "cpu memory");
+        fixture.write("sys/fs/cgroup/user.slice/cpu.max", "max 100000");
+        fixture.write("sys/fs/cgroup/user.slice/memory.max", "max");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        return limits.cgroupVersion == 2
+            && !limits.haveCpuset && !limits.haveCpuQuota && !limits.haveMemoryLimit
+            && limits.threadLimit(16) == 16
+            && limits.scratchpadBudget() == std::numeric_limits<uint64_t>::max();
+    }));
+
+    results.push_back(testCondition("CgroupLimits falls back to the root without a cgroup namespace", [](){
+        FixtureDirectory fixture("cgroup-v2-root");
+
+        /* The host's path for our cgroup, which isn't mounted in here */
+        fixture.write("proc/self/cgroup", "0::/system.slice/docker-abc.scope");
+        fixture.write("sys/fs/cgroup/cgroup.controllers", "cpuset cpu memory");
+        fixture.write("sys/fs/cgroup/cpuset.cpus.effective", "0-1");
+        fixture.write("sys/fs/cgroup/cpu.max", "300000 100000");
+        fixture.write("sys/fs/cgroup/memory.max", "1073741824");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        return limits.cpusetCpus == 2
+            && limits.cpuQuota == 3.0
+            && limits.memoryLimit == 1073741824
+            && limits.threadLimit(16) == 2;
+    }));
+
+    results.push_back(testCondition("CgroupLimits v1 reads each controller's hierarchy", [](){
+        FixtureDirectory fixture("cgroup-v1");
+
+        fixture.write("proc/self/cgroup",
+            "12:memory:/docker/abc\n"
+            "5:cpu,cpuacct:/docker/abc\n"
+            "3:cpuset:/docker/abc\n"
+            "1:name=systemd:/docker/abc");
+
+        fixture.write("sys/fs/cgroup/cpuset/cpuset.cpus", "0-15");
+        fixture.write("sys/fs/cgroup/cpuset/docker/abc/cpuset.effective_cpus", "0-5");
+        fixture.write("sys/fs/cgroup/cpuset/docker/abc/cpuset.cpus", "0-7");
+
+        fixture.write("sys/fs/cgroup/cpu/cpu.cfs_quota_us", "-1");
+        fixture.write("sys/fs/cgroup/cpu/cpu.cfs_period_us", "100000");
+        fixture.write("sys/fs/cgroup/cpu/docker/cpu.cfs_quota_us", "250000");
+        fixture.write("sys/fs/cgroup/cpu/docker/cpu.cfs_period_us", "100000");
+        fixture.write("sys/fs/cgroup/cpu/docker/abc/cpu.cfs_quota_us", "-1");
+        fixture.write("sys/fs/cgroup/cpu/docker/abc/cpu.cfs_period_us", "100000");
+
+        fixture.write("sys/fs/cgroup/memory/memory.limit_in_bytes", "9223372036854771712");
+        fixture.write("sys/fs/cgroup/memory/docker/abc/memory.limit_in_bytes", "536870912");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        /* 2.5 CPUs of quota rounds to 3 threads */
+        return limits.cgroupVersion == 1
+            && limits.haveCpuset && limits.cpusetCpus == 6
+            && limits.haveCpuQuota && limits.cpuQuota == 2.5
+            && limits.haveMemoryLimit && limits.memoryLimit == 536870912
+            && limits.threadLimit(16) == 3;
+    }));
+
+    results.push_back(testCondition("CgroupLimits v1 without limits", [](){
+        FixtureDirectory fixture("cgroup-v1-unlimited");
+
+        fixture.write("proc/self/cgroup", "4:memory:/\n3:cpu,cpuacct:/");
+        fixture.write("sys/fs/cgroup/cpu/cpu.cfs_quota_us", "-1");
+        fixture.write("sys/fs/cgroup/cpu/cpu.cfs_period_us", "100000");
+        fixture.write("sys/fs/cgroup/memory/memory.limit_in_bytes", "9223372036854771712");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        return limits.cgroupVersion == 1
+            && !limits.haveCpuset && !limits.haveCpuQuota && !limits.haveMemoryLimit;
+    }));
+
+    results.push_back(testCondition("CgroupLimits with no cgroup filesystem", [](){
+        FixtureDirectory fixture("cgroup-none");
+
+        const ContainerLimits limits = CgroupLimits(fixture.path("sys/fs/cgroup"), fixture.path("proc/self/cgroup")).read();
+
+        return limits.cgroupVersion == 0 && limits.threadLimit(8) == 8;
+    }));
+
+    results.push_back(testCondition("ContainerLimits rounds the CPU quota and runs at least one thread", [](){
+        ContainerLimits limits;
+
+        limits.haveCpuQuota = true;
+
+        limits.cpuQuota = 1.4;
+        const bool roundsDown = limits.threadLimit(16) == 1;
+
+        limits.cpuQuota = 1.6;
+        const bool roundsUp = limits.threadLimit(16) == 2;
+
+        limits.cpuQuota = 0.2;
+        const bool atLeastOne = limits.threadLimit(16) == 1;
+
+        limits.haveMemoryLimit = true;
+        limits.memoryLimit = ContainerLimits::MEMORY_HEADROOM / 2;
+
+        return roundsDown && roundsUp && atLeastOne && limits.scratchpadBudget() == 0;
+    }));
+
+    results.push_back(testCondition("CpuSensors reads hwmon and cpufreq", [](){
+        FixtureDirectory fixture("cpu-sensors");
+
+        /* Not a CPU sensor */
+        fixture.write("hwmon/hwmon0/name", "acpitz");
+        fixture.write("hwmon/hwmon0/temp1_input", "99000");
+
+        /* coretemp numbers the cores with gaps */
+        fixture.write("hwmon/hwmon1/name", "coretemp");
+        fixture.write("hwmon/hwmon1/temp1_input", "45000");
+        fixture.write("hwmon/hwmon1/temp2_input", "71500");
+        fixture.write("hwmon/hwmon1/temp4_input", "68000");
+
+        /* After a gap in the device numbers */
+        fixture.write("hwmon/hwmon3/name", "k10temp");
+        fixture.write("hwmon/hwmon3/temp1_input", "50000");
+
+        fixture.write("cpu/cpu0/cpufreq/scaling_cur_freq", "3000000");
+        fixture.write("cpu/cpu0/thermal_throttle/core_throttle_count", "2");
+        fixture.write("cpu/cpu0/thermal_throttle/package_throttle_count", "1");
+        fixture.write("cpu/cpu1/cpufreq/scaling_cur_freq", "2000000");
+        fixture.write("cpu/cpu1/thermal_throttle/core_throttle_count", "3");
+        fixture.write("cpu/cpu3/cpufreq/scaling_cur_freq", "4000000");
+
+        const CpuSensorReading reading = CpuSensors(fixture.path("hwmon"), fixture.path("cpu")).read();
+
+        return reading.haveTemperature && reading.temperature == 71.5
+            && reading.haveFrequency && reading.frequency == 3000
+            && reading.haveThrottleCount && reading.throttleCount == 6;
+    }));
+
+    results.push_back(testCondition("CpuSensors without sensors", [](){
+        FixtureDirectory fixture("cpu-sensors-none");
+
+        fixture.write("hwmon/hwmon0/name", "nvme");
+        fixture.write("hwmon/hwmon0/temp1_input", "40000");
+
+        const CpuSensorReading reading = CpuSensors(fixture.path("hwmon"), fixture.path("cpu")).read();
+
+        return !reading.haveTemperature && !reading.haveFrequency && !reading.haveThrottleCount;
+    }));
+
+    /* Drives a governor from a hwmon fixture, once a simulated second */
+    struct GovernedCpu
+    {
+        GovernedCpu(const std::string &name, const GovernorConfig &config, const uint32_t threadCount):
+            fixture(name),
+            governor(config, threadCount)
+        {
+            fixture.write("hwmon/hwmon0/name", "coretemp");
+            fixture.write("cpu/cpu0/thermal_throttle/core_throttle_count", "0");
+            setTemperature(50);
+        }
+
+        void setTemperature(const double celsius)
+        {
+            fixture.write("hwmon/hwmon0/temp1_input", std::to_string(static_cast<uint64_t>(celsius * 1000)));
+        }
+
+        void setThrottleCount(const uint64_t count)
+        {
+            fixture.write("cpu/cpu0/thermal_throttle/core_throttle_count", std::to_string(count));
+        }
+
+        /* Run for some seconds, returning the active threads at the end */
+        uint32_t run(const uint32_t seconds, const double watts = 0)
+        {
+            const CpuSensors sensors(fixture.path("hwmon"), fixture.path("cpu"));
+
+            uint32_t activeThreads = 0;
+
+            for (uint32_t i = 0; i < seconds; i++)
+            {
+                activeThreads = governor.update(sensors.read(), watts);
+            }
+
+            return activeThreads;
+        }
+
+        FixtureDirectory fixture;
+
+        CpuGovernor governor;
+    };
+
+    results.push_back(testCondition("CpuGovernor parks a thread every 5 seconds over the temperature limit", [](){
+        GovernorConfig config;
+        config.maxTemperature = 80;
+
+        GovernedCpu cpu("governor-temperature", config, 4);
+
+        const bool underLimit = cpu.run(60) == 4;
+
+        cpu.setTemperature(85);
+
+        /* Nothing changed for a while, so the first goes straight away */
+        const bool parksOne = cpu.run(1) == 3;
+        const bool waitsToPark = cpu.run(4) == 3;
+        const bool parksAnother = cpu.run(1) == 2;
+
+        return underLimit && parksOne && waitsToPark && parksAnother
+            && cpu.governor.getStats().lastChange.find("temperature") != std::string::npos;
+    }));
+
+    results.push_back(testCondition("CpuGovernor unparks after 30 seconds of headroom", [](){
+        GovernorConfig config;
+        config.maxTemperature = 80;
+
+        GovernedCpu cpu("governor-unpark", config, 4);
+
+        cpu.setTemperature(85);
+        cpu.run(10);
+
+        /* Under the limit, but not by enough to add a thread */
+        cpu.setTemperature(77);
+
+        const bool holdsInHysteresis = cpu.run(120) == 2;
+
+        cpu.setTemperature(70);
+
+        const bool waitsToUnpark = cpu.run(29) == 2;
+        const bool unparksOne = cpu.run(1) == 3;
+        const bool unparksAll = cpu.run(30) == 4 && cpu.run(60) == 4;
+
+        return holdsInHysteresis && waitsToUnpark && unparksOne && unparksAll;
+    }));
+
+    results.push_back(testCondition("CpuGovernor parks straight away when the CPU throttles", [](){
+        GovernorConfig config;
+        config.maxTemperature = 80;
+
+        GovernedCpu cpu("governor-throttle", config, 4);
+
+        cpu.run(1);
+        cpu.setThrottleCount(3);
+
+        const bool parked = cpu.run(1) == 3;
+
+        /* Only a rising count is throttling */
+        const bool holds = cpu.run(2) == 3;
+
+        cpu.setThrottleCount(4);
+
+        return parked && holds && cpu.run(1) == 2 && cpu.governor.getStats().throttleEvents == 4;
+    }));
+
+    results.push_back(testCondition("CpuGovernor keeps minThreads running", [](){
+        GovernorConfig config;
+        config.maxTemperature = 80;
+        config.minThreads = 2;
+
+        GovernedCpu cpu("governor-min-threads", config, 4);
+
+        cpu.setTemperature(95);
+
+        return cpu.run(300) == 2;
+    }));
+
+    results.push_back(testCondition("CpuGovernor stays within the power limit", [](){
+        GovernorConfig config;
+        config.maxTemperature = 0;
+        config.maxPower = 65;
+
+        GovernedCpu cpu("governor-power", config, 4);
+
+        const bool parks = cpu.run(5, 80) == 3;
+
+        /* Another thread at 20W each would go over */
+        const bool holds = cpu.run(60, 60) == 3;
+
+        /* 3 threads at 10W each leaves room for another */
+        return parks && holds && cpu.run(30, 30) == 4;
+    }));
+
+    results.push_back(testCondition("Rapl sums packages and DRAM, and skips other zones", [](){
+        FixtureDirectory fixture("rapl");
+
+        fixture.write("intel-rapl:0/name", "package-0");
+        fixture.write("intel-rapl:0/energy_uj", "1000000");
+        fixture.write("intel-rapl:0/max_energy_range_uj", "262143328850");
+        fixture.write("intel-rapl:0:0/name", "core");
+        fixture.write("intel-rapl:0:0/energy_uj", "0");
+        fixture.write("intel-rapl:0:1/name", "dram");
+        fixture.write("intel-rapl:0:1/energy_uj", "500000");
+        fixture.write("intel-rapl:1/name", "package-1");
+        fixture.write("intel-rapl:1/energy_uj", "0");
+
+        Rapl rapl(fixture.path());
+
+        fixture.write("intel-rapl:0/energy_uj", "3000000");
+        fixture.write("intel-rapl:0:0/energy_uj", "99000000");
+        fixture.write("intel-rapl:0:1/energy_uj", "1500000");
+        fixture.write("intel-rapl:1/energy_uj", "4000000");
+
+        const EnergySample sample = rapl.sample();
+
+        return rapl.available()
+            && sample.measured[PACKAGE] && sample.joules[PACKAGE] == 6
+            && sample.measured[DRAM] && sample.joules[DRAM] == 1
+            && sample.totalJoules() == 7;
+    }));
+
+    results.push_back(testCondition("Rapl counter wraparound", [](){
+        FixtureDirectory fixture("rapl-wraparound");
+
+        fixture.write("intel-rapl:0/name", "package-0");
+        fixture.write("intel-rapl:0/energy_uj", "999000000");
+        fixture.write("intel-rapl:0/max_energy_range_uj", "1000000000");
+
+        Rapl rapl(fixture.path());
+
+        /* 1 joule to the top of the range, then 0.5 after wrapping */
+        fixture.write("intel-rapl:0/energy_uj", "500000");
+
+        const bool wrapped = rapl.sample().joules[PACKAGE] == 1.5;
+
+        fixture.write("intel-rapl:0/energy_uj", "2500000");
+
+        return wrapped && rapl.sample().joules[PACKAGE] == 2;
+    }));
+
+    results.push_back(testCondition("Rapl counter going backwards without a known range", [](){
+        FixtureDirectory fixture("rapl-reset");
+
+        fixture.write("intel-rapl:0/name", "package-0");
+        fixture.write("intel-rapl:0/energy_uj", "5000000");
+
+        Rapl rapl(fixture.path());
+
+        /* Reset, so count from zero rather than underflowing */
+        fixture.write("intel-rapl:0/energy_uj", "2000000");
+
+        return rapl.sample().joules[PACKAGE] == 2;
+    }));
+
+    results.push_back(testCondition("Rapl without counters", [](){
+        FixtureDirectory fixture("rapl-none");
+
+        Rapl rapl(fixture.path());
+
+        const EnergySample sample = rapl.sample();
+
+        return !rapl.available() && rapl.error() != ""
+            && !sample.measured[PACKAGE] && sample.totalJoules() == 0;
+    }));
+
+    results.push_back(testCondition("WorkScheduler leases each nonce of the space once, then stops", [](){
+        const auto backend = std::make_shared<ManualBackend>();
+
+        WorkSchedulerConfig config;
+        config.initialUnitSize = 16;
+
+        WorkScheduler scheduler({ backend }, config, nullptr);
+
+        scheduler.start();
+
+        /* Starts near the top, so has to wrap back to 0 */
+        scheduler.setJob(Job(), 40, 64);
+
+        std::vector<uint32_t> leased(64);
+
+        WorkUnit unit;
+
+        for (int i = 0; i < 64 && backend->nextUnit(unit, milliseconds(500)); i++)
+        {
+            if (uint64_t(unit.startNonce) + unit.nonceCount > 64 || unit.nonceCount == 0)
+            {
+                return false;
+            }
+
+            for (uint32_t nonce = unit.startNonce; nonce < unit.startNonce + unit.nonceCount; nonce++)
+            {
+                leased[nonce]++;
+            }
+
+            backend->complete(unit, unit.nonceCount);
+        }
+
+        const bool onceEach = std::all_of(leased.begin(), leased.end(), [](const uint32_t count) { return count == 1; });
+
+        const SchedulerStats stats = scheduler.getStats();
+
+        return onceEach && stats.noncesLeased == 64 && stats.nonceSpaceExhausted == 1;
+    }));
+
+    results.push_back(testCondition("WorkScheduler leases a new job after running out", [](){
+        const auto backend = std::make_shared<ManualBackend>();
+
+        WorkSchedulerConfig config;
+        config.initialUnitSize = 16;
+        config.unitsInFlight = 1;
+
+        WorkScheduler scheduler({ backend }, config, nullptr);
+
+        scheduler.start();
+        scheduler.setJob(Job(), 0, 16);
+
+        WorkUnit unit;
+
+        if (!backend->nextUnit(unit) || unit.nonceCount != 16)
+        {
+            return false;
+        }
+
+        backend->complete(unit, unit.nonceCount);
+
+        /* Nothing left of this job */
+        if (backend->nextUnit(unit, milliseconds(200)))
+        {
+            return false;
+        }
+
+        scheduler.setJob(Job(), 0, 16);
+
+        return backend->nextUnit(unit) && unit.epoch == 2 && unit.startNonce == 0 && unit.nonceCount == 16;
+    }));
+
+    results.push_back(testCondition("WorkScheduler reissues the rest of a cut short unit", [](){
+        const auto backend = std::make_shared<ManualBackend>();
+
+        WorkSchedulerConfig config;
+        config.initialUnitSize = 16;
+
+        WorkScheduler scheduler({ backend }, config, nullptr);
+
+        scheduler.start();
+        scheduler.setJob(Job(), 0);
+
+        WorkUnit first;
+        WorkUnit second;
+        WorkUnit reissued;
+
+        if (!backend->nextUnit(first) || !backend->nextUnit(second))
+        {
+            return false;
+        }
+
+        /* Found a share after 5 hashes */
+        backend->complete(first, 5);
+
+        return backend->nextUnit(reissued)
+            && reissued.startNonce == first.startNonce + 5
+            && reissued.nonceCount == first.nonceCount - 5
+            && scheduler.getStats().rangesReissued == 1;
+    }));
+
+    results.push_back(testCondition("WorkScheduler reissues the whole of a failed unit", [](){
+        const auto backend = std::make_shared<ManualBackend>();
+
+        WorkSchedulerConfig config;
+        config.initialUnitSize = 16;
+
+        WorkScheduler scheduler({ backend }, config, nullptr);
+
+        scheduler.start();
+        scheduler.setJob(Job(), 0);
+
+        WorkUnit first;
+        WorkUnit second;
+        WorkUnit reissued;
+
+        if (!backend->nextUnit(first) || !backend->nextUnit(second))
+        {
+            return false;
+        }
+
+        backend->complete(second, 0, true);
+
+        return backend->nextUnit(reissued)
+            && reissued.startNonce == second.startNonce
+            && reissued.nonceCount == second.nonceCount
+            && scheduler.getStats().devices[0].unitsFailed == 1;
+    }));
+
+    results.push_back(testCondition("parsePoolMessage reads a job notification", [](){
+        const auto message = parsePoolMessage(makeJobNotification("abc") + "\n");
+
+        const auto job = std::get_if<JobMessage>(&message);
+
+        return job && job->job.jobID == "abc" && job->job.rawBlob.size() == 76
+            && job->job.rawBlob[0] == 0x11 && job->job.height == 1234
+            && job->job.shareDifficulty == 65537 && job->jsonRpc == "2.0";
+    }));
+
+    results.push_back(testCondition("parsePoolMessage falls back to the full parser for arrays", [](){
+        const auto message = parsePoolMessage(makeJobNotification("abc", ",\"extra\":[1,2]"));
+
+        const auto job = std::get_if<JobMessage>(&message);
+
+        return job && job->job.jobID == "abc" && job->job.height == 1234 && job->job.shareDifficulty == 65537;
+    }));
+
+    results.push_back(testCondition("parsePoolMessage unescapes strings", [](){
+        const auto message = parsePoolMessage(makeJobNotification("a\\/b\\\"c"));
+
+        const auto job = std::get_if<JobMessage>(&message);
+
+        return job && job->job.jobID == "a/b\"c";
+    }));
+
+    results.push_back(testCondition("parsePoolMessage rejects jobs with missing or invalid keys", [](){
+        const std::string blob = std::string(152, '1');
+
+        const std::vector<std::string> messages {
+            "{\"method\":\"job\",\"params\":{\"blob\":\"" + blob + "\",\"job_id\":\"abc\"}}",
+            "{\"method\":\"job\",\"params\":{\"blob\":\"" + blob + "\",\"job_id\":\"abc\",\"target\":\"00000000\"}}",
+            "{\"method\":\"job\",\"params\":{\"blob\":\"111\",\"job_id\":\"abc\",\"target\":\"ffff0000\"}}",
+            "{\"method\":\"job\",\"params\":{\"blob\":" + blob + ",\"job_id\":\"abc\",\"target\":\"ffff0000\"}}",
+            "{\"method\":\"job\",\"params\":[]}",
+            "{\"method\":\"job\"}",
+        };
+
+        return std::all_of(messages.begin(), messages.end(), [](const auto &message)
+        {
+            const auto parsed = parsePoolMessage(message);
+            return std::holds_alternative<InvalidMessage>(parsed);
+        });
+    }));
+
+    results.push_back(testCondition("parsePoolMessage rejects unknown and malformed messages", [](){
+        const std::vector<std::string> messages {
+            "{\"method\":\"mining.notify\",\"params\":{}}",
+            "{\"id\":1,\"result\":{\"something\":\"else\"}}",
+            "{\"id\":1,\"error\":{\"message\":\"No code\"}}",
+            "{\"id\":1,\"result\":{\"status\":5}}",
+            "{\"id\":1,\"result\":{\"job\":{}}}",
+            "[1,2,3]",
+            "{\"method\":",
+            "",
+        };
+
+        return std::all_of(messages.begin(), messages.end(), [](const auto &message)
+        {
+            const auto parsed = parsePoolMessage(message);
+            return std::holds_alternative<InvalidMessage>(parsed);
+        });
+    }));
+
+    results.push_back(testCondition("parsePoolMessage reads status, error and login responses", [](){
+        const auto status = parsePoolMessage("{\"id\":7,\"jsonrpc\":\"2.0\",\"result\":{\"status\":\"OK\"}}");
+        const auto error = parsePoolMessage("{\"id\":\"8\",\"error\":{\"code\":-1,\"message\":\"Low difficulty share\"}}");
+
+        const std::string job = makeJobNotification("abc");
+        const std::string params = job.substr(job.find("\"params\":") + 9, job.size() - job.find("\"params\":") - 10);
+
+        const auto login = parsePoolMessage("{\"id\":1,\"result\":{\"id\":\"me\",\"status\":\"OK\",\"job\":" + params + "}}");
+
+        const auto statusMessage = std::get_if<StatusMessage>(&status);
+        const auto errorMessage = std::get_if<ErrorMessage>(&error);
+        const auto loginMessage = std::get_if<LoginMessage>(&login);
+
+        return statusMessage && statusMessage->ID == "7" && statusMessage->status == "OK"
+            && errorMessage && errorMessage->ID == "8" && errorMessage->error.errorCode == -1
+            && errorMessage->error.errorMessage == "Low difficulty share"
+            && loginMessage && loginMessage->loginID == "me" && loginMessage->job.jobID == "abc";
+    }));
+
+    Config::config.optimizationMethod = Constants::AUTO;
+
+    results.push_back(testCondition("ShareVerifier accepts a valid share", [](){
+        ShareVerifier verifier("chukwa", 2);
+
+        const auto verdicts = verifier.verify({ makeShare(1, 1234) }).get();
+
+        return verdicts == std::vector<ShareVerdict>{ VALID };
+    }));
+
+    results.push_back(testCondition("ShareVerifier rejects a bad hash", [](){
+        ShareVerifier verifier("chukwa", 2);
+
+        /* Still meets the target, which only looks at the last 8 bytes */
+        ShareSubmission wrongHash = makeShare(1, 1234);
+        wrongHash.hash[0] ^= 0xFF;
+
+        /* The real hash, but it doesn't meet the target */
+        ShareSubmission lowDifficulty = makeShare(1, 1234);
+        lowDifficulty.target = 0;
+
+        ShareSubmission truncated = makeShare(1, 1234);
+        truncated.hash.pop_back();
+
+        const auto verdicts = verifier.verify({ wrongHash, lowDifficulty, truncated }).get();
+
+        return verdicts == std::vector<ShareVerdict>{ WRONG_HASH, LOW_DIFFICULTY, MALFORMED };
+    }));
+
+    results.push_back(testCondition("ShareVerifier rejects the wrong nonce", [](){
+        ShareVerifier verifier("chukwa", 2);
+
+        ShareSubmission share = makeShare(1, 1234);
+        share.nonce++;
+
+        const auto verdicts = verifier.verify({ share }).get();
+
+        return verdicts == std::vector<ShareVerdict>{ WRONG_HASH };
+    }));
+
+    results.push_back(testCondition("ShareVerifier rejects a share for a stale job", [](){
+        ShareVerifier verifier("chukwa", 2);
+
+        /* Hashed for the old job, checked against the job it was replaced by */
+        ShareSubmission share = makeShare(1, 1234);
+        share.blob = makeShare(2, 1234).blob;
+
+        const auto verdicts = verifier.verify({ share, makeShare(2, 1234) }).get();
+
+        return verdicts == std::vector<ShareVerdict>{ WRONG_HASH, VALID };
+    }));
+
+    results.push_back(testCondition("PoolConnection drops shares for superseded jobs", [](){
+        PoolStats stats;
+
+        /* b is a new template for the same block, so a is still current.
+           c is for the next block, so both are stale, as is a job we never
+           had. */
+        const auto [sent, received] = submitAcrossJobs(false, {
+            { "a" },
+            { "a", "b" },
+            { "a", "b", "unknown", "c" },
+        }, stats);
+
+        return sent == std::vector<bool>{ true, true, true, false, false, false, true }
+            && received == std::vector<std::string>{ "a", "a", "b", "c" }
+            && stats.staleSharesDropped == 3 && stats.staleSharesSubmitted == 0;
+    }));
+
+    results.push_back(testCondition("PoolConnection submits stale shares if the pool wants them", [](){
+        PoolStats stats;
+
+        const auto [sent, received] = submitAcrossJobs(true, {
+            { "a" },
+            { "b" },
+            { "a", "c" },
+        }, stats);
+
+        return sent == std::vector<bool>{ true, true, true, true }
+            && received == std::vector<std::string>{ "a", "b", "a", "c" }
+            && stats.staleSharesDropped == 0 && stats.staleSharesSubmitted == 1;
+    }));
+
+    const bool success = std::all_of(results.begin(), results.end(), [](const bool x) { return x; });
+
+    if (success)
+    {
+        std::cout << "\nAll tests passed" << std::endl;
+        return 0;
+    }
+    else
+    {
+        std::cout << "\nSome tests did not pass!" << std::endl;
+        return 1;
+    }
+}